@@ -0,0 +1,451 @@
+/**
+ * @file CRSAdaptive.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Compressed Row Storage matrix class using OpenMP with the rows binned by their length
+ * @version 0.1
+ * @date 2022-11-12
+ *
+ * The rows are put in three bins when the matrix is loaded, each bin has its own parallel loop:
+ *   - Short rows are packed in groups of pack_size rows which are stored column major and padded to the longest row
+ *     of the group (sliced ELLPACK), the rows of a group are computed together in a vectorized loop.
+ *   - Medium rows are computed one row per iteration with a dynamic scheduler.
+ *   - Long rows (e.g. the hubs of Kronecker graphs) are split in segments which are computed by different threads,
+ *     the partial sums of the segments are added afterwards (segmented reduction).
+ */
+
+#ifndef PWM_CRSADAPTIVE_HPP
+#define PWM_CRSADAPTIVE_HPP
+
+#include <vector>
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include <cmath>
+
+#include "../Matrix/SparseMatrix.hpp"
+#include "../Util/VectorUtill.hpp"
+#include "../Util/Poisson.hpp"
+#include "../Util/TripletToCRS.hpp"
+
+#include <omp.h>
+
+namespace pwm {
+    template<typename T, typename int_type, typename nnz_type = int_type>
+    class CRSAdaptive: public pwm::SparseMatrix<T, int_type, nnz_type> {
+        protected:
+            // Row start array for the CRS format
+            nnz_type* row_start = NULL;
+
+            // Column index array for the CRS format
+            int_type* col_ind = NULL;
+
+            // Data array which stores the actual nonzeros
+            T* data_arr = NULL;
+
+            // Amount of threads to be used
+            int threads;
+
+            // Rows with at most short_limit nonzeros are packed
+            static const int_type short_limit = 8;
+
+            // Amount of rows in one packed group
+            static const int pack_size = 8;
+
+            // Rows of the packed groups (pack_size per group, -1 for padding rows of the last group)
+            int_type* pack_rows = NULL;
+
+            // Start of each group in the packed arrays (amount of groups + 1)
+            nnz_type* pack_start = NULL;
+
+            // Packed column indices and data, entry k of row r in a group is at pack_start[g] + k*pack_size + r
+            int_type* pack_col = NULL;
+            T* pack_data = NULL;
+
+            // Amount of packed groups
+            int_type groups = 0;
+
+            // Medium rows
+            int_type* medium_rows = NULL;
+            int_type medium_am = 0;
+
+            // Long rows and the first segment of each long row (amount of long rows + 1)
+            int_type* long_rows = NULL;
+            int_type* long_seg_start = NULL;
+            int_type long_am = 0;
+
+            // Begin and end of each segment in the CRS arrays
+            nnz_type* seg_begin = NULL;
+            nnz_type* seg_end = NULL;
+            int_type segments = 0;
+
+            // Partial sum of each segment
+            T* seg_sum = NULL;
+
+            // CRS arrays of all rows for the transpose products
+            std::vector<pwm::CRSPart<T, int_type, nnz_type>> crsParts() {
+                return {{0, this->nor, row_start, col_ind, data_arr}};
+            }
+
+        private:
+            // Free the datastructures of a previously loaded matrix
+            void deleteData() {
+                this->arena.reset();
+                row_start = NULL;
+                col_ind = NULL;
+                data_arr = NULL;
+                pack_rows = NULL;
+                pack_start = NULL;
+                pack_col = NULL;
+                pack_data = NULL;
+                medium_rows = NULL;
+                long_rows = NULL;
+                long_seg_start = NULL;
+                seg_begin = NULL;
+                seg_end = NULL;
+                seg_sum = NULL;
+            }
+
+            /**
+             * @brief Put the rows of the CRS arrays in the bins
+             *
+             * Long rows have more than max(1024, nnz/(4*threads)) nonzeros, so that one row is at most a quarter of the
+             * work of a thread, and are split in segments of half that length. The reproducible mode uses the limit of one
+             * thread, so the segments and the order in which their sums are added do not depend on the amount of threads.
+             */
+            void buildBins() {
+                int split_threads = pwm::reproducibleMode() ? 1 : std::max(threads, 1);
+                nnz_type long_limit = std::max<nnz_type>(1024, this->nnz/(4*split_threads));
+                nnz_type seg_length = long_limit/2;
+
+                std::vector<int_type> short_list, medium_list, long_list;
+                for (int_type i = 0; i < this->nor; ++i) {
+                    nnz_type length = row_start[i+1] - row_start[i];
+                    if (length <= short_limit) short_list.push_back(i);
+                    else if (length <= long_limit) medium_list.push_back(i);
+                    else long_list.push_back(i);
+                }
+
+                // Pack the short rows
+                groups = (short_list.size() + pack_size - 1)/pack_size;
+                pack_rows = this->arena.template allocate<int_type>(groups*pack_size);
+                pack_start = this->arena.template allocate<nnz_type>(groups+1);
+                pack_start[0] = 0;
+                for (int_type g = 0; g < groups; ++g) {
+                    nnz_type width = 0;
+                    for (int r = 0; r < pack_size; ++r) {
+                        size_t index = g*pack_size + r;
+                        pack_rows[index] = index < short_list.size() ? short_list[index] : -1;
+                        if (pack_rows[index] >= 0) width = std::max(width, row_start[pack_rows[index]+1] - row_start[pack_rows[index]]);
+                    }
+                    pack_start[g+1] = pack_start[g] + width*pack_size;
+                }
+
+                pack_col = this->arena.template allocate<int_type>(pack_start[groups]);
+                pack_data = this->arena.template allocate<T>(pack_start[groups]);
+
+                #pragma omp parallel for schedule(static)
+                for (int_type g = 0; g < groups; ++g) {
+                    nnz_type width = (pack_start[g+1] - pack_start[g])/pack_size;
+                    for (int r = 0; r < pack_size; ++r) {
+                        int_type row = pack_rows[g*pack_size + r];
+                        nnz_type length = row >= 0 ? row_start[row+1] - row_start[row] : 0;
+                        for (nnz_type k = 0; k < width; ++k) {
+                            // Padding multiplies zero with the first element of x
+                            nnz_type index = pack_start[g] + k*pack_size + r;
+                            pack_col[index] = k < length ? col_ind[row_start[row]+k] : 0;
+                            pack_data[index] = k < length ? data_arr[row_start[row]+k] : 0.;
+                        }
+                    }
+                }
+
+                medium_am = medium_list.size();
+                medium_rows = this->arena.template allocate<int_type>(medium_am);
+                std::copy(medium_list.begin(), medium_list.end(), medium_rows);
+
+                // Split the long rows in segments
+                long_am = long_list.size();
+                long_rows = this->arena.template allocate<int_type>(long_am);
+                long_seg_start = this->arena.template allocate<int_type>(long_am+1);
+                std::copy(long_list.begin(), long_list.end(), long_rows);
+                long_seg_start[0] = 0;
+                for (int_type l = 0; l < long_am; ++l) {
+                    nnz_type length = row_start[long_rows[l]+1] - row_start[long_rows[l]];
+                    long_seg_start[l+1] = long_seg_start[l] + (length + seg_length - 1)/seg_length;
+                }
+
+                segments = long_seg_start[long_am];
+                seg_begin = this->arena.template allocate<nnz_type>(segments);
+                seg_end = this->arena.template allocate<nnz_type>(segments);
+                seg_sum = this->arena.template allocate<T>(segments);
+                for (int_type l = 0; l < long_am; ++l) {
+                    for (int_type s = long_seg_start[l]; s < long_seg_start[l+1]; ++s) {
+                        seg_begin[s] = row_start[long_rows[l]] + (s - long_seg_start[l])*seg_length;
+                        seg_end[s] = std::min(seg_begin[s] + seg_length, row_start[long_rows[l]+1]);
+                    }
+                }
+            }
+
+        public:
+            // Base constructor
+            CRSAdaptive() {}
+
+            // Base constructor
+            CRSAdaptive(int threads): threads(threads) {}
+
+            /**
+             * @brief Model of the bytes moved from memory in one power method iteration
+             *
+             * The short rows are read from the padded packed arrays, the other rows from the CRS arrays.
+             */
+            double bytesPerIteration() const {
+                double packed_nnz = pack_start == NULL ? 0. : pack_start[groups];
+                double crs_nnz = 0.;
+                for (int_type i = 0; i < medium_am; ++i) crs_nnz += row_start[medium_rows[i]+1] - row_start[medium_rows[i]];
+                for (int_type l = 0; l < long_am; ++l) crs_nnz += row_start[long_rows[l]+1] - row_start[long_rows[l]];
+
+                return (packed_nnz + crs_nnz)*(sizeof(T) + sizeof(int_type)) + (groups*pack_size + medium_am + long_am)*sizeof(int_type)
+                       + (groups + 2.*segments)*sizeof(nnz_type) + 5.*this->nor*sizeof(T);
+            }
+
+            /**
+             * @brief Fill the given matrix as a 2D discretized poisson matrix with equal discretization steplength in x and y
+             *
+             * @param m The amount of discretization steps in the x direction
+             * @param n The amount of discretization steps in the y direction
+             */
+            void generatePoissonMatrix(const int_type m, const int_type n, const int partitions) {
+                deleteData();
+
+                omp_set_num_threads(threads);
+
+                this->noc = m*n;
+                this->nor = m*n;
+
+                this->nnz = pwm::poissonNonzeros<nnz_type>(m, n);
+
+                row_start = this->arena.template allocate<nnz_type>(this->nor+1);
+                col_ind = this->arena.template allocate<int_type>(this->nnz);
+                data_arr = this->arena.template allocate<T>(this->nnz);
+
+                pwm::fillPoissonOMP(data_arr, row_start, col_ind, m, n);
+
+                assert(row_start[0] == 0);
+                assert(row_start[this->nor] == this->nnz);
+
+                buildBins();
+            }
+
+            /**
+             * @brief Input the CRS matrix from a Triplet format
+             *
+             * @param input Triplet format matrix used to convert to CRS
+             */
+            void loadFromTriplets(pwm::Triplet<T, int_type, nnz_type>& input, const int partition_am) {
+                deleteData();
+
+                omp_set_num_threads(threads);
+
+                this->noc = input.col_size;
+                this->nor = input.row_size;
+                this->nnz = input.nnz;
+
+                if (input.in_place) {
+                    pwm::TripletToCRSInPlace(input, row_start, col_ind, data_arr, this->arena);
+                } else {
+                    row_start = this->arena.template allocate<nnz_type>(this->nor+1);
+                    col_ind = this->arena.template allocate<int_type>(this->nnz);
+                    data_arr = this->arena.template allocate<T>(this->nnz);
+
+                    pwm::TripletToCRSOMP(input.row_coord, input.col_coord, input.data, row_start, col_ind, data_arr, this->nnz, this->nor);
+                }
+
+                buildBins();
+            }
+
+            /**
+             * @brief Matrix vector product Ax = y
+             *
+             * The short rows are divided statically (equal work per group), the segments of the long rows and the medium
+             * rows dynamically. After a barrier the partial sums of the long rows are added.
+             *
+             * @param x Input vector
+             * @param y Output vector
+             */
+            void mv(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                #pragma omp parallel shared(x, y)
+                {
+                    PWM_PERF_SCOPE(this->perf_counters, omp_get_thread_num());
+
+                    #pragma omp for schedule(static) nowait
+                    for (int_type g = 0; g < groups; ++g) {
+                        T sum[pack_size] = {};
+                        for (nnz_type index = pack_start[g]; index < pack_start[g+1]; index += pack_size) {
+                            #pragma omp simd
+                            for (int r = 0; r < pack_size; ++r) {
+                                sum[r] += pack_data[index+r]*x[pack_col[index+r]];
+                            }
+                        }
+
+                        for (int r = 0; r < pack_size; ++r) {
+                            if (pack_rows[g*pack_size + r] >= 0) y[pack_rows[g*pack_size + r]] = sum[r];
+                        }
+                    }
+
+                    #pragma omp for schedule(dynamic, 1) nowait
+                    for (int_type s = 0; s < segments; ++s) {
+                        T sum = 0.;
+                        for (nnz_type k = seg_begin[s]; k < seg_end[s]; ++k) {
+                            sum += data_arr[k]*x[col_ind[k]];
+                        }
+
+                        seg_sum[s] = sum;
+                    }
+
+                    #pragma omp for schedule(dynamic, 8) // Implicit barrier before the segmented reduction
+                    for (int_type i = 0; i < medium_am; ++i) {
+                        int_type row = medium_rows[i];
+                        T sum = 0.;
+                        for (nnz_type k = row_start[row]; k < row_start[row+1]; ++k) {
+                            sum += data_arr[k]*x[col_ind[k]];
+                        }
+
+                        y[row] = sum;
+                    }
+
+                    #pragma omp for schedule(static) nowait
+                    for (int_type l = 0; l < long_am; ++l) {
+                        T sum = 0.;
+                        for (int_type s = long_seg_start[l]; s < long_seg_start[l+1]; ++s) {
+                            sum += seg_sum[s];
+                        }
+
+                        y[long_rows[l]] = sum;
+                    }
+                }
+            }
+
+            /**
+             * @brief Parallel loop over the rows of the matrix
+             * 
+             * The rows are split in one static range per OpenMP thread.
+             * 
+             * @param body Function called with the first row and one past the last row of a range
+             */
+            void parallelFor(const std::function<void(int_type, int_type)>& body) {
+                #pragma omp parallel num_threads(threads)
+                {
+                    int_type begin = (int_type) ((long long) this->nor * omp_get_thread_num() / omp_get_num_threads());
+                    int_type end = (int_type) ((long long) this->nor * (omp_get_thread_num() + 1) / omp_get_num_threads());
+                    body(begin, end);
+                }
+            }
+
+            /**
+             * @brief Parallel sum over the rows of the matrix
+             * 
+             * One static range per OpenMP thread, the partial sums are added with an OpenMP reduction.
+             * 
+             * @param body Function which returns the partial sum of a range of rows
+             */
+            T parallelSum(const std::function<T(int_type, int_type)>& body) {
+                if (pwm::reproducibleMode()) return pwm::reproducibleSum(this->rowLoop(), this->nor, body);
+
+                T sum = 0.;
+
+                #pragma omp parallel num_threads(threads) reduction(+:sum)
+                {
+                    int_type begin = (int_type) ((long long) this->nor * omp_get_thread_num() / omp_get_num_threads());
+                    int_type end = (int_type) ((long long) this->nor * (omp_get_thread_num() + 1) / omp_get_num_threads());
+                    sum += body(begin, end);
+                }
+
+                return sum;
+            }
+
+            /**
+             * @brief Power method: Executes matrix vector product repeatedly to get the dominant eigenvector.
+             *
+             * Loop is parallelized using OpenMP
+             *
+             * @param x Input vector to start calculation, contains the output at the end of the algorithm is it is uneven
+             * @param y Vector to store calculations, contains the output at the end of the algorithm if it is even
+             * @param it Amount of iterations for the algorithm
+             */
+            void powerMethod(T* x, T* y, const int_type it) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                assert(this->nor == this->noc); //Power method only works on square matrices
+
+                for (int it_nb = 0; it_nb < it; ++it_nb) {
+                    if (it_nb % 2 == 0) {
+                        this->mv(x, y);
+                        T norm = pwm::norm2(y, this->nor);
+
+                        #pragma omp parallel for shared (y, norm) schedule(static)
+                        for (int i = 0; i < this->nor; ++i) {
+                            y[i] /= norm;
+                        }
+                    } else {
+                        this->mv(y, x);
+                        T norm = pwm::norm2(x, this->nor);
+
+                        #pragma omp parallel for shared(y, norm) schedule(static)
+                        for (int i = 0; i < this->nor; ++i) {
+                            x[i] /= norm;
+                        }
+                    }
+                }
+            }
+
+            /**
+             * @brief s-step power method: Only normalizes the iterate every s iterations.
+             *
+             * In between the iterate is divided by an estimate of the dominant eigenvalue (scaled recurrence) to avoid overflow.
+             * The estimate is obtained in the first iteration and refined at every normalization.
+             *
+             * Loop is parallelized using OpenMP
+             *
+             * @param x Input vector to start calculation, contains the output at the end of the algorithm is it is uneven
+             * @param y Vector to store calculations, contains the output at the end of the algorithm if it is even
+             * @param it Amount of iterations for the algorithm
+             * @param s Amount of iterations between two normalizations
+             */
+            void powerMethodSStep(T* x, T* y, const int_type it, const int s) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                assert(this->nor == this->noc); //Power method only works on square matrices
+
+                T x_norm = pwm::norm2(x, this->nor);
+                T scale = 1.;
+                int steps = 0;
+                for (int it_nb = 0; it_nb < it; ++it_nb) {
+                    T* in = it_nb % 2 == 0 ? x : y;
+                    T* out = it_nb % 2 == 0 ? y : x;
+                    this->mv(in, out);
+                    steps++;
+
+                    T div;
+                    if (it_nb == 0 || steps == s || it_nb == it - 1) {
+                        // Synchronization point: normalize and update the eigenvalue estimate
+                        T norm = pwm::norm2(out, this->nor);
+                        if (it_nb == 0) scale = norm/x_norm;
+                        else scale *= std::pow(norm/scale, (T) 1./steps);
+
+                        div = norm;
+                        steps = 0;
+                    } else {
+                        div = scale;
+                    }
+
+                    #pragma omp parallel for shared(out, div) schedule(static)
+                    for (int i = 0; i < this->nor; ++i) {
+                        out[i] /= div;
+                    }
+                }
+            }
+    };
+} // namespace pwm
+
+#endif // PWM_CRSADAPTIVE_HPP
@@ -0,0 +1,550 @@
+/**
+ * @file CRSCompressed.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Compressed Row Storage matrix class using OpenMP with delta compressed column indices
+ * @version 0.1
+ * @date 2022-11-15
+ *
+ * The column indices of a row are sorted, the first column is stored as the base of the row and the other columns
+ * as the difference with the previous column. The rows are grouped in runs of at most run_length consecutive rows
+ * which store their differences with the same width (8, 16 or 32 bits), the smallest width which fits all differences
+ * of the run. The Poisson matrices have differences of 1 and m-1, so they only need 8 or 16 bits per nonzero.
+ *
+ * The matrix is converted from the CRS arrays, the column index array is not kept.
+ * The product decodes the columns with a running sum of the differences, long rows are decoded in chunks which are
+ * computed with a vectorized gather.
+ */
+
+#ifndef PWM_CRSCOMPRESSED_HPP
+#define PWM_CRSCOMPRESSED_HPP
+
+#include <vector>
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "../Matrix/SparseMatrix.hpp"
+#include "../Util/VectorUtill.hpp"
+#include "../Util/Poisson.hpp"
+#include "../Util/TripletToCRS.hpp"
+
+#include <omp.h>
+
+namespace pwm {
+    template<typename T, typename int_type, typename nnz_type = int_type>
+    class CRSCompressed: public pwm::SparseMatrix<T, int_type, nnz_type> {
+        protected:
+            // Row start array for the CRS format
+            nnz_type* row_start = NULL;
+
+            // First (smallest) column of each row
+            int_type* row_base = NULL;
+
+            // Differences between consecutive columns of the rows
+            uint8_t* deltas = NULL;
+
+            // Data array which stores the actual nonzeros (sorted by column within a row)
+            T* data_arr = NULL;
+
+            // First row of each run (runs + 1)
+            int_type* run_row = NULL;
+
+            // Width in bytes of the differences of each run
+            uint8_t* run_width = NULL;
+
+            // Start of each run in the difference array (aligned to 4 bytes)
+            size_t* run_offset = NULL;
+
+            // Amount of runs
+            int_type runs = 0;
+
+            // Size of the difference array in bytes
+            size_t delta_bytes = 0;
+
+            // Maximal amount of rows in a run
+            static constexpr int_type run_length = 256;
+
+            // Amount of columns which are decoded at once
+            static constexpr int chunk_size = 16;
+
+            // Amount of threads to be used
+            int threads;
+
+            // Private output vectors of the transpose products
+            pwm::ScatterBuffers<T> scatter_buffers;
+
+        private:
+            // Free the datastructures of a previously loaded matrix
+            void deleteData() {
+                this->arena.reset();
+                row_start = NULL;
+                row_base = NULL;
+                deltas = NULL;
+                data_arr = NULL;
+                run_row = NULL;
+                run_width = NULL;
+                run_offset = NULL;
+            }
+
+            /**
+             * @brief Compress the column indices of CRS arrays
+             *
+             * row_start_in and data_in become arrays of the matrix (allocated in its arena), the column indices are only read.
+             *
+             * @param row_start_in Row start array of the CRS format
+             * @param col_ind Column index array of the CRS format (sorted within each row afterwards)
+             * @param data_in Data array of the CRS format (sorted with the column indices)
+             */
+            void compress(nnz_type* row_start_in, int_type* col_ind, T* data_in) {
+                row_start = row_start_in;
+                data_arr = data_in;
+                row_base = this->arena.template allocate<int_type>(this->nor);
+
+                // Sort the columns within every row and find the width of the differences
+                std::vector<uint8_t> width(this->nor, 1);
+                #pragma omp parallel for schedule(dynamic, 64)
+                for (int_type i = 0; i < this->nor; ++i) {
+                    nnz_type begin = row_start[i];
+                    nnz_type end = row_start[i+1];
+
+                    std::vector<std::pair<int_type, T>> row(end - begin);
+                    for (nnz_type k = begin; k < end; ++k) row[k - begin] = std::make_pair(col_ind[k], data_arr[k]);
+                    std::sort(row.begin(), row.end(), [](const std::pair<int_type, T>& a, const std::pair<int_type, T>& b) { return a.first < b.first; });
+
+                    int_type max_delta = 0;
+                    for (nnz_type k = begin; k < end; ++k) {
+                        col_ind[k] = row[k - begin].first;
+                        data_arr[k] = row[k - begin].second;
+                        if (k > begin) max_delta = std::max(max_delta, col_ind[k] - col_ind[k-1]);
+                    }
+
+                    row_base[i] = end > begin ? col_ind[begin] : 0;
+                    width[i] = max_delta < (1 << 8) ? 1 : (max_delta < (1 << 16) ? 2 : 4);
+                }
+
+                // Group consecutive rows with the same width in runs
+                std::vector<int_type> rows;
+                std::vector<uint8_t> widths;
+                std::vector<size_t> offsets;
+                size_t bytes = 0;
+                for (int_type i = 0; i < this->nor; ) {
+                    int_type first = i;
+                    uint8_t run_w = width[i];
+                    while (i < this->nor && i - first < run_length && width[i] == run_w) ++i;
+
+                    rows.push_back(first);
+                    widths.push_back(run_w);
+                    offsets.push_back(bytes);
+
+                    // Every row stores one difference less than its amount of nonzeros
+                    size_t run_deltas = 0;
+                    for (int_type r = first; r < i; ++r) run_deltas += std::max<nnz_type>(row_start[r+1] - row_start[r] - 1, 0);
+                    bytes += (run_deltas*run_w + 3)/4*4;
+                }
+                rows.push_back(this->nor);
+
+                runs = widths.size();
+                delta_bytes = bytes;
+                run_row = this->arena.template allocate<int_type>(runs+1);
+                run_width = this->arena.template allocate<uint8_t>(runs);
+                run_offset = this->arena.template allocate<size_t>(runs);
+                deltas = this->arena.template allocate<uint8_t>(std::max<size_t>(bytes, 4));
+                std::copy(rows.begin(), rows.end(), run_row);
+                std::copy(widths.begin(), widths.end(), run_width);
+                std::copy(offsets.begin(), offsets.end(), run_offset);
+
+                #pragma omp parallel for schedule(dynamic, 1)
+                for (int_type run = 0; run < runs; ++run) {
+                    switch (run_width[run]) {
+                        case 1: storeRun<uint8_t>(run, col_ind); break;
+                        case 2: storeRun<uint16_t>(run, col_ind); break;
+                        default: storeRun<uint32_t>(run, col_ind); break;
+                    }
+                }
+            }
+
+            // Store the differences of the rows of a run with width sizeof(D)
+            template<typename D>
+            void storeRun(int_type run, const int_type* col_ind) {
+                D* run_deltas = reinterpret_cast<D*>(deltas + run_offset[run]);
+                size_t index = 0;
+                for (int_type i = run_row[run]; i < run_row[run+1]; ++i) {
+                    for (nnz_type k = row_start[i] + 1; k < row_start[i+1]; ++k) {
+                        run_deltas[index++] = col_ind[k] - col_ind[k-1];
+                    }
+                }
+            }
+
+            // Product of the rows of a run with width sizeof(D)
+            template<typename D>
+            void mvRun(int_type run, const T* x, T* y) const {
+                const D* run_deltas = reinterpret_cast<const D*>(deltas + run_offset[run]);
+                int_type cols[chunk_size];
+                for (int_type i = run_row[run]; i < run_row[run+1]; ++i) {
+                    nnz_type begin = row_start[i];
+                    nnz_type end = row_start[i+1];
+                    if (begin == end) {
+                        y[i] = 0.;
+                        continue;
+                    }
+
+                    int_type col = row_base[i];
+                    T sum = data_arr[begin]*x[col];
+                    nnz_type k = begin + 1;
+
+                    // Long rows: decode a chunk of columns and compute it with a vectorized gather
+                    for (; k + chunk_size <= end; k += chunk_size) {
+                        for (int c = 0; c < chunk_size; ++c) {
+                            col += run_deltas[c];
+                            cols[c] = col;
+                        }
+                        run_deltas += chunk_size;
+
+                        #pragma omp simd reduction(+:sum)
+                        for (int c = 0; c < chunk_size; ++c) {
+                            sum += data_arr[k+c]*x[cols[c]];
+                        }
+                    }
+
+                    // Short rows and the rest of the long rows are decoded one column at a time
+                    for (; k < end; ++k) {
+                        col += *run_deltas++;
+                        sum += data_arr[k]*x[col];
+                    }
+
+                    y[i] = sum;
+                }
+            }
+
+            /**
+             * @brief Add the rows of a run, multiplied with a factor per row, to a private vector
+             *
+             * The factor of row i is x[i] for A^T x, or the dot product of the row with x for A^T A x (normal). The
+             * differences of a row are decoded twice for the normal product.
+             */
+            template<typename D>
+            void scatterRun(int_type run, const T* x, T* y, bool normal) const {
+                const D* run_deltas = reinterpret_cast<const D*>(deltas + run_offset[run]);
+                for (int_type i = run_row[run]; i < run_row[run+1]; ++i) {
+                    nnz_type begin = row_start[i];
+                    nnz_type end = row_start[i+1];
+                    if (begin == end) continue;
+
+                    T factor = x[i];
+                    if (normal) {
+                        int_type col = row_base[i];
+                        factor = data_arr[begin]*x[col];
+                        for (nnz_type k = begin + 1; k < end; ++k) {
+                            col += run_deltas[k - begin - 1];
+                            factor += data_arr[k]*x[col];
+                        }
+                    }
+
+                    int_type col = row_base[i];
+                    y[col] += data_arr[begin]*factor;
+                    for (nnz_type k = begin + 1; k < end; ++k) {
+                        col += *run_deltas++;
+                        y[col] += data_arr[k]*factor;
+                    }
+                }
+            }
+
+            /**
+             * @brief Scatter all runs into one private vector per OpenMP thread, then sum the private vectors into y
+             */
+            void scatterRuns(const T* x, T* y, bool normal) {
+                scatter_buffers.resize(this->noc);
+
+                #pragma omp parallel shared(x)
+                {
+                    PWM_PERF_SCOPE(this->perf_counters, omp_get_thread_num());
+                    T* buffer = scatter_buffers.acquire();
+
+                    #pragma omp for schedule(dynamic, 1) nowait
+                    for (int_type run = 0; run < runs; ++run) {
+                        switch (run_width[run]) {
+                            case 1: scatterRun<uint8_t>(run, x, buffer, normal); break;
+                            case 2: scatterRun<uint16_t>(run, x, buffer, normal); break;
+                            default: scatterRun<uint32_t>(run, x, buffer, normal); break;
+                        }
+                    }
+
+                    scatter_buffers.release(buffer);
+                }
+
+                this->parallelFor([&](int_type begin, int_type end) {
+                    scatter_buffers.reduce(pwm::rowToColumn(begin, this->nor, this->noc), pwm::rowToColumn(end, this->nor, this->noc), y);
+                });
+            }
+
+        public:
+            // Base constructor
+            CRSCompressed() {}
+
+            // Base constructor
+            CRSCompressed(int threads): threads(threads) {}
+
+            /**
+             * @brief Bytes of the compressed column indices (differences, bases and runs)
+             */
+            double indexBytes() const {
+                return (double) delta_bytes + (double) this->nor*sizeof(int_type) + (double) runs*(sizeof(int_type) + sizeof(uint8_t) + sizeof(size_t));
+            }
+
+            /**
+             * @brief Compression ratio of the column indices (bytes of a CRS column index array / compressed bytes)
+             */
+            double compressionRatio() const {
+                return (double) this->nnz*sizeof(int_type) / indexBytes();
+            }
+
+            /**
+             * @brief Model of the bytes moved from memory in one power method iteration
+             *
+             * The column index array is replaced by the compressed indices.
+             */
+            double bytesPerIteration() const {
+                return (double) this->nnz*sizeof(T) + indexBytes() + (this->nor + 1.)*sizeof(nnz_type) + 5.*this->nor*sizeof(T);
+            }
+
+            /**
+             * @brief Fill the given matrix as a 2D discretized poisson matrix with equal discretization steplength in x and y
+             *
+             * @param m The amount of discretization steps in the x direction
+             * @param n The amount of discretization steps in the y direction
+             */
+            void generatePoissonMatrix(const int_type m, const int_type n, const int partitions) {
+                deleteData();
+
+                omp_set_num_threads(threads);
+
+                this->noc = m*n;
+                this->nor = m*n;
+
+                this->nnz = pwm::poissonNonzeros<nnz_type>(m, n);
+
+                // The column indices are only used to build the compressed indices
+                pwm::Arena scratch;
+                nnz_type* crs_row_start = this->arena.template allocate<nnz_type>(this->nor+1);
+                int_type* col_ind = scratch.allocate<int_type>(this->nnz);
+                T* crs_data = this->arena.template allocate<T>(this->nnz);
+
+                pwm::fillPoissonOMP(crs_data, crs_row_start, col_ind, m, n);
+
+                assert(crs_row_start[0] == 0);
+                assert(crs_row_start[this->nor] == this->nnz);
+
+                compress(crs_row_start, col_ind, crs_data);
+            }
+
+            /**
+             * @brief Input the CRS matrix from a Triplet format
+             *
+             * @param input Triplet format matrix used to convert to CRS
+             */
+            void loadFromTriplets(pwm::Triplet<T, int_type, nnz_type>& input, const int partition_am) {
+                deleteData();
+
+                omp_set_num_threads(threads);
+
+                this->noc = input.col_size;
+                this->nor = input.row_size;
+                this->nnz = input.nnz;
+
+                // The column indices are only used to build the compressed indices
+                pwm::Arena scratch;
+                nnz_type* crs_row_start;
+                int_type* col_ind;
+                T* crs_data;
+                if (input.in_place) {
+                    pwm::TripletToCRSInPlace(input, crs_row_start, col_ind, crs_data, this->arena);
+                    scratch.adopt(this->arena, col_ind);
+                } else {
+                    crs_row_start = this->arena.template allocate<nnz_type>(this->nor+1);
+                    col_ind = scratch.allocate<int_type>(this->nnz);
+                    crs_data = this->arena.template allocate<T>(this->nnz);
+
+                    pwm::TripletToCRSOMP(input.row_coord, input.col_coord, input.data, crs_row_start, col_ind, crs_data, this->nnz, this->nor);
+                }
+
+                compress(crs_row_start, col_ind, crs_data);
+            }
+
+            /**
+             * @brief Matrix vector product Ax = y
+             *
+             * Loop over the runs is parallelized using OpenMP
+             *
+             * @param x Input vector
+             * @param y Output vector
+             */
+            void mv(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                #pragma omp parallel shared(x, y)
+                {
+                    PWM_PERF_SCOPE(this->perf_counters, omp_get_thread_num());
+
+                    #pragma omp for schedule(dynamic, 1) nowait
+                    for (int_type run = 0; run < runs; ++run) {
+                        switch (run_width[run]) {
+                            case 1: mvRun<uint8_t>(run, x, y); break;
+                            case 2: mvRun<uint16_t>(run, x, y); break;
+                            default: mvRun<uint32_t>(run, x, y); break;
+                        }
+                    }
+                }
+            }
+
+            /**
+             * @brief Transpose matrix vector product A^T x = y
+             *
+             * The matrix has no column index array to transpose, the runs are scattered into one private vector per
+             * OpenMP thread which are summed at the end.
+             *
+             * @param x Input vector
+             * @param y Output vector
+             */
+            void mvT(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                scatterRuns(x, y, false);
+            }
+
+            /**
+             * @brief Product with the normal matrix A^T A x = y in one pass over the runs
+             *
+             * @param x Input vector
+             * @param y Output vector
+             */
+            void mvTmv(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                scatterRuns(x, y, true);
+            }
+
+            /**
+             * @brief Parallel loop over the rows of the matrix
+             * 
+             * The rows are split in one static range per OpenMP thread.
+             * 
+             * @param body Function called with the first row and one past the last row of a range
+             */
+            void parallelFor(const std::function<void(int_type, int_type)>& body) {
+                #pragma omp parallel num_threads(threads)
+                {
+                    int_type begin = (int_type) ((long long) this->nor * omp_get_thread_num() / omp_get_num_threads());
+                    int_type end = (int_type) ((long long) this->nor * (omp_get_thread_num() + 1) / omp_get_num_threads());
+                    body(begin, end);
+                }
+            }
+
+            /**
+             * @brief Parallel sum over the rows of the matrix
+             * 
+             * One static range per OpenMP thread, the partial sums are added with an OpenMP reduction.
+             * 
+             * @param body Function which returns the partial sum of a range of rows
+             */
+            T parallelSum(const std::function<T(int_type, int_type)>& body) {
+                if (pwm::reproducibleMode()) return pwm::reproducibleSum(this->rowLoop(), this->nor, body);
+
+                T sum = 0.;
+
+                #pragma omp parallel num_threads(threads) reduction(+:sum)
+                {
+                    int_type begin = (int_type) ((long long) this->nor * omp_get_thread_num() / omp_get_num_threads());
+                    int_type end = (int_type) ((long long) this->nor * (omp_get_thread_num() + 1) / omp_get_num_threads());
+                    sum += body(begin, end);
+                }
+
+                return sum;
+            }
+
+            /**
+             * @brief Power method: Executes matrix vector product repeatedly to get the dominant eigenvector.
+             *
+             * Loop is parallelized using OpenMP
+             *
+             * @param x Input vector to start calculation, contains the output at the end of the algorithm is it is uneven
+             * @param y Vector to store calculations, contains the output at the end of the algorithm if it is even
+             * @param it Amount of iterations for the algorithm
+             */
+            void powerMethod(T* x, T* y, const int_type it) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                assert(this->nor == this->noc); //Power method only works on square matrices
+
+                for (int it_nb = 0; it_nb < it; ++it_nb) {
+                    if (it_nb % 2 == 0) {
+                        this->mv(x, y);
+                        T norm = pwm::norm2(y, this->nor);
+
+                        #pragma omp parallel for shared (y, norm) schedule(static)
+                        for (int i = 0; i < this->nor; ++i) {
+                            y[i] /= norm;
+                        }
+                    } else {
+                        this->mv(y, x);
+                        T norm = pwm::norm2(x, this->nor);
+
+                        #pragma omp parallel for shared(y, norm) schedule(static)
+                        for (int i = 0; i < this->nor; ++i) {
+                            x[i] /= norm;
+                        }
+                    }
+                }
+            }
+
+            /**
+             * @brief s-step power method: Only normalizes the iterate every s iterations.
+             *
+             * In between the iterate is divided by an estimate of the dominant eigenvalue (scaled recurrence) to avoid overflow.
+             * The estimate is obtained in the first iteration and refined at every normalization.
+             *
+             * Loop is parallelized using OpenMP
+             *
+             * @param x Input vector to start calculation, contains the output at the end of the algorithm is it is uneven
+             * @param y Vector to store calculations, contains the output at the end of the algorithm if it is even
+             * @param it Amount of iterations for the algorithm
+             * @param s Amount of iterations between two normalizations
+             */
+            void powerMethodSStep(T* x, T* y, const int_type it, const int s) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                assert(this->nor == this->noc); //Power method only works on square matrices
+
+                T x_norm = pwm::norm2(x, this->nor);
+                T scale = 1.;
+                int steps = 0;
+                for (int it_nb = 0; it_nb < it; ++it_nb) {
+                    T* in = it_nb % 2 == 0 ? x : y;
+                    T* out = it_nb % 2 == 0 ? y : x;
+                    this->mv(in, out);
+                    steps++;
+
+                    T div;
+                    if (it_nb == 0 || steps == s || it_nb == it - 1) {
+                        // Synchronization point: normalize and update the eigenvalue estimate
+                        T norm = pwm::norm2(out, this->nor);
+                        if (it_nb == 0) scale = norm/x_norm;
+                        else scale *= std::pow(norm/scale, (T) 1./steps);
+
+                        div = norm;
+                        steps = 0;
+                    } else {
+                        div = scale;
+                    }
+
+                    #pragma omp parallel for shared(out, div) schedule(static)
+                    for (int i = 0; i < this->nor; ++i) {
+                        out[i] /= div;
+                    }
+                }
+            }
+    };
+} // namespace pwm
+
+#endif // PWM_CRSCOMPRESSED_HPP
@@ -0,0 +1,390 @@
+/**
+ * @file CRSDynamic.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Compressed Row Storage matrix class using OpenMP with free slots per row for edge updates
+ * @version 0.1
+ * @date 2022-11-25
+ *
+ * Every row has a capacity of its length plus a slack (a fraction of the length, at least a minimal amount of slots).
+ * row_start holds the start of the slots of every row and row_length the amount of used slots. A batch of edge updates
+ * is sorted by row and every row is updated by one thread: an insertion overwrites the value of an existing edge or
+ * appends to a free slot, a removal moves the last edge of the row into its slot. Only if a row runs out of free slots
+ * the whole structure is copied once with new slack for the batch.
+ *
+ * The free slots hold a zero with the column of the diagonal, so the CRS arrays (crsParts, mvBatch) stay valid with
+ * row_start only. The product skips them with row_length.
+ */
+
+#ifndef PWM_CRSDYNAMIC_HPP
+#define PWM_CRSDYNAMIC_HPP
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <stdexcept>
+
+#include "CRSOMP.hpp"
+
+#include <omp.h>
+
+namespace pwm {
+    template<typename T, typename int_type, typename nnz_type = int_type>
+    class CRSDynamic: public pwm::CRSOMP<T, int_type, nnz_type> {
+        protected:
+            // Amount of used slots of every row
+            int_type* row_length = NULL;
+
+            // Free slots of a row as a fraction of its length and the minimal amount of free slots
+            double slack = 0.25;
+            int_type min_slack = 2;
+
+            // Amount of times the structure was copied because a row ran out of free slots
+            size_t rebuild_am = 0;
+
+        private:
+            // Column of the free slots of row i
+            int_type freeColumn(int_type i) const {
+                return std::min(i, this->noc - 1);
+            }
+
+            /**
+             * @brief Copy rows into new arrays with the slack of this matrix
+             *
+             * @param start Start of every row in the old arrays
+             * @param length Length of every row (NULL if the rows are contiguous: start[i+1] - start[i])
+             * @param extra Amount of slots which are needed on top of the length of every row (NULL for none)
+             */
+            void layout(const nnz_type* start, const int_type* length, const int_type* col, const T* data, const int_type* extra) {
+                auto old_length = [=](int_type i) -> int_type { return length != NULL ? length[i] : (int_type) (start[i+1] - start[i]); };
+
+                nnz_type* new_start = this->arena.template allocate<nnz_type>(this->nor+1);
+                int_type* new_length = this->arena.template allocate<int_type>(this->nor);
+
+                new_start[0] = 0;
+                for (int_type i = 0; i < this->nor; ++i) {
+                    int_type needed = old_length(i) + (extra != NULL ? extra[i] : 0);
+                    int_type free = std::max(min_slack, (int_type) (needed*slack));
+                    new_start[i+1] = new_start[i] + needed + free;
+                }
+
+                int_type* new_col = this->arena.template allocate<int_type>(new_start[this->nor]);
+                T* new_data = this->arena.template allocate<T>(new_start[this->nor]);
+
+                #pragma omp parallel for num_threads(this->threads) schedule(static)
+                for (int_type i = 0; i < this->nor; ++i) {
+                    int_type len = old_length(i);
+                    std::copy(col + start[i], col + start[i] + len, new_col + new_start[i]);
+                    std::copy(data + start[i], data + start[i] + len, new_data + new_start[i]);
+                    std::fill(new_col + new_start[i] + len, new_col + new_start[i+1], freeColumn(i));
+                    std::fill(new_data + new_start[i] + len, new_data + new_start[i+1], (T) 0.);
+                    new_length[i] = len;
+                }
+
+                this->row_start = new_start;
+                row_length = new_length;
+                this->col_ind = new_col;
+                this->data_arr = new_data;
+            }
+
+            // Free the datastructures of a previously loaded matrix
+            void deleteData() {
+                this->arena.reset();
+                this->row_start = NULL;
+                row_length = NULL;
+                this->col_ind = NULL;
+                this->data_arr = NULL;
+            }
+
+            /**
+             * @brief Check that every edge of a batch lies in the matrix before the batch changes it
+             *
+             * Throws std::out_of_range for the first edge outside of the rows or columns, the matrix is not changed.
+             */
+            void checkEdges(const int_type* rows, const int_type* cols, size_t count) const {
+                for (size_t u = 0; u < count; ++u) {
+                    if (rows[u] < 0 || rows[u] >= this->nor || cols[u] < 0 || cols[u] >= this->noc) {
+                        throw std::out_of_range("Edge (" + std::to_string(rows[u]) + ", " + std::to_string(cols[u]) + ") is outside of the "
+                                                + std::to_string(this->nor) + " x " + std::to_string(this->noc) + " matrix");
+                    }
+                }
+            }
+
+            /**
+             * @brief Sort the updates by row (stable, later updates of an edge win) and split them in groups of one row
+             *
+             * @param order Indices of the updates sorted by row
+             * @param groups Start of every group in order (one past the last group at the end)
+             */
+            static void groupByRow(const int_type* rows, size_t count, std::vector<size_t>& order, std::vector<size_t>& groups) {
+                order.resize(count);
+                std::iota(order.begin(), order.end(), 0);
+                std::stable_sort(order.begin(), order.end(), [=](size_t a, size_t b) { return rows[a] < rows[b]; });
+
+                groups.clear();
+                for (size_t u = 0; u < count; ++u) {
+                    if (u == 0 || rows[order[u]] != rows[order[u-1]]) groups.push_back(u);
+                }
+                groups.push_back(count);
+            }
+
+            // Slot of column j in row i, -1 if the row has no edge j
+            nnz_type findSlot(int_type i, int_type j) const {
+                for (nnz_type k = this->row_start[i]; k < this->row_start[i] + row_length[i]; ++k) {
+                    if (this->col_ind[k] == j) return k;
+                }
+
+                return -1;
+            }
+
+            /**
+             * @brief Insert the updates of one row, the row must have enough free slots
+             *
+             * @return int_type Amount of new edges
+             */
+            int_type insertRow(const int_type* cols, const T* values, const size_t* order, size_t begin, size_t end, int_type i) {
+                int_type added = 0;
+                for (size_t u = begin; u < end; ++u) {
+                    size_t update = order[u];
+                    nnz_type k = findSlot(i, cols[update]);
+                    if (k < 0) {
+                        k = this->row_start[i] + row_length[i]++;
+                        this->col_ind[k] = cols[update];
+                        added++;
+                    }
+
+                    this->data_arr[k] = values[update];
+                }
+
+                return added;
+            }
+
+        public:
+            // Base constructor
+            CRSDynamic() {}
+
+            // Base constructor
+            CRSDynamic(int threads): CRSOMP<T, int_type, nnz_type>(threads) {}
+
+            /**
+             * @brief Set the free slots of the rows, used when the matrix is loaded and when a row runs out of slots
+             *
+             * @param fraction Free slots as a fraction of the length of a row
+             * @param minimum Minimal amount of free slots of a row
+             */
+            void setSlack(double fraction, int_type minimum) {
+                slack = fraction;
+                min_slack = minimum;
+            }
+
+            // Amount of times the structure was copied because a row ran out of free slots
+            size_t rebuilds() const { return rebuild_am; }
+
+            // Used and free slots of all rows
+            nnz_type storedEntries() const {
+                return this->row_start != NULL ? this->row_start[this->nor] : 0;
+            }
+
+            /**
+             * @brief Fill the given matrix as a 2D discretized poisson matrix with equal discretization steplength in x and y
+             *
+             * @param m The amount of discretization steps in the x direction
+             * @param n The amount of discretization steps in the y direction
+             */
+            void generatePoissonMatrix(const int_type m, const int_type n, const int partitions) {
+                deleteData();
+
+                omp_set_num_threads(this->threads);
+
+                this->noc = m*n;
+                this->nor = m*n;
+                this->nnz = pwm::poissonNonzeros<nnz_type>(m, n);
+
+                pwm::Arena plain;
+                nnz_type* start = plain.template allocate<nnz_type>(this->nor+1);
+                int_type* col = plain.template allocate<int_type>(this->nnz);
+                T* data = plain.template allocate<T>(this->nnz);
+
+                pwm::fillPoissonOMP(data, start, col, m, n);
+                layout(start, NULL, col, data, NULL);
+            }
+
+            /**
+             * @brief Input the CRS matrix from a Triplet format
+             *
+             * The triplets are converted to a contiguous CRS first, which is copied into the rows with free slots.
+             *
+             * @param input Triplet format matrix used to convert to CRS
+             */
+            void loadFromTriplets(pwm::Triplet<T, int_type, nnz_type>& input, const int partition_am) {
+                deleteData();
+
+                omp_set_num_threads(this->threads);
+
+                this->noc = input.col_size;
+                this->nor = input.row_size;
+                this->nnz = input.nnz;
+
+                pwm::Arena plain;
+                nnz_type* start;
+                int_type* col;
+                T* data;
+                if (input.in_place) {
+                    pwm::TripletToCRSInPlace(input, start, col, data, plain);
+                } else {
+                    start = plain.template allocate<nnz_type>(this->nor+1);
+                    col = plain.template allocate<int_type>(this->nnz);
+                    data = plain.template allocate<T>(this->nnz);
+
+                    pwm::TripletToCRSOMP(input.row_coord, input.col_coord, input.data, start, col, data, this->nnz, this->nor);
+                }
+
+                layout(start, NULL, col, data, NULL);
+            }
+
+            /**
+             * @brief Insert a batch of edges A_ij = v, the value of an existing edge is overwritten
+             *
+             * Rows are updated in parallel. Rows without enough free slots are left out in a first pass, then the
+             * structure is copied once with the slots they need and they are updated in a second pass. An edge outside of
+             * the matrix throws std::out_of_range before anything changes.
+             *
+             * @param rows Row of every edge
+             * @param cols Column of every edge
+             * @param values Value of every edge
+             * @param count Amount of edges
+             */
+            void insertEdges(const int_type* rows, const int_type* cols, const T* values, size_t count) {
+                checkEdges(rows, cols, count);
+
+                std::vector<size_t> order, groups;
+                groupByRow(rows, count, order, groups);
+                const long long group_am = (long long) groups.size() - 1;
+
+                // Missing slots of the rows which do not fit (0 if the row was updated)
+                std::vector<int_type> missing(group_am, 0);
+                long long added = 0, overflow = 0;
+
+                #pragma omp parallel for num_threads(this->threads) schedule(dynamic, 64) reduction(+:added, overflow)
+                for (long long g = 0; g < group_am; ++g) {
+                    int_type i = rows[order[groups[g]]];
+
+                    // Upper bound of the new edges (a repeated new edge is counted more than once)
+                    int_type needed = 0;
+                    for (size_t u = groups[g]; u < groups[g+1]; ++u) {
+                        if (findSlot(i, cols[order[u]]) < 0) needed++;
+                    }
+
+                    if (row_length[i] + needed > (int_type) (this->row_start[i+1] - this->row_start[i])) {
+                        missing[g] = row_length[i] + needed - (int_type) (this->row_start[i+1] - this->row_start[i]);
+                        overflow++;
+                    } else {
+                        added += insertRow(cols, values, order.data(), groups[g], groups[g+1], i);
+                    }
+                }
+
+                if (overflow > 0) {
+                    std::vector<int_type> extra(this->nor, 0);
+                    for (long long g = 0; g < group_am; ++g) extra[rows[order[groups[g]]]] = missing[g];
+
+                    nnz_type* old_start = this->row_start;
+                    int_type* old_length = row_length;
+                    int_type* old_col = this->col_ind;
+                    T* old_data = this->data_arr;
+
+                    layout(old_start, old_length, old_col, old_data, extra.data());
+                    this->arena.deallocate(old_start);
+                    this->arena.deallocate(old_length);
+                    this->arena.deallocate(old_col);
+                    this->arena.deallocate(old_data);
+                    rebuild_am++;
+
+                    #pragma omp parallel for num_threads(this->threads) schedule(dynamic, 64) reduction(+:added)
+                    for (long long g = 0; g < group_am; ++g) {
+                        if (missing[g] > 0) added += insertRow(cols, values, order.data(), groups[g], groups[g+1], rows[order[groups[g]]]);
+                    }
+                }
+
+                // The transposed CRS holds a copy of the old values
+                if (count > 0) this->transpose.release(this->arena);
+                this->nnz += added;
+            }
+
+            /**
+             * @brief Remove a batch of edges, edges which are not in the matrix are ignored
+             *
+             * The last edge of the row moves into the slot of the removed edge, which becomes a free slot. An edge outside
+             * of the matrix throws std::out_of_range before anything changes.
+             *
+             * @param rows Row of every edge
+             * @param cols Column of every edge
+             * @param count Amount of edges
+             */
+            void removeEdges(const int_type* rows, const int_type* cols, size_t count) {
+                checkEdges(rows, cols, count);
+
+                std::vector<size_t> order, groups;
+                groupByRow(rows, count, order, groups);
+                const long long group_am = (long long) groups.size() - 1;
+                long long removed = 0;
+
+                #pragma omp parallel for num_threads(this->threads) schedule(dynamic, 64) reduction(+:removed)
+                for (long long g = 0; g < group_am; ++g) {
+                    int_type i = rows[order[groups[g]]];
+                    for (size_t u = groups[g]; u < groups[g+1]; ++u) {
+                        nnz_type k = findSlot(i, cols[order[u]]);
+                        if (k < 0) continue;
+
+                        nnz_type last = this->row_start[i] + --row_length[i];
+                        this->col_ind[k] = this->col_ind[last];
+                        this->data_arr[k] = this->data_arr[last];
+                        this->col_ind[last] = freeColumn(i);
+                        this->data_arr[last] = 0.;
+                        removed++;
+                    }
+                }
+
+                if (removed > 0) this->transpose.release(this->arena);
+                this->nnz -= removed;
+            }
+
+            /**
+             * @brief Matrix vector product Ax = y
+             *
+             * Loop is parallelized using OpenMP, only the used slots of a row are read
+             *
+             * @param x Input vector
+             * @param y Output vector
+             */
+            void mv(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                #pragma omp parallel shared(x, y)
+                {
+                    PWM_PERF_SCOPE(this->perf_counters, omp_get_thread_num());
+
+                    #pragma omp for schedule(dynamic, 8) nowait
+                    for (int_type i = 0; i < this->nor; ++i) {
+                        T sum = 0.;
+                        nnz_type end = this->row_start[i] + row_length[i];
+                        for (nnz_type k = this->row_start[i]; k < end; ++k) {
+                            sum += this->data_arr[k]*x[this->col_ind[k]];
+                        }
+
+                        y[i] = sum;
+                    }
+                }
+            }
+
+            /**
+             * @brief Model of the bytes moved from memory in one power method iteration
+             *
+             * The used slots are read and the row lengths on top of the row starts.
+             */
+            double bytesPerIteration() const {
+                return CRSOMP<T, int_type, nnz_type>::bytesPerIteration() + (double) this->nor*sizeof(int_type);
+            }
+    };
+} // namespace pwm
+
+#endif // PWM_CRSDYNAMIC_HPP
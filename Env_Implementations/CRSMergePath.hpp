@@ -0,0 +1,165 @@
+/**
+ * @file CRSMergePath.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Compressed Row Storage matrix class using OpenMP with merge path load balancing
+ * @version 0.1
+ * @date 2022-11-13
+ *
+ * The matrix vector product is seen as a merge of the row end offsets (row_start[1..nor]) and the indices of the
+ * nonzeros. Every thread gets an equal share of the nor + nnz steps of this merge path, found by a binary search
+ * on the diagonal of the thread. A thread can thus start and end in the middle of a row, the partial sum of the
+ * last row of a thread is carried out and added to the result in a fix up pass. In the reproducible mode (set before
+ * the matrix is loaded) the parts only start at the first nonzero of a row, so every row is summed in order by one
+ * thread and the result does not depend on the amount of threads.
+ *
+ * Duane Merrill and Michael Garland. 2016. Merge-based parallel sparse matrix-vector multiplication. SC '16.
+ */
+
+#ifndef PWM_CRSMERGEPATH_HPP
+#define PWM_CRSMERGEPATH_HPP
+
+#include <algorithm>
+
+#include "CRSOMP.hpp"
+
+#include <omp.h>
+
+namespace pwm {
+    template<typename T, typename int_type, typename nnz_type = int_type>
+    class CRSMergePath: public pwm::CRSOMP<T, int_type, nnz_type> {
+        protected:
+            // Row and nonzero at the start of the merge path of each thread (threads + 1)
+            int_type* path_row = NULL;
+            nnz_type* path_nz = NULL;
+
+            // Row and partial sum which are carried out by each thread
+            int_type* carry_row = NULL;
+            T* carry_val = NULL;
+
+        private:
+            /**
+             * @brief Find the point where a diagonal of the merge grid crosses the merge path
+             *
+             * @param diagonal Index of the diagonal (amount of rows + nonzeros before the point)
+             * @param row Row at the point
+             * @param nz Nonzero at the point
+             */
+            void mergePathSearch(nnz_type diagonal, int_type& row, nnz_type& nz) const {
+                int_type x_min = std::max<nnz_type>(diagonal - this->nnz, 0);
+                int_type x_max = std::min<nnz_type>(diagonal, this->nor);
+
+                // Row end offsets are row_start + 1
+                while (x_min < x_max) {
+                    int_type pivot = x_min + (x_max - x_min)/2;
+                    if (this->row_start[pivot+1] <= diagonal - pivot - 1) {
+                        x_min = pivot + 1;
+                    } else {
+                        x_max = pivot;
+                    }
+                }
+
+                row = x_min;
+                nz = diagonal - x_min;
+            }
+
+            // Split the merge path in an equal share per thread (the arena of the matrix was reset by the base class)
+            void buildPath() {
+                int teams = std::max(this->threads, 1);
+                path_row = this->arena.template allocate<int_type>(teams+1);
+                path_nz = this->arena.template allocate<nnz_type>(teams+1);
+                carry_row = this->arena.template allocate<int_type>(teams);
+                carry_val = this->arena.template allocate<T>(teams);
+
+                long long total = (long long) this->nor + this->nnz;
+                for (int t = 0; t <= teams; ++t) {
+                    nnz_type diagonal = std::min<long long>(total, (total*t + teams - 1)/teams);
+                    mergePathSearch(diagonal, path_row[t], path_nz[t]);
+
+                    // Move the start of the part to the start of its row, the previous part gets the whole row
+                    if (pwm::reproducibleMode()) path_nz[t] = this->row_start[path_row[t]];
+                }
+            }
+
+        public:
+            // Base constructor
+            CRSMergePath() {}
+
+            // Base constructor
+            CRSMergePath(int threads): CRSOMP<T, int_type, nnz_type>(threads) {}
+
+            /**
+             * @brief Fill the given matrix as a 2D discretized poisson matrix with equal discretization steplength in x and y
+             *
+             * @param m The amount of discretization steps in the x direction
+             * @param n The amount of discretization steps in the y direction
+             */
+            void generatePoissonMatrix(const int_type m, const int_type n, const int partitions) {
+                CRSOMP<T, int_type, nnz_type>::generatePoissonMatrix(m, n, partitions);
+                buildPath();
+            }
+
+            /**
+             * @brief Input the CRS matrix from a Triplet format
+             *
+             * @param input Triplet format matrix used to convert to CRS
+             */
+            void loadFromTriplets(pwm::Triplet<T, int_type, nnz_type>& input, const int partition_am) {
+                CRSOMP<T, int_type, nnz_type>::loadFromTriplets(input, partition_am);
+                buildPath();
+            }
+
+            /**
+             * @brief Matrix vector product Ax = y
+             *
+             * Every thread consumes its part of the merge path: complete rows are written to y, the partial sum of the
+             * row in which the part ends is carried out. After all threads finished the carries are added in order.
+             *
+             * @param x Input vector
+             * @param y Output vector
+             */
+            void mv(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                const nnz_type* row_start = this->row_start;
+                const int_type* col_ind = this->col_ind;
+                const T* data_arr = this->data_arr;
+                int teams = std::max(this->threads, 1);
+
+                #pragma omp parallel shared(x, y)
+                {
+                    PWM_PERF_SCOPE(this->perf_counters, omp_get_thread_num());
+
+                    // Loop in case the runtime gives less threads than requested
+                    for (int t = omp_get_thread_num(); t < teams; t += omp_get_num_threads()) {
+                        int_type row = path_row[t];
+                        nnz_type nz = path_nz[t];
+
+                        for (; row < path_row[t+1]; ++row) {
+                            T sum = 0.;
+                            for (; nz < row_start[row+1]; ++nz) {
+                                sum += data_arr[nz]*x[col_ind[nz]];
+                            }
+
+                            y[row] = sum;
+                        }
+
+                        // Partial row at the end of the path of this thread
+                        T sum = 0.;
+                        for (; nz < path_nz[t+1]; ++nz) {
+                            sum += data_arr[nz]*x[col_ind[nz]];
+                        }
+
+                        carry_row[t] = path_row[t+1];
+                        carry_val[t] = sum;
+                    }
+                }
+
+                // Fix up the rows which were split over threads
+                for (int t = 0; t < teams - 1; ++t) {
+                    if (carry_row[t] < this->nor && path_nz[t+1] > this->row_start[carry_row[t]]) y[carry_row[t]] += carry_val[t];
+                }
+            }
+    };
+} // namespace pwm
+
+#endif // PWM_CRSMERGEPATH_HPP
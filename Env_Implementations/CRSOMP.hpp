@@ -19,25 +19,40 @@
 #include "../Matrix/SparseMatrix.hpp"
 #include "../Util/VectorUtill.hpp"
 #include "../Util/Poisson.hpp"
+#include "../Util/Batch.hpp"
 
 #include <omp.h>
 
 namespace pwm {
-    template<typename T, typename int_type>
-    class CRSOMP: public pwm::SparseMatrix<T, int_type> {
+    template<typename T, typename int_type, typename nnz_type = int_type>
+    class CRSOMP: public pwm::SparseMatrix<T, int_type, nnz_type> {
         protected:
             // Row start array for the CRS format
-            int_type* row_start;
+            nnz_type* row_start = NULL;
             
             // Column index array for the CRS format
-            int_type* col_ind;
+            int_type* col_ind = NULL;
 
             // Data array which stores the actual nonzeros
-            T* data_arr;
+            T* data_arr = NULL;
 
             // Amount of threads to be used
             int threads;
 
+            // CRS arrays of all rows for the transpose products
+            std::vector<pwm::CRSPart<T, int_type, nnz_type>> crsParts() {
+                return {{0, this->nor, row_start, col_ind, data_arr}};
+            }
+
+        private:
+            // Free the datastructures of a previously loaded matrix
+            void deleteData() {
+                this->arena.reset();
+                row_start = NULL;
+                col_ind = NULL;
+                data_arr = NULL;
+            }
+
         public:
             // Base constructor
             CRSOMP() {}
@@ -52,16 +67,18 @@ namespace pwm {
              * @param n The amount of discretization steps in the y direction
              */
             void generatePoissonMatrix(const int_type m, const int_type n, const int partitions) {
+                deleteData();
+
                 omp_set_num_threads(threads);
 
                 this->noc = m*n;
                 this->nor = m*n;
 
-                this->nnz = n*(m+2*(m-1)) + 2*(n-1)*m;
+                this->nnz = pwm::poissonNonzeros<nnz_type>(m, n);
 
-                row_start = new int_type[this->nor+1];
-                col_ind = new int_type[this->nnz];
-                data_arr = new T[this->nnz];
+                row_start = this->arena.template allocate<nnz_type>(this->nor+1);
+                col_ind = this->arena.template allocate<int_type>(this->nnz);
+                data_arr = this->arena.template allocate<T>(this->nnz);
 
                 pwm::fillPoissonOMP(data_arr, row_start, col_ind, m, n);
 
@@ -74,18 +91,24 @@ namespace pwm {
              * 
              * @param input Triplet format matrix used to convert to CRS
              */
-            void loadFromTriplets(pwm::Triplet<T, int_type> input, const int partition_am) {
+            void loadFromTriplets(pwm::Triplet<T, int_type, nnz_type>& input, const int partition_am) {
+                deleteData();
+
                 omp_set_num_threads(threads);
 
                 this->noc = input.col_size;
                 this->nor = input.row_size;
                 this->nnz = input.nnz;
 
-                row_start = new int_type[this->nor+1];
-                col_ind = new int_type[this->nnz];
-                data_arr = new T[this->nnz];
+                if (input.in_place) {
+                    pwm::TripletToCRSInPlace(input, row_start, col_ind, data_arr, this->arena);
+                } else {
+                    row_start = this->arena.template allocate<nnz_type>(this->nor+1);
+                    col_ind = this->arena.template allocate<int_type>(this->nnz);
+                    data_arr = this->arena.template allocate<T>(this->nnz);
 
-                pwm::TripletToCRSOMP(input.row_coord, input.col_coord, input.data, row_start, col_ind, data_arr, this->nnz, this->nor);
+                    pwm::TripletToCRSOMP(input.row_coord, input.col_coord, input.data, row_start, col_ind, data_arr, this->nnz, this->nor);
+                }
             }
 
             /**
@@ -96,20 +119,88 @@ namespace pwm {
              * @param x Input vector
              * @param y Output vector
              */
-            void mv(const T* x, T* y) {             
-                #pragma omp parallel for shared(x, y) schedule(dynamic, 8) // We use dynamic scheduler because of the varying workload per row
-                for (int_type i = 0; i < this->nor; ++i) {
-                    T sum = 0.;
-                    int_type j;
-                    for (int_type k = row_start[i]; k < row_start[i+1]; ++k) {
-                        j = col_ind[k];
-                        sum += data_arr[k]*x[j];
+            void mv(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                #pragma omp parallel shared(x, y)
+                {
+                    PWM_PERF_SCOPE(this->perf_counters, omp_get_thread_num());
+
+                    #pragma omp for schedule(dynamic, 8) nowait // We use dynamic scheduler because of the varying workload per row
+                    for (int_type i = 0; i < this->nor; ++i) {
+                        T sum = 0.;
+                        int_type j;
+                        for (nnz_type k = row_start[i]; k < row_start[i+1]; ++k) {
+                            j = col_ind[k];
+                            sum += data_arr[k]*x[j];
+                        }
+                        
+                        y[i] = sum;
+                    }
+                }
+            }
+
+            /**
+             * @brief Matrix product with a batch of interleaved vectors Y = AX
+             * 
+             * One sweep over the matrix computes the products of all vectors, the loop is parallelized using OpenMP
+             * 
+             * @param X Input vectors
+             * @param Y Output vectors
+             * @param batch Amount of vectors
+             */
+            void mvBatch(const T* X, T* Y, int batch) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                #pragma omp parallel shared(X, Y)
+                {
+                    PWM_PERF_SCOPE(this->perf_counters, omp_get_thread_num());
+
+                    #pragma omp for schedule(dynamic, 8) nowait
+                    for (int_type i = 0; i < this->nor; ++i) {
+                        pwm::batchRows(row_start, col_ind, data_arr, X, Y, batch, i, i+1);
                     }
-                    
-                    y[i] = sum;
                 }
             }
 
+            /**
+             * @brief Parallel loop over the rows of the matrix
+             * 
+             * The rows are split in one static range per OpenMP thread.
+             * 
+             * @param body Function called with the first row and one past the last row of a range
+             */
+            void parallelFor(const std::function<void(int_type, int_type)>& body) {
+                #pragma omp parallel num_threads(threads)
+                {
+                    int_type begin = (int_type) ((long long) this->nor * omp_get_thread_num() / omp_get_num_threads());
+                    int_type end = (int_type) ((long long) this->nor * (omp_get_thread_num() + 1) / omp_get_num_threads());
+                    body(begin, end);
+                }
+            }
+
+            /**
+             * @brief Parallel sum over the rows of the matrix
+             * 
+             * One static range per OpenMP thread, the partial sums are added with an OpenMP reduction.
+             * 
+             * @param body Function which returns the partial sum of a range of rows
+             */
+            T parallelSum(const std::function<T(int_type, int_type)>& body) {
+                if (pwm::reproducibleMode()) return pwm::reproducibleSum(this->rowLoop(), this->nor, body);
+
+                T sum = 0.;
+
+                #pragma omp parallel num_threads(threads) reduction(+:sum)
+                {
+                    int_type begin = (int_type) ((long long) this->nor * omp_get_thread_num() / omp_get_num_threads());
+                    int_type end = (int_type) ((long long) this->nor * (omp_get_thread_num() + 1) / omp_get_num_threads());
+                    sum += body(begin, end);
+                }
+
+                return sum;
+            }
+
             /**
              * @brief Power method: Executes matrix vector product repeatedly to get the dominant eigenvector.
              * 
@@ -120,6 +211,8 @@ namespace pwm {
              * @param it Amount of iterations for the algorithm
              */
             void powerMethod(T* x, T* y, const int_type it) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
                 assert(this->nor == this->noc); //Power method only works on square matrices
                 
                 for (int it_nb = 0; it_nb < it; ++it_nb) {
@@ -142,6 +235,53 @@ namespace pwm {
                     }
                 }
             }
+
+            /**
+             * @brief s-step power method: Only normalizes the iterate every s iterations.
+             * 
+             * In between the iterate is divided by an estimate of the dominant eigenvalue (scaled recurrence) to avoid overflow.
+             * The estimate is obtained in the first iteration and refined at every normalization.
+             * 
+             * Loop is parallelized using OpenMP
+             * 
+             * @param x Input vector to start calculation, contains the output at the end of the algorithm is it is uneven
+             * @param y Vector to store calculations, contains the output at the end of the algorithm if it is even
+             * @param it Amount of iterations for the algorithm
+             * @param s Amount of iterations between two normalizations
+             */
+            void powerMethodSStep(T* x, T* y, const int_type it, const int s) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                assert(this->nor == this->noc); //Power method only works on square matrices
+
+                T x_norm = pwm::norm2(x, this->nor);
+                T scale = 1.;
+                int steps = 0;
+                for (int it_nb = 0; it_nb < it; ++it_nb) {
+                    T* in = it_nb % 2 == 0 ? x : y;
+                    T* out = it_nb % 2 == 0 ? y : x;
+                    this->mv(in, out);
+                    steps++;
+
+                    T div;
+                    if (it_nb == 0 || steps == s || it_nb == it - 1) {
+                        // Synchronization point: normalize and update the eigenvalue estimate
+                        T norm = pwm::norm2(out, this->nor);
+                        if (it_nb == 0) scale = norm/x_norm;
+                        else scale *= std::pow(norm/scale, (T) 1./steps);
+
+                        div = norm;
+                        steps = 0;
+                    } else {
+                        div = scale;
+                    }
+
+                    #pragma omp parallel for shared(out, div) schedule(static)
+                    for (int i = 0; i < this->nor; ++i) {
+                        out[i] /= div;
+                    }
+                }
+            }
     };
 } // namespace pwm
 
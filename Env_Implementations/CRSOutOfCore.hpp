@@ -0,0 +1,549 @@
+/**
+ * @file CRSOutOfCore.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Compressed Row Storage matrix class which streams row blocks from disk (out of core) using OpenMP
+ * @version 0.1
+ * @date 2022-11-17
+ *
+ * The rows are split in blocks of about block_bytes, every block is stored as CRS arrays (data, local row start and
+ * column indices) in a scratch file on local storage. Only x, y and a ring of buffers (two or three blocks) are
+ * resident. A reader thread reads the blocks in order with pread into the free buffers while the OpenMP threads
+ * compute the rows of the blocks which are already read, so every product is one sequential scan of the file and its
+ * throughput approaches the read bandwidth of the disk.
+ *
+ * The Poisson matrix is generated block by block and never resident as a whole. A matrix from Triplet format is
+ * converted to CRS in memory (in place when the Triplet allows it) and then written to the file.
+ * Read blocks are dropped from the page cache, such that the product also streams from disk if the file fits in memory.
+ */
+
+#ifndef PWM_CRSOUTOFCORE_HPP
+#define PWM_CRSOUTOFCORE_HPP
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "CRSOMP.hpp"
+#include "../Util/Poisson.hpp"
+
+#include <omp.h>
+
+namespace pwm {
+    template<typename T, typename int_type, typename nnz_type = int_type>
+    class CRSOutOfCore: public pwm::CRSOMP<T, int_type, nnz_type> {
+        protected:
+            // Row block stored in the file
+            struct Block {
+                int_type first_row;
+                int_type rows;
+                nnz_type nnz;
+                off_t offset;
+                size_t bytes;
+            };
+
+            // All blocks in row order
+            std::vector<Block> blocks;
+
+            // Buffers of the blocks which are read or computed
+            std::vector<char*> buffers;
+
+            // Private output vectors of the transpose products
+            pwm::ScatterBuffers<T> scatter_buffers;
+
+            // Directory of the scratch file
+            std::string directory;
+
+            // Target size of a block in bytes
+            size_t block_bytes = (size_t) 64 << 20;
+
+            // Amount of buffers (blocks in flight)
+            int buffer_am = 3;
+
+            // Scratch file (removed as soon as it is created, so it disappears when it is closed)
+            int fd = -1;
+
+            // Size of the scratch file in bytes
+            size_t file_bytes = 0;
+
+            // Statistics of the products: bytes read, time spent reading and time the computation waited for a block
+            size_t bytes_read = 0;
+            double read_seconds = 0.;
+            double stall_seconds = 0.;
+
+            // The rows are not in memory, the transpose products stream the blocks
+            std::vector<pwm::CRSPart<T, int_type, nnz_type>> crsParts() {
+                return {};
+            }
+
+        private:
+            // Size of a section of a block (every section starts at a cache line)
+            static size_t section(size_t bytes) {
+                return (bytes + 63)/64*64;
+            }
+
+            // Size of a block with an amount of rows and nonzeros
+            static size_t blockSize(int_type rows, nnz_type nnz) {
+                return section(nnz*sizeof(T)) + section((rows+1)*sizeof(nnz_type)) + section(nnz*sizeof(int_type));
+            }
+
+            // Arrays of a block in a buffer
+            static void blockArrays(char* buffer, int_type rows, nnz_type nnz, T*& data, nnz_type*& row_start, int_type*& col_ind) {
+                data = reinterpret_cast<T*>(buffer);
+                row_start = reinterpret_cast<nnz_type*>(buffer + section(nnz*sizeof(T)));
+                col_ind = reinterpret_cast<int_type*>(buffer + section(nnz*sizeof(T)) + section((rows+1)*sizeof(nnz_type)));
+            }
+
+            static void throwError(const std::string& what) {
+                throw std::runtime_error("Out of core matrix: " + what + ": " + std::strerror(errno));
+            }
+
+            // Write an array to the file
+            void writeAll(const void* buffer, size_t bytes, off_t offset) {
+                const char* ptr = static_cast<const char*>(buffer);
+                while (bytes > 0) {
+                    ssize_t written = pwrite(fd, ptr, bytes, offset);
+                    if (written < 0 && errno == EINTR) continue;
+                    if (written <= 0) throwError("write failed");
+
+                    ptr += written;
+                    bytes -= written;
+                    offset += written;
+                }
+            }
+
+            // Read a block from the file
+            void readAll(void* buffer, size_t bytes, off_t offset) {
+                char* ptr = static_cast<char*>(buffer);
+                while (bytes > 0) {
+                    ssize_t read_bytes = pread(fd, ptr, bytes, offset);
+                    if (read_bytes < 0 && errno == EINTR) continue;
+                    if (read_bytes <= 0) throwError("read failed");
+
+                    ptr += read_bytes;
+                    bytes -= read_bytes;
+                    offset += read_bytes;
+                }
+            }
+
+            // Free the blocks and the file of a previously loaded matrix
+            void deleteData() {
+                this->arena.reset();
+                this->row_start = NULL;
+                this->col_ind = NULL;
+                this->data_arr = NULL;
+                blocks.clear();
+                buffers.clear();
+                file_bytes = 0;
+                resetStatistics();
+
+                if (fd >= 0) close(fd);
+                fd = -1;
+            }
+
+            // Create the scratch file in the directory
+            void openFile() {
+                std::string dir = directory;
+                if (dir.empty()) dir = std::getenv("TMPDIR") != NULL ? std::getenv("TMPDIR") : "/tmp";
+
+                std::string name = dir + "/pwm_ooc_XXXXXX";
+                std::vector<char> path(name.begin(), name.end());
+                path.push_back('\0');
+
+                fd = mkstemp(path.data());
+                if (fd < 0) throwError("cannot create a file in " + dir);
+                unlink(path.data());
+            }
+
+            // Append a block to the file
+            void writeBlock(int_type first_row, int_type rows, const nnz_type* row_start, const int_type* col_ind, const T* data) {
+                nnz_type nnz = row_start[rows] - row_start[0];
+                Block block{first_row, rows, nnz, (off_t) file_bytes, blockSize(rows, nnz)};
+
+                // The row start array of a block is local to the block
+                std::vector<nnz_type> local(rows+1);
+                for (int_type i = 0; i <= rows; ++i) local[i] = row_start[i] - row_start[0];
+
+                writeAll(data + row_start[0], nnz*sizeof(T), block.offset);
+                writeAll(local.data(), (rows+1)*sizeof(nnz_type), block.offset + section(nnz*sizeof(T)));
+                writeAll(col_ind + row_start[0], nnz*sizeof(int_type), block.offset + section(nnz*sizeof(T)) + section((rows+1)*sizeof(nnz_type)));
+
+                file_bytes += block.bytes;
+                blocks.push_back(block);
+            }
+
+            // Flush the file, drop it from the page cache and allocate the buffers
+            void finishFile() {
+                // The padding of the last block is part of the file
+                if (ftruncate(fd, file_bytes) != 0) throwError("resize failed");
+                if (fdatasync(fd) != 0) throwError("sync failed");
+                posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+                size_t buffer_bytes = 0;
+                for (const Block& block : blocks) buffer_bytes = std::max(buffer_bytes, block.bytes);
+
+                buffers.clear();
+                int am = std::min<int>(buffer_am, std::max<size_t>(blocks.size(), 1));
+                for (int i = 0; i < am; ++i) buffers.push_back(this->arena.template allocate<char>(buffer_bytes));
+            }
+
+            // Multiply the rows of a block which is in a buffer
+            void computeBlock(const Block& block, char* buffer, const T* x, T* y) {
+                T* data;
+                nnz_type* row_start;
+                int_type* col_ind;
+                blockArrays(buffer, block.rows, block.nnz, data, row_start, col_ind);
+                T* y_block = y + block.first_row;
+
+                #pragma omp parallel shared(x, y_block)
+                {
+                    PWM_PERF_SCOPE(this->perf_counters, omp_get_thread_num());
+
+                    #pragma omp for schedule(dynamic, 64) nowait
+                    for (int_type i = 0; i < block.rows; ++i) {
+                        T sum = 0.;
+                        for (nnz_type k = row_start[i]; k < row_start[i+1]; ++k) {
+                            sum += data[k]*x[col_ind[k]];
+                        }
+
+                        y_block[i] = sum;
+                    }
+                }
+            }
+
+            /**
+             * @brief Add the rows of a block which is in a buffer, multiplied with a factor per row, to the private vectors
+             *
+             * The factor of row i is x[i] for A^T x, or the dot product of the row with x for A^T A x (normal).
+             */
+            void scatterBlock(const Block& block, char* buffer, const T* x, bool normal) {
+                T* data;
+                nnz_type* row_start;
+                int_type* col_ind;
+                blockArrays(buffer, block.rows, block.nnz, data, row_start, col_ind);
+
+                #pragma omp parallel shared(x)
+                {
+                    PWM_PERF_SCOPE(this->perf_counters, omp_get_thread_num());
+                    T* y = scatter_buffers.acquire();
+
+                    #pragma omp for schedule(dynamic, 64) nowait
+                    for (int_type i = 0; i < block.rows; ++i) {
+                        T factor = x[block.first_row + i];
+                        if (normal) {
+                            factor = 0.;
+                            for (nnz_type k = row_start[i]; k < row_start[i+1]; ++k) factor += data[k]*x[col_ind[k]];
+                        }
+
+                        for (nnz_type k = row_start[i]; k < row_start[i+1]; ++k) y[col_ind[k]] += data[k]*factor;
+                    }
+
+                    scatter_buffers.release(y);
+                }
+            }
+
+            // Multiply the rows of a block which is in a buffer with a batch of interleaved vectors
+            void computeBlockBatch(const Block& block, char* buffer, const T* X, T* Y, int batch) {
+                T* data;
+                nnz_type* row_start;
+                int_type* col_ind;
+                blockArrays(buffer, block.rows, block.nnz, data, row_start, col_ind);
+                T* Y_block = Y + (size_t) block.first_row*batch;
+
+                #pragma omp parallel shared(X, Y_block)
+                {
+                    PWM_PERF_SCOPE(this->perf_counters, omp_get_thread_num());
+
+                    #pragma omp for schedule(dynamic, 64) nowait
+                    for (int_type i = 0; i < block.rows; ++i) {
+                        pwm::batchRows(row_start, col_ind, data, X, Y_block, batch, i, i+1);
+                    }
+                }
+            }
+
+            /**
+             * @brief Stream all blocks and scatter their rows, then sum the private vectors into y
+             */
+            void scatterBlocks(const T* x, T* y, bool normal) {
+                scatter_buffers.resize(this->noc);
+                streamBlocks([&](const Block& block, char* buffer) {
+                    scatterBlock(block, buffer, x, normal);
+                });
+
+                this->parallelFor([&](int_type begin, int_type end) {
+                    scatter_buffers.reduce(pwm::rowToColumn(begin, this->nor, this->noc), pwm::rowToColumn(end, this->nor, this->noc), y);
+                });
+            }
+
+            /**
+             * @brief Stream all blocks through the buffers and compute each block when it is read
+             *
+             * A reader thread reads the blocks in order into the ring of buffers, a block is read as soon as its buffer is
+             * computed.
+             *
+             * @param compute Function which computes a block from its buffer
+             */
+            void streamBlocks(const std::function<void(const Block&, char*)>& compute) {
+                size_t block_am = blocks.size();
+                size_t read_am = 0;
+                size_t done_am = 0;
+                std::mutex mutex;
+                std::condition_variable cond;
+                std::exception_ptr error;
+
+                std::thread reader([&]() {
+                    try {
+                        for (size_t b = 0; b < block_am; ++b) {
+                            {
+                                std::unique_lock<std::mutex> lock(mutex);
+                                cond.wait(lock, [&]() { return b < done_am + buffers.size(); });
+                            }
+
+                            double start = omp_get_wtime();
+                            readAll(buffers[b % buffers.size()], blocks[b].bytes, blocks[b].offset);
+                            posix_fadvise(fd, blocks[b].offset, blocks[b].bytes, POSIX_FADV_DONTNEED);
+                            read_seconds += omp_get_wtime() - start;
+                            bytes_read += blocks[b].bytes;
+
+                            std::lock_guard<std::mutex> lock(mutex);
+                            read_am = b + 1;
+                            cond.notify_all();
+                        }
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        error = std::current_exception();
+                        read_am = block_am;
+                        cond.notify_all();
+                    }
+                });
+
+                for (size_t b = 0; b < block_am; ++b) {
+                    {
+                        double start = omp_get_wtime();
+                        std::unique_lock<std::mutex> lock(mutex);
+                        cond.wait(lock, [&]() { return read_am > b; });
+                        stall_seconds += omp_get_wtime() - start;
+                        if (error) break;
+                    }
+
+                    compute(blocks[b], buffers[b % buffers.size()]);
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    done_am = b + 1;
+                    cond.notify_all();
+                }
+
+                reader.join();
+                if (error) std::rethrow_exception(error);
+            }
+
+        public:
+            // Base constructor
+            CRSOutOfCore() {}
+
+            // Base constructor
+            CRSOutOfCore(int threads): CRSOMP<T, int_type, nnz_type>(threads) {}
+
+            // Destructor
+            ~CRSOutOfCore() {
+                if (fd >= 0) close(fd);
+            }
+
+            /**
+             * @brief Set where and how the blocks are stored, used when the next matrix is loaded
+             *
+             * @param directory_in Directory of the scratch file (empty: $TMPDIR or /tmp)
+             * @param block_bytes_in Target size of a block in bytes
+             * @param buffers_in Amount of blocks in flight (2 is double, 3 triple buffering)
+             */
+            void setStorage(const std::string& directory_in, size_t block_bytes_in, int buffers_in) {
+                directory = directory_in;
+                block_bytes = std::max<size_t>(block_bytes_in, 4096);
+                buffer_am = std::max(buffers_in, 2);
+            }
+
+            // Amount of blocks in the file
+            size_t getBlocks() const { return blocks.size(); }
+
+            // Reset the statistics of the products
+            void resetStatistics() {
+                bytes_read = 0;
+                read_seconds = 0.;
+                stall_seconds = 0.;
+            }
+
+            /**
+             * @brief Print the size of the file and the read bandwidth and waiting time of the products since the last reset
+             */
+            void printReport() const {
+                const double mb = 1024.*1024.;
+                std::cout << "Out of core: " << blocks.size() << " blocks, file " << file_bytes/mb << "MB, ";
+                std::cout << buffers.size() << " buffers of " << (buffers.empty() ? 0. : this->arena.bytes()/mb/buffers.size()) << "MB" << std::endl;
+                if (read_seconds > 0.) {
+                    std::cout << "Out of core: read " << bytes_read/mb << "MB at " << bytes_read/read_seconds/1e9 << "GB/s, ";
+                    std::cout << "computation waited " << stall_seconds*1000 << "ms for blocks" << std::endl;
+                }
+            }
+
+            /**
+             * @brief Model of the bytes moved in one power method iteration
+             *
+             * The complete file is read once, the vectors as for CRS.
+             */
+            double bytesPerIteration() const {
+                return (double) file_bytes + 5.*this->nor*sizeof(T);
+            }
+
+            /**
+             * @brief Fill the given matrix as a 2D discretized poisson matrix with equal discretization steplength in x and y
+             *
+             * Every block is generated in a buffer and written to the file, the matrix is never resident as a whole.
+             *
+             * @param m The amount of discretization steps in the x direction
+             * @param n The amount of discretization steps in the y direction
+             */
+            void generatePoissonMatrix(const int_type m, const int_type n, const int partitions) {
+                deleteData();
+
+                omp_set_num_threads(this->threads);
+
+                this->noc = m*n;
+                this->nor = m*n;
+
+                this->nnz = pwm::poissonNonzeros<nnz_type>(m, n);
+
+                openFile();
+
+                // At most 5 nonzeros per row
+                int_type block_rows = std::max<size_t>(1, block_bytes/(5*(sizeof(T) + sizeof(int_type)) + sizeof(nnz_type)));
+                block_rows = std::min(block_rows, this->nor);
+                {
+                    pwm::Arena scratch;
+                    T* data = scratch.allocate<T>((size_t) 5*block_rows);
+                    nnz_type* row_start = scratch.allocate<nnz_type>(block_rows+1);
+                    int_type* col_ind = scratch.allocate<int_type>((size_t) 5*block_rows);
+
+                    for (int_type first_row = 0; first_row < this->nor; first_row += block_rows) {
+                        int_type last_row = std::min<int_type>(this->nor, first_row + block_rows);
+                        pwm::fillPoisson(data, row_start, col_ind, m, n, first_row, last_row);
+                        writeBlock(first_row, last_row - first_row, row_start, col_ind, data);
+                    }
+                }
+
+                finishFile();
+            }
+
+            /**
+             * @brief Input the matrix from a Triplet format
+             *
+             * The matrix is converted to CRS in memory, written to the file block by block and freed.
+             *
+             * @param input Triplet format matrix used to convert to CRS
+             */
+            void loadFromTriplets(pwm::Triplet<T, int_type, nnz_type>& input, const int partition_am) {
+                deleteData();
+                CRSOMP<T, int_type, nnz_type>::loadFromTriplets(input, partition_am);
+
+                openFile();
+
+                // Cut the rows in blocks of at most block_bytes (a longer row gets its own block)
+                int_type first_row = 0;
+                while (first_row < this->nor) {
+                    int_type last_row = first_row + 1;
+                    while (last_row < this->nor &&
+                           blockSize(last_row + 1 - first_row, this->row_start[last_row+1] - this->row_start[first_row]) <= block_bytes) {
+                        last_row++;
+                    }
+
+                    writeBlock(first_row, last_row - first_row, this->row_start + first_row, this->col_ind, this->data_arr);
+                    first_row = last_row;
+                }
+
+                // Only the buffers stay resident
+                this->arena.reset();
+                this->row_start = NULL;
+                this->col_ind = NULL;
+                this->data_arr = NULL;
+
+                finishFile();
+            }
+
+            /**
+             * @brief Matrix vector product Ax = y
+             *
+             * The blocks are streamed from the file, the rows of a block are computed in parallel using OpenMP.
+             *
+             * @param x Input vector
+             * @param y Output vector
+             */
+            void mv(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                streamBlocks([&](const Block& block, char* buffer) {
+                    computeBlock(block, buffer, x, y);
+                });
+            }
+
+            /**
+             * @brief Matrix product with a batch of interleaved vectors Y = AX
+             *
+             * The file is streamed once for all vectors, the rows of a block are computed in parallel using OpenMP.
+             *
+             * @param X Input vectors
+             * @param Y Output vectors
+             * @param batch Amount of vectors
+             */
+            void mvBatch(const T* X, T* Y, int batch) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                streamBlocks([&](const Block& block, char* buffer) {
+                    computeBlockBatch(block, buffer, X, Y, batch);
+                });
+            }
+
+            /**
+             * @brief Transpose matrix vector product A^T x = y
+             *
+             * The blocks are streamed from the file, the rows of a block are scattered into one private vector per OpenMP
+             * thread which are summed at the end.
+             *
+             * @param x Input vector
+             * @param y Output vector
+             */
+            void mvT(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                scatterBlocks(x, y, false);
+            }
+
+            /**
+             * @brief Product with the normal matrix A^T A x = y
+             *
+             * The file is streamed once: the dot product of every row with x is scattered with the same row.
+             *
+             * @param x Input vector
+             * @param y Output vector
+             */
+            void mvTmv(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                scatterBlocks(x, y, true);
+            }
+    };
+} // namespace pwm
+
+#endif // PWM_CRSOUTOFCORE_HPP
@@ -15,29 +15,45 @@
 #include <iostream>
 #include <cassert>
 #include <algorithm>
+#include <functional>
 
 #include "../Matrix/SparseMatrix.hpp"
 #include "../Util/VectorUtill.hpp"
 #include "../Util/Poisson.hpp"
+#include "../Util/Batch.hpp"
 
 #include "oneapi/tbb.h"
 
 namespace pwm {
-    template<typename T, typename int_type>
-    class CRSTBB: public pwm::SparseMatrix<T, int_type> {
+    template<typename T, typename int_type, typename nnz_type = int_type>
+    class CRSTBB: public pwm::SparseMatrix<T, int_type, nnz_type> {
         protected:
             // Row start array for the CRS format
-            int_type* row_start;
+            nnz_type* row_start = NULL;
             
             // Column index array for the CRS format
-            int_type* col_ind;
+            int_type* col_ind = NULL;
 
             // Data array which stores the actual nonzeros
-            T* data_arr;
+            T* data_arr = NULL;
 
             // Global threads limit
             oneapi::tbb::global_control global_limit;
 
+            // CRS arrays of all rows for the transpose products
+            std::vector<pwm::CRSPart<T, int_type, nnz_type>> crsParts() {
+                return {{0, this->nor, row_start, col_ind, data_arr}};
+            }
+
+        private:
+            // Free the datastructures of a previously loaded matrix
+            void deleteData() {
+                this->arena.reset();
+                row_start = NULL;
+                col_ind = NULL;
+                data_arr = NULL;
+            }
+
         public:
             // Base constructor
             CRSTBB() {}
@@ -52,14 +68,16 @@ namespace pwm {
              * @param n The amount of discretization steps in the y direction
              */
             void generatePoissonMatrix(const int_type m, const int_type n, const int partitions) {
+                deleteData();
+
                 this->noc = m*n;
                 this->nor = m*n;
 
-                this->nnz = n*(m+2*(m-1)) + 2*(n-1)*m;
+                this->nnz = pwm::poissonNonzeros<nnz_type>(m, n);
 
-                row_start = new int_type[this->nor+1];
-                col_ind = new int_type[this->nnz];
-                data_arr = new T[this->nnz];
+                row_start = this->arena.template allocate<nnz_type>(this->nor+1);
+                col_ind = this->arena.template allocate<int_type>(this->nnz);
+                data_arr = this->arena.template allocate<T>(this->nnz);
 
                 pwm::fillPoissonTBB(data_arr, row_start, col_ind, m, n);
 
@@ -72,16 +90,22 @@ namespace pwm {
              * 
              * @param input Triplet format matrix used to convert to CRS
              */
-            void loadFromTriplets(pwm::Triplet<T, int_type> input, const int partition_am) {
+            void loadFromTriplets(pwm::Triplet<T, int_type, nnz_type>& input, const int partition_am) {
+                deleteData();
+
                 this->noc = input.col_size;
                 this->nor = input.row_size;
                 this->nnz = input.nnz;
 
-                row_start = new int_type[this->nor+1];
-                col_ind = new int_type[this->nnz];
-                data_arr = new T[this->nnz];
+                if (input.in_place) {
+                    pwm::TripletToCRSInPlace(input, row_start, col_ind, data_arr, this->arena);
+                } else {
+                    row_start = this->arena.template allocate<nnz_type>(this->nor+1);
+                    col_ind = this->arena.template allocate<int_type>(this->nnz);
+                    data_arr = this->arena.template allocate<T>(this->nnz);
 
-                pwm::TripletToCRSTBB(input.row_coord, input.col_coord, input.data, row_start, col_ind, data_arr, this->nnz, this->nor);
+                    pwm::TripletToCRSTBB(input.row_coord, input.col_coord, input.data, row_start, col_ind, data_arr, this->nnz, this->nor);
+                }
             }
 
             /**
@@ -92,19 +116,74 @@ namespace pwm {
              * @param x Input vector
              * @param y Output vector
              */
-            void mv(const T* x, T* y) {   
-                oneapi::tbb::parallel_for(0, this->nor, [=](int_type i) {
-                    T sum = 0.;
-                    int_type j;
-                    for (int_type k = row_start[i]; k < row_start[i+1]; ++k) {
-                        j = col_ind[k];
-                        sum += data_arr[k]*x[j];
+            void mv(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<int_type>(0, this->nor), [=](const oneapi::tbb::blocked_range<int_type>& range) {
+                    PWM_PERF_SCOPE(this->perf_counters, oneapi::tbb::this_task_arena::current_thread_index());
+
+                    for (int_type i = range.begin(); i < range.end(); ++i) {
+                        T sum = 0.;
+                        int_type j;
+                        for (nnz_type k = row_start[i]; k < row_start[i+1]; ++k) {
+                            j = col_ind[k];
+                            sum += data_arr[k]*x[j];
+                        }
+                        
+                        y[i] = sum;
                     }
-                    
-                    y[i] = sum;
                 });
             }
 
+            /**
+             * @brief Matrix product with a batch of interleaved vectors Y = AX
+             * 
+             * One sweep over the matrix computes the products of all vectors, the loop is parallelized using parallel_for
+             * from TBB
+             * 
+             * @param X Input vectors
+             * @param Y Output vectors
+             * @param batch Amount of vectors
+             */
+            void mvBatch(const T* X, T* Y, int batch) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<int_type>(0, this->nor), [=](const oneapi::tbb::blocked_range<int_type>& range) {
+                    PWM_PERF_SCOPE(this->perf_counters, oneapi::tbb::this_task_arena::current_thread_index());
+
+                    pwm::batchRows(row_start, col_ind, data_arr, X, Y, batch, range.begin(), range.end());
+                });
+            }
+
+            /**
+             * @brief Parallel loop over the rows of the matrix
+             * 
+             * The rows are split by parallel_for from TBB.
+             * 
+             * @param body Function called with the first row and one past the last row of a range
+             */
+            void parallelFor(const std::function<void(int_type, int_type)>& body) {
+                oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<int_type>(0, this->nor, 1024), [&](const oneapi::tbb::blocked_range<int_type>& r) {
+                    body(r.begin(), r.end());
+                });
+            }
+
+            /**
+             * @brief Parallel sum over the rows of the matrix
+             * 
+             * The rows are split and the partial sums added by parallel_reduce from TBB.
+             * 
+             * @param body Function which returns the partial sum of a range of rows
+             */
+            T parallelSum(const std::function<T(int_type, int_type)>& body) {
+                if (pwm::reproducibleMode()) return pwm::reproducibleSum(this->rowLoop(), this->nor, body);
+
+                return oneapi::tbb::parallel_reduce(oneapi::tbb::blocked_range<int_type>(0, this->nor, 1024), (T) 0.,
+                    [&](const oneapi::tbb::blocked_range<int_type>& r, T sum) {
+                        return sum + body(r.begin(), r.end());
+                    }, std::plus<T>());
+            }
+
             /**
              * @brief Power method: Executes matrix vector product repeatedly to get the dominant eigenvector.
              * 
@@ -115,6 +194,8 @@ namespace pwm {
              * @param it Amount of iterations for the algorithm
              */
             void powerMethod(T* x, T* y, const int_type it) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
                 assert(this->nor == this->noc); //Power method only works on square matrices
                 
                 for (int it_nb = 0; it_nb < it; ++it_nb) {
@@ -137,6 +218,52 @@ namespace pwm {
                     }
                 }
             }
+
+            /**
+             * @brief s-step power method: Only normalizes the iterate every s iterations.
+             * 
+             * In between the iterate is divided by an estimate of the dominant eigenvalue (scaled recurrence) to avoid overflow.
+             * The estimate is obtained in the first iteration and refined at every normalization.
+             * 
+             * Loop is parallelized using parallel_for function of TBB
+             * 
+             * @param x Input vector to start calculation, contains the output at the end of the algorithm is it is uneven
+             * @param y Vector to store calculations, contains the output at the end of the algorithm if it is even
+             * @param it Amount of iterations for the algorithm
+             * @param s Amount of iterations between two normalizations
+             */
+            void powerMethodSStep(T* x, T* y, const int_type it, const int s) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                assert(this->nor == this->noc); //Power method only works on square matrices
+
+                T x_norm = pwm::norm2(x, this->nor);
+                T scale = 1.;
+                int steps = 0;
+                for (int it_nb = 0; it_nb < it; ++it_nb) {
+                    T* in = it_nb % 2 == 0 ? x : y;
+                    T* out = it_nb % 2 == 0 ? y : x;
+                    this->mv(in, out);
+                    steps++;
+
+                    T div;
+                    if (it_nb == 0 || steps == s || it_nb == it - 1) {
+                        // Synchronization point: normalize and update the eigenvalue estimate
+                        T norm = pwm::norm2(out, this->nor);
+                        if (it_nb == 0) scale = norm/x_norm;
+                        else scale *= std::pow(norm/scale, (T) 1./steps);
+
+                        div = norm;
+                        steps = 0;
+                    } else {
+                        div = scale;
+                    }
+
+                    oneapi::tbb::parallel_for(0, this->nor, [=](int_type i) {
+                        out[i] /= div;
+                    });
+                }
+            }
     };
 } // namespace pwm
 
@@ -15,39 +15,42 @@
 #include <iostream>
 #include <cassert>
 #include <algorithm>
+#include <numeric>
 #include <tuple>
 #include <thread>
 
 #include "../Matrix/SparseMatrix.hpp"
 #include "../Util/VectorUtill.hpp"
 #include "../Util/Poisson.hpp"
+#include "../Util/TripletToCRS.hpp"
+#include "../Util/MatrixPowers.hpp"
 
 #include "oneapi/tbb.h"
 
 namespace pwm {
-    template<typename T, typename int_type>
-    class CRSTBBGraphPinned: public pwm::SparseMatrix<T, int_type> {
+    template<typename T, typename int_type, typename nnz_type = int_type>
+    class CRSTBBGraphPinned: public pwm::SparseMatrix<T, int_type, nnz_type> {
         protected:
             // Array of row start arrays for the CRS format. 1 for each thread.
-            int_type** row_start;
+            nnz_type** row_start = NULL;
             
             // Array of column index array for the CRS format. 1 for each thread
-            int_type** col_ind;
+            int_type** col_ind = NULL;
 
             // Array of data array which stores the actual nonzeros. 1 for each thread.
-            T** data_arr;
+            T** data_arr = NULL;
 
             // Threads
             int threads;
 
             // Amount of partitions
-            int partitions;
+            int partitions = 0;
 
             // Amount of rows per partition
-            int_type* partition_rows;
+            int_type* partition_rows = NULL;
 
             // First row of each partition
-            int_type* first_rows;
+            int_type* first_rows = NULL;
 
             // Graph for TBB nodes
             oneapi::tbb::flow::graph g;
@@ -55,14 +58,45 @@ namespace pwm {
             // TBB mv nodes list
             std::vector<oneapi::tbb::flow::function_node<std::tuple<const T*, T*>, int>> mv_func_list;
 
+            // TBB matrix powers nodes list
+            std::vector<oneapi::tbb::flow::function_node<std::tuple<const T*, T*, int, T, T>, int>> mpk_func_list;
+
+            // Matrix powers kernel for the s-step power method (built on first use)
+            pwm::MatrixPowers<T, int_type, nnz_type> mpk;
+
+            // Sum of squares of each partition computed by the matrix powers kernel
+            std::vector<T> norm_parts;
+
             // TBB normalize nodes list
             std::vector<oneapi::tbb::flow::function_node<std::tuple<T*, T>, int>> norm_func_list;
 
             // Global threads limit
             oneapi::tbb::global_control global_limit;
 
+            // CRS arrays of every partition for the transpose products
+            std::vector<pwm::CRSPart<T, int_type, nnz_type>> crsParts() {
+                std::vector<pwm::CRSPart<T, int_type, nnz_type>> parts;
+                for (int i = 0; i < partitions; ++i) {
+                    parts.push_back({first_rows[i], partition_rows[i], row_start[i], col_ind[i], data_arr[i]});
+                }
+                return parts;
+            }
+
         private:
+            // Free the datastructures of a previously loaded matrix
+            void deleteData() {
+                this->arena.reset();
+                row_start = NULL;
+                col_ind = NULL;
+                data_arr = NULL;
+                partition_rows = NULL;
+                first_rows = NULL;
+            }
+
             void generateFunctionNodes() {
+                mpk_func_list = std::vector<oneapi::tbb::flow::function_node<std::tuple<const T*, T*, int, T, T>, int>>();
+                mpk = pwm::MatrixPowers<T, int_type, nnz_type>();
+                norm_parts = std::vector<T>(partitions);
                 mv_func_list = std::vector<oneapi::tbb::flow::function_node<std::tuple<const T*, T*>, int>>();
                 norm_func_list = std::vector<oneapi::tbb::flow::function_node<std::tuple<T*, T>, int>>();
 
@@ -81,13 +115,16 @@ namespace pwm {
                             std::cout << "Error in setAffinity" << std::endl;
                         }
 
+                        PWM_PERF_SCOPE(this->perf_counters, i);
+                        PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::MV, i);
+
                         const T* x = std::get<0>(input);
                         T* y = std::get<1>(input);
 
                         int_type j;
                         for (int_type l = 0; l < partition_rows[i]; ++l) {
                             T sum = 0;
-                            for (int_type k = row_start[i][l]; k < row_start[i][l+1]; ++k) {
+                            for (nnz_type k = row_start[i][l]; k < row_start[i][l+1]; ++k) {
                                 j = col_ind[i][k];
                                 sum += data_arr[i][k]*x[j];
                             }
@@ -99,6 +136,28 @@ namespace pwm {
 
                     mv_func_list.push_back(mv_node);
 
+                    // Create matrix powers node for this partition
+                    oneapi::tbb::flow::function_node<std::tuple<const T*, T*, int, T, T>, int> mpk_node(g, 1, [=](std::tuple<const T*, T*, int, T, T> input) -> int {
+                        // Put the current thread on the right cpu
+                        cpu_set_t *mask;
+                        mask = CPU_ALLOC(1);
+                        auto mask_size = CPU_ALLOC_SIZE(1);
+                        CPU_ZERO_S(mask_size, mask);
+                        CPU_SET_S(i % max_threads, mask_size, mask);
+                        if (sched_setaffinity(0, mask_size, mask)) {
+                            std::cout << "Error in setAffinity" << std::endl;
+                        }
+
+                        PWM_PERF_SCOPE(this->perf_counters, i);
+                        PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::MPK, i);
+
+                        norm_parts[i] = mpk.run(i, std::get<0>(input), std::get<1>(input), std::get<2>(input), std::get<3>(input), std::get<4>(input));
+
+                        return 0;
+                    });
+
+                    mpk_func_list.push_back(mpk_node);
+
                     // Create normalize node for this partition
                     oneapi::tbb::flow::function_node<std::tuple<T*, T>, int> norm_node(g, 1, [=](std::tuple<T*, T> input) -> int {
                         // Put the current thread on the right cpu
@@ -114,6 +173,8 @@ namespace pwm {
                         T* x = std::get<0>(input);
                         T norm = std::get<1>(input);
 
+                        PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::NORM, i);
+
                         for (int_type l = 0; l < partition_rows[i]; ++l) {
                             x[l+first_rows[i]] /= norm;
                         }
@@ -147,19 +208,21 @@ namespace pwm {
              * @param partitions_am The amount of partitions the matrix is partitioned in
              */
             void generatePoissonMatrix(const int_type m, const int_type n, const int partitions_am) {
+                deleteData();
+
                 this->noc = m*n;
                 this->nor = m*n;
 
-                this->nnz = n*(m+2*(m-1)) + 2*(n-1)*m;
+                this->nnz = pwm::poissonNonzeros<nnz_type>(m, n);
 
                 partitions = partitions_am;
 
-                row_start = new int_type*[partitions];
-                col_ind = new int_type*[partitions];
-                data_arr = new T*[partitions];
+                row_start = this->arena.template allocate<nnz_type*>(partitions);
+                col_ind = this->arena.template allocate<int_type*>(partitions);
+                data_arr = this->arena.template allocate<T*>(partitions);
 
-                partition_rows = new int_type[partitions];
-                first_rows = new int_type[partitions];
+                partition_rows = this->arena.template allocate<int_type>(partitions);
+                first_rows = this->arena.template allocate<int_type>(partitions);
 
                 // Generate data for each thread
                 int_type am_rows = std::round(m*n/partitions);
@@ -172,9 +235,9 @@ namespace pwm {
                     partition_rows[i] = last_row - first_rows[i];
 
                     // Generate datastructures for this thread CRS (data_arr & col_ind are sometimes too large...)
-                    data_arr[i] = new T[5*partition_rows[i]];
-                    row_start[i] = new int_type[partition_rows[i]+1];
-                    col_ind[i] = new int_type[5*partition_rows[i]];
+                    data_arr[i] = this->arena.template allocate<T>((nnz_type) 5*partition_rows[i]);
+                    row_start[i] = this->arena.template allocate<nnz_type>(partition_rows[i]+1);
+                    col_ind[i] = this->arena.template allocate<int_type>((nnz_type) 5*partition_rows[i]);
                     
                     // Fill CRS matrix for given thread
                     pwm::fillPoisson(data_arr[i], row_start[i], col_ind [i], m, n, first_rows[i], last_row);
@@ -187,30 +250,48 @@ namespace pwm {
             /**
              * @brief Input the CRS matrix from a Triplet format
              * 
+             * The rows are split in equal parts unless partition boundaries are given with setPartitionBounds.
+             * 
              * @param input Triplet format matrix used to convert to CRS
              */
-            void loadFromTriplets(pwm::Triplet<T, int_type> input, const int partitions_am) {
+            void loadFromTriplets(pwm::Triplet<T, int_type, nnz_type>& input, const int partitions_am) {
+                deleteData();
+
                 this->noc = input.col_size;
                 this->nor = input.row_size;
                 this->nnz = input.nnz;
 
                 partitions = partitions_am;
 
-                row_start = new int_type*[partitions];
-                col_ind = new int_type*[partitions];
-                data_arr = new T*[partitions];
+                row_start = this->arena.template allocate<nnz_type*>(partitions);
+                col_ind = this->arena.template allocate<int_type*>(partitions);
+                data_arr = this->arena.template allocate<T*>(partitions);
                 
-                partition_rows = new int_type[partitions];
-                first_rows = new int_type[partitions];
+                partition_rows = this->arena.template allocate<int_type>(partitions);
+                first_rows = this->arena.template allocate<int_type>(partitions);
 
                 // Generate data for each thread
-                pwm::TripletToMultipleCRS(input.row_coord, input.col_coord, input.data, row_start, col_ind, data_arr, 
-                                          partitions, partition_rows, first_rows, this->nnz, this->nor);
+                if (input.in_place) {
+                    pwm::TripletToMultipleCRSInPlace(input, row_start, col_ind, data_arr, partitions, partition_rows, first_rows, 
+                                                     this->arena, this->partition_bounds);
+                } else {
+                    pwm::TripletToMultipleCRS(input.row_coord, input.col_coord, input.data, row_start, col_ind, data_arr, 
+                                              partitions, partition_rows, first_rows, this->nnz, this->nor, this->arena, this->partition_bounds);
+                }
 
                 // Generate function nodes per thread
                 generateFunctionNodes();
             }
 
+            /**
+             * @brief Model of the bytes moved from memory in one power method iteration
+             * 
+             * Same as for CRS but every partition has its own row start array.
+             */
+            double bytesPerIteration() const {
+                return (double) this->nnz*(sizeof(T) + sizeof(int_type)) + ((double) this->nor + partitions)*sizeof(nnz_type) + 5.*this->nor*sizeof(T);
+            }
+
             /**
              * @brief Matrix vector product Ax = y
              * 
@@ -219,14 +300,49 @@ namespace pwm {
              * @param x Input vector
              * @param y Output vector
              */
-            void mv(const T* x, T* y) {   
+            void mv(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+                PWM_TRACE_ITERATION(this->tracer);
+
                 for (int i = 0; i < partitions; ++i) {
                     mv_func_list[i].try_put(std::make_tuple(x,y));
                 }
                 
+                PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::WAIT, -1);
                 g.wait_for_all();
             }
 
+            /**
+             * @brief Parallel loop over the rows of the matrix
+             * 
+             * One range per partition, the partitions are executed by parallel_for from TBB.
+             * 
+             * @param body Function called with the first row and one past the last row of a range
+             */
+            void parallelFor(const std::function<void(int_type, int_type)>& body) {
+                oneapi::tbb::parallel_for(0, partitions, [&](int i) {
+                    body(first_rows[i], first_rows[i] + partition_rows[i]);
+                });
+            }
+
+            /**
+             * @brief Parallel sum over the rows of the matrix
+             * 
+             * One partial sum per partition, added in the order of the partitions.
+             * 
+             * @param body Function which returns the partial sum of a range of rows
+             */
+            T parallelSum(const std::function<T(int_type, int_type)>& body) {
+                if (pwm::reproducibleMode()) return pwm::reproducibleSum(this->rowLoop(), this->nor, body);
+
+                std::vector<T> parts(partitions);
+                oneapi::tbb::parallel_for(0, partitions, [&](int i) {
+                    parts[i] = body(first_rows[i], first_rows[i] + partition_rows[i]);
+                });
+
+                return std::accumulate(parts.begin(), parts.end(), (T) 0.);
+            }
+
             /**
              * @brief Power method: Executes matrix vector product repeatedly to get the dominant eigenvector.
              * 
@@ -237,6 +353,8 @@ namespace pwm {
              * @param it Amount of iterations for the algorithm
              */
             void powerMethod(T* x, T* y, const int_type it) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
                 assert(this->nor == this->noc); //Power method only works on square matrices
                 
                 for (int it_nb = 0; it_nb < it; ++it_nb) {
@@ -249,6 +367,7 @@ namespace pwm {
                             norm_func_list[i].try_put(std::make_tuple(y,norm));
                         }
                         
+                        PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::WAIT, -1);
                         g.wait_for_all();
                     } else {
                         this->mv(y, x);
@@ -259,10 +378,71 @@ namespace pwm {
                             norm_func_list[i].try_put(std::make_tuple(x,norm));
                         }
                         
+                        PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::WAIT, -1);
                         g.wait_for_all();
                     }
                 }
             }
+
+            /**
+             * @brief s-step power method: Only synchronizes the partitions every s iterations.
+             * 
+             * Each partition does s iterations on its own using the matrix powers kernel with the ghost zone of its rows.
+             * In between the iterate is divided by an estimate of the dominant eigenvalue (scaled recurrence) to avoid overflow.
+             * The estimate is obtained in the first iteration and refined at every synchronization.
+             * 
+             * The partitions are executed using different graph nodes from TBB which are pinned to a CPU.
+             * 
+             * @param x Input vector to start calculation, contains the output at the end of the algorithm is it is uneven
+             * @param y Vector to store calculations, contains the output at the end of the algorithm if it is even
+             * @param it Amount of iterations for the algorithm
+             * @param s Amount of iterations between two synchronizations
+             */
+            void powerMethodSStep(T* x, T* y, const int_type it, const int s) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                assert(this->nor == this->noc); //Power method only works on square matrices
+
+                if (mpk.steps() != s) {
+                    mpk.build(row_start, col_ind, data_arr, partitions, partition_rows, first_rows, this->nor, s);
+                }
+
+                T x_norm = pwm::norm2(x, this->nor);
+                T x_scale = 1.;
+                T scale = 1.;
+                T* in = x;
+                T* out = y;
+                bool first = true;
+                for (int steps : pwm::MatrixPowers<T, int_type, nnz_type>::schedule(it, s)) {
+                    T step_scale = first ? 1. : 1./scale;
+                    PWM_TRACE_ITERATION(this->tracer);
+
+                    for (int i = 0; i < partitions; ++i) {
+                        mpk_func_list[i].try_put(std::make_tuple((const T*) in, out, steps, x_scale, step_scale));
+                    }
+
+                    PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::WAIT, -1);
+                    g.wait_for_all();
+
+                    // Synchronization point: update the eigenvalue estimate
+                    T norm = std::sqrt(std::accumulate(norm_parts.begin(), norm_parts.end(), (T) 0.));
+                    if (first) scale = norm/x_norm;
+                    else scale *= std::pow(norm, (T) 1./steps);
+
+                    x_scale = 1./norm;
+                    first = false;
+                    std::swap(in, out);
+                }
+
+                // Normalize the result
+                T norm = 1./x_scale;
+                for (int i = 0; i < partitions; ++i) {
+                    norm_func_list[i].try_put(std::make_tuple(in, norm));
+                }
+                
+                PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::WAIT, -1);
+                g.wait_for_all();
+            }
     };
 } // namespace pwm
 
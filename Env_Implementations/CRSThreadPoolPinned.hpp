@@ -17,11 +17,14 @@
 #include <iostream>
 #include <cassert>
 #include <algorithm>
+#include <numeric>
 #include <functional>
 
 #include "../Matrix/SparseMatrix.hpp"
 #include "../Util/VectorUtill.hpp"
 #include "../Util/Poisson.hpp"
+#include "../Util/TripletToCRS.hpp"
+#include "../Util/MatrixPowers.hpp"
 
 #include <boost/bind/bind.hpp>
 #include <boost/asio.hpp>
@@ -29,29 +32,29 @@
 #include <boost/thread/future.hpp>
 
 namespace pwm {
-    template<typename T, typename int_type>
-    class CRSThreadPoolPinned: public pwm::SparseMatrix<T, int_type> {
+    template<typename T, typename int_type, typename nnz_type = int_type>
+    class CRSThreadPoolPinned: public pwm::SparseMatrix<T, int_type, nnz_type> {
         protected:
             // Array of row start arrays for the CRS format. 1 for each thread.
-            int_type** row_start;
+            nnz_type** row_start = NULL;
             
             // Array of column index array for the CRS format. 1 for each thread
-            int_type** col_ind;
+            int_type** col_ind = NULL;
 
             // Array of data array which stores the actual nonzeros. 1 for each thread.
-            T** data_arr;
+            T** data_arr = NULL;
 
             // Amount of threads
             int threads;
 
             // Amount of partitions
-            int partitions;
+            int partitions = 0;
 
             // Amount of rows per partition
-            int_type* partition_rows;
+            int_type* partition_rows = NULL;
 
             // First row of each partition
-            int_type* first_rows;
+            int_type* first_rows = NULL;
 
             // Thread pool
             boost::asio::thread_pool pool;
@@ -62,10 +65,41 @@ namespace pwm {
             // Normalize Function list
             std::vector<std::function<void(T*, T)>> norm_function_list;
 
+            // Matrix powers function list
+            std::vector<std::function<void(const T*, T*, int, T, T)>> mpk_function_list;
+
+            // Matrix powers kernel for the s-step power method (built on first use)
+            pwm::MatrixPowers<T, int_type, nnz_type> mpk;
+
+            // Sum of squares of each partition computed by the matrix powers kernel
+            std::vector<T> norm_parts;
+
+            // CRS arrays of every partition for the transpose products
+            std::vector<pwm::CRSPart<T, int_type, nnz_type>> crsParts() {
+                std::vector<pwm::CRSPart<T, int_type, nnz_type>> parts;
+                for (int i = 0; i < partitions; ++i) {
+                    parts.push_back({first_rows[i], partition_rows[i], row_start[i], col_ind[i], data_arr[i]});
+                }
+                return parts;
+            }
+
         private:
+            // Free the datastructures of a previously loaded matrix
+            void deleteData() {
+                this->arena.reset();
+                row_start = NULL;
+                col_ind = NULL;
+                data_arr = NULL;
+                partition_rows = NULL;
+                first_rows = NULL;
+            }
+
             void generateFunctions() {
                 mv_function_list = std::vector<std::function<void(const T*, T*)>>();
                 norm_function_list = std::vector<std::function<void(T*, T)>>();
+                mpk_function_list = std::vector<std::function<void(const T*, T*, int, T, T)>>();
+                mpk = pwm::MatrixPowers<T, int_type, nnz_type>();
+                norm_parts = std::vector<T>(partitions);
 
                 int cpu_count = std::thread::hardware_concurrency();
                 int max_threads = std::min(threads, cpu_count);
@@ -82,10 +116,13 @@ namespace pwm {
                             std::cout << "Error in setAffinity" << std::endl;
                         }
 
+                        PWM_PERF_SCOPE(this->perf_counters, i);
+                        PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::MV, i);
+
                         int_type j;
                         for (int_type l = 0; l < partition_rows[i]; ++l) {
                             T sum = 0;
-                            for (int_type k = row_start[i][l]; k < row_start[i][l+1]; ++k) {
+                            for (nnz_type k = row_start[i][l]; k < row_start[i][l+1]; ++k) {
                                 j = col_ind[i][k];
                                 sum += data_arr[i][k]*x[j];
                             }
@@ -108,15 +145,66 @@ namespace pwm {
                             std::cout << "Error in setAffinity" << std::endl;
                         }
 
+                        PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::NORM, i);
+
                         for (int_type l = 0; l < partition_rows[i]; ++l) {
                             x[l+first_rows[i]] /= norm;
                         }
                     };
 
                     norm_function_list.push_back(norm_func);
+
+                    // Create matrix powers function for this thread
+                    std::function<void(const T*, T*, int, T, T)> mpk_func = [=](const T* x, T* y, int steps, T x_scale, T step_scale) -> void {
+                        // Put the current thread on the right cpu
+                        cpu_set_t *mask;
+                        mask = CPU_ALLOC(1);
+                        auto mask_size = CPU_ALLOC_SIZE(1);
+                        CPU_ZERO_S(mask_size, mask);
+                        CPU_SET_S(i % max_threads, mask_size, mask);
+                        if (sched_setaffinity(0, mask_size, mask)) {
+                            std::cout << "Error in setAffinity" << std::endl;
+                        }
+
+                        PWM_PERF_SCOPE(this->perf_counters, i);
+                        PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::MPK, i);
+
+                        norm_parts[i] = mpk.run(i, x, y, steps, x_scale, step_scale);
+                    };
+
+                    mpk_function_list.push_back(mpk_func);
                 }
             }
 
+            /**
+             * @brief One partial sum per partition (posted to the threadpool), added in the order of the partitions
+             * 
+             * @param body Function which returns the partial sum of a range of rows
+             */
+            T partitionSum(const std::function<T(int_type, int_type)>& body) {
+                std::vector<boost::packaged_task<T>> tasks;
+                tasks.reserve(partitions);
+
+                for (int i = 0; i < partitions; ++i) {
+                    int_type begin = first_rows[i];
+                    int_type end = first_rows[i] + partition_rows[i];
+                    tasks.emplace_back([&body, begin, end]() { return body(begin, end); });
+                }
+
+                std::vector<boost::unique_future<T>> futures;
+                for (auto& t : tasks) {
+                    futures.push_back(t.get_future());
+                    boost::asio::post(pool, std::move(t));
+                }
+
+                T sum = 0.;
+                for (auto& fut : futures) {
+                    sum += fut.get();
+                }
+
+                return sum;
+            }
+
         public:
             // Base constructor
             CRSThreadPoolPinned() {}
@@ -137,19 +225,21 @@ namespace pwm {
              * @param n The amount of discretization steps in the y direction
              */
             void generatePoissonMatrix(const int_type m, const int_type n, const int partitions_am) {
+                deleteData();
+
                 this->noc = m*n;
                 this->nor = m*n;
 
-                this->nnz = n*(m+2*(m-1)) + 2*(n-1)*m;
+                this->nnz = pwm::poissonNonzeros<nnz_type>(m, n);
 
                 partitions = partitions_am;
 
-                row_start = new int_type*[partitions];
-                col_ind = new int_type*[partitions];
-                data_arr = new T*[partitions];
+                row_start = this->arena.template allocate<nnz_type*>(partitions);
+                col_ind = this->arena.template allocate<int_type*>(partitions);
+                data_arr = this->arena.template allocate<T*>(partitions);
 
-                partition_rows = new int_type[partitions];
-                first_rows = new int_type[partitions];
+                partition_rows = this->arena.template allocate<int_type>(partitions);
+                first_rows = this->arena.template allocate<int_type>(partitions);
 
                 // Generate data for each thread
                 int_type am_rows = std::round(m*n/partitions);
@@ -162,9 +252,9 @@ namespace pwm {
                     partition_rows[i] = last_row - first_rows[i];
 
                     // Generate datastructures for this thread CRS (data_arr & col_ind are sometimes too large...)
-                    data_arr[i] = new T[5*partition_rows[i]];
-                    row_start[i] = new int_type[partition_rows[i]+1];
-                    col_ind[i] = new int_type[5*partition_rows[i]];
+                    data_arr[i] = this->arena.template allocate<T>((nnz_type) 5*partition_rows[i]);
+                    row_start[i] = this->arena.template allocate<nnz_type>(partition_rows[i]+1);
+                    col_ind[i] = this->arena.template allocate<int_type>((nnz_type) 5*partition_rows[i]);
                     
                     // Fill CRS matrix for given thread
                     pwm::fillPoisson(data_arr[i], row_start[i], col_ind [i], m, n, first_rows[i], last_row);
@@ -177,30 +267,48 @@ namespace pwm {
             /**
              * @brief Input the CRS matrix from a Triplet format
              * 
+             * The rows are split in equal parts unless partition boundaries are given with setPartitionBounds.
+             * 
              * @param input Triplet format matrix used to convert to CRS
              */
-            void loadFromTriplets(pwm::Triplet<T, int_type> input, const int partitions_am) {
+            void loadFromTriplets(pwm::Triplet<T, int_type, nnz_type>& input, const int partitions_am) {
+                deleteData();
+
                 this->noc = input.col_size;
                 this->nor = input.row_size;
                 this->nnz = input.nnz;
 
                 partitions = partitions_am;
 
-                row_start = new int_type*[partitions];
-                col_ind = new int_type*[partitions];
-                data_arr = new T*[partitions];
+                row_start = this->arena.template allocate<nnz_type*>(partitions);
+                col_ind = this->arena.template allocate<int_type*>(partitions);
+                data_arr = this->arena.template allocate<T*>(partitions);
                 
-                partition_rows = new int_type[partitions];
-                first_rows = new int_type[partitions];
+                partition_rows = this->arena.template allocate<int_type>(partitions);
+                first_rows = this->arena.template allocate<int_type>(partitions);
 
                 // Generate data for each thread
-                pwm::TripletToMultipleCRS(input.row_coord, input.col_coord, input.data, row_start, col_ind, data_arr, 
-                                          partitions, partition_rows, first_rows, this->nnz, this->nor);
+                if (input.in_place) {
+                    pwm::TripletToMultipleCRSInPlace(input, row_start, col_ind, data_arr, partitions, partition_rows, first_rows, 
+                                                     this->arena, this->partition_bounds);
+                } else {
+                    pwm::TripletToMultipleCRS(input.row_coord, input.col_coord, input.data, row_start, col_ind, data_arr, 
+                                              partitions, partition_rows, first_rows, this->nnz, this->nor, this->arena, this->partition_bounds);
+                }
 
                 // Generate function nodes per thread
                 generateFunctions();
             }
 
+            /**
+             * @brief Model of the bytes moved from memory in one power method iteration
+             * 
+             * Same as for CRS but every partition has its own row start array.
+             */
+            double bytesPerIteration() const {
+                return (double) this->nnz*(sizeof(T) + sizeof(int_type)) + ((double) this->nor + partitions)*sizeof(nnz_type) + 5.*this->nor*sizeof(T);
+            }
+
             /**
              * @brief Matrix vector product Ax = y
              * 
@@ -210,6 +318,9 @@ namespace pwm {
              * @param y Output vector
              */
             void mv(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+                PWM_TRACE_ITERATION(this->tracer);
+
                 std::vector<boost::packaged_task<void>> tasks;
                 tasks.reserve(partitions);
 
@@ -223,11 +334,39 @@ namespace pwm {
                     boost::asio::post(pool, std::move(t));
                 }
 
+                PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::WAIT, -1);
                 for (auto& fut : boost::when_all(futures.begin(), futures.end()).get()) {
                     fut.get();
                 }
             }
 
+            /**
+             * @brief Parallel loop over the rows of the matrix
+             * 
+             * One range per partition, the partitions are executed using functions posted to the threadpool.
+             * 
+             * @param body Function called with the first row and one past the last row of a range
+             */
+            void parallelFor(const std::function<void(int_type, int_type)>& body) {
+                partitionSum([&](int_type begin, int_type end) -> T {
+                    body(begin, end);
+                    return 0.;
+                });
+            }
+
+            /**
+             * @brief Parallel sum over the rows of the matrix
+             * 
+             * One partial sum per partition (partitionSum), in the reproducible mode fixed blocks of rows (reproducibleSum).
+             * 
+             * @param body Function which returns the partial sum of a range of rows
+             */
+            T parallelSum(const std::function<T(int_type, int_type)>& body) {
+                if (pwm::reproducibleMode()) return pwm::reproducibleSum(this->rowLoop(), this->nor, body);
+
+                return partitionSum(body);
+            }
+
             /**
              * @brief Power method: Executes matrix vector product repeatedly to get the dominant eigenvector.
              * 
@@ -238,6 +377,8 @@ namespace pwm {
              * @param it Amount of iterations for the algorithm
              */
             void powerMethod(T* x, T* y, const int_type it) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
                 assert(this->nor == this->noc); //Power method only works on square matrices
                 
                 for (int it_nb = 0; it_nb < it; ++it_nb) {
@@ -258,6 +399,7 @@ namespace pwm {
                             boost::asio::post(pool, std::move(t));
                         }
 
+                        PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::WAIT, -1);
                         for (auto& fut : boost::when_all(futures.begin(), futures.end()).get()) {
                             fut.get();
                         }
@@ -278,12 +420,95 @@ namespace pwm {
                             boost::asio::post(pool, std::move(t));
                         }
 
+                        PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::WAIT, -1);
                         for (auto& fut : boost::when_all(futures.begin(), futures.end()).get()) {
                             fut.get();
                         }
                     }
                 }
             }
+
+            /**
+             * @brief s-step power method: Only synchronizes the partitions every s iterations.
+             * 
+             * Each partition does s iterations on its own using the matrix powers kernel with the ghost zone of its rows.
+             * In between the iterate is divided by an estimate of the dominant eigenvalue (scaled recurrence) to avoid overflow.
+             * The estimate is obtained in the first iteration and refined at every synchronization.
+             * 
+             * The partitions are executed using functions posted to the threadpool which are pinned to a CPU
+             * 
+             * @param x Input vector to start calculation, contains the output at the end of the algorithm is it is uneven
+             * @param y Vector to store calculations, contains the output at the end of the algorithm if it is even
+             * @param it Amount of iterations for the algorithm
+             * @param s Amount of iterations between two synchronizations
+             */
+            void powerMethodSStep(T* x, T* y, const int_type it, const int s) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                assert(this->nor == this->noc); //Power method only works on square matrices
+
+                if (mpk.steps() != s) {
+                    mpk.build(row_start, col_ind, data_arr, partitions, partition_rows, first_rows, this->nor, s);
+                }
+
+                T x_norm = pwm::norm2(x, this->nor);
+                T x_scale = 1.;
+                T scale = 1.;
+                T* in = x;
+                T* out = y;
+                bool first = true;
+                for (int steps : pwm::MatrixPowers<T, int_type, nnz_type>::schedule(it, s)) {
+                    T step_scale = first ? 1. : 1./scale;
+                    PWM_TRACE_ITERATION(this->tracer);
+
+                    std::vector<boost::packaged_task<void>> tasks;
+                    tasks.reserve(partitions);
+
+                    for (int i = 0; i < partitions; ++i) {
+                        tasks.emplace_back(boost::bind(mpk_function_list[i], (const T*) in, out, steps, x_scale, step_scale));
+                    }
+
+                    std::vector<boost::unique_future<boost::packaged_task<void>::result_type>> futures;
+                    for (auto& t : tasks) {
+                        futures.push_back(t.get_future());
+                        boost::asio::post(pool, std::move(t));
+                    }
+
+                    PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::WAIT, -1);
+                    for (auto& fut : boost::when_all(futures.begin(), futures.end()).get()) {
+                        fut.get();
+                    }
+
+                    // Synchronization point: update the eigenvalue estimate
+                    T norm = std::sqrt(std::accumulate(norm_parts.begin(), norm_parts.end(), (T) 0.));
+                    if (first) scale = norm/x_norm;
+                    else scale *= std::pow(norm, (T) 1./steps);
+
+                    x_scale = 1./norm;
+                    first = false;
+                    std::swap(in, out);
+                }
+
+                // Normalize the result
+                T norm = 1./x_scale;
+                std::vector<boost::packaged_task<void>> tasks;
+                tasks.reserve(partitions);
+
+                for (int i = 0; i < partitions; ++i) {
+                    tasks.emplace_back(boost::bind(norm_function_list[i], in, norm));
+                }
+
+                std::vector<boost::unique_future<boost::packaged_task<void>::result_type>> futures;
+                for (auto& t : tasks) {
+                    futures.push_back(t.get_future());
+                    boost::asio::post(pool, std::move(t));
+                }
+
+                PWM_TRACE_SCOPE(this->tracer, pwm::Tracer::WAIT, -1);
+                for (auto& fut : boost::when_all(futures.begin(), futures.end()).get()) {
+                    fut.get();
+                }
+            }
     };
 } // namespace pwm
 
@@ -0,0 +1,459 @@
+/**
+ * @file CSB.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Compressed Sparse Blocks matrix class using TBB
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * The matrix is tiled in beta x beta blocks, beta is the power of two closest above sqrt(nor) such that the amount
+ * of blocks is about the amount of rows (at most 2^16 because the indices inside a block are stored in 16 bits).
+ * A block row only reads beta elements of x per block, which fit in the cache for large matrices.
+ * The nonzeros of a block are stored contiguously in Z-Morton order of their in-block coordinates, the blocks are
+ * stored block row by block row.
+ *
+ * The product is parallelized over the block rows, block rows with a lot of nonzeros are split recursively in chunks of
+ * blocks which are computed in parallel with a temporary output vector (a single block is not split). The transpose
+ * product uses the same structure over the block columns, so it needs no atomics either.
+ *
+ * Aydin Buluc et al. 2009. Parallel sparse matrix-vector and matrix-transpose-vector multiplication using compressed sparse blocks. SPAA '09.
+ */
+
+#ifndef PWM_CSB_HPP
+#define PWM_CSB_HPP
+
+#include <vector>
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <cstdint>
+
+#include "../Matrix/SparseMatrix.hpp"
+#include "../Util/VectorUtill.hpp"
+#include "../Util/Poisson.hpp"
+#include "../Util/TripletToCRS.hpp"
+
+#include "oneapi/tbb.h"
+
+namespace pwm {
+    template<typename T, typename int_type, typename nnz_type = int_type>
+    class CSB: public pwm::SparseMatrix<T, int_type, nnz_type> {
+        protected:
+            // Block size and its base 2 logarithm
+            int_type beta = 0;
+            int log_beta = 0;
+
+            // Amount of block rows and block columns
+            int_type block_rows = 0;
+            int_type block_cols = 0;
+
+            // Start of each block in the nonzero arrays (block (i, j) is block i*block_cols + j)
+            nnz_type* block_start = NULL;
+
+            // Row and column of each nonzero inside its block
+            uint16_t* row_ind = NULL;
+            uint16_t* col_ind = NULL;
+
+            // Data array which stores the actual nonzeros
+            T* data_arr = NULL;
+
+            // Chunks with more nonzeros are split in the recursive product
+            nnz_type split_limit = 0;
+
+            // Global threads limit
+            oneapi::tbb::global_control global_limit;
+
+        private:
+            // Free the datastructures of a previously loaded matrix
+            void deleteData() {
+                this->arena.reset();
+                block_start = NULL;
+                row_ind = NULL;
+                col_ind = NULL;
+                data_arr = NULL;
+            }
+
+            // Interleave the bits of the in-block coordinates (Z-Morton order)
+            static uint32_t mortonKey(uint32_t row, uint32_t col) {
+                uint32_t key = 0;
+                for (int b = 0; b < 16; ++b) {
+                    key |= ((row >> b) & 1u) << (2*b + 1);
+                    key |= ((col >> b) & 1u) << (2*b);
+                }
+
+                return key;
+            }
+
+            /**
+             * @brief Build the blocks from CRS arrays
+             *
+             * @param row_start Row start array of the CRS format
+             * @param crs_col Column index array of the CRS format
+             * @param crs_data Data array of the CRS format
+             */
+            void buildFromCRS(const nnz_type* row_start, const int_type* crs_col, const T* crs_data) {
+                int_type n = std::max(this->nor, this->noc);
+                log_beta = 3;
+                while (log_beta < 16 && (1ll << log_beta)*(1ll << log_beta) < n) log_beta++;
+                beta = (int_type) 1 << log_beta;
+                split_limit = 4*beta;
+
+                block_rows = (this->nor + beta - 1) >> log_beta;
+                block_cols = (this->noc + beta - 1) >> log_beta;
+                size_t blocks = (size_t) block_rows*block_cols;
+
+                block_start = this->arena.template allocate<nnz_type>(blocks+1);
+                row_ind = this->arena.template allocate<uint16_t>(this->nnz);
+                col_ind = this->arena.template allocate<uint16_t>(this->nnz);
+                data_arr = this->arena.template allocate<T>(this->nnz);
+
+                // Count the nonzeros per block, every block row is counted by one task
+                std::fill(block_start, block_start+blocks+1, 0);
+                oneapi::tbb::parallel_for((int_type) 0, block_rows, [&](int_type i) {
+                    int_type last_row = std::min(this->nor, (i+1) << log_beta);
+                    for (int_type row = i << log_beta; row < last_row; ++row) {
+                        for (nnz_type k = row_start[row]; k < row_start[row+1]; ++k) {
+                            block_start[(size_t) i*block_cols + (crs_col[k] >> log_beta) + 1]++;
+                        }
+                    }
+                });
+
+                for (size_t b = 0; b < blocks; ++b) {
+                    block_start[b+1] += block_start[b];
+                }
+
+                // Scatter the nonzeros in their blocks and sort every block in Z-Morton order
+                oneapi::tbb::parallel_for((int_type) 0, block_rows, [&](int_type i) {
+                    nnz_type first = block_start[(size_t) i*block_cols];
+                    nnz_type last = block_start[(size_t) (i+1)*block_cols];
+                    std::vector<std::pair<uint32_t, T>> entries(last - first);
+                    std::vector<nnz_type> cursor(block_start + (size_t) i*block_cols, block_start + (size_t) (i+1)*block_cols);
+
+                    int_type last_row = std::min(this->nor, (i+1) << log_beta);
+                    for (int_type row = i << log_beta; row < last_row; ++row) {
+                        for (nnz_type k = row_start[row]; k < row_start[row+1]; ++k) {
+                            int_type j = crs_col[k] >> log_beta;
+                            uint32_t key = mortonKey(row & (beta-1), crs_col[k] & (beta-1));
+                            entries[cursor[j]++ - first] = std::make_pair(key, crs_data[k]);
+                        }
+                    }
+
+                    for (int_type j = 0; j < block_cols; ++j) {
+                        auto begin = entries.begin() + (block_start[(size_t) i*block_cols + j] - first);
+                        auto end = entries.begin() + (block_start[(size_t) i*block_cols + j + 1] - first);
+                        std::stable_sort(begin, end, [](const std::pair<uint32_t, T>& a, const std::pair<uint32_t, T>& b) { return a.first < b.first; });
+                    }
+
+                    for (nnz_type k = first; k < last; ++k) {
+                        uint32_t key = entries[k - first].first;
+                        uint32_t row = 0, col = 0;
+                        for (int b = 0; b < 16; ++b) {
+                            row |= ((key >> (2*b + 1)) & 1u) << b;
+                            col |= ((key >> (2*b)) & 1u) << b;
+                        }
+
+                        row_ind[k] = row;
+                        col_ind[k] = col;
+                        data_arr[k] = entries[k - first].second;
+                    }
+                });
+            }
+
+            /**
+             * @brief Add the product of the blocks jlo until jhi of block row i to y_block
+             *
+             * Chunks with more than split_limit nonzeros are split in two halves with about the same amount of nonzeros,
+             * the second half is computed in a temporary vector which is added afterwards.
+             */
+            void blockRowMV(int_type i, int_type jlo, int_type jhi, const T* x, T* y_block) const {
+                size_t base = (size_t) i*block_cols;
+                nnz_type first = block_start[base + jlo];
+                nnz_type last = block_start[base + jhi];
+
+                if (jhi - jlo > 1 && last - first > split_limit) {
+                    // Block column at which half of the nonzeros are reached
+                    nnz_type* split = std::upper_bound(block_start + base + jlo + 1, block_start + base + jhi, first + (last - first)/2);
+                    int_type jmid = std::min<int_type>(std::max<int_type>(split - (block_start + base), jlo + 1), jhi - 1);
+
+                    int_type rows = std::min(beta, this->nor - (i << log_beta));
+                    std::vector<T> temp(rows, 0.);
+                    oneapi::tbb::parallel_invoke(
+                        [&]() { blockRowMV(i, jlo, jmid, x, y_block); },
+                        [&]() { blockRowMV(i, jmid, jhi, x, temp.data()); }
+                    );
+
+                    for (int_type r = 0; r < rows; ++r) {
+                        y_block[r] += temp[r];
+                    }
+                    return;
+                }
+
+                for (int_type j = jlo; j < jhi; ++j) {
+                    const T* x_block = x + (j << log_beta);
+                    for (nnz_type k = block_start[base + j]; k < block_start[base + j + 1]; ++k) {
+                        y_block[row_ind[k]] += data_arr[k]*x_block[col_ind[k]];
+                    }
+                }
+            }
+
+            /**
+             * @brief Add the transpose product of the blocks ilo until ihi of block column j to y_block
+             */
+            void blockColMVT(int_type j, int_type ilo, int_type ihi, const T* x, T* y_block) const {
+                nnz_type chunk_nnz = 0;
+                for (int_type i = ilo; i < ihi && chunk_nnz <= split_limit; ++i) {
+                    chunk_nnz += block_start[(size_t) i*block_cols + j + 1] - block_start[(size_t) i*block_cols + j];
+                }
+
+                if (ihi - ilo > 1 && chunk_nnz > split_limit) {
+                    int_type imid = ilo + (ihi - ilo)/2;
+                    int_type cols = std::min(beta, this->noc - (j << log_beta));
+                    std::vector<T> temp(cols, 0.);
+                    oneapi::tbb::parallel_invoke(
+                        [&]() { blockColMVT(j, ilo, imid, x, y_block); },
+                        [&]() { blockColMVT(j, imid, ihi, x, temp.data()); }
+                    );
+
+                    for (int_type c = 0; c < cols; ++c) {
+                        y_block[c] += temp[c];
+                    }
+                    return;
+                }
+
+                for (int_type i = ilo; i < ihi; ++i) {
+                    const T* x_block = x + (i << log_beta);
+                    size_t block = (size_t) i*block_cols + j;
+                    for (nnz_type k = block_start[block]; k < block_start[block+1]; ++k) {
+                        y_block[col_ind[k]] += data_arr[k]*x_block[row_ind[k]];
+                    }
+                }
+            }
+
+        public:
+            // Base constructor
+            CSB() {}
+
+            // Base constructor
+            CSB(int threads): global_limit(oneapi::tbb::global_control::max_allowed_parallelism, threads) {}
+
+            /**
+             * @brief Model of the bytes moved from memory in one power method iteration
+             *
+             * Every nonzero stores two 16 bit indices, the block start array replaces the row start array.
+             */
+            double bytesPerIteration() const {
+                return (double) this->nnz*(sizeof(T) + 2*sizeof(uint16_t)) + ((double) block_rows*block_cols + 1.)*sizeof(nnz_type) + 5.*this->nor*sizeof(T);
+            }
+
+            /**
+             * @brief Fill the given matrix as a 2D discretized poisson matrix with equal discretization steplength in x and y
+             *
+             * @param m The amount of discretization steps in the x direction
+             * @param n The amount of discretization steps in the y direction
+             */
+            void generatePoissonMatrix(const int_type m, const int_type n, const int partitions) {
+                deleteData();
+
+                this->noc = m*n;
+                this->nor = m*n;
+
+                this->nnz = pwm::poissonNonzeros<nnz_type>(m, n);
+
+                // The CRS arrays are only used to build the blocks
+                pwm::Arena scratch;
+                nnz_type* row_start = scratch.allocate<nnz_type>(this->nor+1);
+                int_type* crs_col = scratch.allocate<int_type>(this->nnz);
+                T* crs_data = scratch.allocate<T>(this->nnz);
+
+                pwm::fillPoissonTBB(crs_data, row_start, crs_col, m, n);
+
+                assert(row_start[0] == 0);
+                assert(row_start[this->nor] == this->nnz);
+
+                buildFromCRS(row_start, crs_col, crs_data);
+            }
+
+            /**
+             * @brief Input the CSB matrix from a Triplet format
+             *
+             * @param input Triplet format matrix used to convert to CSB
+             */
+            void loadFromTriplets(pwm::Triplet<T, int_type, nnz_type>& input, const int partition_am) {
+                deleteData();
+
+                this->noc = input.col_size;
+                this->nor = input.row_size;
+                this->nnz = input.nnz;
+
+                // The CRS arrays are only used to build the blocks
+                pwm::Arena scratch;
+                nnz_type* row_start;
+                int_type* crs_col;
+                T* crs_data;
+                if (input.in_place) {
+                    pwm::TripletToCRSInPlace(input, row_start, crs_col, crs_data, scratch);
+                } else {
+                    row_start = scratch.allocate<nnz_type>(this->nor+1);
+                    crs_col = scratch.allocate<int_type>(this->nnz);
+                    crs_data = scratch.allocate<T>(this->nnz);
+
+                    pwm::TripletToCRSTBB(input.row_coord, input.col_coord, input.data, row_start, crs_col, crs_data, this->nnz, this->nor);
+                }
+
+                buildFromCRS(row_start, crs_col, crs_data);
+            }
+
+            /**
+             * @brief Matrix vector product Ax = y
+             *
+             * Parallelized over the block rows using parallel_for function from TBB
+             *
+             * @param x Input vector
+             * @param y Output vector
+             */
+            void mv(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                oneapi::tbb::parallel_for((int_type) 0, block_rows, [=](int_type i) {
+                    PWM_PERF_SCOPE(this->perf_counters, oneapi::tbb::this_task_arena::current_thread_index());
+
+                    T* y_block = y + (i << log_beta);
+                    std::fill(y_block, y_block + std::min(beta, this->nor - (i << log_beta)), 0.);
+                    blockRowMV(i, 0, block_cols, x, y_block);
+                });
+            }
+
+            /**
+             * @brief Transpose matrix vector product A^T x = y
+             *
+             * Parallelized over the block columns using parallel_for function from TBB
+             *
+             * @param x Input vector (size nor)
+             * @param y Output vector (size noc)
+             */
+            void mvT(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                oneapi::tbb::parallel_for((int_type) 0, block_cols, [=](int_type j) {
+                    PWM_PERF_SCOPE(this->perf_counters, oneapi::tbb::this_task_arena::current_thread_index());
+
+                    T* y_block = y + (j << log_beta);
+                    std::fill(y_block, y_block + std::min(beta, this->noc - (j << log_beta)), 0.);
+                    blockColMVT(j, 0, block_rows, x, y_block);
+                });
+            }
+
+            /**
+             * @brief Parallel loop over the rows of the matrix
+             * 
+             * The rows are split by parallel_for from TBB.
+             * 
+             * @param body Function called with the first row and one past the last row of a range
+             */
+            void parallelFor(const std::function<void(int_type, int_type)>& body) {
+                oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<int_type>(0, this->nor, 1024), [&](const oneapi::tbb::blocked_range<int_type>& r) {
+                    body(r.begin(), r.end());
+                });
+            }
+
+            /**
+             * @brief Parallel sum over the rows of the matrix
+             * 
+             * The rows are split and the partial sums added by parallel_reduce from TBB.
+             * 
+             * @param body Function which returns the partial sum of a range of rows
+             */
+            T parallelSum(const std::function<T(int_type, int_type)>& body) {
+                if (pwm::reproducibleMode()) return pwm::reproducibleSum(this->rowLoop(), this->nor, body);
+
+                return oneapi::tbb::parallel_reduce(oneapi::tbb::blocked_range<int_type>(0, this->nor, 1024), (T) 0.,
+                    [&](const oneapi::tbb::blocked_range<int_type>& r, T sum) {
+                        return sum + body(r.begin(), r.end());
+                    }, std::plus<T>());
+            }
+
+            /**
+             * @brief Power method: Executes matrix vector product repeatedly to get the dominant eigenvector.
+             *
+             * Loop is parallelized using parallel_for function of TBB
+             *
+             * @param x Input vector to start calculation, contains the output at the end of the algorithm is it is uneven
+             * @param y Vector to store calculations, contains the output at the end of the algorithm if it is even
+             * @param it Amount of iterations for the algorithm
+             */
+            void powerMethod(T* x, T* y, const int_type it) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                assert(this->nor == this->noc); //Power method only works on square matrices
+
+                for (int it_nb = 0; it_nb < it; ++it_nb) {
+                    if (it_nb % 2 == 0) {
+                        this->mv(x, y);
+
+                        T norm = pwm::norm2(y, this->nor);
+
+                        oneapi::tbb::parallel_for(0, this->nor, [=](int_type i) {
+                            y[i] /= norm;
+                        });
+                    } else {
+                        this->mv(y, x);
+
+                        T norm = pwm::norm2(x, this->nor);
+
+                        oneapi::tbb::parallel_for(0, this->nor, [=](int_type i) {
+                            x[i] /= norm;
+                        });
+                    }
+                }
+            }
+
+            /**
+             * @brief s-step power method: Only normalizes the iterate every s iterations.
+             *
+             * In between the iterate is divided by an estimate of the dominant eigenvalue (scaled recurrence) to avoid overflow.
+             * The estimate is obtained in the first iteration and refined at every normalization.
+             *
+             * Loop is parallelized using parallel_for function of TBB
+             *
+             * @param x Input vector to start calculation, contains the output at the end of the algorithm is it is uneven
+             * @param y Vector to store calculations, contains the output at the end of the algorithm if it is even
+             * @param it Amount of iterations for the algorithm
+             * @param s Amount of iterations between two normalizations
+             */
+            void powerMethodSStep(T* x, T* y, const int_type it, const int s) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                assert(this->nor == this->noc); //Power method only works on square matrices
+
+                T x_norm = pwm::norm2(x, this->nor);
+                T scale = 1.;
+                int steps = 0;
+                for (int it_nb = 0; it_nb < it; ++it_nb) {
+                    T* in = it_nb % 2 == 0 ? x : y;
+                    T* out = it_nb % 2 == 0 ? y : x;
+                    this->mv(in, out);
+                    steps++;
+
+                    T div;
+                    if (it_nb == 0 || steps == s || it_nb == it - 1) {
+                        // Synchronization point: normalize and update the eigenvalue estimate
+                        T norm = pwm::norm2(out, this->nor);
+                        if (it_nb == 0) scale = norm/x_norm;
+                        else scale *= std::pow(norm/scale, (T) 1./steps);
+
+                        div = norm;
+                        steps = 0;
+                    } else {
+                        div = scale;
+                    }
+
+                    oneapi::tbb::parallel_for(0, this->nor, [=](int_type i) {
+                        out[i] /= div;
+                    });
+                }
+            }
+    };
+} // namespace pwm
+
+#endif // PWM_CSB_HPP
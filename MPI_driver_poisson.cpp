@@ -10,9 +10,13 @@
 #include <algorithm>
 #include <time.h>
 #include <string>
+#include <limits>
 
 #include "Util/VectorUtill.hpp"
 #include "Util/Poisson.hpp"
+#include "Util/Options.hpp"
+#include "Util/GraphPartitioner.hpp"
+#include "Util/Checkpoint.hpp"
 
 #include <mpi.h>
 #include "omp.h"
@@ -22,14 +26,22 @@ void printErrorMsg() {
     std::cout << "  1° Amount of times the power algorithm is executed" << std::endl;
     std::cout << "  2° Amount of warm up runs for the power algorithm (not timed)" << std::endl;
     std::cout << "  3° Amount of iterations in the power method algorithm" << std::endl;
-    std::cout << "  4° Poisson equation discretization steps";
+    std::cout << "  4° Poisson equation discretization steps" << std::endl;
+    std::cout << "Optional flags (after the arguments above):" << std::endl;
+    std::cout << "  --partitioner  Distribute the rows with the multilevel graph partitioner instead of equal contiguous blocks" << std::endl;
+    std::cout << "  --s-step s     Use the s-step power method which only communicates every s iterations (not with --partitioner)" << std::endl;
+    std::cout << "  --index64      Use 64-bit row offsets even if the amount of nonzeros fits in 32 bits (selected automatically otherwise)" << std::endl;
+    std::cout << "  --checkpoint f Run the power method with checkpoints, every process writes its rows to f.rank<id> in the background" << std::endl;
+    std::cout << "  --checkpoint-every k  Iterations between two checkpoints of --checkpoint (default: 10)" << std::endl;
+    std::cout << "  --resume       Continue --checkpoint from the checkpoints of all processes (same amount of processes and options)" << std::endl;
 }
 
-void mv(const double* x, double* y, const double* data_arr, const int* col_ind, const int* row_start, const int thread_rows, const int first_row) {
+template<typename nnz_type>
+void mv(const double* x, double* y, const double* data_arr, const int* col_ind, const nnz_type* row_start, const int thread_rows, const int first_row) {
     int j;
     for (int l = 0; l < thread_rows; ++l) {
         double sum = 0;
-        for (int k = row_start[l]; k < row_start[l+1]; ++k) {
+        for (nnz_type k = row_start[l]; k < row_start[l+1]; ++k) {
             j = col_ind[k];
             sum += data_arr[k]*x[j];
         }
@@ -37,7 +49,8 @@ void mv(const double* x, double* y, const double* data_arr, const int* col_ind,
     }
 }
 
-void powerMethod(double* x, double* y, const double* data_arr, const int* col_ind, const int* row_start, const int thread_rows, const int first_row, 
+template<typename nnz_type>
+void powerMethod(double* x, double* y, const double* data_arr, const int* col_ind, const nnz_type* row_start, const int thread_rows, const int first_row, 
                  const int iterations, const int* recvcount, const int* displs) {
     for (int i = 0; i < iterations; ++i) {
         mv(x, y, data_arr, col_ind, row_start, thread_rows, first_row);
@@ -59,35 +72,161 @@ void powerMethod(double* x, double* y, const double* data_arr, const int* col_in
             x[i+first_row] = y[i];
         }
 
-        // Allgather x
-        MPI_Allgatherv(x+first_row, thread_rows, MPI_DOUBLE, x, recvcount, displs, MPI_DOUBLE, MPI_COMM_WORLD);
+        // Allgather x (the own rows are already in place)
+        MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, x, recvcount, displs, MPI_DOUBLE, MPI_COMM_WORLD);
     }
 }
 
-int main(int argc, char **argv) {
-    double start = 0;
-    double stop; 
-    double time;
+/**
+ * @brief Power method which takes a snapshot of the own rows every few iterations
+ * 
+ * @param first_iteration Amount of iterations which were already done (0 without checkpoint)
+ * @param every Amount of iterations between two snapshots
+ * @param history Norm of the product of every iteration, extended by this run
+ * @param checkpointer Writer of the snapshots of this process
+ */
+template<typename nnz_type>
+void checkpointedPowerMethod(double* x, double* y, const double* data_arr, const int* col_ind, const nnz_type* row_start, const int thread_rows, 
+                             const int first_row, const int n, const int first_iteration, const int iterations, const int every, 
+                             std::vector<double>& history, pwm::AsyncCheckpointer<double>& checkpointer, const int* recvcount, const int* displs) {
+    for (int i = first_iteration; i < iterations; ++i) {
+        mv(x, y, data_arr, col_ind, row_start, thread_rows, first_row);
 
-    // Setup MPI
-    int processes, processID;
-    MPI_Init(&argc, &argv);
-    MPI_Comm_size(MPI_COMM_WORLD, &processes);
-    MPI_Comm_rank(MPI_COMM_WORLD, &processID);
+        double norm_part = 0;
+        for (int l = 0; l < thread_rows; ++l) {
+            norm_part += y[l]*y[l];
+        }
 
-    if (argc < 5) {
-        if (processID == 0) printErrorMsg();
-        return -1;
+        double norm;
+        MPI_Allreduce(&norm_part, &norm, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        norm = std::sqrt(norm);
+        history.push_back(norm);
+
+        for (int l = 0; l < thread_rows; ++l) {
+            y[l] /= norm;
+            x[l+first_row] = y[l];
+        }
+
+        // The writer thread of this process writes the snapshot while the iteration continues
+        if ((i + 1) % every == 0 || i + 1 == iterations) {
+            checkpointer.snapshot(x+first_row, thread_rows, first_row, n, i + 1, history);
+        }
+
+        MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, x, recvcount, displs, MPI_DOUBLE, MPI_COMM_WORLD);
     }
+}
 
-    MPI_Barrier(MPI_COMM_WORLD);
-    if (processID == 0) start = omp_get_wtime();
+/**
+ * @brief Exchange a halo of h rows with the neighbouring processes
+ * 
+ * Each process needs to have at least h rows.
+ */
+void exchangeHalo(double* x, const int first_row, const int last_row, const int h, const int processID, const int processes) {
+    int prev = processID > 0 ? processID - 1 : MPI_PROC_NULL;
+    int next = processID < processes - 1 ? processID + 1 : MPI_PROC_NULL;
+    int h_prev = processID > 0 ? h : 0;
+    int h_next = processID < processes - 1 ? h : 0;
 
-    // Get command line arguments and properties of matrix
-    int iter = std::stoi(argv[1]);
-    int warm_up = std::stoi(argv[2]);
-    int pwm_iter = std::stoi(argv[3]);
-    int m = std::stoi(argv[4]);
+    // Send the first own rows to the previous process and receive the halo after the own rows from the next process
+    MPI_Sendrecv(x+first_row, h_prev, MPI_DOUBLE, prev, 0, x+last_row, h_next, MPI_DOUBLE, next, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+    // Send the last own rows to the next process and receive the halo before the own rows from the previous process
+    MPI_Sendrecv(x+last_row-h_next, h_next, MPI_DOUBLE, next, 1, x+first_row-h_prev, h_prev, MPI_DOUBLE, prev, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+}
+
+/**
+ * @brief s-step power method which only communicates every s iterations
+ * 
+ * The local matrix contains the own rows and (s-1)*m extra rows on each side. After the halo of s*m rows 
+ * is exchanged, each process can do s iterations on its own by computing the product on the extra rows redundantly.
+ * In between the normalizations the iterate is divided by an estimate of the dominant eigenvalue (scaled recurrence) to avoid overflow.
+ * 
+ * @param x Full vector to start the power method, contains the full result at the end
+ * @param work Full work vector
+ * @param ext_first First row of the local (extended) matrix
+ * @param n Size of the matrix
+ * @param s Amount of iterations between two normalizations
+ */
+template<typename nnz_type>
+void powerMethodSStep(double* x, double* work, const double* data_arr, const int* col_ind, const nnz_type* row_start, const int ext_first, 
+                      const int first_row, const int last_row, const int n, const int m, const int iterations, const int s, 
+                      const int* recvcount, const int* displs, const int processID, const int processes) {
+    double* in = x;
+    double* out = work;
+
+    // Norm of the start vector
+    double norm_part = 0;
+    for (int i = first_row; i < last_row; ++i) {
+        norm_part += x[i]*x[i];
+    }
+    double x_norm;
+    MPI_Allreduce(&norm_part, &x_norm, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    x_norm = std::sqrt(x_norm);
+
+    double x_scale = 1.;
+    double scale = 1.;
+    int done = 0;
+    while (done < iterations) {
+        // The first block is one iteration to estimate the dominant eigenvalue
+        int steps = done == 0 ? 1 : std::min(s, iterations - done);
+        double step_scale = done == 0 ? 1. : 1./scale;
+
+        for (int k = 1; k <= steps; ++k) {
+            // Rows which are still needed for the remaining steps
+            int lo = std::max(0, first_row - (steps-k)*m);
+            int hi = std::min(n, last_row + (steps-k)*m);
+            double factor = k == 1 ? step_scale*x_scale : step_scale;
+
+            int j;
+            for (int row = lo; row < hi; ++row) {
+                double sum = 0;
+                int l = row - ext_first;
+                for (nnz_type k2 = row_start[l]; k2 < row_start[l+1]; ++k2) {
+                    j = col_ind[k2];
+                    sum += data_arr[k2]*in[j];
+                }
+                out[row] = factor*sum;
+            }
+
+            std::swap(in, out);
+        }
+
+        // All reduce the norm and update the eigenvalue estimate
+        norm_part = 0;
+        for (int i = first_row; i < last_row; ++i) {
+            norm_part += in[i]*in[i];
+        }
+        double norm;
+        MPI_Allreduce(&norm_part, &norm, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        norm = std::sqrt(norm);
+
+        if (done == 0) scale = norm/x_norm;
+        else scale *= std::pow(norm, 1./steps);
+
+        x_scale = 1./norm;
+        done += steps;
+
+        if (done < iterations) exchangeHalo(in, first_row, last_row, s*m, processID, processes);
+    }
+
+    // Normalize the own rows and gather the full result in x
+    for (int i = first_row; i < last_row; ++i) {
+        x[i] = in[i]*x_scale;
+    }
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, x, recvcount, displs, MPI_DOUBLE, MPI_COMM_WORLD);
+}
+
+/**
+ * @brief Distribute the Poisson matrix and run the power method on every process
+ * 
+ * nnz_type is the type of the row offsets, column indices and row counts are 32-bit. The row counts of the collectives
+ * are bounded by the amount of rows and thus fit in the int counts of MPI.
+ */
+template<typename nnz_type>
+int runPoisson(int processes, int processID, int iter, int warm_up, int pwm_iter, int m, int s, bool use_partitioner, double start,
+               const std::string& checkpoint, int every, bool resume) {
+    double stop; 
+    double time;
 
     // Fill the Matrix datastructures for each matrix
     int am_rows = std::round(m * m / processes);
@@ -97,25 +236,89 @@ int main(int argc, char **argv) {
     else last_row = first_row + am_rows;
     int thread_rows = last_row - first_row;
 
-    int* row_start = new int[thread_rows + 1];
-    int* col_ind = new int[5 * thread_rows];
-    double* data_arr = new double[5 * thread_rows];
-    pwm::fillPoisson(data_arr, row_start, col_ind, m, m, first_row, last_row);
+    nnz_type* row_start;
+    int* col_ind;
+    double* data_arr;
+    pwm::GraphPartitioner<int, nnz_type> partitioner;
+    if (use_partitioner) {
+        // Every process partitions the full matrix, this gives the same result everywhere because the partitioner is deterministic
+        nnz_type* full_row_start = new nnz_type[m*m + 1];
+        int* full_col_ind = new int[pwm::poissonNonzeros<nnz_type>(m, m)];
+        double* full_data_arr = new double[pwm::poissonNonzeros<nnz_type>(m, m)];
+        pwm::fillPoisson(full_data_arr, full_row_start, full_col_ind, m, m);
+
+        partitioner.loadFromCRS(full_row_start, full_col_ind, m*m);
+        partitioner.partition(processes);
+        if (processID == 0) partitioner.printReport();
+
+        first_row = partitioner.bounds[processID];
+        last_row = partitioner.bounds[processID+1];
+        thread_rows = last_row - first_row;
+
+        // Copy the permuted rows of this process with permuted column indices
+        row_start = new nnz_type[thread_rows + 1];
+        col_ind = new int[(nnz_type) 5*thread_rows];
+        data_arr = new double[(nnz_type) 5*thread_rows];
+        row_start[0] = 0;
+        for (int l = 0; l < thread_rows; ++l) {
+            int old_row = partitioner.perm[first_row + l];
+            row_start[l+1] = row_start[l];
+            for (nnz_type k = full_row_start[old_row]; k < full_row_start[old_row+1]; ++k) {
+                col_ind[row_start[l+1]] = partitioner.iperm[full_col_ind[k]];
+                data_arr[row_start[l+1]] = full_data_arr[k];
+                row_start[l+1]++;
+            }
+        }
+
+        delete[] full_row_start;
+        delete[] full_col_ind;
+        delete[] full_data_arr;
+    } else {
+        row_start = new nnz_type[thread_rows + 1];
+        col_ind = new int[(nnz_type) 5*thread_rows];
+        data_arr = new double[(nnz_type) 5*thread_rows];
+        pwm::fillPoisson(data_arr, row_start, col_ind, m, m, first_row, last_row);
+    }
 
     // Create y and x on each processor
     double* x = new double[m*m];
     double* y = new double[thread_rows];
     std::fill(x, x+m*m, 1.);
 
+    // Extended matrix with (s-1)*m extra rows on each side for the s-step power method
+    int ext_first = std::max(0, first_row - (s-1)*m);
+    int ext_last = std::min(m*m, last_row + (s-1)*m);
+    nnz_type* ext_row_start = NULL;
+    int* ext_col_ind = NULL;
+    double* ext_data_arr = NULL;
+    double* work = NULL;
+    if (s > 1) {
+        // The halo of s*m rows may only come from the neighbouring processes
+        int min_rows;
+        MPI_Allreduce(&thread_rows, &min_rows, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (min_rows < s*m) {
+            if (processID == 0) std::cout << "Every process needs at least s*m rows for the s-step power method" << std::endl;
+            return -1;
+        }
+
+        ext_row_start = new nnz_type[ext_last - ext_first + 1];
+        ext_col_ind = new int[(nnz_type) 5*(ext_last - ext_first)];
+        ext_data_arr = new double[(nnz_type) 5*(ext_last - ext_first)];
+        pwm::fillPoisson(ext_data_arr, ext_row_start, ext_col_ind, m, m, ext_first, ext_last);
+
+        work = new double[m*m];
+    }
+
     // Create recvcount & displs
     int* recvcount = new int[processes];
     int* displs = new int[processes];
     displs[0] = 0;
     for (int i = 0; i < processes; ++i) {
-        if (i != processes - 1) recvcount[i] = am_rows;
+        if (!partitioner.bounds.empty()) recvcount[i] = partitioner.bounds[i+1] - partitioner.bounds[i];
+        else if (i != processes - 1) recvcount[i] = am_rows;
         else recvcount[i] = m*m-am_rows*(processes-1);
 
-        if (i != 0) displs[i] = displs[i-1] + am_rows;
+        if (i != 0) displs[i] = displs[i-1] + recvcount[i-1];
     }
 
     MPI_Barrier(MPI_COMM_WORLD);
@@ -128,7 +331,12 @@ int main(int argc, char **argv) {
     // Do warm up iterations
     for (int i = 0; i < warm_up; ++i) {
         std::fill(x, x+m*m, 1.);
-        powerMethod(x, y, data_arr, col_ind, row_start, thread_rows, first_row, pwm_iter, recvcount, displs);
+        if (s > 1) {
+            powerMethodSStep(x, work, ext_data_arr, ext_col_ind, ext_row_start, ext_first, first_row, last_row, m*m, m, pwm_iter, s, 
+                             recvcount, displs, processID, processes);
+        } else {
+            powerMethod(x, y, data_arr, col_ind, row_start, thread_rows, first_row, pwm_iter, recvcount, displs);
+        }
     }
 
     MPI_Barrier(MPI_COMM_WORLD);
@@ -137,7 +345,12 @@ int main(int argc, char **argv) {
     // Do power iterations
     for (int i = 0; i < iter; ++i) {
         std::fill(x, x+m*m, 1.);
-        powerMethod(x, y, data_arr, col_ind, row_start, thread_rows, first_row, pwm_iter, recvcount, displs);
+        if (s > 1) {
+            powerMethodSStep(x, work, ext_data_arr, ext_col_ind, ext_row_start, ext_first, first_row, last_row, m*m, m, pwm_iter, s, 
+                             recvcount, displs, processID, processes);
+        } else {
+            powerMethod(x, y, data_arr, col_ind, row_start, thread_rows, first_row, pwm_iter, recvcount, displs);
+        }
     }
 
     MPI_Barrier(MPI_COMM_WORLD);
@@ -147,6 +360,58 @@ int main(int argc, char **argv) {
         std::cout << "Time (ms) to get " << iter << " executions: " << time << "ms" << std::endl;
     }
 
+    // Power method with checkpoints, every process writes its own rows to its own file in parallel
+    if (!checkpoint.empty()) {
+        std::string path = checkpoint + ".rank" + std::to_string(processID);
+        std::fill(x, x+m*m, 1.);
+        std::vector<double> history;
+        int first_iteration = 0;
+
+        if (resume) {
+            // Only resume if the checkpoints of all processes fit their rows and are of the same iteration
+            pwm::CheckpointState<double> state;
+            int valid = pwm::readCheckpoint(path, state) && state.first_row == first_row && state.total_rows == m*m
+                        && (int) state.x.size() == thread_rows;
+            int iterations[2] = {valid ? (int) state.iteration : -1, valid ? -(int) state.iteration : 1};
+            int all_iterations[2];
+            MPI_Allreduce(iterations, all_iterations, 2, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+
+            if (all_iterations[0] >= 0 && all_iterations[0] == -all_iterations[1]) {
+                std::copy(state.x.begin(), state.x.end(), x+first_row);
+                MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, x, recvcount, displs, MPI_DOUBLE, MPI_COMM_WORLD);
+                history = state.history;
+                first_iteration = all_iterations[0];
+                if (processID == 0) std::cout << "Resumed from iteration " << first_iteration << " of " << checkpoint << ".rank*" << std::endl;
+            } else if (processID == 0) {
+                std::cout << "No matching checkpoints of all processes in " << checkpoint << ".rank*, starting from x = 1" << std::endl;
+            }
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        double checkpoint_start = omp_get_wtime();
+
+        pwm::AsyncCheckpointer<double> checkpointer(path);
+        checkpointedPowerMethod(x, y, data_arr, col_ind, row_start, thread_rows, first_row, m*m, first_iteration, pwm_iter, every, 
+                                history, checkpointer, recvcount, displs);
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        double checkpoint_time = (omp_get_wtime() - checkpoint_start) * 1000;
+        checkpointer.finish();
+
+        // Slowest writer thread and all checkpoints
+        double write_time = checkpointer.writeTime(), max_write_time;
+        long long written = checkpointer.checkpoints(), all_written;
+        MPI_Reduce(&write_time, &max_write_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&written, &all_written, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+        if (processID == 0) {
+            std::cout << "Checkpointed power method (iterations " << first_iteration << " until " << pwm_iter << ", every " << every << "): " << checkpoint_time << "ms" << std::endl;
+            std::cout << "  " << all_written << " checkpoints written by " << processes << " processes in the background (slowest writer " << max_write_time << "ms)";
+            if (!history.empty()) std::cout << ", eigenvalue estimate " << history.back();
+            std::cout << std::endl;
+        }
+    }
+
 #ifndef NDEBUG
     // Print each proc contents
     for (int i = 0; i < processes; ++i) {
@@ -154,11 +419,72 @@ int main(int argc, char **argv) {
             MPI_Barrier(MPI_COMM_WORLD);
         } else {
             std::cout << "Proc " << processID << " has following result: " << std::endl;
+            if (!partitioner.perm.empty()) {
+                // Undo the permutation of the graph partitioner
+                std::vector<double> unpermuted(m*m);
+                for (int j = 0; j < m*m; ++j) {
+                    unpermuted[j] = x[partitioner.iperm[j]];
+                }
+                std::copy(unpermuted.begin(), unpermuted.end(), x);
+            }
             pwm::printVector(x, m*m);
             MPI_Barrier(MPI_COMM_WORLD);
         }
     }
 #endif
 
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    double start = 0;
+
+    // Setup MPI
+    int processes, processID;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &processes);
+    MPI_Comm_rank(MPI_COMM_WORLD, &processID);
+
+    if (pwm::positionalArgs(argc, argv) < 5) {
+        if (processID == 0) printErrorMsg();
+        return -1;
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (processID == 0) start = omp_get_wtime();
+
+    // Get command line arguments and properties of matrix
+    int iter = std::stoi(argv[1]);
+    int warm_up = std::stoi(argv[2]);
+    int pwm_iter = std::stoi(argv[3]);
+    int m = std::stoi(argv[4]);
+    int s = pwm::getOption(argc, argv, "--s-step", 1);
+    bool use_partitioner = pwm::hasOption(argc, argv, "--partitioner");
+    std::string checkpoint = pwm::getOption<std::string>(argc, argv, "--checkpoint", "");
+    int every = std::max(1, pwm::getOption(argc, argv, "--checkpoint-every", 10));
+    bool resume = pwm::hasOption(argc, argv, "--resume");
+
+    if (s > 1 && use_partitioner) {
+        if (processID == 0) printErrorMsg();
+        MPI_Finalize();
+        return -1;
+    }
+
+    // Column indices are 32-bit, the row offsets are 64-bit if the amount of nonzeros does not fit in 32 bits
+    if ((long long) m*m > std::numeric_limits<int>::max()) {
+        if (processID == 0) std::cout << "Matrices with more than " << std::numeric_limits<int>::max() << " rows are not supported" << std::endl;
+        MPI_Finalize();
+        return -1;
+    }
+
+    int result;
+    if (pwm::poissonNonzeros<long long>(m, m) > std::numeric_limits<int>::max() || pwm::hasOption(argc, argv, "--index64")) {
+        if (processID == 0) std::cout << "Using 64-bit row offsets" << std::endl;
+        result = runPoisson<long long>(processes, processID, iter, warm_up, pwm_iter, m, s, use_partitioner, start, checkpoint, every, resume);
+    } else {
+        result = runPoisson<int>(processes, processID, iter, warm_up, pwm_iter, m, s, use_partitioner, start, checkpoint, every, resume);
+    }
+
     MPI_Finalize();
-}
\ No newline at end of file
+    return result;
+}
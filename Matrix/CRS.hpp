@@ -21,19 +21,34 @@
 #include "../Util/VectorUtill.hpp"
 #include "../Util/Poisson.hpp"
 #include "../Util/TripletToCRS.hpp"
+#include "../Util/Batch.hpp"
 
 namespace pwm {
-    template<typename T, typename int_type>
-    class CRS: public pwm::SparseMatrix<T, int_type> {
+    template<typename T, typename int_type, typename nnz_type = int_type>
+    class CRS: public pwm::SparseMatrix<T, int_type, nnz_type> {
         protected:
             // Row start array for the CRS format
-            int_type* row_start;
+            nnz_type* row_start = NULL;
             
             // Column index array for the CRS format
-            int_type* col_ind;
+            int_type* col_ind = NULL;
 
             // Data array which stores the actual nonzeros
-            T* data_arr;
+            T* data_arr = NULL;
+
+            // CRS arrays of all rows for the transpose products
+            std::vector<pwm::CRSPart<T, int_type, nnz_type>> crsParts() {
+                return {{0, this->nor, row_start, col_ind, data_arr}};
+            }
+
+        private:
+            // Free the datastructures of a previously loaded matrix
+            void deleteData() {
+                this->arena.reset();
+                row_start = NULL;
+                col_ind = NULL;
+                data_arr = NULL;
+            }
 
         public:
             // Base constructor
@@ -49,14 +64,16 @@ namespace pwm {
              * @param n The amount of discretization steps in the y direction
              */
             void generatePoissonMatrix(const int_type m, const int_type n, const int partitions) {
+                deleteData();
+
                 this->noc = m*n;
                 this->nor = m*n;
 
-                this->nnz = n*(m+2*(m-1)) + 2*(n-1)*m;
+                this->nnz = pwm::poissonNonzeros<nnz_type>(m, n);
 
-                row_start = new int_type[this->nor+1];
-                col_ind = new int_type[this->nnz];
-                data_arr = new T[this->nnz];
+                row_start = this->arena.template allocate<nnz_type>(this->nor+1);
+                col_ind = this->arena.template allocate<int_type>(this->nnz);
+                data_arr = this->arena.template allocate<T>(this->nnz);
 
                 pwm::fillPoisson(data_arr, row_start, col_ind, m, n);
 
@@ -69,16 +86,22 @@ namespace pwm {
              * 
              * @param input Triplet format matrix used to convert to CRS
              */
-            void loadFromTriplets(pwm::Triplet<T, int_type> input, const int partitions_am) {
+            void loadFromTriplets(pwm::Triplet<T, int_type, nnz_type>& input, const int partitions_am) {
+                deleteData();
+
                 this->noc = input.col_size;
                 this->nor = input.row_size;
                 this->nnz = input.nnz;
                 
-                row_start = new int_type[this->nor+1];
-                col_ind = new int_type[this->nnz];
-                data_arr = new T[this->nnz];
- 
-                pwm::TripletToCRS(input.row_coord, input.col_coord, input.data, row_start, col_ind, data_arr, this->nnz, this->nor);
+                if (input.in_place) {
+                    pwm::TripletToCRSInPlace(input, row_start, col_ind, data_arr, this->arena);
+                } else {
+                    row_start = this->arena.template allocate<nnz_type>(this->nor+1);
+                    col_ind = this->arena.template allocate<int_type>(this->nnz);
+                    data_arr = this->arena.template allocate<T>(this->nnz);
+
+                    pwm::TripletToCRS(input.row_coord, input.col_coord, input.data, row_start, col_ind, data_arr, this->nnz, this->nor);
+                }
             }
 
             /**
@@ -88,17 +111,36 @@ namespace pwm {
              * @param y Output vector
              */
             void mv(const T* x, T* y) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+                PWM_PERF_SCOPE(this->perf_counters, 0);
+
                 std::fill(y, y+this->nor, 0.);
 
                 int_type j;
                 for (int_type i = 0; i < this->nor; ++i) {
-                    for (int_type k = row_start[i]; k < row_start[i+1]; ++k) {
+                    for (nnz_type k = row_start[i]; k < row_start[i+1]; ++k) {
                         j = col_ind[k];
                         y[i] = y[i] + data_arr[k]*x[j];
                     }
                 }
             }
 
+            /**
+             * @brief Matrix product with a batch of interleaved vectors Y = AX
+             * 
+             * One sweep over the matrix computes the products of all vectors.
+             * 
+             * @param X Input vectors
+             * @param Y Output vectors
+             * @param batch Amount of vectors
+             */
+            void mvBatch(const T* X, T* Y, int batch) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+                PWM_PERF_SCOPE(this->perf_counters, 0);
+
+                pwm::batchRows(row_start, col_ind, data_arr, X, Y, batch, (int_type) 0, this->nor);
+            }
+
             /**
              * @brief Power method: Executes matrix vector product repeatedly to get the dominant eigenvector.
              * 
@@ -107,6 +149,8 @@ namespace pwm {
              * @param it Amount of iterations for the algorithm
              */
             void powerMethod(T* x, T* y, const int_type it) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
                 assert(this->nor == this->noc); //Power method only works on square matrices
                 
                 for (int i = 0; i < it; ++i) {
@@ -119,6 +163,50 @@ namespace pwm {
                     }
                 }
             }
+
+            /**
+             * @brief s-step power method: Only normalizes the iterate every s iterations.
+             * 
+             * In between the iterate is divided by an estimate of the dominant eigenvalue (scaled recurrence) to avoid overflow.
+             * The estimate is obtained in the first iteration and refined at every normalization.
+             * 
+             * @param x Input vector to start calculation, contains the output at the end of the algorithm is it is uneven
+             * @param y Vector to store calculations, contains the output at the end of the algorithm if it is even
+             * @param it Amount of iterations for the algorithm
+             * @param s Amount of iterations between two normalizations
+             */
+            void powerMethodSStep(T* x, T* y, const int_type it, const int s) {
+                PWM_PERF_SCOPE(this->perf_counters, pwm::PerfCounters::caller);
+
+                assert(this->nor == this->noc); //Power method only works on square matrices
+
+                T x_norm = pwm::norm2(x, this->nor);
+                T scale = 1.;
+                int steps = 0;
+                for (int it_nb = 0; it_nb < it; ++it_nb) {
+                    T* in = it_nb % 2 == 0 ? x : y;
+                    T* out = it_nb % 2 == 0 ? y : x;
+                    this->mv(in, out);
+                    steps++;
+
+                    T div;
+                    if (it_nb == 0 || steps == s || it_nb == it - 1) {
+                        // Synchronization point: normalize and update the eigenvalue estimate
+                        T norm = pwm::norm2(out, this->nor);
+                        if (it_nb == 0) scale = norm/x_norm;
+                        else scale *= std::pow(norm/scale, (T) 1./steps);
+
+                        div = norm;
+                        steps = 0;
+                    } else {
+                        div = scale;
+                    }
+
+                    for (int_type i = 0; i < this->nor; ++i) {
+                        out[i] /= div;
+                    }
+                }
+            }
     };
 } // namespace pwm
 
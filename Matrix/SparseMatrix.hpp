@@ -9,10 +9,26 @@
 #ifndef PWM_SPARSEMATRIX_HPP
 #define PWM_SPARSEMATRIX_HPP
 
+#include <functional>
+#include <vector>
+#include <stdexcept>
+
 #include "Triplet.hpp"
+#include "../Util/PerfCounters.hpp"
+#include "../Util/Trace.hpp"
+#include "../Util/Memory.hpp"
+#include "../Util/Transpose.hpp"
+#include "../Util/Reproducible.hpp"
 
 namespace pwm {
-    template<typename T, typename int_type>
+    /**
+     * @brief Base interface for all solvers
+     * 
+     * int_type is the type of the row and column indices, nnz_type the type of the amount of nonzeros and of the row
+     * offsets into the nonzero arrays. The default uses int_type for both, a 64-bit nnz_type with 32-bit column indices
+     * supports matrices with more than 2^31 nonzeros while the column index array keeps its size.
+     */
+    template<typename T, typename int_type, typename nnz_type = int_type>
     class SparseMatrix {
         protected:
             // Number of rows
@@ -22,7 +38,40 @@ namespace pwm {
             int_type noc;
 
             // Number of nonzeros
-            int_type nnz;
+            nnz_type nnz;
+
+            // Optional partition boundaries used by the partitioned implementations (NULL means an equal split of the rows)
+            const int_type* partition_bounds = NULL;
+
+            // Owner of all arrays of the matrix (reset when a new matrix is loaded)
+            pwm::Arena arena;
+
+            // Transposed CRS or scatter buffers of the transpose products (chosen at the first product after a load)
+            pwm::TransposeProduct<T, int_type, nnz_type> transpose;
+
+#ifdef PWM_PERF_COUNTERS
+            // Hardware performance counters of mv and powerMethod
+            pwm::PerfCounters perf_counters;
+#endif
+
+#ifdef PWM_TRACE
+            // Per partition timing trace of the partitioned implementations
+            pwm::Tracer tracer;
+#endif
+
+            /**
+             * @brief CRS arrays of the rows of the matrix, used by the transpose products of the base class
+             * 
+             * The base version has none, the implementations which store CRS arrays return them (one part per partition).
+             */
+            virtual std::vector<pwm::CRSPart<T, int_type, nnz_type>> crsParts() {
+                return {};
+            }
+
+            // Parallel loop over the rows for the transpose products
+            std::function<void(const std::function<void(int_type, int_type)>&)> rowLoop() {
+                return [this](const std::function<void(int_type, int_type)>& body) { this->parallelFor(body); };
+            }
 
         public:
             // Base constructor
@@ -34,6 +83,48 @@ namespace pwm {
             // Base destructor
             virtual ~SparseMatrix() {}
 
+#ifdef PWM_PERF_COUNTERS
+            // Hardware performance counters of mv and powerMethod
+            pwm::PerfCounters& perfCounters() { return perf_counters; }
+#endif
+
+#ifdef PWM_TRACE
+            // Per partition timing trace of the partitioned implementations
+            pwm::Tracer& trace() { return tracer; }
+#endif
+
+            // Number of rows
+            int_type getRows() const { return nor; }
+
+            // Number of nonzeros
+            nnz_type getNonzeros() const { return nnz; }
+
+            // Amount of entries in the CRS arrays of crsParts (more than the nonzeros if the rows have free slots)
+            virtual nnz_type storedEntries() const { return nnz; }
+
+            // Bytes of all arrays of the matrix
+            size_t allocatedBytes() const { return arena.bytes(); }
+
+            /**
+             * @brief Model of the bytes moved from memory in one power method iteration
+             * 
+             * The matrix is read once, the input vector is read once (perfect cache reuse), the output vector is written once 
+             * and read again for the norm and the normalization which writes it back.
+             * Formats which store the matrix differently override this model.
+             */
+            virtual double bytesPerIteration() const {
+                return (double) nnz*(sizeof(T) + sizeof(int_type)) + (nor + 1.)*sizeof(nnz_type) + 5.*nor*sizeof(T);
+            }
+
+            /**
+             * @brief Floating point operations of one power method iteration
+             * 
+             * One multiply-add per nonzero, the norm (multiply-add per row) and the division by the norm.
+             */
+            virtual double flopsPerIteration() const {
+                return 2.*nnz + 3.*nor;
+            }
+
             /**
              * @brief Fill the given matrix as a 2D discretized poisson matrix with equal discretization steplength in x and y
              * 
@@ -45,11 +136,24 @@ namespace pwm {
             /**
              * @brief Input the CRS matrix from a Triplet format
              * 
+             * If input.in_place is set the conversion reuses the column and data arrays of the input, which is empty afterwards.
+             * 
              * @param input Triplet format matrix used to convert to CRS
              */
-            virtual void loadFromTriplets(pwm::Triplet<T, int_type> input, const int partitions_am) = 0;
+            virtual void loadFromTriplets(pwm::Triplet<T, int_type, nnz_type>& input, const int partitions_am) = 0;
             
             
+            /**
+             * @brief Set the partition boundaries which are used when loading from Triplet format
+             * 
+             * Only used by the partitioned implementations, the other implementations ignore the boundaries.
+             * 
+             * @param bounds Array of partitions+1 rows, partition i consists of rows bounds[i] until bounds[i+1]-1
+             */
+            void setPartitionBounds(const int_type* bounds) {
+                partition_bounds = bounds;
+            }
+
             /**
              * @brief Sparse matrix vector product calculation
              * 
@@ -58,6 +162,156 @@ namespace pwm {
              */
             virtual void mv(const T* x, T* y) = 0;
 
+            /**
+             * @brief Matrix product with a batch of vectors Y = AX
+             * 
+             * The vectors are stored interleaved: element i of vector b is X[i*batch + b]. The base version multiplies the
+             * vectors one by one, the CRS implementations override it with one sweep over the matrix for all vectors.
+             * 
+             * @param X Input vectors
+             * @param Y Output vectors
+             * @param batch Amount of vectors
+             */
+            virtual void mvBatch(const T* X, T* Y, int batch) {
+                std::vector<T> x(this->noc), y(this->nor);
+                for (int b = 0; b < batch; ++b) {
+                    for (int_type i = 0; i < this->noc; ++i) x[i] = X[(size_t) i*batch + b];
+                    mv(x.data(), y.data());
+                    for (int_type i = 0; i < this->nor; ++i) Y[(size_t) i*batch + b] = y[i];
+                }
+            }
+
+            /**
+             * @brief Insert a batch of edges A_ij = v, the value of an existing edge is overwritten
+             * 
+             * Only supported by the implementations with a dynamic structure, the base version throws.
+             * 
+             * @param rows Row of every edge
+             * @param cols Column of every edge
+             * @param values Value of every edge
+             * @param count Amount of edges
+             */
+            virtual void insertEdges(const int_type* rows, const int_type* cols, const T* values, size_t count) {
+                throw std::runtime_error("Edge updates are not supported by this implementation");
+            }
+
+            /**
+             * @brief Remove a batch of edges, edges which are not in the matrix are ignored
+             * 
+             * @param rows Row of every edge
+             * @param cols Column of every edge
+             * @param count Amount of edges
+             */
+            virtual void removeEdges(const int_type* rows, const int_type* cols, size_t count) {
+                throw std::runtime_error("Edge updates are not supported by this implementation");
+            }
+
+            /**
+             * @brief Set the memory budget of the transposed CRS of the transpose products
+             * 
+             * The transposed CRS is built at the first transpose product if it fits in the budget, otherwise the products
+             * scatter into private vectors. Without a budget the transposed CRS may be as large as the matrix.
+             * 
+             * @param bytes Maximal size of the transposed CRS in bytes (0 always scatters)
+             */
+            void setTransposeBudget(size_t bytes) {
+                transpose.setBudget(bytes);
+            }
+
+            // CRS arrays of the rows (empty if the implementation stores no CRS arrays), e.g. for sequential products
+            std::vector<pwm::CRSPart<T, int_type, nnz_type>> rowArrays() {
+                return crsParts();
+            }
+
+            // The transpose products use a transposed CRS (valid after the first transpose product)
+            bool transposeStored() const { return transpose.isStored(); }
+
+            /**
+             * @brief Transpose matrix vector product A^T x = y
+             * 
+             * The base version uses the CRS arrays of crsParts with a transposed CRS or a scatter, chosen by the memory
+             * budget. Implementations without CRS arrays override it.
+             * 
+             * @param x Input vector (size of the rows)
+             * @param y Output vector (size of the columns)
+             */
+            virtual void mvT(const T* x, T* y) {
+                std::vector<pwm::CRSPart<T, int_type, nnz_type>> parts = crsParts();
+                if (parts.empty()) throw std::runtime_error("Transpose product is not supported by this implementation");
+
+                transpose.mvT(rowLoop(), parts, this->nor, this->noc, this->storedEntries(), this->arena, x, y);
+            }
+
+            /**
+             * @brief Product with the normal matrix A^T A x = y
+             * 
+             * The base version reads every row once: its dot product with x is scattered with the same row. Without CRS
+             * arrays or in the reproducible mode it is mv followed by mvT.
+             * 
+             * @param x Input vector (size of the columns)
+             * @param y Output vector (size of the columns)
+             */
+            virtual void mvTmv(const T* x, T* y) {
+                std::vector<pwm::CRSPart<T, int_type, nnz_type>> parts = crsParts();
+                if (parts.empty() || pwm::reproducibleMode()) {
+                    std::vector<T> z(this->nor);
+                    mv(x, z.data());
+                    mvT(z.data(), y);
+                    return;
+                }
+
+                transpose.mvTmv(rowLoop(), parts, this->nor, this->noc, x, y);
+            }
+
+            /**
+             * @brief Product with the matrix A A^T x = y
+             * 
+             * With a transposed CRS every row of A^T is read once, otherwise (or in the reproducible mode) it is mvT followed by mv.
+             * 
+             * @param x Input vector (size of the rows)
+             * @param y Output vector (size of the rows)
+             */
+            virtual void mvmvT(const T* x, T* y) {
+                std::vector<pwm::CRSPart<T, int_type, nnz_type>> parts = crsParts();
+                if (!parts.empty() && !pwm::reproducibleMode()) {
+                    transpose.prepare(parts, this->nor, this->noc, this->storedEntries(), this->arena);
+                    if (transpose.isStored()) {
+                        transpose.mvmvT(rowLoop(), this->nor, this->noc, x, y);
+                        return;
+                    }
+                }
+
+                std::vector<T> z(this->noc);
+                mvT(x, z.data());
+                mv(z.data(), y);
+            }
+
+            /**
+             * @brief Parallel loop over the rows of the matrix, used by the vector operations of the solvers built on mv
+             * 
+             * The body is called on disjoint ranges of rows which together cover all rows. The base version calls it once
+             * on all rows, the implementations split the rows with their own threading model.
+             * 
+             * @param body Function called with the first row and one past the last row of a range
+             */
+            virtual void parallelFor(const std::function<void(int_type, int_type)>& body) {
+                body(0, this->nor);
+            }
+
+            /**
+             * @brief Parallel sum over the rows of the matrix (dot products and norms of the solvers built on mv)
+             * 
+             * In the reproducible mode every implementation adds fixed blocks of rows with a fixed tree (reproducibleSum).
+             * 
+             * @param body Function which returns the partial sum of a range of rows
+             * @return T Sum of the partial sums of all ranges
+             */
+            virtual T parallelSum(const std::function<T(int_type, int_type)>& body) {
+                if (pwm::reproducibleMode()) return pwm::reproducibleSum(this->rowLoop(), this->nor, body);
+
+                return body(0, this->nor);
+            }
+
             /**
              * @brief Power method
              * 
@@ -67,6 +321,16 @@ namespace pwm {
              */
             virtual void powerMethod(T* x, T* y, const int_type it) = 0;
 
+            /**
+             * @brief s-step power method which only synchronizes for the norm once every s iterations
+             * 
+             * @param x Input vector to start power method
+             * @param y Vector to store calculations
+             * @param it Amount of iterations
+             * @param s Amount of iterations between two normalizations
+             */
+            virtual void powerMethodSStep(T* x, T* y, const int_type it, const int s) = 0;
+
     };
 } // namespace pwm
 
@@ -16,35 +16,96 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <limits>
+#include <stdexcept>
 #include <sys/stat.h>
 
 #include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_real_distribution.hpp>
 
 #include "../Util/VectorUtill.hpp"
+#include "../Util/Memory.hpp"
 
 namespace pwm {
-    template<typename T, typename int_type>
+    /**
+     * @brief Amount of rows and nonzeros of a Matrix Market (.mtx) or Kronecker graph (.bin) file without loading it
+     * 
+     * Used by the drivers to select the index types before loading: the amount of nonzeros is computed in 64-bit and
+     * includes the doubling of symmetric matrices. Uses the same filename indicators as Triplet::loadFromFile.
+     * 
+     * @param input_file Filename of input file
+     * @param rows Amount of rows of the matrix
+     * @param nnz Amount of nonzeros which will be stored
+     * @return bool False if the extension of the file is not known or the file can't be read
+     */
+    inline bool peekFileSize(std::string input_file, long long& rows, long long& nnz) {
+        int file_start = input_file.find("/");
+        if (boost::algorithm::ends_with(input_file, ".mtx")) {
+            int indicator = std::stoi(input_file.substr(file_start+1, 1));
+            bool symmetric = indicator >= 3 && indicator <= 5;
+
+            std::ifstream input(input_file);
+            std::string temp_line;
+            while (std::getline(input, temp_line)) {
+                if (temp_line[0] == '%') continue;
+
+                long long cols;
+                std::stringstream line(temp_line);
+                if (!(line >> rows >> cols >> nnz)) return false;
+                if (symmetric) nnz *= 2;
+                return true;
+            }
+
+            return false;
+        } else if (boost::algorithm::ends_with(input_file, ".bin")) {
+            int first_ = input_file.find("_");
+            rows = std::stoll(input_file.substr(file_start+1, first_-file_start-1));
+            int indicator = std::stoi(input_file.substr(first_+1, 1));
+
+            struct stat results;
+            if (stat(input_file.c_str(), &results) != 0) return false;
+            nnz = results.st_size / (2*sizeof(uint32_t));
+            if (indicator >= 3) nnz *= 2;
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Sparse matrix in Triplet (coordinate) format
+     * 
+     * Coordinates are stored as int_type, the amount of nonzeros and the indices into the coordinate arrays as nnz_type.
+     * A 64-bit nnz_type with 32-bit coordinates stores graphs with more than 2^31 edges without widening the coordinates.
+     */
+    template<typename T, typename int_type, typename nnz_type = int_type>
     class Triplet {
         public:
             // Row Coordinate array
-            int_type* row_coord;
+            int_type* row_coord = NULL;
 
             // Column coordinate array
-            int_type* col_coord;
+            int_type* col_coord = NULL;
 
             // Data array
-            T* data;
+            T* data = NULL;
 
             // x size
-            int_type row_size;
+            int_type row_size = 0;
 
             // y size
-            int_type col_size;
+            int_type col_size = 0;
 
             // Amount of nonzeros
-            int_type nnz;
+            nnz_type nnz = 0;
+
+            // Owner of the coordinate and data arrays
+            pwm::Arena arena;
+
+            // Convert in place when a matrix is loaded: the matrix reuses the column and data arrays, the Triplet is empty afterwards
+            bool in_place = false;
 
             // Random number generator for random vals of kronecker graph (set seed is 747846)
             boost::random::mt19937 gen;
@@ -55,6 +116,52 @@ namespace pwm {
             // Base constructor
             Triplet(): gen(747846), dist(-100., 100.) {}
 
+            // Copy constructor, copies the arrays
+            Triplet(const Triplet& other): row_size(other.row_size), col_size(other.col_size), nnz(other.nnz), in_place(other.in_place),
+                                           gen(other.gen), dist(other.dist) {
+                allocate();
+                std::copy(other.row_coord, other.row_coord+nnz, row_coord);
+                std::copy(other.col_coord, other.col_coord+nnz, col_coord);
+                std::copy(other.data, other.data+nnz, data);
+            }
+
+            Triplet& operator=(const Triplet&) = delete;
+
+            /**
+             * @brief Allocate the arrays for nnz nonzeros (the previous arrays are freed)
+             */
+            void allocate() {
+                arena.reset();
+                row_coord = arena.allocate<int_type>(nnz);
+                col_coord = arena.allocate<int_type>(nnz);
+                data = arena.allocate<T>(nnz);
+            }
+
+            /**
+             * @brief Free the arrays, e.g. as soon as the matrix is converted to another format
+             */
+            void release() {
+                arena.reset();
+                row_coord = NULL;
+                col_coord = NULL;
+                data = NULL;
+                nnz = 0;
+            }
+
+            /**
+             * @brief Convert an amount of nonzeros computed in 64-bit to nnz_type
+             * 
+             * Throws instead of silently wrapping around when the amount does not fit, the drivers select a 64-bit nnz_type
+             * for such matrices (see peekFileSize).
+             */
+            static nnz_type checkedNonzeros(long long entries) {
+                if (entries < 0 || entries > (long long) std::numeric_limits<nnz_type>::max()) {
+                    throw std::overflow_error("Amount of nonzeros (" + std::to_string(entries) + ") does not fit in the nonzero index type");
+                }
+
+                return (nnz_type) entries;
+            }
+
             /**
              * @brief Load from Matrix Market format
              * 
@@ -83,23 +190,20 @@ namespace pwm {
                             line >> word;
                             col_size = boost::lexical_cast<int_type>(word);
 
-                            line >> word; // Get amount of entries
-                            if (!symmetric) {
-                                nnz = boost::lexical_cast<int_type>(word);
-                            } else {
-                                nnz = 2*boost::lexical_cast<int_type>(word);
+                            line >> word; // Get amount of entries (computed in 64-bit to detect overflow)
+                            long long entries = boost::lexical_cast<long long>(word);
+                            if (symmetric) {
+                                entries *= 2;
                             }
-                            
-                            row_coord = new int_type[nnz];
-                            col_coord = new int_type[nnz];
-                            data = new T[nnz];
+                            nnz = checkedNonzeros(entries);
+                            allocate();
 
                             break;
                         }
                     }
 
                     // Get data (Subtract 1 from coordinates to get index 0 for start)
-                    int_type index = 0;
+                    nnz_type index = 0;
                     while (input_file.good()) {
                         std::getline(input_file, temp_line);
                         if (temp_line.size() == 0) break;
@@ -146,25 +250,24 @@ namespace pwm {
                 row_size = mat_size;
                 col_size = mat_size;
 
+                long long entries = 0;
                 struct stat results;
                 if (stat(filename.c_str(), &results) == 0) {
-                    nnz = results.st_size / (2*sizeof(uint32_t)); // Binary file is stored in unsigned long format
+                    entries = results.st_size / (2*sizeof(uint32_t)); // Binary file is stored in unsigned long format
                 } else {
                     std::cout << "An error occurred while reading the Kronecker input file" << std::endl;
                 }
 
                 if (symmetric) {
-                    nnz = nnz*2;
+                    entries = entries*2;
                 }
-
-                row_coord = new int_type[nnz];
-                col_coord = new int_type[nnz];
-                data = new T[nnz];
+                nnz = checkedNonzeros(entries);
+                allocate();
 
                 uint32_t input_nb;
                 char input_buf[sizeof(uint32_t)];
                 std::ifstream input_file(filename, std::ios::in | std::ios::binary);
-                int_type i = 0;
+                nnz_type i = 0;
                 while (i < nnz) {
                     input_file.read(input_buf, sizeof(uint32_t));
                     std::memcpy(&input_nb, input_buf, sizeof(uint32_t));
@@ -190,6 +293,65 @@ namespace pwm {
                     }
                 }
             }
+
+            /**
+             * @brief Load from a Matrix Market (.mtx) or Kronecker graph (.bin) file
+             * 
+             * The way the file is read is determined by the indicator in the filename (see the help of driver_input).
+             * The indicator is the first character after the first "/" for .mtx files and the first character after the size for .bin files.
+             * 
+             * @param input_file Filename of input file
+             * @return bool False if the extension of the file is not known
+             */
+            bool loadFromFile(std::string input_file) {
+                int file_start = input_file.find("/");
+                if (boost::algorithm::ends_with(input_file, ".mtx")) {
+                    int indicator = std::stoi(input_file.substr(file_start+1, 1));
+                    if (indicator == 1) {
+                        loadFromMM(input_file, false, false, false);
+                    } else if (indicator == 2) {
+                        loadFromMM(input_file, false, false, true);
+                    } else if (indicator == 3) {
+                        loadFromMM(input_file, true, true);
+                    } else if (indicator == 4) {
+                        loadFromMM(input_file, false, true, false);
+                    } else if (indicator == 5) {
+                        loadFromMM(input_file, false, true, true);
+                    } else {
+                        loadFromMM(input_file, true, false);
+                    }
+                } else if (boost::algorithm::ends_with(input_file, ".bin")) {
+                    int first_ = input_file.find("_");
+                    int_type mat_size = std::stoll(input_file.substr(file_start+1, first_-file_start-1));
+                    int indicator = std::stoi(input_file.substr(first_+1, 1));
+
+                    if (indicator == 1) {
+                        loadFromBin(input_file, mat_size, false, false);
+                    } else if (indicator == 2) {
+                        loadFromBin(input_file, mat_size, false, true);
+                    } else if (indicator == 3) {
+                        loadFromBin(input_file, mat_size, true, false);
+                    } else {
+                        loadFromBin(input_file, mat_size, true, true);
+                    }
+                } else {
+                    return false;
+                }
+
+                return true;
+            }
+
+            /**
+             * @brief Symmetrically permute the rows and columns of the matrix
+             * 
+             * @param iperm Inverse permutation: row and column i are moved to iperm[i]
+             */
+            void permute(const int_type* iperm) {
+                for (nnz_type i = 0; i < nnz; ++i) {
+                    row_coord[i] = iperm[row_coord[i]];
+                    col_coord[i] = iperm[col_coord[i]];
+                }
+            }
     };
 } // namespace pwm
 
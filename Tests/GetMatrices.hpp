@@ -18,30 +18,53 @@
 #include "../Env_Implementations/CRSTBBGraphPinned.hpp"
 #include "../Env_Implementations/CRSThreadPool.hpp"
 #include "../Env_Implementations/CRSThreadPoolPinned.hpp"
+#include "../Env_Implementations/CRSAdaptive.hpp"
+#include "../Env_Implementations/CRSMergePath.hpp"
+#include "../Env_Implementations/CSB.hpp"
+#include "../Env_Implementations/CRSCompressed.hpp"
+#include "../Env_Implementations/CRSOutOfCore.hpp"
+#include "../Env_Implementations/CRSDynamic.hpp"
 #include "../Matrix/SparseMatrix.hpp"
 
 #include "omp.h"
 
 namespace pwm {
-    template<typename T, typename int_type>
-    std::vector<pwm::SparseMatrix<T, int_type>*> get_all_matrices() {
-        std::vector<pwm::SparseMatrix<double, int>*> matrices;
-        matrices.push_back(new pwm::CRS<double, int>(1));
+    template<typename T, typename int_type, typename nnz_type = int_type>
+    std::vector<pwm::SparseMatrix<T, int_type, nnz_type>*> get_all_matrices() {
+        std::vector<pwm::SparseMatrix<T, int_type, nnz_type>*> matrices;
+        matrices.push_back(new pwm::CRS<T, int_type, nnz_type>(1));
         for (int i = 1; i <= omp_get_max_threads(); ++i) {
-            matrices.push_back(new pwm::CRSOMP<double, int>(i));
-            matrices.push_back(new pwm::CRSTBB<double, int>(i));
-            matrices.push_back(new pwm::CRSTBBGraph<double, int>(i));
-            matrices.push_back(new pwm::CRSTBBGraphPinned<double, int>(i));
-            matrices.push_back(new pwm::CRSThreadPool<double, int>(i));
-            matrices.push_back(new pwm::CRSThreadPoolPinned<double, int>(i));
+            matrices.push_back(new pwm::CRSOMP<T, int_type, nnz_type>(i));
+            matrices.push_back(new pwm::CRSTBB<T, int_type, nnz_type>(i));
+            matrices.push_back(new pwm::CRSTBBGraph<T, int_type, nnz_type>(i));
+            matrices.push_back(new pwm::CRSTBBGraphPinned<T, int_type, nnz_type>(i));
+            matrices.push_back(new pwm::CRSThreadPool<T, int_type, nnz_type>(i));
+            matrices.push_back(new pwm::CRSThreadPoolPinned<T, int_type, nnz_type>(i));
+            matrices.push_back(new pwm::CRSAdaptive<T, int_type, nnz_type>(i));
+            matrices.push_back(new pwm::CRSMergePath<T, int_type, nnz_type>(i));
+            matrices.push_back(new pwm::CSB<T, int_type, nnz_type>(i));
+            matrices.push_back(new pwm::CRSCompressed<T, int_type, nnz_type>(i));
+            matrices.push_back(new pwm::CRSOutOfCore<T, int_type, nnz_type>(i));
+            matrices.push_back(new pwm::CRSDynamic<T, int_type, nnz_type>(i));
         }
         return matrices;
     }
 
+    // Amount of matrices which get_all_matrices adds for every amount of threads
+    const int matrices_per_thread = 12;
+
     int get_threads_for_matrix(int index) {
         if (index == 0) return 1;
 
-        return std::floor((index - 1)/6.) + 1;
+        return (index - 1)/matrices_per_thread + 1;
+    }
+
+    // Check if the matrix at an index of get_all_matrices uses the amount of partitions
+    bool is_partitioned_matrix(int index) {
+        if (index == 0) return false;
+
+        int method = (index - 1) % matrices_per_thread;
+        return method >= 2 && method <= 5;
     }
 } // namespace pwm
 
@@ -13,10 +13,18 @@
 
 #include <vector>
 #include <cmath>
+#include <numeric>
+#include <map>
 
 #include "../Matrix/SparseMatrix.hpp"
 #include "../Matrix/Triplet.hpp"
 #include "GetMatrices.hpp"
+#include "../Util/PageRank.hpp"
+#include "../Util/Batch.hpp"
+#include "../Util/Singular.hpp"
+#include "../Util/Lanczos.hpp"
+#include "../Util/Dynamic.hpp"
+#include "../Util/GraphPartitioner.hpp"
 
 #include "omp.h"
 #include "oneapi/tbb.h"
@@ -58,8 +66,8 @@ BOOST_AUTO_TEST_CASE(mv_arc130, * boost::unit_test::tolerance(std::pow(10, -14))
                 BOOST_TEST(y[i] == real_sol[i]);
             }
 
-            // If matrix is an omp or TBB matrix break because all executions are the same
-            if ((mat_index-1) % 6 == 0 || (mat_index-2) % 6 == 0) {
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
                 break;
             }
         }
@@ -103,8 +111,8 @@ BOOST_AUTO_TEST_CASE(mv_gre_1107, * boost::unit_test::tolerance(std::pow(10, -14
                 BOOST_TEST(y[i] == real_sol[i]);
             }
 
-            // If matrix is an omp or TBB matrix break because all executions are the same
-            if ((mat_index-1) % 6 == 0 || (mat_index-2) % 6 == 0) {
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
                 break;
             }
         }
@@ -148,8 +156,8 @@ BOOST_AUTO_TEST_CASE(mv_mycielskian5, * boost::unit_test::tolerance(std::pow(10,
                 BOOST_TEST(y[i] == real_sol[i]);
             }
 
-            // If matrix is an omp or TBB matrix break because all executions are the same
-            if ((mat_index-1) % 6 == 0 || (mat_index-2) % 6 == 0) {
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
                 break;
             }
         }
@@ -193,8 +201,8 @@ BOOST_AUTO_TEST_CASE(mv_mycielskian5_bin, * boost::unit_test::tolerance(std::pow
                 BOOST_TEST(y[i] == real_sol[i]);
             }
 
-            // If matrix is an omp or TBB matrix break because all executions are the same
-            if ((mat_index-1) % 6 == 0 || (mat_index-2) % 6 == 0) {
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
                 break;
             }
         }
@@ -237,8 +245,8 @@ BOOST_AUTO_TEST_CASE(mv_8_4_bin_no_rand, * boost::unit_test::tolerance(std::pow(
                 BOOST_TEST(y[i] == real_sol[i]);
             }
 
-            // If matrix is an omp or TBB matrix break because all executions are the same
-            if ((mat_index-1) % 6 == 0 || (mat_index-2) % 6 == 0) {
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
                 break;
             }
         }
@@ -248,6 +256,401 @@ BOOST_AUTO_TEST_CASE(mv_8_4_bin_no_rand, * boost::unit_test::tolerance(std::pow(
     }
 }
 
+BOOST_AUTO_TEST_CASE(mvT_csb_arc130, * boost::unit_test::tolerance(std::pow(10, -14))) {
+    pwm::Triplet<double, int> input_mat;
+    input_mat.loadFromMM("Test_input/arc130.mtx", true, false);
+    int mat_size = input_mat.col_size;
+
+    // Reference: product with the transposed matrix in CRS format
+    pwm::Triplet<double, int> transposed = input_mat;
+    std::swap(transposed.row_coord, transposed.col_coord);
+
+    double* x = new double[mat_size];
+    double* y = new double[mat_size];
+    double* y_ref = new double[mat_size];
+    for (int i = 0; i < mat_size; ++i) x[i] = 1. + i % 7;
+
+    pwm::CRS<double, int> reference(1);
+    reference.loadFromTriplets(transposed, 0);
+    reference.mv(x, y_ref);
+
+    for (int threads = 1; threads <= omp_get_max_threads(); ++threads) {
+        pwm::CSB<double, int> mat(threads);
+        mat.loadFromTriplets(input_mat, 0);
+        mat.mvT(x, y);
+
+        // Check solution
+        for (int i = 0; i < mat_size; ++i) {
+            BOOST_TEST(y[i] == y_ref[i]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mvT_8_4_bin_no_rand, * boost::unit_test::tolerance(std::pow(10, -14))) {
+    pwm::Triplet<double, int> input_mat;
+    input_mat.loadFromBin("Test_input/test_mat_8_4.bin", std::pow(2, 8), false, false);
+    int mat_size = input_mat.col_size;
+
+    // Reference: products with the matrix and the transposed matrix in CRS format
+    pwm::Triplet<double, int> transposed = input_mat;
+    std::swap(transposed.row_coord, transposed.col_coord);
+
+    pwm::CRS<double, int> reference(1), reference_t(1);
+    reference.loadFromTriplets(input_mat, 0);
+    reference_t.loadFromTriplets(transposed, 0);
+
+    std::vector<double> x(mat_size), y(mat_size), z(mat_size), y_t(mat_size), y_tmv(mat_size), y_mvt(mat_size);
+    for (int i = 0; i < mat_size; ++i) x[i] = 1. + i % 7;
+    reference_t.mv(x.data(), y_t.data());
+    reference.mv(x.data(), z.data());
+    reference_t.mv(z.data(), y_tmv.data());
+    reference.mv(y_t.data(), y_mvt.data());
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        for (int partitions = 1; partitions <= std::min(max_threads*2, mat_size); ++partitions) {
+            // Scatter version and transposed CRS
+            for (size_t budget : {(size_t) 0, (size_t) -1}) {
+                mat->setTransposeBudget(budget);
+                mat->loadFromTriplets(input_mat, partitions);
+
+                mat->mvT(x.data(), y.data());
+                if (budget == 0) BOOST_TEST(!mat->transposeStored());
+                for (int i = 0; i < mat_size; ++i) BOOST_TEST(y[i] == y_t[i]);
+
+                mat->mvTmv(x.data(), y.data());
+                for (int i = 0; i < mat_size; ++i) BOOST_TEST(y[i] == y_tmv[i]);
+
+                mat->mvmvT(x.data(), y.data());
+                for (int i = 0; i < mat_size; ++i) BOOST_TEST(y[i] == y_mvt[i]);
+            }
+
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
+                break;
+            }
+        }
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(transpose_scratch_bound) {
+    typedef pwm::TransposeProduct<double, int, long long> Transpose;
+    int max_threads = omp_get_max_threads();
+    omp_set_num_threads(64);
+
+    // Wide matrices: the counters of the threads may not exceed the transposed CRS
+    const int noc = 1 << 20;
+    for (long long nnz : {(long long) noc/4, (long long) noc, 3LL*noc, 200LL*noc}) {
+        BOOST_TEST(Transpose::buildThreads(noc, nnz) >= 1);
+        BOOST_TEST(Transpose::buildThreads(noc, nnz) <= 64);
+        BOOST_TEST(Transpose::buildScratchBytes(noc, nnz) <= Transpose::transposedBytes(noc, nnz));
+    }
+    BOOST_TEST(Transpose::buildThreads(noc, 200LL*noc) == 64);
+
+    // Reset omp threads
+    omp_set_num_threads(max_threads);
+}
+
+BOOST_AUTO_TEST_CASE(triplet_copy_release_arc130) {
+    pwm::Triplet<double, int> input_mat;
+    input_mat.loadFromMM("Test_input/arc130.mtx", true, false);
+    int nnz = input_mat.nnz;
+
+    // The copy owns its own (cache line aligned) arrays
+    pwm::Triplet<double, int> copy = input_mat;
+    BOOST_TEST(copy.nnz == nnz);
+    BOOST_TEST(copy.row_coord != input_mat.row_coord);
+    BOOST_TEST((uintptr_t) copy.data % pwm::Arena::alignment == 0);
+    for (int i = 0; i < nnz; ++i) {
+        BOOST_TEST(copy.row_coord[i] == input_mat.row_coord[i]);
+        BOOST_TEST(copy.col_coord[i] == input_mat.col_coord[i]);
+        BOOST_TEST(copy.data[i] == input_mat.data[i]);
+    }
+
+    // Loading a matrix does not need the triplets afterwards
+    pwm::CRS<double, int> mat(1);
+    mat.loadFromTriplets(copy, 0);
+    copy.release();
+    BOOST_TEST(copy.nnz == 0);
+    BOOST_TEST(copy.data == nullptr);
+    BOOST_TEST(copy.arena.bytes() == 0u);
+    BOOST_TEST(mat.allocatedBytes() >= (size_t) nnz*(sizeof(double) + sizeof(int)));
+}
+
+BOOST_AUTO_TEST_CASE(edge_updates_8_4_bin_no_rand, * boost::unit_test::tolerance(std::pow(10, -12))) {
+    pwm::Triplet<double, int> input_mat;
+    input_mat.loadFromBin("Test_input/test_mat_8_4.bin", std::pow(2, 8), false, false);
+    int mat_size = input_mat.col_size;
+
+    // Reference: the edges of the matrix (duplicates are added) and the amount of times they occur
+    std::map<std::pair<int, int>, double> edges;
+    std::map<std::pair<int, int>, int> occurrences;
+    for (int k = 0; k < input_mat.nnz; ++k) {
+        edges[{input_mat.row_coord[k], input_mat.col_coord[k]}] += input_mat.data[k];
+        occurrences[{input_mat.row_coord[k], input_mat.col_coord[k]}]++;
+    }
+
+    // Remove every fifth edge which occurs once, overwrite every seventh and insert new edges
+    std::vector<int> remove_rows, remove_cols, insert_rows, insert_cols;
+    std::vector<double> insert_values;
+    int index = 0;
+    for (const auto& edge : occurrences) {
+        if (edge.second == 1 && index % 5 == 0) {
+            remove_rows.push_back(edge.first.first);
+            remove_cols.push_back(edge.first.second);
+        } else if (edge.second == 1 && index % 7 == 0) {
+            insert_rows.push_back(edge.first.first);
+            insert_cols.push_back(edge.first.second);
+            insert_values.push_back(0.5);
+        }
+        index++;
+    }
+
+    int inserted = 0;
+    for (int i = 0; i < mat_size; i += 3) {
+        int j = (7*i + 1) % mat_size;
+        if (edges.count({i, j}) > 0) continue;
+        insert_rows.insert(insert_rows.end(), {i, i});
+        insert_cols.insert(insert_cols.end(), {j, j});
+        insert_values.insert(insert_values.end(), {1., 2. + i % 5}); // The second insertion overwrites the first
+        inserted++;
+    }
+
+    bool symmetric = true;
+    for (const auto& edge : edges) {
+        auto mirrored = edges.find({edge.first.second, edge.first.first});
+        if (mirrored == edges.end() || mirrored->second != edge.second) symmetric = false;
+    }
+
+    for (size_t u = 0; u < remove_rows.size(); ++u) edges.erase({remove_rows[u], remove_cols[u]});
+    for (size_t u = 0; u < insert_rows.size(); ++u) edges[{insert_rows[u], insert_cols[u]}] = insert_values[u];
+
+    std::vector<double> x(mat_size), y(mat_size), y_ref(mat_size, 0.), y_t(mat_size, 0.);
+    for (int i = 0; i < mat_size; ++i) x[i] = 1. + i % 7;
+    for (const auto& edge : edges) {
+        y_ref[edge.first.first] += edge.second*x[edge.first.second];
+        y_t[edge.first.second] += edge.second*x[edge.first.first];
+    }
+
+    for (int threads = 1; threads <= omp_get_max_threads(); ++threads) {
+        pwm::CRSDynamic<double, int> mat(threads);
+        mat.setSlack(0., 1);
+        mat.loadFromTriplets(input_mat, 0);
+
+        // Eigenvector of the matrix before the updates (same start as printUpdateReport)
+        std::vector<double> previous(mat_size);
+        pwm::reportStart(previous.data(), mat_size);
+        pwm::powerMethodTolerance(mat, previous.data(), y.data(), 1e-10, 10000);
+
+        // The transposed CRS is built before the updates and must not be used afterwards
+        mat.mvT(x.data(), y.data());
+        BOOST_TEST(mat.transposeStored());
+
+        // The matrix is not symmetric, random updates are not mirrored
+        BOOST_TEST(pwm::isSymmetric(mat) == symmetric);
+        if (!symmetric) {
+            pwm::EdgeUpdates<double, int> random_updates = pwm::randomEdgeUpdates(mat, 10, 1, false);
+            BOOST_TEST(random_updates.remove_rows.size() == 10u);
+            BOOST_TEST(random_updates.insert_rows.size() == 10u);
+        }
+
+        pwm::EdgeUpdates<double, int> updates;
+        updates.remove_rows = remove_rows;
+        updates.remove_cols = remove_cols;
+        updates.insert_rows = insert_rows;
+        updates.insert_cols = insert_cols;
+        updates.insert_values = insert_values;
+        pwm::EdgeUpdateCounts<int> counts = pwm::applyEdgeUpdates(mat, updates);
+        BOOST_TEST(mat.rebuilds() > 0);
+        BOOST_TEST(counts.removed == (int) remove_rows.size());
+        BOOST_TEST(counts.inserted == inserted);
+        BOOST_TEST(mat.getNonzeros() == (int) (input_mat.nnz - remove_rows.size() + inserted));
+
+        mat.mv(x.data(), y.data());
+        for (int i = 0; i < mat_size; ++i) BOOST_TEST(y[i] == y_ref[i]);
+
+        mat.mvT(x.data(), y.data());
+        for (int i = 0; i < mat_size; ++i) BOOST_TEST(y[i] == y_t[i]);
+
+        // Edges outside of the matrix throw before the matrix changes
+        int bad_rows[] = {0, mat_size}, bad_cols[] = {0, 0}, negative_cols[] = {-1};
+        double bad_values[] = {1., 1.};
+        BOOST_CHECK_THROW(mat.insertEdges(bad_rows, bad_cols, bad_values, 2), std::out_of_range);
+        BOOST_CHECK_THROW(mat.removeEdges(bad_rows, negative_cols, 1), std::out_of_range);
+        BOOST_TEST(mat.getNonzeros() == (int) (input_mat.nnz - remove_rows.size() + inserted));
+        mat.mv(x.data(), y.data());
+        for (int i = 0; i < mat_size; ++i) BOOST_TEST(y[i] == y_ref[i]);
+
+        // The power method started from the previous eigenvector needs fewer products than a random start
+        std::vector<double> cold(mat_size);
+        pwm::reportStart(cold.data(), mat_size);
+        pwm::PowerResult<double> cold_result = pwm::powerMethodTolerance(mat, cold.data(), y.data(), 1e-10, 10000);
+        pwm::PowerResult<double> warm_result = pwm::powerMethodTolerance(mat, previous.data(), y.data(), 1e-10, 10000);
+        BOOST_TEST(cold_result.converged);
+        BOOST_TEST(warm_result.converged);
+        BOOST_TEST(warm_result.products < cold_result.products);
+        BOOST_TEST(warm_result.value == cold_result.value, boost::test_tools::tolerance(1e-8));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mv_in_place_arc130, * boost::unit_test::tolerance(std::pow(10, -14))) {
+    pwm::Triplet<double, int> input_mat;
+    input_mat.loadFromMM("Test_input/arc130.mtx", true, false);
+    int mat_size = input_mat.col_size;
+
+    // Reference: CRS converted with a copy
+    double* x = new double[mat_size];
+    double* y = new double[mat_size];
+    double* y_ref = new double[mat_size];
+    std::fill(x, x+mat_size, 1.);
+
+    pwm::CRS<double, int> reference(1);
+    reference.loadFromTriplets(input_mat, 0);
+    reference.mv(x, y_ref);
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+        
+        for (int partitions = 1; partitions <= std::min(max_threads*2, mat_size); ++partitions) {
+            // The conversion consumes the triplets
+            pwm::Triplet<double, int> consumed = input_mat;
+            consumed.in_place = true;
+            mat->loadFromTriplets(consumed, partitions);
+            BOOST_TEST(consumed.nnz == 0);
+            BOOST_TEST(consumed.arena.bytes() == 0u);
+
+            mat->mv(x, y);
+
+            // Check solution
+            for (int i = 0; i < mat_size; ++i) {
+                BOOST_TEST(y[i] == y_ref[i]);
+            }
+
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
+                break;
+            }
+        }
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mv_partitioner_gre_1107, * boost::unit_test::tolerance(std::pow(10, -12))) {
+    pwm::Triplet<double, int> input_mat;
+    input_mat.loadFromMM("Test_input/gre_1107.mtx", true, false);
+    int mat_size = input_mat.col_size;
+
+    // Reference: product with the original matrix in CRS format
+    std::vector<double> x(mat_size), x_perm(mat_size), y(mat_size), y_ref(mat_size);
+    for (int i = 0; i < mat_size; ++i) x[i] = 1. + i % 7;
+
+    pwm::CRS<double, int> reference(1);
+    reference.loadFromTriplets(input_mat, 0);
+    reference.mv(x.data(), y_ref.data());
+
+    // Partition for every amount of partitions of the matrices
+    int max_partitions = std::min(omp_get_max_threads()*2, mat_size);
+    std::vector<pwm::GraphPartitioner<int>> partitioners(max_partitions + 1);
+    for (int partitions = 1; partitions <= max_partitions; ++partitions) {
+        pwm::GraphPartitioner<int>& partitioner = partitioners[partitions];
+        partitioner.loadFromTriplets(input_mat.row_coord, input_mat.col_coord, input_mat.nnz, mat_size);
+        partitioner.partition(partitions);
+
+        // perm and iperm are inverse bijections
+        BOOST_TEST(partitioner.perm.size() == (size_t) mat_size);
+        BOOST_TEST(partitioner.iperm.size() == (size_t) mat_size);
+        std::vector<bool> seen(mat_size, false);
+        for (int i = 0; i < mat_size; ++i) {
+            BOOST_REQUIRE(partitioner.perm[i] >= 0);
+            BOOST_REQUIRE(partitioner.perm[i] < mat_size);
+            BOOST_TEST(!seen[partitioner.perm[i]]);
+            seen[partitioner.perm[i]] = true;
+            BOOST_TEST(partitioner.iperm[partitioner.perm[i]] == i);
+        }
+
+        // The partitions cover all rows in increasing order and every row lies in its own partition
+        BOOST_REQUIRE(partitioner.bounds.size() == (size_t) partitions + 1);
+        BOOST_TEST(partitioner.bounds.front() == 0);
+        BOOST_TEST(partitioner.bounds.back() == mat_size);
+        for (int p = 0; p < partitions; ++p) {
+            BOOST_TEST(partitioner.bounds[p] <= partitioner.bounds[p+1]);
+            for (int i = partitioner.bounds[p]; i < partitioner.bounds[p+1]; ++i) {
+                BOOST_TEST(partitioner.part[partitioner.perm[i]] == p);
+            }
+        }
+    }
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        for (int partitions = 1; partitions <= std::min(max_threads*2, mat_size); ++partitions) {
+            const pwm::GraphPartitioner<int>& partitioner = partitioners[partitions];
+
+            // Permute the rows and columns such that every partition is a contiguous block of rows
+            pwm::Triplet<double, int> permuted = input_mat;
+            permuted.permute(partitioner.iperm.data());
+            mat->setPartitionBounds(partitioner.bounds.data());
+            mat->loadFromTriplets(permuted, partitions);
+
+            // Permuted input vector: new row i is old row perm[i]
+            for (int i = 0; i < mat_size; ++i) x_perm[i] = x[partitioner.perm[i]];
+            mat->mv(x_perm.data(), y.data());
+
+            // Check solution after undoing the permutation
+            for (int i = 0; i < mat_size; ++i) {
+                BOOST_TEST(y[partitioner.iperm[i]] == y_ref[i]);
+            }
+
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
+                break;
+            }
+        }
+
+        // The bounds belong to the partitioners of this test
+        mat->setPartitionBounds(NULL);
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(powermethod_input)
@@ -286,8 +689,8 @@ BOOST_AUTO_TEST_CASE(powermethod_arc130, * boost::unit_test::tolerance(std::pow(
                 BOOST_TEST(x[i] == real_sol[i]);
             }
 
-            // If matrix is an omp or TBB matrix break because all executions are the same
-            if ((mat_index-1) % 6 == 0 || (mat_index-2) % 6 == 0) {
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
                 break;
             }
         }
@@ -297,4 +700,171 @@ BOOST_AUTO_TEST_CASE(powermethod_arc130, * boost::unit_test::tolerance(std::pow(
     }
 }
 
+BOOST_AUTO_TEST_CASE(pagerank_arc130, * boost::unit_test::tolerance(std::pow(10, -10))) {
+    pwm::Triplet<double, int> input_mat;
+    input_mat.loadFromMM("Test_input/arc130.mtx", true, false);
+    int mat_size = input_mat.col_size;
+    double damping = 0.85;
+
+    // Node 3 is dangling: its edges have weight 0
+    for (int k = 0; k < input_mat.nnz; ++k) {
+        if (input_mat.row_coord[k] == 3) input_mat.data[k] = 0.;
+    }
+
+    // Reference: dense iteration with the dangling nodes handled explicitly
+    std::vector<double> out_weight(mat_size, 0.);
+    for (int k = 0; k < input_mat.nnz; ++k) out_weight[input_mat.row_coord[k]] += std::abs(input_mat.data[k]);
+
+    std::vector<double> real_sol(mat_size, 1./mat_size), next(mat_size);
+    for (int it = 0; it < 1000; ++it) {
+        double dangling = 0.;
+        for (int j = 0; j < mat_size; ++j) {
+            if (out_weight[j] == 0.) dangling += real_sol[j];
+        }
+
+        std::fill(next.begin(), next.end(), (damping*dangling + 1. - damping)/mat_size);
+        for (int k = 0; k < input_mat.nnz; ++k) {
+            int from = input_mat.row_coord[k];
+            if (out_weight[from] > 0.) next[input_mat.col_coord[k]] += damping*std::abs(input_mat.data[k])/out_weight[from]*real_sol[from];
+        }
+        real_sol.swap(next);
+    }
+
+    BOOST_TEST(pwm::toPageRankMatrix(input_mat) >= 1);
+
+    double* x = new double[mat_size];
+    double* y = new double[mat_size];
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        mat->loadFromTriplets(input_mat, std::min(max_threads*2, 7));
+        std::fill(x, x+mat_size, 1.);
+        pwm::PageRankResult<double> result = pwm::pageRank(*mat, x, y, damping, 1e-13, 1000);
+        BOOST_TEST(result.converged);
+
+        // Check solution
+        for (int i = 0; i < mat_size; ++i) {
+            BOOST_TEST(x[i] == real_sol[i]);
+        }
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+
+    delete[] x;
+    delete[] y;
+}
+
+BOOST_AUTO_TEST_CASE(batch_pagerank_arc130, * boost::unit_test::tolerance(std::pow(10, -10))) {
+    pwm::Triplet<double, int> input_mat;
+    input_mat.loadFromMM("Test_input/arc130.mtx", true, false);
+    int mat_size = input_mat.col_size;
+    int batch = 5;
+    double damping = 0.85;
+    pwm::toPageRankMatrix(input_mat);
+
+    // Personalization: uniform (plain PageRank) and seed nodes which converge after a different amount of iterations
+    std::vector<double> V((size_t) mat_size*batch, 0.), X((size_t) mat_size*batch);
+    for (int i = 0; i < mat_size; ++i) V[(size_t) i*batch] = 1.;
+    for (int b = 1; b < batch; ++b) V[(size_t) (17*b)*batch + b] = 1.;
+
+    double* x = new double[mat_size];
+    double* y = new double[mat_size];
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        mat->loadFromTriplets(input_mat, std::min(max_threads*2, 7));
+        pwm::BatchResult<double> result = pwm::batchPageRank(*mat, V.data(), X.data(), batch, damping, 1e-13, 1000);
+
+        // Check the uniform personalization with plain PageRank
+        std::fill(x, x+mat_size, 1.);
+        pwm::pageRank(*mat, x, y, damping, 1e-13, 1000);
+        for (int i = 0; i < mat_size; ++i) {
+            BOOST_TEST(X[(size_t) i*batch] == x[i]);
+        }
+
+        // Every vector converged to a probability vector
+        for (int b = 0; b < batch; ++b) {
+            BOOST_TEST(result.converged[b]);
+            double sum = 0.;
+            for (int i = 0; i < mat_size; ++i) sum += X[(size_t) i*batch + b];
+            BOOST_TEST(sum == 1.);
+        }
+        BOOST_TEST(result.vector_iterations == std::accumulate(result.iterations.begin(), result.iterations.end(), 0LL));
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+
+    delete[] x;
+    delete[] y;
+}
+
+BOOST_AUTO_TEST_CASE(singular_8_4_bin_no_rand, * boost::unit_test::tolerance(std::pow(10, -8))) {
+    pwm::Triplet<double, int> input_mat;
+    input_mat.loadFromBin("Test_input/test_mat_8_4.bin", std::pow(2, 8), false, false);
+    int mat_size = input_mat.col_size;
+
+    pwm::CRS<double, int> reference(1);
+    reference.loadFromTriplets(input_mat, 0);
+
+    std::vector<double> v(mat_size), u(mat_size), y(mat_size);
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        mat->loadFromTriplets(input_mat, std::min(max_threads*2, 7));
+
+        std::fill(v.begin(), v.end(), 1.);
+        pwm::SingularResult<double> right = pwm::singularPowerMethod(*mat, v.data(), y.data(), false, 1e-12, 10000);
+        BOOST_TEST(right.converged);
+
+        std::fill(u.begin(), u.end(), 1.);
+        pwm::SingularResult<double> left = pwm::singularPowerMethod(*mat, u.data(), y.data(), true, 1e-12, 10000);
+        BOOST_TEST(left.converged);
+        BOOST_TEST(left.value == right.value);
+
+        // A v = s u for the (nonnegative) singular vectors
+        reference.mv(v.data(), y.data());
+        for (int i = 0; i < mat_size; ++i) {
+            BOOST_TEST(std::abs(y[i] - right.value*u[i]) < 1e-8*right.value);
+        }
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
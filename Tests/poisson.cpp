@@ -10,9 +10,17 @@
 
 #include <vector>
 #include <cmath>
+#include <numeric>
 
 #include "../Matrix/SparseMatrix.hpp"
 #include "GetMatrices.hpp"
+#include "../Util/Lanczos.hpp"
+#include "../Util/Chebyshev.hpp"
+#include "../Util/Batch.hpp"
+#include "../Util/Deflation.hpp"
+#include "../Util/Throughput.hpp"
+#include "../Util/Checkpoint.hpp"
+#include "../Util/Reproducible.hpp"
 
 #include "omp.h"
 #include "oneapi/tbb.h"
@@ -51,8 +59,8 @@ BOOST_AUTO_TEST_CASE(mv_size_3_3, * boost::unit_test::tolerance(std::pow(10, -14
                 BOOST_TEST(y[i] == real_sol[i]);
             }
 
-            // If matrix is an omp or TBB matrix break because all executions are the same
-            if ((mat_index-1) % 6 == 0 || (mat_index-2) % 6 == 0) {
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
                 break;
             }
         }
@@ -95,8 +103,8 @@ BOOST_AUTO_TEST_CASE(mv_size_9_3, * boost::unit_test::tolerance(std::pow(10, -14
                 BOOST_TEST(y[i] == real_sol[i]);
             }
 
-            // If matrix is an omp or TBB matrix break because all executions are the same
-            if ((mat_index-1) % 6 == 0 || (mat_index-2) % 6 == 0) {
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
                 break;
             }
         }
@@ -107,6 +115,136 @@ BOOST_AUTO_TEST_CASE(mv_size_9_3, * boost::unit_test::tolerance(std::pow(10, -14
     }
 }
 
+BOOST_AUTO_TEST_CASE(mv_size_9_3_index64, * boost::unit_test::tolerance(std::pow(10, -14))) {
+    int mat_size = 9*3;
+
+    // Precomputed solution using matlab
+    double real_sol[] = {2., 1., 1., 1., 1., 1., 1., 1., 2., 1., 0., 0., 
+                         0., 0., 0., 0., 0., 1., 2., 1., 1., 1., 1., 1., 1., 1., 2.};
+
+
+    // Get datastructures with 64-bit row offsets
+    std::vector<pwm::SparseMatrix<double, int, long long>*> matrices = pwm::get_all_matrices<double, int, long long>();
+    double* x = new double[mat_size];
+    double* y = new double[mat_size];
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int, long long>* mat = matrices[mat_index];
+            
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        for (int partitions = 1; partitions <= std::min(max_threads*3, 9*3); ++partitions) {
+            mat->generatePoissonMatrix(9, 3, partitions);
+            std::fill(x, x+mat_size, 1.);
+            mat->mv(x,y);
+
+            // Check solution
+            for (int i = 0; i < mat_size; ++i) {
+                BOOST_TEST(y[i] == real_sol[i]);
+            }
+
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
+                break;
+            }
+        }
+
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mv_out_of_core_blocks, * boost::unit_test::tolerance(std::pow(10, -14))) {
+    int m = 60;
+    int mat_size = m*m;
+
+    // Reference: CRS in memory
+    double* x = new double[mat_size];
+    double* y = new double[mat_size];
+    double* y_ref = new double[mat_size];
+    for (int i = 0; i < mat_size; ++i) x[i] = 1. + i % 7;
+
+    pwm::CRS<double, int> reference(1);
+    reference.generatePoissonMatrix(m, m, 0);
+    reference.mv(x, y_ref);
+
+    // Smallest blocks (about 4 kB) such that the product streams many blocks through 2 or 3 buffers
+    for (int buffers = 2; buffers <= 3; ++buffers) {
+        pwm::CRSOutOfCore<double, int> mat(omp_get_max_threads());
+        mat.setStorage("", 0, buffers);
+        mat.generatePoissonMatrix(m, m, 0);
+        BOOST_TEST(mat.getBlocks() > 10u);
+
+        std::fill(y, y+mat_size, 0.);
+        mat.mv(x, y);
+        for (int i = 0; i < mat_size; ++i) {
+            BOOST_TEST(y[i] == y_ref[i]);
+        }
+    }
+
+    delete[] x;
+    delete[] y;
+    delete[] y_ref;
+}
+
+BOOST_AUTO_TEST_CASE(mv_batch_size_10_5, * boost::unit_test::tolerance(std::pow(10, -14))) {
+    int mat_size = 10*5;
+
+    std::vector<double> x(mat_size), y(mat_size);
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        mat->generatePoissonMatrix(10, 5, std::min(max_threads*3, 7));
+
+        // Batch sizes which use every register width of the kernel
+        for (int batch = 1; batch <= 2*pwm::batch_width + 7; ++batch) {
+            std::vector<double> X((size_t) mat_size*batch), Y((size_t) mat_size*batch);
+            for (int i = 0; i < mat_size; ++i) {
+                for (int b = 0; b < batch; ++b) X[(size_t) i*batch + b] = 1. + std::sin(0.7*i + b);
+            }
+
+            mat->mvBatch(X.data(), Y.data(), batch);
+
+            // Check each vector with the product of the vector alone
+            for (int b = 0; b < batch; ++b) {
+                for (int i = 0; i < mat_size; ++i) x[i] = X[(size_t) i*batch + b];
+                mat->mv(x.data(), y.data());
+                for (int i = 0; i < mat_size; ++i) {
+                    BOOST_TEST(Y[(size_t) i*batch + b] == y[i]);
+                }
+            }
+        }
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(nonzeros_overflow) {
+    // 5*50000^2 - 4*50000 nonzeros do not fit in 32 bits
+    BOOST_TEST(pwm::poissonNonzeros<long long>(50000, 50000) == 12499800000LL);
+
+    BOOST_CHECK_THROW((pwm::Triplet<double, int>::checkedNonzeros(12499800000LL)), std::overflow_error);
+    BOOST_TEST((pwm::Triplet<double, int, long long>::checkedNonzeros(12499800000LL)) == 12499800000LL);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(poisson_powermethod)
@@ -144,8 +282,8 @@ BOOST_AUTO_TEST_CASE(powermethod_size_5_5, * boost::unit_test::tolerance(std::po
                 BOOST_TEST(x[i] == real_sol[i]);
             }
 
-            // If matrix is an omp or TBB matrix break because all executions are the same
-            if ((mat_index-1) % 6 == 0 || (mat_index-2) % 6 == 0) {
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
                 break;
             }
         }
@@ -188,8 +326,8 @@ BOOST_AUTO_TEST_CASE(powermethod_size_10_5, * boost::unit_test::tolerance(std::p
                 BOOST_TEST(x[i] == real_sol[i]);
             }
 
-            // If matrix is an omp or TBB matrix break because all executions are the same
-            if ((mat_index-1) % 6 == 0 || (mat_index-2) % 6 == 0) {
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
                 break;
             }
         }
@@ -199,4 +337,510 @@ BOOST_AUTO_TEST_CASE(powermethod_size_10_5, * boost::unit_test::tolerance(std::p
     }
 }
 
+BOOST_AUTO_TEST_CASE(powermethod_sstep_size_10_5, * boost::unit_test::tolerance(std::pow(10, -12))) {
+    int mat_size = 10*5;
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+    double* x = new double[mat_size];
+    double* y = new double[mat_size];
+    double* x_ref = new double[mat_size];
+    double* y_ref = new double[mat_size];
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        for (int partitions = 1; partitions <= std::min(max_threads*3, 10*5); ++partitions) {
+            mat->generatePoissonMatrix(10, 5, partitions);
+
+            // Compare with the standard power method for an even and odd amount of iterations
+            for (int it = 20; it <= 21; ++it) {
+                for (int s = 2; s <= 5; ++s) {
+                    std::fill(x_ref, x_ref+mat_size, 1.);
+                    mat->powerMethod(x_ref, y_ref, it);
+                    std::fill(x, x+mat_size, 1.);
+                    mat->powerMethodSStep(x, y, it, s);
+
+                    // Check solution
+                    double* result = it % 2 == 0 ? x : y;
+                    double* ref = it % 2 == 0 ? x_ref : y_ref;
+                    for (int i = 0; i < mat_size; ++i) {
+                        BOOST_TEST(result[i] == ref[i]);
+                    }
+                }
+            }
+
+            // If matrix is not partitioned break because all executions are the same
+            if (!pwm::is_partitioned_matrix(mat_index)) {
+                break;
+            }
+        }
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(lanczos_size_10_5, * boost::unit_test::tolerance(std::pow(10, -9))) {
+    int mat_size = 10*5;
+    int k = 3;
+
+    // Eigenvalues 4 - 2cos(i pi/11) - 2cos(j pi/6) of the poisson matrix, largest first
+    std::vector<double> real_values;
+    for (int i = 1; i <= 10; ++i) {
+        for (int j = 1; j <= 5; ++j) {
+            real_values.push_back(4. - 2.*std::cos(i*M_PI/11.) - 2.*std::cos(j*M_PI/6.));
+        }
+    }
+    std::sort(real_values.rbegin(), real_values.rend());
+
+    // Start vector which is not orthogonal to any eigenvector (the ones vector is)
+    std::vector<double> start(mat_size), y(mat_size);
+    for (int i = 0; i < mat_size; ++i) start[i] = 1. + std::sin(1.3*i);
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        mat->generatePoissonMatrix(10, 5, std::min(max_threads*3, 7));
+
+        // A basis of 10 vectors needs several restarts
+        pwm::LanczosResult<double> result = pwm::lanczos(*mat, start.data(), k, 1e-12, 10, 1000);
+        BOOST_TEST(result.converged);
+        BOOST_TEST(result.restarts > 0);
+        BOOST_TEST(result.values.size() == (size_t) k);
+
+        for (int l = 0; l < k; ++l) {
+            BOOST_TEST(result.values[l] == real_values[l]);
+
+            // Check the residual of the eigenvector
+            const double* v = result.vectors.data() + (size_t) l*mat_size;
+            mat->mv(v, y.data());
+            double residual = 0.;
+            for (int i = 0; i < mat_size; ++i) residual += (y[i] - result.values[l]*v[i])*(y[i] - result.values[l]*v[i]);
+            BOOST_TEST(std::sqrt(residual) < 1e-9);
+        }
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(lanczos_multiple_size_8_8, * boost::unit_test::tolerance(std::pow(10, -9))) {
+    int mat_size = 8*8;
+    int k = 4;
+
+    // Eigenvalues 4 - 2cos(i pi/9) - 2cos(j pi/9) of the square poisson matrix, (i, j) and (j, i) give a double eigenvalue
+    std::vector<double> real_values;
+    for (int i = 1; i <= 8; ++i) {
+        for (int j = 1; j <= 8; ++j) {
+            real_values.push_back(4. - 2.*std::cos(i*M_PI/9.) - 2.*std::cos(j*M_PI/9.));
+        }
+    }
+    std::sort(real_values.rbegin(), real_values.rend());
+
+    std::vector<double> start(mat_size);
+    pwm::reportStart(start.data(), mat_size);
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        mat->generatePoissonMatrix(8, 8, std::min(max_threads*3, 7));
+
+        // Both directions of the double eigenvalues are found
+        pwm::LanczosResult<double> result = pwm::lanczos(*mat, start.data(), k, 1e-12, 12, 1000);
+        BOOST_TEST(result.converged);
+        BOOST_TEST(result.values.size() == (size_t) k);
+        for (int l = 0; l < k; ++l) BOOST_TEST(result.values[l] == real_values[l]);
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(chebyshev_size_10_5, * boost::unit_test::tolerance(std::pow(10, -9))) {
+    int mat_size = 10*5;
+
+    // Two largest eigenvalues 4 - 2cos(i pi/11) - 2cos(j pi/6) of the poisson matrix
+    std::vector<double> real_values;
+    for (int i = 1; i <= 10; ++i) {
+        for (int j = 1; j <= 5; ++j) {
+            real_values.push_back(4. - 2.*std::cos(i*M_PI/11.) - 2.*std::cos(j*M_PI/6.));
+        }
+    }
+    std::sort(real_values.rbegin(), real_values.rend());
+
+    std::vector<double> x(mat_size), y(mat_size);
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        mat->generatePoissonMatrix(10, 5, std::min(max_threads*3, 7));
+
+        // Filter of degree 8 which damps [0, l2]
+        for (int i = 0; i < mat_size; ++i) x[i] = 1. + std::sin(1.3*i);
+        pwm::PowerResult<double> filtered = pwm::chebyshevPowerMethod(*mat, x.data(), y.data(), 0., real_values[1], 8, 1e-11, 10000);
+        BOOST_TEST(filtered.converged);
+        BOOST_TEST(filtered.value == real_values[0]);
+
+        // Same eigenvalue with less products than the power method
+        for (int i = 0; i < mat_size; ++i) x[i] = 1. + std::sin(1.3*i);
+        pwm::PowerResult<double> power = pwm::powerMethodTolerance(*mat, x.data(), y.data(), 1e-11, 10000);
+        BOOST_TEST(power.converged);
+        BOOST_TEST(power.value == real_values[0]);
+        BOOST_TEST(filtered.products < power.products);
+
+        // Degree 1 is the shifted power method
+        for (int i = 0; i < mat_size; ++i) x[i] = 1. + std::sin(1.3*i);
+        pwm::PowerResult<double> shifted = pwm::chebyshevPowerMethod(*mat, x.data(), y.data(), 1., 3., 1, 1e-11, 10000);
+        BOOST_TEST(shifted.converged);
+        BOOST_TEST(shifted.value == real_values[0]);
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(chebyshev_report_start_size_10_10, * boost::unit_test::tolerance(std::pow(10, -9))) {
+    int mat_size = 10*10;
+
+    // Largest eigenvalue 4 + 4cos(pi/11) of the poisson matrix, x = 1 is orthogonal to its eigenvector (even m)
+    double real_value = 4. + 4.*std::cos(M_PI/11.);
+
+    std::vector<double> x(mat_size), y(mat_size);
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        mat->generatePoissonMatrix(10, 10, std::min(max_threads*3, 7));
+
+        // Same steps as printChebyshevComparison with an estimated interval
+        pwm::reportStart(x.data(), mat_size);
+        pwm::SpectralBounds<double> bounds = pwm::estimateSpectralBounds(*mat, x.data(), 20);
+        pwm::PowerResult<double> filtered = pwm::chebyshevPowerMethod(*mat, x.data(), y.data(), bounds.lower, bounds.upper, 8, 1e-11, 10000);
+        BOOST_TEST(filtered.converged);
+        BOOST_TEST(filtered.value == real_value);
+
+        pwm::reportStart(x.data(), mat_size);
+        pwm::PowerResult<double> power = pwm::powerMethodTolerance(*mat, x.data(), y.data(), 1e-11, 10000);
+        BOOST_TEST(power.converged);
+        BOOST_TEST(power.value == real_value);
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(deflation_size_10_5, * boost::unit_test::tolerance(std::pow(10, -9))) {
+    int mat_size = 10*5;
+    int k = 3;
+
+    // Largest eigenvalues 4 - 2cos(i pi/11) - 2cos(j pi/6) of the poisson matrix
+    std::vector<double> real_values;
+    for (int i = 1; i <= 10; ++i) {
+        for (int j = 1; j <= 5; ++j) {
+            real_values.push_back(4. - 2.*std::cos(i*M_PI/11.) - 2.*std::cos(j*M_PI/6.));
+        }
+    }
+    std::sort(real_values.rbegin(), real_values.rend());
+
+    std::vector<double> start(mat_size), y(mat_size);
+    for (int i = 0; i < mat_size; ++i) start[i] = 1. + std::sin(1.3*i);
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        mat->generatePoissonMatrix(10, 5, std::min(max_threads*3, 7));
+
+        for (pwm::Deflation method : {pwm::Deflation::hotelling, pwm::Deflation::projection}) {
+            pwm::DeflationResult<double> result = pwm::deflatedPowerMethod(*mat, start.data(), k, method, 1e-11, 10000);
+
+            for (int i = 0; i < k; ++i) {
+                BOOST_TEST(result.converged[i]);
+                BOOST_TEST(result.values[i] == real_values[i]);
+
+                // Eigenpair of the original matrix
+                const double* v = result.vectors.data() + i*mat_size;
+                mat->mv(v, y.data());
+                double residual = 0.;
+                for (int r = 0; r < mat_size; ++r) residual += (y[r] - result.values[i]*v[r])*(y[r] - result.values[i]*v[r]);
+                BOOST_TEST(std::sqrt(residual) < 1e-8);
+
+                // Orthonormal eigenvectors
+                for (int j = 0; j <= i; ++j) {
+                    double dot = 0.;
+                    for (int r = 0; r < mat_size; ++r) dot += v[r]*result.vectors[j*mat_size + r];
+                    BOOST_TEST(dot == (i == j ? 1. : 0.), boost::test_tools::tolerance(1e-8));
+                }
+            }
+        }
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(throughput_size_10_5, * boost::unit_test::tolerance(std::pow(10, -12))) {
+    int mat_size = 10*5;
+    int solves = 11;
+    int it = 30;
+
+    // Reference: norm of the last product of every solve with the CRS matrix
+    pwm::CRS<double, int> reference(1);
+    reference.generatePoissonMatrix(10, 5, 0);
+    std::vector<double> real_values(solves), x(mat_size), y(mat_size);
+    for (int solve = 0; solve < solves; ++solve) {
+        for (int i = 0; i < mat_size; ++i) x[i] = pwm::throughputStart<double>(solve, i);
+        for (int iteration = 0; iteration < it; ++iteration) {
+            reference.mv(x.data(), y.data());
+            real_values[solve] = std::sqrt(std::inner_product(y.begin(), y.end(), y.begin(), 0.));
+            for (int i = 0; i < mat_size; ++i) x[i] = y[i] / real_values[solve];
+        }
+    }
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        mat->generatePoissonMatrix(10, 5, std::min(max_threads*3, 7));
+
+        // Batches of 4 vectors (the last batch has 3)
+        pwm::ThroughputResult<double> batch = pwm::throughputBatch(*mat, solves, it, 4);
+        for (int solve = 0; solve < solves; ++solve) BOOST_TEST(batch.values[solve] == real_values[solve]);
+
+        // One task per solve on the CRS arrays
+        if (!mat->rowArrays().empty()) {
+            pwm::ThroughputResult<double> tasks = pwm::throughputTasks(*mat, solves, it, max_threads);
+            for (int solve = 0; solve < solves; ++solve) BOOST_TEST(tasks.values[solve] == real_values[solve]);
+        }
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkpoint_size_10_5, * boost::unit_test::tolerance(std::pow(10, -12))) {
+    int mat_size = 10*5;
+    int it = 40;
+    std::string path = "checkpoint_test.bin";
+
+    // Get datastructures
+    std::vector<pwm::SparseMatrix<double, int>*> matrices = pwm::get_all_matrices<double, int>();
+
+    // Run test on all the matrices
+    for (size_t mat_index = 0; mat_index < matrices.size(); ++mat_index) {
+        pwm::SparseMatrix<double, int>* mat = matrices[mat_index];
+
+        // Get omp max threads
+        int max_threads = omp_get_max_threads();
+
+        // If we have a TBB implementation set a global limiter to overwrite other limits
+        tbb::global_control global_limit(tbb::global_control::max_allowed_parallelism, pwm::get_threads_for_matrix(mat_index));
+
+        mat->generatePoissonMatrix(10, 5, std::min(max_threads*3, 7));
+
+        // Reference: all iterations without interruption
+        std::vector<double> x(mat_size, 1.), y(mat_size), history;
+        pwm::checkpointedPowerMethod<double, int, int>(*mat, x.data(), y.data(), it, 1, NULL, 0, history);
+
+        // Interrupted after half of the iterations (the last checkpoint is of iteration 20)
+        std::vector<double> x_part(mat_size, 1.), history_part;
+        {
+            pwm::AsyncCheckpointer<double> checkpointer(path);
+            pwm::checkpointedPowerMethod(*mat, x_part.data(), y.data(), it/2, 3, &checkpointer, 0, history_part);
+            checkpointer.finish();
+            BOOST_TEST(checkpointer.checkpoints() >= 1);
+            BOOST_TEST(checkpointer.failures() == 0);
+        }
+
+        pwm::CheckpointState<double> state;
+        BOOST_TEST(pwm::readCheckpoint(path, state));
+        BOOST_TEST(state.iteration == it/2);
+        BOOST_TEST(state.total_rows == mat_size);
+        BOOST_TEST(state.history.size() == (size_t) it/2);
+
+        // Resume from the checkpoint
+        std::vector<double> x_resumed = state.x, history_resumed = state.history;
+        pwm::checkpointedPowerMethod<double, int, int>(*mat, x_resumed.data(), y.data(), it, 1, NULL, (int) state.iteration, history_resumed);
+
+        for (int i = 0; i < mat_size; ++i) BOOST_TEST(x_resumed[i] == x[i]);
+        BOOST_TEST(history_resumed.size() == history.size());
+        for (size_t i = 0; i < history.size(); ++i) BOOST_TEST(history_resumed[i] == history[i]);
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(reproducible_size_100_90) {
+    int mat_size = 100*90; // More than two blocks of the reproducible reductions
+    int it = 20;
+
+    pwm::reproducibleMode() = true;
+
+    // Reference: sequential CRS
+    pwm::CRS<double, int> reference(1);
+    reference.generatePoissonMatrix(100, 90, 1);
+    std::vector<double> x_ref(mat_size, 1.), y_ref(mat_size);
+    reference.powerMethod(x_ref.data(), y_ref.data(), it);
+    std::vector<double> x_tol(mat_size, 1.), y_tol(mat_size);
+    pwm::PowerResult<double> result_ref = pwm::powerMethodTolerance(reference, x_tol.data(), y_tol.data(), 1e-6, 200);
+
+    // The implementations which sum the nonzeros of a row in order give the same bits for every amount of threads and partitions
+    for (int threads = 1; threads <= 4; ++threads) {
+        std::vector<pwm::SparseMatrix<double, int>*> matrices;
+        matrices.push_back(new pwm::CRSOMP<double, int>(threads));
+        matrices.push_back(new pwm::CRSTBB<double, int>(threads));
+        matrices.push_back(new pwm::CRSThreadPool<double, int>(threads));
+        matrices.push_back(new pwm::CRSDynamic<double, int>(threads));
+
+        for (pwm::SparseMatrix<double, int>* mat : matrices) {
+            mat->generatePoissonMatrix(100, 90, 2*threads + 1);
+
+            std::vector<double> x(mat_size, 1.), y(mat_size);
+            mat->powerMethod(x.data(), y.data(), it);
+            BOOST_TEST(pwm::vectorHash(x.data(), mat_size) == pwm::vectorHash(x_ref.data(), mat_size));
+            BOOST_TEST(pwm::vectorHash(y.data(), mat_size) == pwm::vectorHash(y_ref.data(), mat_size));
+
+            std::fill(x.begin(), x.end(), 1.);
+            pwm::PowerResult<double> result = pwm::powerMethodTolerance(*mat, x.data(), y.data(), 1e-6, 200);
+            BOOST_TEST(result.products == result_ref.products);
+            BOOST_TEST(std::memcmp(&result.value, &result_ref.value, sizeof(double)) == 0);
+            BOOST_TEST(std::memcmp(&result.residual, &result_ref.residual, sizeof(double)) == 0);
+            BOOST_TEST(pwm::vectorHash(x.data(), mat_size) == pwm::vectorHash(x_tol.data(), mat_size));
+
+            delete mat;
+        }
+    }
+
+    pwm::reproducibleMode() = false;
+}
+
+BOOST_AUTO_TEST_CASE(reproducible_threads_all_methods) {
+    int mat_size = 100*90;
+    int it = 100;
+
+    // Poisson matrix with a hub row which is a long row of method 8 for 4 threads (split over threads without the mode)
+    pwm::Triplet<double, int> input_mat;
+    input_mat.row_size = mat_size;
+    input_mat.col_size = mat_size;
+    input_mat.nnz = pwm::poissonNonzeros<int>(100, 90) + 3000;
+    input_mat.allocate();
+    pwm::fillPoissonTriplets(input_mat.data, input_mat.row_coord, input_mat.col_coord, 100, 90);
+    for (int k = 0; k < 3000; ++k) {
+        int index = input_mat.nnz - 3000 + k;
+        input_mat.row_coord[index] = 0;
+        input_mat.col_coord[index] = 3*k + 2;
+        input_mat.data[index] = 0.01*(1 + k % 7);
+    }
+
+    pwm::reproducibleMode() = true;
+    int max_threads = omp_get_max_threads();
+
+    // Every method gives the same bits for every amount of threads (and partitions), pinned methods up to the amount of cores
+    const int methods = 13;
+    std::vector<uint64_t> hash_x(methods), hash_y(methods);
+    for (int threads = 1; threads <= 4; ++threads) {
+        bool pin = threads <= omp_get_num_procs();
+        std::vector<pwm::SparseMatrix<double, int>*> matrices = {
+            new pwm::CRS<double, int>(threads), new pwm::CRSOMP<double, int>(threads), new pwm::CRSTBB<double, int>(threads),
+            new pwm::CRSTBBGraph<double, int>(threads), pin ? new pwm::CRSTBBGraphPinned<double, int>(threads) : NULL,
+            new pwm::CRSThreadPool<double, int>(threads), pin ? new pwm::CRSThreadPoolPinned<double, int>(threads) : NULL,
+            new pwm::CRSAdaptive<double, int>(threads), new pwm::CRSMergePath<double, int>(threads), new pwm::CSB<double, int>(threads),
+            new pwm::CRSCompressed<double, int>(threads), new pwm::CRSOutOfCore<double, int>(threads), new pwm::CRSDynamic<double, int>(threads)
+        };
+
+        for (int method = 0; method < methods; ++method) {
+            pwm::SparseMatrix<double, int>* mat = matrices[method];
+            if (mat == NULL) continue;
+
+            mat->loadFromTriplets(input_mat, 2*threads + 1);
+            std::vector<double> x(mat_size, 1.), y(mat_size);
+            mat->powerMethod(x.data(), y.data(), it);
+
+            if (threads == 1) {
+                hash_x[method] = pwm::vectorHash(x.data(), mat_size);
+                hash_y[method] = pwm::vectorHash(y.data(), mat_size);
+            } else {
+                BOOST_TEST(pwm::vectorHash(x.data(), mat_size) == hash_x[method], "method " << method + 1 << ", " << threads << " threads");
+                BOOST_TEST(pwm::vectorHash(y.data(), mat_size) == hash_y[method], "method " << method + 1 << ", " << threads << " threads");
+            }
+
+            delete mat;
+        }
+
+        // Reset omp threads
+        omp_set_num_threads(max_threads);
+    }
+
+    pwm::reproducibleMode() = false;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -0,0 +1,289 @@
+/**
+ * @file Autotuner.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Autotuner which selects the method, amount of threads and amount of partitions for a matrix
+ * @version 0.1
+ * @date 2022-11-11
+ *
+ * The autotuner computes cheap features of the sparsity pattern, prunes the search space with them and runs short
+ * timed trials of the remaining configurations (successive halving: all candidates are timed once, the best third is
+ * timed again with more repetitions). The best configuration is stored in a tuning database, a text file with one line
+ * per matrix fingerprint and host, such that later runs on the same matrix and machine can skip the tuning.
+ */
+
+#ifndef PWM_AUTOTUNER_HPP
+#define PWM_AUTOTUNER_HPP
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+
+#include <unistd.h>
+
+#include "../Matrix/SparseMatrix.hpp"
+#include "../Matrix/Triplet.hpp"
+
+#include "omp.h"
+
+namespace pwm {
+    // Features of the sparsity pattern of a matrix
+    struct MatrixFeatures {
+        long long rows = 0;
+        long long nnz = 0;
+
+        // Mean and variance of the amount of nonzeros per row
+        double row_mean = 0.;
+        double row_variance = 0.;
+
+        // Maximal amount of nonzeros in a row
+        long long max_row = 0;
+
+        // Maximal distance of a nonzero to the diagonal
+        long long bandwidth = 0;
+
+        // Hash of the dimensions and the coordinates (not the data, which may be filled in randomly)
+        std::string fingerprint;
+
+        /**
+         * @brief Coefficient of variation of the amount of nonzeros per row
+         */
+        double rowVariation() const {
+            return row_mean > 0. ? std::sqrt(row_variance) / row_mean : 0.;
+        }
+    };
+
+    /**
+     * @brief Compute the features of a matrix in Triplet format in one pass over the nonzeros
+     *
+     * The fingerprint is independent of the order of the triplets.
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    MatrixFeatures computeFeatures(const Triplet<T, int_type, nnz_type>& input) {
+        MatrixFeatures features;
+        features.rows = input.row_size;
+        features.nnz = input.nnz;
+
+        std::vector<long long> row_count(input.row_size, 0);
+        uint64_t coord_hash = 0;
+        for (nnz_type i = 0; i < input.nnz; ++i) {
+            row_count[input.row_coord[i]]++;
+            features.bandwidth = std::max<long long>(features.bandwidth, std::abs((long long) input.row_coord[i] - input.col_coord[i]));
+
+            // Sum of a mixed hash of each coordinate, the sum does not depend on the order of the triplets
+            uint64_t h = (uint64_t) input.row_coord[i] * 0x9E3779B97F4A7C15ull ^ (uint64_t) input.col_coord[i];
+            h ^= h >> 33;
+            h *= 0xFF51AFD7ED558CCDull;
+            h ^= h >> 33;
+            coord_hash += h;
+        }
+
+        if (input.row_size > 0) features.row_mean = (double) input.nnz / input.row_size;
+        for (long long count : row_count) {
+            features.max_row = std::max(features.max_row, count);
+            features.row_variance += (count - features.row_mean) * (count - features.row_mean);
+        }
+        if (input.row_size > 0) features.row_variance /= input.row_size;
+
+        std::ostringstream fingerprint;
+        fingerprint << input.row_size << "x" << input.col_size << "-" << input.nnz << "-" << std::hex << coord_hash;
+        features.fingerprint = fingerprint.str();
+        return features;
+    }
+
+    /**
+     * @brief Name of the host and its amount of hardware threads (key of the tuning database)
+     */
+    inline std::string hostName() {
+        char name[256] = "unknown";
+        gethostname(name, sizeof(name) - 1);
+        return std::string(name) + "/" + std::to_string(std::thread::hardware_concurrency());
+    }
+
+    // One configuration of the search space
+    struct TuningConfig {
+        int method = 1;
+        int threads = 1;
+        int partitions = 0;
+
+        // Best measured time of one trial in ms
+        double time = 0.;
+    };
+
+    // Text file with the best configuration per matrix fingerprint and host
+    class TuningDatabase {
+        protected:
+            struct Entry {
+                std::string fingerprint;
+                std::string host;
+                TuningConfig config;
+            };
+
+            // Filename of the database
+            std::string filename;
+
+            // All entries in the database
+            std::vector<Entry> entries;
+
+        public:
+            /**
+             * @brief Read the database, a missing file is an empty database
+             *
+             * @param filename_in Filename of the database
+             */
+            TuningDatabase(const std::string& filename_in): filename(filename_in) {
+                std::ifstream input(filename);
+                std::string line;
+                while (std::getline(input, line)) {
+                    if (line.empty() || line[0] == '#') continue;
+
+                    std::istringstream words(line);
+                    Entry entry;
+                    if (words >> entry.fingerprint >> entry.host >> entry.config.method >> entry.config.threads
+                              >> entry.config.partitions >> entry.config.time) {
+                        entries.push_back(entry);
+                    }
+                }
+            }
+
+            /**
+             * @brief Search the configuration of a matrix on a host
+             *
+             * @return bool False if the matrix was not tuned on this host
+             */
+            bool lookup(const std::string& fingerprint, const std::string& host, TuningConfig& config) const {
+                for (const Entry& entry : entries) {
+                    if (entry.fingerprint == fingerprint && entry.host == host) {
+                        config = entry.config;
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            /**
+             * @brief Store (or replace) the configuration of a matrix on a host and write the database
+             */
+            void store(const std::string& fingerprint, const std::string& host, const TuningConfig& config) {
+                entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const Entry& entry) {
+                    return entry.fingerprint == fingerprint && entry.host == host;
+                }), entries.end());
+                entries.push_back(Entry{fingerprint, host, config});
+
+                std::ofstream output(filename);
+                output << "# fingerprint host method threads partitions trial_time_ms" << std::endl;
+                for (const Entry& entry : entries) {
+                    output << entry.fingerprint << " " << entry.host << " " << entry.config.method << " " << entry.config.threads;
+                    output << " " << entry.config.partitions << " " << entry.config.time << std::endl;
+                }
+
+                if (!output) std::cout << "Could not write tuning database " << filename << std::endl;
+            }
+    };
+
+    /**
+     * @brief Pruned search space of the methods of the drivers
+     *
+     * Thread counts are the amount of hardware threads and its halves down to a quarter (memory bound products often
+     * saturate the bandwidth before all cores are used). Small matrices only try the non partitioned methods because the
+     * dispatch overhead of the partitioned methods dominates. Regular matrices (low variation of the amount of nonzeros
+     * per row) use one partition per thread, irregular ones also try four partitions per thread for load balancing.
+     *
+     * @param features Features of the matrix
+     * @param max_threads Maximal amount of threads
+     */
+    inline std::vector<TuningConfig> searchSpace(const MatrixFeatures& features, int max_threads) {
+        std::vector<TuningConfig> space;
+        space.push_back(TuningConfig{1, 1, 0});
+
+        std::vector<int> thread_list;
+        for (int t = max_threads; t >= std::max(max_threads/4, 1); t /= 2) {
+            thread_list.push_back(t);
+            if (t == 1) break;
+        }
+
+        bool small = features.nnz < 50000;
+        std::vector<int> per_thread = {1};
+        if (features.rowVariation() > 0.5 || features.max_row > 4*features.row_mean) per_thread.push_back(4);
+
+        for (int threads : thread_list) {
+            space.push_back(TuningConfig{2, threads, 0});
+            space.push_back(TuningConfig{3, threads, 0});
+            space.push_back(TuningConfig{8, threads, 0});
+            space.push_back(TuningConfig{9, threads, 0});
+            space.push_back(TuningConfig{10, threads, 0});
+            space.push_back(TuningConfig{11, threads, 0});
+            if (small) continue;
+
+            for (int method = 4; method <= 7; ++method) {
+                for (int ppt : per_thread) {
+                    // Partitions need enough rows to be worth a task
+                    if (features.rows / (ppt*threads) < 64) continue;
+                    space.push_back(TuningConfig{method, threads, ppt*threads});
+                }
+            }
+        }
+
+        return space;
+    }
+
+    /**
+     * @brief Time the configurations of the search space and return the fastest one
+     *
+     * @param input Input matrix (reused for every configuration)
+     * @param features Features of the input matrix
+     * @param factory Function which creates the datastructure of a method with an amount of threads
+     * @param max_threads Maximal amount of threads
+     * @param trial_iterations Iterations of the power method in one trial
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    TuningConfig autotune(Triplet<T, int_type, nnz_type>& input, const MatrixFeatures& features,
+                          std::function<SparseMatrix<T, int_type, nnz_type>*(int, int)> factory, int max_threads, int trial_iterations) {
+        std::vector<TuningConfig> candidates = searchSpace(features, max_threads);
+        std::cout << "Autotuning " << candidates.size() << " configurations (" << features.rows << " rows, " << features.nnz;
+        std::cout << " nonzeros, " << features.row_mean << " +- " << std::sqrt(features.row_variance) << " per row, max ";
+        std::cout << features.max_row << ", bandwidth " << features.bandwidth << ")" << std::endl;
+
+        T* x = new T[input.row_size];
+        T* y = new T[input.row_size];
+
+        // Best time of a configuration over an amount of repetitions (after one untimed run)
+        auto trial = [&](TuningConfig& config, int repetitions) {
+            SparseMatrix<T, int_type, nnz_type>* mat = factory(config.method, config.threads);
+            mat->loadFromTriplets(input, config.partitions);
+
+            config.time = 1e30;
+            for (int r = 0; r <= repetitions; ++r) {
+                std::fill(x, x+input.row_size, 1.);
+                double start = omp_get_wtime();
+                mat->powerMethod(x, y, trial_iterations);
+                double stop = omp_get_wtime();
+                if (r > 0) config.time = std::min(config.time, (stop - start) * 1000);
+            }
+
+            delete mat;
+        };
+
+        // First round: every candidate once
+        for (TuningConfig& config : candidates) trial(config, 1);
+        std::sort(candidates.begin(), candidates.end(), [](const TuningConfig& a, const TuningConfig& b) { return a.time < b.time; });
+
+        // Second round: the best third with more repetitions
+        candidates.resize(std::max<size_t>(1, (candidates.size() + 2)/3));
+        for (TuningConfig& config : candidates) trial(config, 3);
+        std::sort(candidates.begin(), candidates.end(), [](const TuningConfig& a, const TuningConfig& b) { return a.time < b.time; });
+
+        delete[] x;
+        delete[] y;
+        return candidates.front();
+    }
+} // namespace pwm
+
+#endif // PWM_AUTOTUNER_HPP
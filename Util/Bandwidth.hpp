@@ -0,0 +1,131 @@
+/**
+ * @file Bandwidth.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief STREAM style memory bandwidth probe and roofline report
+ * @version 0.1
+ * @date 2022-11-08
+ *
+ * The sparse matrix vector product is memory bound, the attainable performance is thus the arithmetic intensity
+ * (flops per byte moved from memory) times the memory bandwidth. The bandwidth is measured with the copy (c = a)
+ * and triad (a = b + s*c) kernels of the STREAM benchmark using the same amount of threads as the method.
+ */
+
+#ifndef PWM_BANDWIDTH_HPP
+#define PWM_BANDWIDTH_HPP
+
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <sched.h>
+
+#include "omp.h"
+
+namespace pwm {
+    // Result of the bandwidth probe in GB/s
+    struct StreamResult {
+        double copy = 0.;
+        double triad = 0.;
+    };
+
+    /**
+     * @brief Measure the memory bandwidth with the STREAM copy and triad kernels
+     *
+     * The arrays are initialized by the threads which use them (first touch). When pinned is true every
+     * thread is fixed to a CPU during the probe like the pinned methods do, the original affinity is restored afterwards.
+     *
+     * @param threads Amount of threads
+     * @param pinned Pin thread i to CPU i
+     * @param elements Amount of elements of each of the three arrays (should be much larger than the last level cache)
+     * @param repetitions Amount of repetitions, the best one is reported
+     */
+    inline StreamResult measureBandwidth(int threads, bool pinned, long elements = 1 << 24, int repetitions = 5) {
+        threads = std::max(threads, 1);
+        double* a = new double[elements];
+        double* b = new double[elements];
+        double* c = new double[elements];
+
+        double copy_time = 1e30;
+        double triad_time = 1e30;
+        int cpu_count = std::thread::hardware_concurrency();
+
+        #pragma omp parallel num_threads(threads)
+        {
+            // Put the current thread on the right cpu
+            cpu_set_t old_mask;
+            if (pinned) {
+                sched_getaffinity(0, sizeof(cpu_set_t), &old_mask);
+
+                cpu_set_t mask;
+                CPU_ZERO(&mask);
+                CPU_SET(omp_get_thread_num() % cpu_count, &mask);
+                if (sched_setaffinity(0, sizeof(cpu_set_t), &mask)) {
+                    std::cout << "Error in setAffinity" << std::endl;
+                }
+            }
+
+            #pragma omp for schedule(static)
+            for (long i = 0; i < elements; ++i) {
+                a[i] = 1.;
+                b[i] = 2.;
+                c[i] = 0.;
+            }
+
+            for (int r = 0; r < repetitions; ++r) {
+                #pragma omp barrier
+                double start = omp_get_wtime();
+                #pragma omp for schedule(static)
+                for (long i = 0; i < elements; ++i) {
+                    c[i] = a[i];
+                }
+                #pragma omp single
+                copy_time = std::min(copy_time, omp_get_wtime() - start);
+
+                start = omp_get_wtime();
+                #pragma omp for schedule(static)
+                for (long i = 0; i < elements; ++i) {
+                    a[i] = b[i] + 3.*c[i];
+                }
+                #pragma omp single
+                triad_time = std::min(triad_time, omp_get_wtime() - start);
+            }
+
+            if (pinned) sched_setaffinity(0, sizeof(cpu_set_t), &old_mask);
+        }
+
+        delete[] a;
+        delete[] b;
+        delete[] c;
+
+        StreamResult result;
+        result.copy = 2.*sizeof(double)*elements / copy_time / 1e9;
+        result.triad = 3.*sizeof(double)*elements / triad_time / 1e9;
+        return result;
+    }
+
+    /**
+     * @brief Print the achieved performance against the memory roofline
+     *
+     * @param flops Floating point operations of one power method iteration
+     * @param bytes Bytes moved from memory in one power method iteration (model)
+     * @param iterations Amount of power method iterations of one execution
+     * @param time_ms Time of one execution in ms
+     * @param bandwidth Measured bandwidth (only the triad bandwidth is used if the copy bandwidth is zero)
+     */
+    inline void printRooflineReport(double flops, double bytes, int iterations, double time_ms, const StreamResult& bandwidth) {
+        double seconds = time_ms / 1000.;
+        double intensity = flops / bytes;
+        double gflops = iterations * flops / seconds / 1e9;
+        double gbs = iterations * bytes / seconds / 1e9;
+
+        std::cout << "Bytes moved per iteration (model): " << bytes / 1e6 << "MB, arithmetic intensity: " << intensity << " flop/byte" << std::endl;
+        if (bandwidth.copy > 0.) {
+            std::cout << "Stream bandwidth: copy " << bandwidth.copy << "GB/s, triad " << bandwidth.triad << "GB/s" << std::endl;
+        } else {
+            std::cout << "Given bandwidth: " << bandwidth.triad << "GB/s" << std::endl;
+        }
+        std::cout << "Achieved (median): " << gflops << "GFLOP/s, " << gbs << "GB/s, ";
+        std::cout << 100. * gbs / bandwidth.triad << "% of roofline peak (" << intensity * bandwidth.triad << "GFLOP/s)" << std::endl;
+    }
+} // namespace pwm
+
+#endif // PWM_BANDWIDTH_HPP
@@ -0,0 +1,432 @@
+/**
+ * @file Batch.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Batched power method and personalized PageRank which advance many vectors per sweep over the matrix
+ * @version 0.1
+ * @date 2022-11-21
+ *
+ * A product with one vector reads the whole matrix for 2 flops per nonzero. With a batch of B vectors stored
+ * interleaved (element i of vector b at X[i*B + b]) one sweep over the matrix computes all B products: every nonzero
+ * is multiplied with B consecutive elements, which are computed in chunks of batch_width vectors in SIMD registers.
+ * The matrix traffic per vector iteration drops by a factor B until the vectors themselves dominate.
+ *
+ * Vectors which converge are written to the output and removed from the batch, the remaining vectors are packed so
+ * later sweeps only compute the vectors which still iterate. The throughput is reported in vector iterations per
+ * second (one product of one vector).
+ */
+
+#ifndef PWM_BATCH_HPP
+#define PWM_BATCH_HPP
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <cmath>
+
+#include "../Matrix/SparseMatrix.hpp"
+#include "Memory.hpp"
+#include "Reproducible.hpp"
+
+#include "omp.h"
+
+namespace pwm {
+    // Amount of vectors of a batch which are computed together in registers (one 512-bit register of doubles)
+    constexpr int batch_width = 8;
+
+    /**
+     * @brief Products of the nonzeros of one row with W consecutive vectors of a batch
+     *
+     * @param begin First nonzero of the row
+     * @param end One past the last nonzero of the row
+     * @param X First of the W vectors of the input batch
+     * @param batch Amount of vectors of the batch (stride of X)
+     * @param y W elements of the output row
+     */
+    template<int W, typename T, typename int_type, typename nnz_type>
+    inline void batchRow(nnz_type begin, nnz_type end, const int_type* col_ind, const T* data, const T* X, int batch, T* y) {
+        T sum[W] = {};
+        for (nnz_type k = begin; k < end; ++k) {
+            const T a = data[k];
+            const T* x = X + (size_t) col_ind[k]*batch;
+
+            #pragma omp simd
+            for (int b = 0; b < W; ++b) sum[b] += a*x[b];
+        }
+
+        for (int b = 0; b < W; ++b) y[b] = sum[b];
+    }
+
+    /**
+     * @brief Batched product of a range of CRS rows, Y = AX with interleaved vectors
+     *
+     * @param first First row
+     * @param last One past the last row
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    inline void batchRows(const nnz_type* row_start, const int_type* col_ind, const T* data, const T* X, T* Y, int batch,
+                          int_type first, int_type last) {
+        for (int_type i = first; i < last; ++i) {
+            T* y = Y + (size_t) i*batch;
+            int c = 0;
+            for (; c + batch_width <= batch; c += batch_width) {
+                batchRow<batch_width>(row_start[i], row_start[i+1], col_ind, data, X + c, batch, y + c);
+            }
+            if (batch - c >= 4) {
+                batchRow<4>(row_start[i], row_start[i+1], col_ind, data, X + c, batch, y + c);
+                c += 4;
+            }
+            if (batch - c >= 2) {
+                batchRow<2>(row_start[i], row_start[i+1], col_ind, data, X + c, batch, y + c);
+                c += 2;
+            }
+            if (batch - c >= 1) {
+                batchRow<1>(row_start[i], row_start[i+1], col_ind, data, X + c, batch, y + c);
+            }
+        }
+    }
+
+    /**
+     * @brief Several sums over the rows of a matrix in one pass, using its threading model
+     *
+     * The partial sums of the ranges are added in the order of the rows, so the result does not depend on which thread
+     * finishes first. In the reproducible mode the rows are summed in fixed blocks instead (reproducibleColumnSums), so
+     * the result does not depend on the ranges either.
+     *
+     * @param mat Matrix which splits the rows
+     * @param count Amount of sums
+     * @param body Function which adds the partial sums of a range of rows to an array of count zeros
+     * @param sums Output array of count sums
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void parallelColumnSums(SparseMatrix<T, int_type, nnz_type>& mat, int count, const std::function<void(int_type, int_type, T*)>& body, T* sums) {
+        if (pwm::reproducibleMode()) {
+            pwm::reproducibleColumnSums([&mat](const std::function<void(int_type, int_type)>& range) {
+                mat.parallelFor(range);
+            }, mat.getRows(), count, body, sums);
+            return;
+        }
+
+        std::mutex lock;
+        std::vector<std::pair<int_type, std::vector<T>>> parts;
+        mat.parallelFor([&](int_type begin, int_type end) {
+            std::vector<T> part(count, 0.);
+            body(begin, end, part.data());
+
+            std::lock_guard<std::mutex> guard(lock);
+            parts.emplace_back(begin, std::move(part));
+        });
+
+        std::sort(parts.begin(), parts.end(), [](const std::pair<int_type, std::vector<T>>& a, const std::pair<int_type, std::vector<T>>& b) {
+            return a.first < b.first;
+        });
+
+        std::fill(sums, sums + count, 0.);
+        for (const auto& part : parts) {
+            for (int b = 0; b < count; ++b) sums[b] += part.second[b];
+        }
+    }
+
+    /**
+     * @brief Pack the vectors of a batch which keep iterating
+     *
+     * @param src Batch of batch vectors
+     * @param dst Batch of keep.size() vectors
+     * @param keep Slots of src which are kept, in increasing order
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void compactBatch(SparseMatrix<T, int_type, nnz_type>& mat, const T* src, T* dst, int batch, const std::vector<int>& keep) {
+        const int kept = (int) keep.size();
+        mat.parallelFor([=, &keep](int_type begin, int_type end) {
+            for (int_type i = begin; i < end; ++i) {
+                for (int s = 0; s < kept; ++s) dst[(size_t) i*kept + s] = src[(size_t) i*batch + keep[s]];
+            }
+        });
+    }
+
+    // Per vector results of a batched solver
+    template<typename T>
+    struct BatchResult {
+        // Eigenvalue (power method) of each vector
+        std::vector<T> values;
+
+        // Residual norm (power method) or L1 change (PageRank) of each vector
+        std::vector<T> residuals;
+
+        // Iterations of each vector
+        std::vector<int> iterations;
+
+        // Converged vectors
+        std::vector<bool> converged;
+
+        // Total amount of vector iterations (products of one vector)
+        long long vector_iterations = 0;
+
+        // Amount of sweeps over the matrix
+        int sweeps = 0;
+
+        // Resize for a batch
+        explicit BatchResult(int batch): values(batch, 0.), residuals(batch, 0.), iterations(batch, 0), converged(batch, false) {}
+    };
+
+    /**
+     * @brief Power method on a batch of start vectors until each residual satisfies a relative tolerance
+     *
+     * Every sweep computes the products of all active vectors, their Rayleigh quotients, residuals and norms in two
+     * passes and normalizes them in a third.
+     *
+     * @param mat Square matrix
+     * @param X Interleaved batch of start vectors, contains the normalized eigenvectors at the end
+     * @param batch Amount of vectors
+     * @param tol Relative tolerance on the residual norm |Ax - lx| <= tol*|l|
+     * @param max_it Maximal amount of iterations of a vector
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    BatchResult<T> batchPowerMethod(SparseMatrix<T, int_type, nnz_type>& mat, T* X, int batch, T tol, int max_it) {
+        const int_type n = mat.getRows();
+        BatchResult<T> result(batch);
+
+        pwm::Arena arena;
+        T* cur = arena.template allocate<T>((size_t) n*batch);
+        T* next = arena.template allocate<T>((size_t) n*batch);
+
+        std::vector<int> ids(batch);
+        for (int b = 0; b < batch; ++b) ids[b] = b;
+        int active = batch;
+        std::vector<T> sums(2*batch);
+
+        // Normalized start vectors
+        parallelColumnSums<T, int_type, nnz_type>(mat, active, [=](int_type begin, int_type end, T* part) {
+            for (int_type i = begin; i < end; ++i) {
+                for (int b = 0; b < active; ++b) part[b] += X[(size_t) i*batch + b]*X[(size_t) i*batch + b];
+            }
+        }, sums.data());
+        for (int b = 0; b < active; ++b) sums[b] = 1./std::sqrt(sums[b]);
+        const T* scale = sums.data();
+        mat.parallelFor([=](int_type begin, int_type end) {
+            for (int_type i = begin; i < end; ++i) {
+                for (int b = 0; b < active; ++b) cur[(size_t) i*active + b] = X[(size_t) i*batch + b]*scale[b];
+            }
+        });
+
+        std::vector<T> theta(batch);
+        while (active > 0) {
+            mat.mvBatch(cur, next, active);
+            result.sweeps++;
+            result.vector_iterations += active;
+
+            // Rayleigh quotients
+            parallelColumnSums<T, int_type, nnz_type>(mat, active, [=](int_type begin, int_type end, T* part) {
+                for (int_type i = begin; i < end; ++i) {
+                    for (int b = 0; b < active; ++b) part[b] += cur[(size_t) i*active + b]*next[(size_t) i*active + b];
+                }
+            }, theta.data());
+
+            // Residuals and norms of the products
+            const T* th = theta.data();
+            parallelColumnSums<T, int_type, nnz_type>(mat, 2*active, [=](int_type begin, int_type end, T* part) {
+                for (int_type i = begin; i < end; ++i) {
+                    for (int b = 0; b < active; ++b) {
+                        T y = next[(size_t) i*active + b];
+                        T r = y - th[b]*cur[(size_t) i*active + b];
+                        part[b] += r*r;
+                        part[active + b] += y*y;
+                    }
+                }
+            }, sums.data());
+
+            // Normalize the products into the iterates
+            const T* norms = sums.data() + active;
+            mat.parallelFor([=](int_type begin, int_type end) {
+                for (int_type i = begin; i < end; ++i) {
+                    for (int b = 0; b < active; ++b) cur[(size_t) i*active + b] = next[(size_t) i*active + b] / std::sqrt(norms[b]);
+                }
+            });
+
+            // Write out the converged vectors and keep the others
+            std::vector<int> keep;
+            for (int b = 0; b < active; ++b) {
+                int id = ids[b];
+                result.iterations[id]++;
+                result.values[id] = theta[b];
+                result.residuals[id] = std::sqrt(sums[b]);
+                result.converged[id] = result.residuals[id] <= tol*std::abs(theta[b]);
+                if (!result.converged[id] && result.iterations[id] < max_it) {
+                    keep.push_back(b);
+                    continue;
+                }
+
+                const T* src = cur;
+                mat.parallelFor([=](int_type begin, int_type end) {
+                    for (int_type i = begin; i < end; ++i) X[(size_t) i*batch + id] = src[(size_t) i*active + b];
+                });
+            }
+
+            if ((int) keep.size() < active) {
+                compactBatch(mat, cur, next, active, keep);
+                std::swap(cur, next);
+                for (size_t s = 0; s < keep.size(); ++s) ids[s] = ids[keep[s]];
+                active = (int) keep.size();
+            }
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Personalized PageRank for a batch of personalization vectors until each L1 change satisfies a tolerance
+     *
+     * Same iteration as pageRank, but the teleportation and the dangling mass go to the personalization vector v:
+     * x = d P x + (d m(x) + 1 - d) v.
+     *
+     * @param mat Column stochastic matrix P of the graph (see toPageRankMatrix)
+     * @param V Interleaved batch of personalization vectors (nonnegative, normalized to sum 1 here)
+     * @param X Interleaved batch of the PageRank vectors at the end
+     * @param batch Amount of vectors
+     * @param damping Damping factor d
+     * @param tol Tolerance on the L1 norm of the change of the iterate
+     * @param max_it Maximal amount of iterations of a vector
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    BatchResult<T> batchPageRank(SparseMatrix<T, int_type, nnz_type>& mat, const T* V, T* X, int batch, T damping, T tol, int max_it) {
+        const int_type n = mat.getRows();
+        BatchResult<T> result(batch);
+
+        pwm::Arena arena;
+        T* cur = arena.template allocate<T>((size_t) n*batch);
+        T* next = arena.template allocate<T>((size_t) n*batch);
+        T* pers = arena.template allocate<T>((size_t) n*batch);
+        T* pers_next = arena.template allocate<T>((size_t) n*batch);
+
+        std::vector<int> ids(batch);
+        for (int b = 0; b < batch; ++b) ids[b] = b;
+        int active = batch;
+        std::vector<T> sums(batch), change(batch);
+
+        // The iteration starts from the normalized personalization vectors
+        parallelColumnSums<T, int_type, nnz_type>(mat, active, [=](int_type begin, int_type end, T* part) {
+            for (int_type i = begin; i < end; ++i) {
+                for (int b = 0; b < active; ++b) part[b] += std::abs(V[(size_t) i*batch + b]);
+            }
+        }, sums.data());
+        const T* total = sums.data();
+        mat.parallelFor([=](int_type begin, int_type end) {
+            for (int_type i = begin; i < end; ++i) {
+                for (int b = 0; b < active; ++b) {
+                    pers[(size_t) i*active + b] = std::abs(V[(size_t) i*batch + b]) / total[b];
+                    cur[(size_t) i*active + b] = pers[(size_t) i*active + b];
+                }
+            }
+        });
+
+        while (active > 0) {
+            mat.mvBatch(cur, next, active);
+            result.sweeps++;
+            result.vector_iterations += active;
+
+            // Mass which each product kept (the rest belonged to dangling nodes)
+            parallelColumnSums<T, int_type, nnz_type>(mat, active, [=](int_type begin, int_type end, T* part) {
+                for (int_type i = begin; i < end; ++i) {
+                    for (int b = 0; b < active; ++b) part[b] += next[(size_t) i*active + b];
+                }
+            }, sums.data());
+
+            // Fused update and L1 norm of the change
+            for (int b = 0; b < active; ++b) sums[b] = damping*(1. - sums[b]) + 1. - damping;
+            const T* teleport = sums.data();
+            parallelColumnSums<T, int_type, nnz_type>(mat, active, [=](int_type begin, int_type end, T* part) {
+                for (int_type i = begin; i < end; ++i) {
+                    for (int b = 0; b < active; ++b) {
+                        size_t k = (size_t) i*active + b;
+                        T value = damping*next[k] + teleport[b]*pers[k];
+                        part[b] += std::abs(value - cur[k]);
+                        next[k] = value;
+                    }
+                }
+            }, change.data());
+            std::swap(cur, next);
+
+            // Write out the converged vectors and keep the others
+            std::vector<int> keep;
+            for (int b = 0; b < active; ++b) {
+                int id = ids[b];
+                result.iterations[id]++;
+                result.residuals[id] = change[b];
+                result.converged[id] = change[b] <= tol;
+                if (!result.converged[id] && result.iterations[id] < max_it) {
+                    keep.push_back(b);
+                    continue;
+                }
+
+                const T* src = cur;
+                mat.parallelFor([=](int_type begin, int_type end) {
+                    for (int_type i = begin; i < end; ++i) X[(size_t) i*batch + id] = src[(size_t) i*active + b];
+                });
+            }
+
+            if ((int) keep.size() < active) {
+                compactBatch(mat, cur, next, active, keep);
+                compactBatch(mat, pers, pers_next, active, keep);
+                std::swap(cur, next);
+                std::swap(pers, pers_next);
+                for (size_t s = 0; s < keep.size(); ++s) ids[s] = ids[keep[s]];
+                active = (int) keep.size();
+            }
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Compare a batch of power methods or personalized PageRanks with running the vectors one by one
+     *
+     * The power method starts from batch different vectors, PageRank is personalized to batch seed nodes spread over the
+     * graph. The vectors one by one use the same solver with a batch of one vector.
+     *
+     * @param mat Matrix (column stochastic matrix of the graph for PageRank)
+     * @param batch Amount of vectors
+     * @param pagerank Personalized PageRank instead of the power method
+     * @param damping Damping factor of PageRank
+     * @param tol Tolerance of the residual (power method) or the L1 change (PageRank)
+     * @param max_it Maximal amount of iterations of a vector
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void printBatchReport(SparseMatrix<T, int_type, nnz_type>& mat, int batch, bool pagerank, T damping, T tol, int max_it) {
+        const int_type n = mat.getRows();
+        std::vector<T> start((size_t) n*batch, 0.), X((size_t) n*batch), x(n), single(n);
+        for (int b = 0; b < batch; ++b) {
+            if (pagerank) start[(size_t) ((long long) n*b/batch)*batch + b] = 1.;
+            else for (int_type i = 0; i < n; ++i) start[(size_t) i*batch + b] = 1. + 0.5*std::sin((b + 1.)*i);
+        }
+
+        auto run = [&](const T* in, T* out, int size) {
+            if (pagerank) return pwm::batchPageRank(mat, in, out, size, damping, tol, max_it);
+            std::copy(in, in + (size_t) n*size, out);
+            return pwm::batchPowerMethod(mat, out, size, tol, max_it);
+        };
+
+        double begin = omp_get_wtime();
+        BatchResult<T> result = run(start.data(), X.data(), batch);
+        double batch_time = omp_get_wtime() - begin;
+
+        // The same vectors one by one
+        long long single_iterations = 0;
+        begin = omp_get_wtime();
+        for (int b = 0; b < batch; ++b) {
+            for (int_type i = 0; i < n; ++i) x[i] = start[(size_t) i*batch + b];
+            single_iterations += run(x.data(), single.data(), 1).vector_iterations;
+        }
+        double single_time = omp_get_wtime() - begin;
+
+        int converged = (int) std::count(result.converged.begin(), result.converged.end(), true);
+        int max_iterations = *std::max_element(result.iterations.begin(), result.iterations.end());
+        std::cout << (pagerank ? "Batched personalized PageRank (" : "Batched power method (") << batch << " vectors, tolerance " << tol << "): ";
+        std::cout << batch_time * 1000 << "ms, " << result.sweeps << " sweeps, " << result.vector_iterations << " vector iterations, ";
+        std::cout << converged << " converged, at most " << max_iterations << " iterations" << std::endl;
+        std::cout << "  " << result.vector_iterations / batch_time << " vector iterations per second batched, ";
+        std::cout << single_iterations / single_time << " one by one (speedup " << single_time/batch_time << ")" << std::endl;
+    }
+} // namespace pwm
+
+#endif // PWM_BATCH_HPP
@@ -0,0 +1,298 @@
+/**
+ * @file Benchmark.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Configuration, statistics and output of the benchmark executable
+ * @version 0.1
+ * @date 2022-11-07
+ *
+ * A configuration file contains lines of the form "key = value", lists are separated by commas and everything
+ * after a '#' is a comment. The same "key=value" pairs can be given on the command line to overwrite the file.
+ */
+
+#ifndef PWM_BENCHMARK_HPP
+#define PWM_BENCHMARK_HPP
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+
+namespace pwm {
+    /**
+     * @brief Parse a comma separated list
+     *
+     * @param value String of the form "a, b, c"
+     */
+    template<typename V>
+    std::vector<V> parseList(const std::string& value) {
+        std::vector<std::string> items;
+        boost::algorithm::split(items, value, boost::algorithm::is_any_of(","));
+
+        std::vector<V> result;
+        for (std::string& item : items) {
+            boost::algorithm::trim(item);
+            if (!item.empty()) result.push_back(boost::lexical_cast<V>(item));
+        }
+
+        return result;
+    }
+
+    // Sweep which is done by the benchmark executable
+    struct BenchmarkConfig {
+        // Input files (see driver_input for the naming of the files)
+        std::vector<std::string> matrices;
+
+        // Discretization steps of the Poisson matrices (m x m grid)
+        std::vector<int> poisson;
+
+        // Methods as numbered in the drivers
+        std::vector<int> methods = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13};
+
+        // Amount of threads for the parallel methods
+        std::vector<int> threads = {1};
+
+        // Amount of partitions for the partitioned methods, if empty partitions_per_thread is used
+        std::vector<int> partitions;
+
+        // Amount of partitions per thread for the partitioned methods
+        std::vector<int> partitions_per_thread = {2};
+
+        // Timed executions of the power method per configuration
+        int iterations = 10;
+
+        // Untimed executions of the power method per configuration
+        int warm_up = 2;
+
+        // Iterations of the power method
+        int pwm_iterations = 100;
+
+        // Amount of iterations between normalizations (1 is the standard power method)
+        int s_step = 1;
+
+        // Output files (empty for no output)
+        std::string json;
+        std::string csv;
+
+        /**
+         * @brief Set one key of the configuration
+         *
+         * @return bool False if the key is not known
+         */
+        bool set(std::string key, std::string value) {
+            boost::algorithm::trim(key);
+            boost::algorithm::trim(value);
+
+            if (key == "matrices") matrices = parseList<std::string>(value);
+            else if (key == "poisson") poisson = parseList<int>(value);
+            else if (key == "methods") methods = parseList<int>(value);
+            else if (key == "threads") threads = parseList<int>(value);
+            else if (key == "partitions") partitions = parseList<int>(value);
+            else if (key == "partitions_per_thread") partitions_per_thread = parseList<int>(value);
+            else if (key == "iterations") iterations = boost::lexical_cast<int>(value);
+            else if (key == "warm_up") warm_up = boost::lexical_cast<int>(value);
+            else if (key == "pwm_iterations") pwm_iterations = boost::lexical_cast<int>(value);
+            else if (key == "s_step") s_step = boost::lexical_cast<int>(value);
+            else if (key == "json") json = value;
+            else if (key == "csv") csv = value;
+            else return false;
+
+            return true;
+        }
+
+        /**
+         * @brief Set the configuration from a "key = value" pair
+         *
+         * @return bool False if the pair could not be parsed
+         */
+        bool setPair(const std::string& line) {
+            size_t eq = line.find('=');
+            if (eq == std::string::npos) return false;
+
+            return set(line.substr(0, eq), line.substr(eq+1));
+        }
+
+        /**
+         * @brief Read the configuration file
+         *
+         * @param filename Filename of the configuration file
+         * @return bool False if the file could not be read or contains an unknown key
+         */
+        bool loadFromFile(const std::string& filename) {
+            std::ifstream input(filename);
+            if (!input.is_open()) {
+                std::cout << "Could not open configuration file " << filename << std::endl;
+                return false;
+            }
+
+            std::string line;
+            int line_nb = 0;
+            while (std::getline(input, line)) {
+                line_nb++;
+                line = line.substr(0, line.find('#'));
+                boost::algorithm::trim(line);
+                if (line.empty()) continue;
+
+                if (!setPair(line)) {
+                    std::cout << "Could not parse line " << line_nb << " of " << filename << ": " << line << std::endl;
+                    return false;
+                }
+            }
+
+            return true;
+        }
+    };
+
+    // Statistics of the timings of one configuration (in ms)
+    struct BenchmarkStatistics {
+        double median = 0.;
+        double min = 0.;
+        double max = 0.;
+        double mean = 0.;
+        double p95 = 0.;
+        double stddev = 0.;
+
+        // Amount of timings outside of [Q1 - 1.5 IQR, Q3 + 1.5 IQR]
+        int outliers = 0;
+    };
+
+    /**
+     * @brief Percentile of a sorted vector with linear interpolation between the closest ranks
+     *
+     * @param sorted Sorted values
+     * @param p Percentile between 0 and 1
+     */
+    inline double percentile(const std::vector<double>& sorted, double p) {
+        if (sorted.empty()) return 0.;
+
+        double pos = p*(sorted.size()-1);
+        size_t lo = std::floor(pos);
+        size_t hi = std::min(lo+1, sorted.size()-1);
+        return sorted[lo] + (pos-lo)*(sorted[hi]-sorted[lo]);
+    }
+
+    /**
+     * @brief Calculate the statistics of the timings
+     *
+     * @param timings Timings of one configuration
+     */
+    inline BenchmarkStatistics computeStatistics(std::vector<double> timings) {
+        BenchmarkStatistics stats;
+        if (timings.empty()) return stats;
+
+        std::sort(timings.begin(), timings.end());
+        stats.median = percentile(timings, 0.5);
+        stats.min = timings.front();
+        stats.max = timings.back();
+        stats.p95 = percentile(timings, 0.95);
+        stats.mean = std::accumulate(timings.begin(), timings.end(), 0.)/timings.size();
+
+        double var = 0.;
+        for (double t : timings) var += (t-stats.mean)*(t-stats.mean);
+        stats.stddev = std::sqrt(var/timings.size());
+
+        double q1 = percentile(timings, 0.25);
+        double q3 = percentile(timings, 0.75);
+        double iqr = q3 - q1;
+        for (double t : timings) {
+            if (t < q1 - 1.5*iqr || t > q3 + 1.5*iqr) stats.outliers++;
+        }
+
+        return stats;
+    }
+
+    // Result of one configuration of the sweep
+    struct BenchmarkResult {
+        std::string matrix;
+        std::string method;
+        int threads = 0;
+        int partitions = 0;
+        long long nor = 0;
+        long long nnz = 0;
+        int pwm_iterations = 0;
+        double setup_time = 0.;
+        BenchmarkStatistics stats;
+
+        // Derived from the median time
+        double gflops = 0.;
+        double gbs = 0.;
+
+        // Arithmetic intensity (flops per byte) of the bytes moved model
+        double intensity = 0.;
+
+        // Measured triad bandwidth with the same amount of threads and pinning policy
+        double stream_gbs = 0.;
+
+        // Percentage of the roofline peak (arithmetic intensity times the triad bandwidth)
+        double pct_peak = 0.;
+
+        std::vector<double> timings;
+    };
+
+    /**
+     * @brief Escape a string for JSON output
+     */
+    inline std::string jsonEscape(const std::string& value) {
+        std::string result;
+        for (char c : value) {
+            if (c == '"' || c == '\\') result += '\\';
+            result += c;
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Write the results as a JSON array of configurations
+     *
+     * @param results Results of the sweep
+     * @param filename Output filename
+     */
+    inline void writeJSON(const std::vector<BenchmarkResult>& results, const std::string& filename) {
+        std::ofstream out(filename);
+        out << "[\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const BenchmarkResult& r = results[i];
+            out << "  {\"matrix\": \"" << jsonEscape(r.matrix) << "\", \"method\": \"" << r.method << "\", ";
+            out << "\"threads\": " << r.threads << ", \"partitions\": " << r.partitions << ", ";
+            out << "\"rows\": " << r.nor << ", \"nnz\": " << r.nnz << ", \"pwm_iterations\": " << r.pwm_iterations << ", ";
+            out << "\"setup_ms\": " << r.setup_time << ", ";
+            out << "\"median_ms\": " << r.stats.median << ", \"min_ms\": " << r.stats.min << ", \"max_ms\": " << r.stats.max << ", ";
+            out << "\"mean_ms\": " << r.stats.mean << ", \"p95_ms\": " << r.stats.p95 << ", \"stddev_ms\": " << r.stats.stddev << ", ";
+            out << "\"outliers\": " << r.stats.outliers << ", \"gflops\": " << r.gflops << ", \"gbs\": " << r.gbs << ", ";
+            out << "\"intensity\": " << r.intensity << ", \"stream_gbs\": " << r.stream_gbs << ", \"pct_peak\": " << r.pct_peak << ", ";
+            out << "\"timings_ms\": [";
+            for (size_t j = 0; j < r.timings.size(); ++j) {
+                out << (j > 0 ? ", " : "") << r.timings[j];
+            }
+            out << "]}" << (i+1 < results.size() ? "," : "") << "\n";
+        }
+        out << "]" << std::endl;
+    }
+
+    /**
+     * @brief Write the results as CSV with one line per configuration
+     *
+     * @param results Results of the sweep
+     * @param filename Output filename
+     */
+    inline void writeCSV(const std::vector<BenchmarkResult>& results, const std::string& filename) {
+        std::ofstream out(filename);
+        out << "matrix,method,threads,partitions,rows,nnz,pwm_iterations,setup_ms,median_ms,min_ms,max_ms,mean_ms,p95_ms,stddev_ms,outliers,gflops,gbs,intensity,stream_gbs,pct_peak" << std::endl;
+        for (const BenchmarkResult& r : results) {
+            out << r.matrix << "," << r.method << "," << r.threads << "," << r.partitions << ",";
+            out << r.nor << "," << r.nnz << "," << r.pwm_iterations << "," << r.setup_time << ",";
+            out << r.stats.median << "," << r.stats.min << "," << r.stats.max << "," << r.stats.mean << ",";
+            out << r.stats.p95 << "," << r.stats.stddev << "," << r.stats.outliers << "," << r.gflops << "," << r.gbs << ",";
+            out << r.intensity << "," << r.stream_gbs << "," << r.pct_peak << std::endl;
+        }
+    }
+} // namespace pwm
+
+#endif // PWM_BENCHMARK_HPP
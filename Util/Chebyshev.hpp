@@ -0,0 +1,221 @@
+/**
+ * @file Chebyshev.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Chebyshev accelerated and shifted power method built on the matrix vector product of the implementations
+ * @version 0.1
+ * @date 2022-11-19
+ *
+ * The power method damps every eigenvector with |l/l1| per product. A Chebyshev polynomial of degree d on the interval
+ * [a, b] of the unwanted eigenvalues stays below 1 on the interval and grows fast outside of it, so one filter of d
+ * products damps the unwanted eigenvectors with roughly exp(-d*acosh((l1-c)/e)) where c and e are the center and half
+ * width of the interval. For the Poisson matrix this is about the square root of the iterations of the power method.
+ *
+ * The filter uses the scaled three-term recurrence (Zhou and Saad), which keeps the component of the wanted eigenvector
+ * close to 1 so the iterate does not overflow. One step is a product and one fused update of three vectors, the
+ * normalization and the residual check only happen once per filter. A filter of degree 1 is the power method with the
+ * shift c. The interval is given by the user or estimated with a short Lanczos run.
+ */
+
+#ifndef PWM_CHEBYSHEV_HPP
+#define PWM_CHEBYSHEV_HPP
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include "../Matrix/SparseMatrix.hpp"
+#include "Memory.hpp"
+#include "Lanczos.hpp"
+
+#include "omp.h"
+
+namespace pwm {
+    // Spectral bounds of a symmetric matrix for the Chebyshev filter of the largest eigenvalue
+    template<typename T>
+    struct SpectralBounds {
+        // Lower bound of the spectrum (lower end of the damped interval)
+        T lower = 0.;
+
+        // Upper end of the damped interval (estimate of the second largest eigenvalue)
+        T upper = 0.;
+
+        // Estimate of the largest eigenvalue
+        T largest = 0.;
+
+        // Amount of matrix vector products of the estimate
+        int products = 0;
+    };
+
+    /**
+     * @brief Estimate the interval of the unwanted eigenvalues with a short Lanczos run
+     *
+     * The smallest Ritz value minus its residual norm is a lower bound of the spectrum, the second largest Ritz value is
+     * the upper end of the damped interval.
+     *
+     * @param mat Symmetric matrix
+     * @param start Start vector
+     * @param steps Amount of Lanczos steps (matrix vector products)
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    SpectralBounds<T> estimateSpectralBounds(SparseMatrix<T, int_type, nnz_type>& mat, const T* start, int steps) {
+        LanczosResult<T> estimate = pwm::lanczos(mat, start, 1, (T) 0., std::max(steps, 3), 0);
+
+        SpectralBounds<T> bounds;
+        size_t size = estimate.ritz_values.size();
+        bounds.lower = estimate.ritz_values[0] - estimate.ritz_residuals[0];
+        bounds.upper = estimate.ritz_values[std::max<size_t>(size, 2) - 2];
+        bounds.largest = estimate.ritz_values[size - 1];
+        bounds.products = estimate.products;
+        return bounds;
+    }
+
+    /**
+     * @brief Chebyshev accelerated power method for the largest eigenvalue of a symmetric matrix
+     *
+     * Applies filters of the given degree until the residual of the Rayleigh quotient satisfies a relative tolerance.
+     * The product of the residual check is the first step of the next filter, so a filter costs degree products.
+     *
+     * @param mat Symmetric matrix
+     * @param x Start vector, contains the eigenvector at the end
+     * @param y Vector to store calculations, contains the product with the eigenvector at the end
+     * @param lower Lower end of the damped interval (below all eigenvalues)
+     * @param upper Upper end of the damped interval (below the largest eigenvalue)
+     * @param degree Degree of the Chebyshev polynomial (1 is the power method with shift (lower+upper)/2)
+     * @param tol Relative tolerance on the residual norm
+     * @param max_it Maximal amount of matrix vector products
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    PowerResult<T> chebyshevPowerMethod(SparseMatrix<T, int_type, nnz_type>& mat, T* x, T* y, T lower, T upper, int degree,
+                                        T tol, int max_it) {
+        const int_type n = mat.getRows();
+        const T c = (upper + lower)/2.;
+        const T e = (upper - lower)/2.;
+
+        // Product of the recurrence
+        pwm::Arena arena;
+        T* w = arena.template allocate<T>(n);
+
+        PowerResult<T> result;
+
+        T norm = std::sqrt(parallelDot(mat, x, x));
+        mat.parallelFor([=](int_type begin, int_type end) {
+            for (int_type i = begin; i < end; ++i) x[i] /= norm;
+        });
+
+        mat.mv(x, y);
+        result.products++;
+
+        for (;;) {
+            T value = parallelDot(mat, x, y);
+            T residual = std::sqrt(mat.parallelSum([=](int_type begin, int_type end) -> T {
+                T sum = 0.;
+                for (int_type i = begin; i < end; ++i) sum += (y[i] - value*x[i])*(y[i] - value*x[i]);
+                return sum;
+            }));
+
+            result.value = value;
+            result.residual = residual;
+            if (residual <= tol*std::abs(value)) {
+                result.converged = true;
+                break;
+            }
+            if (result.products + degree > max_it) break;
+
+            // Scale with the estimate of the wanted eigenvalue, which has to lie above the interval
+            T target = std::max(value, upper + (T) 0.1*e);
+            T sigma1 = e/(target - c);
+            T sigma = sigma1;
+
+            // First step from the product which is already computed: Y = sigma1/e (A - cI) X
+            T* X = x;
+            T* Y = y;
+            mat.parallelFor([=](int_type begin, int_type end) {
+                for (int_type i = begin; i < end; ++i) Y[i] = sigma1/e*(Y[i] - c*X[i]);
+            });
+
+            // Scaled three-term recurrence, the new iterate overwrites X
+            for (int step = 1; step < degree; ++step) {
+                mat.mv(Y, w);
+                result.products++;
+
+                T sigma_new = 1./(2./sigma1 - sigma);
+                T alpha = 2.*sigma_new/e;
+                T beta = sigma*sigma_new;
+                mat.parallelFor([=](int_type begin, int_type end) {
+                    for (int_type i = begin; i < end; ++i) X[i] = alpha*(w[i] - c*Y[i]) - beta*X[i];
+                });
+
+                std::swap(X, Y);
+                sigma = sigma_new;
+            }
+
+            // Normalize the filtered vector into x and compute its product
+            norm = std::sqrt(parallelDot(mat, Y, Y));
+            mat.parallelFor([=](int_type begin, int_type end) {
+                for (int_type i = begin; i < end; ++i) x[i] = Y[i] / norm;
+            });
+
+            mat.mv(x, y);
+            result.products++;
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Compare the time to tolerance of the Chebyshev accelerated (or shifted) power method with the power method
+     *
+     * The estimate of the interval and both solvers start from the same random vector (reportStart).
+     *
+     * @param mat Symmetric matrix
+     * @param degree Degree of the filter (1 for the shifted power method)
+     * @param lower Lower end of the damped interval
+     * @param upper Upper end of the damped interval
+     * @param estimate Estimate the interval with a short Lanczos run instead of using lower and upper
+     * @param steps Amount of Lanczos steps of the estimate
+     * @param tol Relative tolerance on the residual norm
+     * @param max_it Maximal amount of matrix vector products of both solvers
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void printChebyshevComparison(SparseMatrix<T, int_type, nnz_type>& mat, int degree, T lower, T upper, bool estimate,
+                                  int steps, T tol, int max_it) {
+        const int_type n = mat.getRows();
+        std::vector<T> x(n), y(n);
+        pwm::reportStart(x.data(), n);
+
+        double start = omp_get_wtime();
+        int estimate_products = 0;
+        if (estimate) {
+            SpectralBounds<T> bounds = pwm::estimateSpectralBounds(mat, x.data(), steps);
+            lower = bounds.lower;
+            upper = bounds.upper;
+            estimate_products = bounds.products;
+        }
+
+        PowerResult<T> filtered = pwm::chebyshevPowerMethod(mat, x.data(), y.data(), lower, upper, degree, tol, max_it);
+        double filtered_time = (omp_get_wtime() - start) * 1000;
+
+        if (degree == 1) std::cout << "Shifted power method (shift " << (lower + upper)/2. << ")";
+        else std::cout << "Chebyshev power method (degree " << degree << ", interval [" << lower << ", " << upper << "])";
+        std::cout << ": " << filtered_time << "ms, " << filtered.products + estimate_products << " products";
+        if (estimate) std::cout << " (" << estimate_products << " for the Lanczos estimate of the interval)";
+        std::cout << (filtered.converged ? "" : " (not converged)") << std::endl;
+        std::cout << "  eigenvalue " << filtered.value << ", residual " << filtered.residual << std::endl;
+
+        pwm::reportStart(x.data(), n);
+        start = omp_get_wtime();
+        PowerResult<T> power_result = pwm::powerMethodTolerance(mat, x.data(), y.data(), tol, max_it);
+        double power_time = (omp_get_wtime() - start) * 1000;
+
+        std::cout << "Power method (tolerance " << tol << "): " << power_time << "ms, " << power_result.products << " products";
+        std::cout << (power_result.converged ? "" : " (not converged)") << std::endl;
+        std::cout << "  eigenvalue " << power_result.value << ", residual " << power_result.residual << std::endl;
+
+        if (filtered.converged && power_result.converged) {
+            std::cout << "Speedup to tolerance over the power method: " << power_time/filtered_time << std::endl;
+        }
+    }
+} // namespace pwm
+
+#endif // PWM_CHEBYSHEV_HPP
@@ -0,0 +1,330 @@
+/**
+ * @file Checkpoint.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Checkpoints of long power method runs, written by a background thread
+ * @version 0.1
+ * @date 2022-11-26
+ *
+ * A checkpoint holds the iterate (or the slice of the rows of one MPI process), the amount of iterations done and the
+ * norm of every iteration (convergence history). The file is a small header followed by the raw arrays, it is written
+ * to a temporary file which replaces the previous checkpoint only when it is complete.
+ *
+ * The iteration copies the iterate into the back buffer of a double buffer and continues, the writer thread writes
+ * the front buffer. If the writer is still busy at the next snapshot the waiting snapshot is replaced by the newer one,
+ * so the iteration never waits for the disk.
+ */
+
+#ifndef PWM_CHECKPOINT_HPP
+#define PWM_CHECKPOINT_HPP
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "../Matrix/SparseMatrix.hpp"
+#include "Lanczos.hpp"
+
+#include "omp.h"
+
+namespace pwm {
+    // Header of a checkpoint file
+    struct CheckpointHeader {
+        char magic[4] = {'P', 'W', 'M', 'C'};
+        int32_t version = 1;
+
+        // Bytes of one element (checkpoints of float and double are not mixed)
+        int32_t element_bytes = 0;
+
+        // Rows in the file, first row of the slice and rows of the whole vector
+        int64_t rows = 0;
+        int64_t first_row = 0;
+        int64_t total_rows = 0;
+
+        // Amount of iterations done and length of the convergence history
+        int64_t iteration = 0;
+        int64_t history = 0;
+    };
+
+    // State of a power method run in a checkpoint
+    template<typename T>
+    struct CheckpointState {
+        // First row of the slice and rows of the whole vector
+        long long first_row = 0;
+        long long total_rows = 0;
+
+        // Amount of iterations done
+        long long iteration = 0;
+
+        // Iterate (rows of the slice)
+        std::vector<T> x;
+
+        // Norm of the product of every iteration
+        std::vector<T> history;
+    };
+
+    /**
+     * @brief Write a checkpoint, the previous checkpoint in the file is replaced only when the new one is complete
+     *
+     * @return bool The checkpoint was written
+     */
+    template<typename T>
+    bool writeCheckpoint(const std::string& path, const CheckpointState<T>& state) {
+        CheckpointHeader header;
+        header.element_bytes = sizeof(T);
+        header.rows = state.x.size();
+        header.first_row = state.first_row;
+        header.total_rows = state.total_rows;
+        header.iteration = state.iteration;
+        header.history = state.history.size();
+
+        std::string temporary = path + ".tmp";
+        std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+        if (!output.is_open()) return false;
+
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        output.write(reinterpret_cast<const char*>(state.x.data()), state.x.size()*sizeof(T));
+        output.write(reinterpret_cast<const char*>(state.history.data()), state.history.size()*sizeof(T));
+        output.close();
+        if (!output.good()) return false;
+
+        return std::rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+    /**
+     * @brief Read a checkpoint
+     *
+     * @return bool The file is a complete checkpoint with elements of type T
+     */
+    template<typename T>
+    bool readCheckpoint(const std::string& path, CheckpointState<T>& state) {
+        std::ifstream input(path, std::ios::binary);
+        if (!input.is_open()) return false;
+
+        CheckpointHeader header, expected;
+        input.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!input.good() || std::memcmp(header.magic, expected.magic, 4) != 0 || header.version != expected.version
+            || header.element_bytes != (int32_t) sizeof(T) || header.rows < 0 || header.history < 0) {
+            return false;
+        }
+
+        state.first_row = header.first_row;
+        state.total_rows = header.total_rows;
+        state.iteration = header.iteration;
+        state.x.resize(header.rows);
+        state.history.resize(header.history);
+        input.read(reinterpret_cast<char*>(state.x.data()), state.x.size()*sizeof(T));
+        input.read(reinterpret_cast<char*>(state.history.data()), state.history.size()*sizeof(T));
+
+        return input.good();
+    }
+
+    template<typename T>
+    class AsyncCheckpointer {
+        protected:
+            // File of the checkpoints
+            std::string path;
+
+            // Double buffer: the iteration fills buffers[back], the writer writes the other one
+            CheckpointState<T> buffers[2];
+            int back = 0;
+
+            // A snapshot waits in the back buffer, the writer has to stop
+            bool pending = false;
+            bool stopping = false;
+
+            std::mutex lock;
+            std::condition_variable wake;
+            std::thread writer;
+
+            // Statistics: written checkpoints, snapshots replaced before they were written, failed writes, write time in ms
+            size_t written = 0;
+            size_t replaced = 0;
+            size_t failed = 0;
+            double write_time = 0.;
+
+            // Write the waiting snapshots until finish is called
+            void run() {
+                std::unique_lock<std::mutex> guard(lock);
+                while (true) {
+                    wake.wait(guard, [this]() { return pending || stopping; });
+                    if (!pending) break;
+
+                    int front = back;
+                    back = 1 - back;
+                    pending = false;
+
+                    guard.unlock();
+                    double start = omp_get_wtime();
+                    bool success = writeCheckpoint(path, buffers[front]);
+                    double time = (omp_get_wtime() - start) * 1000;
+                    guard.lock();
+
+                    write_time += time;
+                    if (success) written++;
+                    else failed++;
+                }
+            }
+
+        public:
+            /**
+             * @brief Start the writer thread
+             *
+             * @param path File of the checkpoints
+             */
+            AsyncCheckpointer(const std::string& path): path(path) {
+                writer = std::thread(&AsyncCheckpointer::run, this);
+            }
+
+            // The checkpointer owns a thread
+            AsyncCheckpointer(const AsyncCheckpointer&) = delete;
+            AsyncCheckpointer& operator=(const AsyncCheckpointer&) = delete;
+
+            // Destructor, writes the waiting snapshot
+            ~AsyncCheckpointer() {
+                finish();
+            }
+
+            /**
+             * @brief Copy the state into the back buffer and wake the writer
+             *
+             * @param x Iterate (rows of the slice)
+             * @param rows Rows of the slice
+             * @param first_row First row of the slice
+             * @param total_rows Rows of the whole vector
+             * @param iteration Amount of iterations done
+             * @param history Norm of the product of every iteration
+             */
+            void snapshot(const T* x, long long rows, long long first_row, long long total_rows, long long iteration,
+                          const std::vector<T>& history) {
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (pending) replaced++;
+
+                    CheckpointState<T>& state = buffers[back];
+                    state.first_row = first_row;
+                    state.total_rows = total_rows;
+                    state.iteration = iteration;
+                    state.x.assign(x, x + rows);
+                    state.history = history;
+                    pending = true;
+                }
+
+                wake.notify_one();
+            }
+
+            // Write the waiting snapshot and stop the writer thread
+            void finish() {
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    stopping = true;
+                }
+
+                wake.notify_one();
+                if (writer.joinable()) writer.join();
+            }
+
+            // Written checkpoints
+            size_t checkpoints() const { return written; }
+
+            // Snapshots which were replaced by a newer one before they were written
+            size_t replacedSnapshots() const { return replaced; }
+
+            // Failed writes
+            size_t failures() const { return failed; }
+
+            // Time of the writer thread in ms
+            double writeTime() const { return write_time; }
+    };
+
+    /**
+     * @brief Power method which takes a snapshot every few iterations, x holds the normalized iterate at the end
+     *
+     * @param mat Square matrix
+     * @param x Start vector (or the iterate of a checkpoint), contains the result at the end
+     * @param y Vector to store calculations
+     * @param it Amount of iterations, including the iterations before first_iteration
+     * @param every Amount of iterations between two snapshots
+     * @param checkpointer Writer of the snapshots (NULL for none)
+     * @param first_iteration Amount of iterations which were already done (0 without checkpoint)
+     * @param history Norm of the product of every iteration, extended by this run
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void checkpointedPowerMethod(SparseMatrix<T, int_type, nnz_type>& mat, T* x, T* y, int it, int every,
+                                 AsyncCheckpointer<T>* checkpointer, int first_iteration, std::vector<T>& history) {
+        const int_type n = mat.getRows();
+
+        for (int iteration = first_iteration; iteration < it; ++iteration) {
+            mat.mv(x, y);
+            T norm = std::sqrt(parallelDot(mat, y, y));
+            mat.parallelFor([=](int_type begin, int_type end) {
+                for (int_type i = begin; i < end; ++i) x[i] = y[i] / norm;
+            });
+            history.push_back(norm);
+
+            if (checkpointer != NULL && ((iteration + 1) % every == 0 || iteration + 1 == it)) {
+                checkpointer->snapshot(x, n, 0, n, iteration + 1, history);
+            }
+        }
+    }
+
+    /**
+     * @brief Run the power method with checkpoints (optionally resumed from the checkpoint file) and compare the time
+     * with the same iterations without checkpoints
+     *
+     * @param mat Square matrix
+     * @param it Amount of iterations
+     * @param path File of the checkpoints
+     * @param every Amount of iterations between two checkpoints
+     * @param resume Continue from the checkpoint in the file
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void printCheckpointReport(SparseMatrix<T, int_type, nnz_type>& mat, int it, const std::string& path, int every, bool resume) {
+        const int_type n = mat.getRows();
+        std::vector<T> x(n, 1.), y(n);
+        std::vector<T> history;
+        int first_iteration = 0;
+
+        if (resume) {
+            CheckpointState<T> state;
+            if (!readCheckpoint(path, state) || state.total_rows != n || (long long) state.x.size() != n) {
+                std::cout << "No checkpoint of this matrix in " << path << ", starting from x = 1" << std::endl;
+            } else {
+                std::copy(state.x.begin(), state.x.end(), x.begin());
+                history = state.history;
+                first_iteration = (int) state.iteration;
+                std::cout << "Resumed from iteration " << first_iteration << " of " << path << std::endl;
+            }
+        }
+        std::vector<T> start_x = x;
+        std::vector<T> start_history = history;
+
+        double start = omp_get_wtime();
+        AsyncCheckpointer<T> checkpointer(path);
+        pwm::checkpointedPowerMethod(mat, x.data(), y.data(), it, every, &checkpointer, first_iteration, history);
+        double time = (omp_get_wtime() - start) * 1000;
+        checkpointer.finish();
+
+        start = omp_get_wtime();
+        pwm::checkpointedPowerMethod<T, int_type, nnz_type>(mat, start_x.data(), y.data(), it, every, NULL, first_iteration, start_history);
+        double plain_time = (omp_get_wtime() - start) * 1000;
+
+        std::cout << "Checkpointed power method (iterations " << first_iteration << " until " << it << ", every " << every << "): ";
+        std::cout << time << "ms, without checkpoints " << plain_time << "ms (overhead " << (time/plain_time - 1.)*100 << "%)" << std::endl;
+        std::cout << "  " << checkpointer.checkpoints() << " checkpoints written to " << path << " in the background (" << checkpointer.writeTime();
+        std::cout << "ms), " << checkpointer.replacedSnapshots() << " snapshots replaced by a newer one";
+        if (checkpointer.failures() > 0) std::cout << ", " << checkpointer.failures() << " writes failed";
+        std::cout << std::endl;
+        if (!history.empty()) std::cout << "  eigenvalue estimate " << history.back() << std::endl;
+    }
+} // namespace pwm
+
+#endif // PWM_CHECKPOINT_HPP
@@ -0,0 +1,217 @@
+/**
+ * @file Deflation.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Power method with deflation which computes the k eigenpairs of largest magnitude one after the other
+ * @version 0.1
+ * @date 2022-11-22
+ *
+ * After eigenpair (l_i, v_i) has converged the power method continues on a matrix without it:
+ *  - Hotelling deflation: A - sum l_i v_i v_i^T (for a symmetric matrix this is Wielandt deflation with u_i = v_i)
+ *  - Projection: (I - VV^T) A, the product is projected on the complement of the found eigenvectors
+ * The deflated matrix is never formed, the correction is applied to the product in every iteration.
+ *
+ * The found eigenvectors are stored interleaved (element r of vector i at V[r*k + i]) such that one pass over the rows
+ * computes the dot products with all of them (blocked instead of one pass per vector). One iteration is the product,
+ * one pass with the dot products of x and Ax with the found vectors, one fused pass which applies the correction and
+ * computes the residual and the norm, and the normalization. The passes use the parallel loops of the matrix.
+ */
+
+#ifndef PWM_DEFLATION_HPP
+#define PWM_DEFLATION_HPP
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include "../Matrix/SparseMatrix.hpp"
+#include "Memory.hpp"
+#include "Lanczos.hpp"
+#include "Batch.hpp"
+
+#include "omp.h"
+
+namespace pwm {
+    // Deflation method
+    enum class Deflation {
+        hotelling,
+        projection
+    };
+
+    // Eigenpairs computed with deflation
+    template<typename T>
+    struct DeflationResult {
+        // Eigenvalues in the order they were found
+        std::vector<T> values;
+
+        // Eigenvectors, vector i starts at element i*rows
+        std::vector<T> vectors;
+
+        // Residual norm |Av - lv| of each eigenpair for the deflated matrix
+        std::vector<T> residuals;
+
+        // Iterations of each eigenpair
+        std::vector<int> iterations;
+
+        // Time of each eigenpair in ms
+        std::vector<double> times;
+
+        // Converged eigenpairs
+        std::vector<bool> converged;
+    };
+
+    /**
+     * @brief Power method with deflation until the residual of each eigenpair satisfies a relative tolerance
+     *
+     * @param mat Symmetric matrix
+     * @param start Start vectors, eigenpair i starts from start + i*stride
+     * @param k Amount of eigenpairs
+     * @param method Hotelling deflation or projection
+     * @param tol Relative tolerance on the residual norm
+     * @param max_it Maximal amount of iterations of one eigenpair
+     * @param stride Distance between the start vectors of two eigenpairs (0 for the same start vector)
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    DeflationResult<T> deflatedPowerMethod(SparseMatrix<T, int_type, nnz_type>& mat, const T* start, int k, Deflation method,
+                                           T tol, int max_it, size_t stride = 0) {
+        const int_type n = mat.getRows();
+        DeflationResult<T> result;
+
+        pwm::Arena arena;
+        T* V = arena.template allocate<T>((size_t) n*k);
+        T* x = arena.template allocate<T>(n);
+        T* y = arena.template allocate<T>(n);
+
+        // Dot products with the found vectors: x.v_i at i, Ax.v_i at found + i, x.Ax at 2*found
+        std::vector<T> dots(2*k + 1), coef(k);
+
+        for (int found = 0; found < k; ++found) {
+            double begin_time = omp_get_wtime();
+
+            const T* first = start + found*stride;
+            T norm = std::sqrt(parallelDot(mat, first, first));
+            mat.parallelFor([=](int_type begin, int_type end) {
+                for (int_type i = begin; i < end; ++i) x[i] = first[i] / norm;
+            });
+
+            T value = 0., residual = 0.;
+            int it = 0;
+            bool converged = false;
+            while (it < max_it) {
+                mat.mv(x, y);
+                it++;
+
+                // Blocked dot products with all found vectors in one pass
+                parallelColumnSums<T, int_type, nnz_type>(mat, 2*found + 1, [=](int_type begin, int_type end, T* part) {
+                    for (int_type r = begin; r < end; ++r) {
+                        const T* v = V + (size_t) r*k;
+                        for (int i = 0; i < found; ++i) {
+                            part[i] += v[i]*x[r];
+                            part[found + i] += v[i]*y[r];
+                        }
+                        part[2*found] += x[r]*y[r];
+                    }
+                }, dots.data());
+
+                // Coefficients of the correction y -= sum coef_i v_i and the Rayleigh quotient x.(deflated y)
+                value = dots[2*found];
+                for (int i = 0; i < found; ++i) {
+                    coef[i] = method == Deflation::hotelling ? result.values[i]*dots[i] : dots[found + i];
+                    value -= coef[i]*dots[i];
+                }
+
+                // Fused correction, residual and norm of the corrected product
+                const T* c = coef.data();
+                const T theta = value;
+                T sums[2];
+                parallelColumnSums<T, int_type, nnz_type>(mat, 2, [=](int_type begin, int_type end, T* part) {
+                    for (int_type r = begin; r < end; ++r) {
+                        const T* v = V + (size_t) r*k;
+                        T corrected = y[r];
+                        for (int i = 0; i < found; ++i) corrected -= c[i]*v[i];
+                        y[r] = corrected;
+                        part[0] += (corrected - theta*x[r])*(corrected - theta*x[r]);
+                        part[1] += corrected*corrected;
+                    }
+                }, sums);
+                residual = std::sqrt(sums[0]);
+                norm = std::sqrt(sums[1]);
+
+                if (residual <= tol*std::abs(value)) converged = true;
+
+                mat.parallelFor([=](int_type begin, int_type end) {
+                    for (int_type r = begin; r < end; ++r) x[r] = y[r] / norm;
+                });
+
+                if (converged) break;
+            }
+
+            // Store the eigenvector, projected on the complement of the found vectors
+            parallelColumnSums<T, int_type, nnz_type>(mat, found, [=](int_type begin, int_type end, T* part) {
+                for (int_type r = begin; r < end; ++r) {
+                    for (int i = 0; i < found; ++i) part[i] += V[(size_t) r*k + i]*x[r];
+                }
+            }, dots.data());
+            const T* d = dots.data();
+            mat.parallelFor([=](int_type begin, int_type end) {
+                for (int_type r = begin; r < end; ++r) {
+                    T value_r = x[r];
+                    for (int i = 0; i < found; ++i) value_r -= d[i]*V[(size_t) r*k + i];
+                    V[(size_t) r*k + found] = value_r;
+                }
+            });
+            norm = std::sqrt(mat.parallelSum([=](int_type begin, int_type end) -> T {
+                T sum = 0.;
+                for (int_type r = begin; r < end; ++r) sum += V[(size_t) r*k + found]*V[(size_t) r*k + found];
+                return sum;
+            }));
+            mat.parallelFor([=](int_type begin, int_type end) {
+                for (int_type r = begin; r < end; ++r) V[(size_t) r*k + found] /= norm;
+            });
+
+            result.values.push_back(value);
+            result.residuals.push_back(residual);
+            result.iterations.push_back(it);
+            result.converged.push_back(converged);
+            result.times.push_back((omp_get_wtime() - begin_time) * 1000);
+        }
+
+        result.vectors.resize((size_t) k*n);
+        for (int i = 0; i < k; ++i) {
+            for (int_type r = 0; r < n; ++r) result.vectors[(size_t) i*n + r] = V[(size_t) r*k + i];
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Compute k eigenpairs with deflation and print the convergence of each pair
+     *
+     * @param mat Symmetric matrix
+     * @param k Amount of eigenpairs
+     * @param mode Deflation method: hotelling or projection
+     * @param tol Relative tolerance on the residual norm
+     * @param max_it Maximal amount of iterations of one eigenpair
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void printDeflationReport(SparseMatrix<T, int_type, nnz_type>& mat, int k, const std::string& mode, T tol, int max_it) {
+        const int_type n = mat.getRows();
+        Deflation method = mode == "projection" ? Deflation::projection : Deflation::hotelling;
+
+        // A seeded random start vector for every eigenpair (x = 1 is orthogonal to the dominant Poisson eigenvectors)
+        std::vector<T> start((size_t) k*n);
+        for (int i = 0; i < k; ++i) pwm::randomStart(start.data() + (size_t) i*n, n, i + 1);
+
+        DeflationResult<T> result = pwm::deflatedPowerMethod(mat, start.data(), k, method, tol, max_it, (size_t) n);
+
+        std::cout << "Deflation (" << (method == Deflation::projection ? "projection" : "hotelling") << ", " << k;
+        std::cout << " eigenpairs, tolerance " << tol << "):" << std::endl;
+        for (int i = 0; i < k; ++i) {
+            std::cout << "  eigenvalue " << result.values[i] << ", residual " << result.residuals[i] << ", " << result.iterations[i];
+            std::cout << " iterations, " << result.times[i] << "ms" << (result.converged[i] ? "" : " (not converged)") << std::endl;
+        }
+    }
+} // namespace pwm
+
+#endif // PWM_DEFLATION_HPP
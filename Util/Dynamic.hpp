@@ -0,0 +1,223 @@
+/**
+ * @file Dynamic.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Warm started power method after a batch of edge updates of the matrix
+ * @version 0.1
+ * @date 2022-11-25
+ *
+ * A small change of the matrix moves the dominant eigenvector only a little, so the power method started from the
+ * eigenvector of the previous matrix needs far fewer iterations to reach the tolerance than a start from x = 1.
+ * The updates are applied in place by the implementations with a dynamic structure (insertEdges and removeEdges)
+ * instead of building the matrix again from triplets.
+ */
+
+#ifndef PWM_DYNAMIC_HPP
+#define PWM_DYNAMIC_HPP
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <tuple>
+
+#include "../Matrix/SparseMatrix.hpp"
+#include "Lanczos.hpp"
+
+#include "omp.h"
+
+namespace pwm {
+    // Batch of edge updates of a matrix
+    template<typename T, typename int_type>
+    struct EdgeUpdates {
+        // Inserted edges
+        std::vector<int_type> insert_rows;
+        std::vector<int_type> insert_cols;
+        std::vector<T> insert_values;
+
+        // Removed edges
+        std::vector<int_type> remove_rows;
+        std::vector<int_type> remove_cols;
+    };
+
+    // Edges which changed the structure when a batch was applied
+    template<typename nnz_type>
+    struct EdgeUpdateCounts {
+        // Removed edges (edges which were not in the matrix are not counted)
+        nnz_type removed = 0;
+
+        // Inserted edges (edges which overwrite the value of an existing edge are not counted)
+        nnz_type inserted = 0;
+    };
+
+    /**
+     * @brief Check if the matrix is symmetric using its CRS arrays (free slots with a zero are skipped)
+     *
+     * @param mat Square matrix with CRS arrays
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    bool isSymmetric(SparseMatrix<T, int_type, nnz_type>& mat) {
+        const std::vector<CRSPart<T, int_type, nnz_type>> parts = mat.rowArrays();
+        if (parts.empty()) throw std::runtime_error("The symmetry check needs the CRS arrays of the matrix");
+
+        // The entries and the transposed entries sorted on row and column must be the same
+        std::vector<std::tuple<int_type, int_type, T>> entries, transposed;
+        for (const CRSPart<T, int_type, nnz_type>& part : parts) {
+            for (int_type i = 0; i < part.rows; ++i) {
+                for (nnz_type k = part.row_start[i]; k < part.row_start[i+1]; ++k) {
+                    if (part.data[k] == 0.) continue;
+                    entries.emplace_back(part.first_row + i, part.col_ind[k], part.data[k]);
+                    transposed.emplace_back(part.col_ind[k], part.first_row + i, part.data[k]);
+                }
+            }
+        }
+
+        std::sort(entries.begin(), entries.end());
+        std::sort(transposed.begin(), transposed.end());
+        return entries == transposed;
+    }
+
+    /**
+     * @brief Random batch of updates: count removed edges of the matrix and count inserted edges with the value of an
+     * edge of the matrix. For a symmetric matrix every edge comes with its mirrored edge, so the matrix stays symmetric.
+     *
+     * @param mat Square matrix with CRS arrays
+     * @param count Amount of removed and of inserted edges
+     * @param seed Seed of the random generator
+     * @param symmetric Add the mirrored edge (j, i) of every edge (i, j) off the diagonal
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    EdgeUpdates<T, int_type> randomEdgeUpdates(SparseMatrix<T, int_type, nnz_type>& mat, int count, unsigned seed, bool symmetric) {
+        const std::vector<CRSPart<T, int_type, nnz_type>> parts = mat.rowArrays();
+        if (parts.empty()) throw std::runtime_error("Random edge updates need the CRS arrays of the matrix");
+
+        const int_type n = mat.getRows();
+        std::mt19937 gen(seed);
+        std::uniform_int_distribution<size_t> part_dist(0, parts.size() - 1);
+        std::uniform_int_distribution<int_type> node_dist(0, n - 1);
+
+        // Random edge of the matrix (free slots of a dynamic structure hold a zero and are skipped)
+        auto randomEdge = [&](int_type& row, int_type& col, T& value) {
+            for (int attempt = 0; attempt < 1000; ++attempt) {
+                const CRSPart<T, int_type, nnz_type>& part = parts[part_dist(gen)];
+                if (part.rows == 0) continue;
+
+                int_type i = std::uniform_int_distribution<int_type>(0, part.rows - 1)(gen);
+                nnz_type begin = part.row_start[i], end = part.row_start[i+1];
+                if (begin == end) continue;
+
+                nnz_type k = std::uniform_int_distribution<nnz_type>(begin, end - 1)(gen);
+                if (part.data[k] == 0.) continue;
+
+                row = part.first_row + i;
+                col = part.col_ind[k];
+                value = part.data[k];
+                return true;
+            }
+
+            return false;
+        };
+
+        EdgeUpdates<T, int_type> updates;
+        int_type row, col;
+        T value;
+        for (int u = 0; u < count; ++u) {
+            if (!randomEdge(row, col, value)) break;
+            updates.remove_rows.push_back(row);
+            updates.remove_cols.push_back(col);
+            if (symmetric && row != col) {
+                updates.remove_rows.push_back(col);
+                updates.remove_cols.push_back(row);
+            }
+
+            // New edge between random nodes with the value of a random edge
+            if (!randomEdge(row, col, value)) break;
+            row = node_dist(gen);
+            col = node_dist(gen);
+            updates.insert_rows.push_back(row);
+            updates.insert_cols.push_back(col);
+            updates.insert_values.push_back(value);
+            if (symmetric && row != col) {
+                updates.insert_rows.push_back(col);
+                updates.insert_cols.push_back(row);
+                updates.insert_values.push_back(value);
+            }
+        }
+
+        return updates;
+    }
+
+    /**
+     * @brief Apply a batch of updates: the removals first, then the insertions
+     *
+     * @return EdgeUpdateCounts The edges which were actually removed and inserted
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    EdgeUpdateCounts<nnz_type> applyEdgeUpdates(SparseMatrix<T, int_type, nnz_type>& mat, const EdgeUpdates<T, int_type>& updates) {
+        EdgeUpdateCounts<nnz_type> counts;
+        nnz_type before = mat.getNonzeros();
+        mat.removeEdges(updates.remove_rows.data(), updates.remove_cols.data(), updates.remove_rows.size());
+        counts.removed = before - mat.getNonzeros();
+
+        before = mat.getNonzeros();
+        mat.insertEdges(updates.insert_rows.data(), updates.insert_cols.data(), updates.insert_values.data(), updates.insert_rows.size());
+        counts.inserted = mat.getNonzeros() - before;
+
+        return counts;
+    }
+
+    /**
+     * @brief Update random edges of the matrix and compare the power method to tolerance started from the previous
+     * eigenvector with a start from a random vector
+     *
+     * The eigenvector before the updates and the cold start use the same seeded random start (reportStart), x = 1 can be
+     * orthogonal to the dominant eigenvector (e.g. the Poisson matrix with an even m).
+     *
+     * @param mat Square matrix with a dynamic structure
+     * @param count Amount of removed and of inserted edges (each with its mirrored edge)
+     * @param tol Relative tolerance on the residual norm
+     * @param max_it Maximal amount of iterations of each power method
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void printUpdateReport(SparseMatrix<T, int_type, nnz_type>& mat, int count, T tol, int max_it) {
+        const int_type n = mat.getRows();
+        std::vector<T> x(n), y(n);
+        pwm::reportStart(x.data(), n);
+
+        // Eigenvector of the matrix before the updates
+        PowerResult<T> before = pwm::powerMethodTolerance(mat, x.data(), y.data(), tol, max_it);
+        std::vector<T> previous = x;
+
+        bool symmetric = pwm::isSymmetric(mat);
+        EdgeUpdates<T, int_type> updates = pwm::randomEdgeUpdates(mat, count, 1, symmetric);
+        nnz_type nonzeros = mat.getNonzeros();
+        nnz_type stored = mat.storedEntries();
+
+        double start = omp_get_wtime();
+        EdgeUpdateCounts<nnz_type> counts = pwm::applyEdgeUpdates(mat, updates);
+        double update_time = (omp_get_wtime() - start) * 1000;
+
+        std::cout << "Edge updates (" << (symmetric ? "symmetric, " : "") << counts.removed << " of " << updates.remove_rows.size();
+        std::cout << " removed, " << counts.inserted << " of " << updates.insert_rows.size() << " inserted): ";
+        std::cout << update_time << "ms, nonzeros " << nonzeros << " -> " << mat.getNonzeros() << ", stored entries " << stored;
+        std::cout << " -> " << mat.storedEntries() << std::endl;
+
+        pwm::reportStart(x.data(), n);
+        start = omp_get_wtime();
+        PowerResult<T> cold = pwm::powerMethodTolerance(mat, x.data(), y.data(), tol, max_it);
+        double cold_time = (omp_get_wtime() - start) * 1000;
+
+        start = omp_get_wtime();
+        PowerResult<T> warm = pwm::powerMethodTolerance(mat, previous.data(), y.data(), tol, max_it);
+        double warm_time = (omp_get_wtime() - start) * 1000;
+
+        std::cout << "Power method after the updates (tolerance " << tol << ", eigenvalue before " << before.value << "):" << std::endl;
+        std::cout << "  start from a random vector: " << cold_time << "ms, " << cold.products << " products, eigenvalue " << cold.value;
+        std::cout << (cold.converged ? "" : " (not converged)") << std::endl;
+        std::cout << "  warm start from the previous eigenvector: " << warm_time << "ms, " << warm.products << " products, eigenvalue ";
+        std::cout << warm.value << (warm.converged ? "" : " (not converged)") << std::endl;
+        std::cout << "  warm start speedup: " << cold_time/warm_time << " (" << (double) cold.products/warm.products << "x fewer products)" << std::endl;
+    }
+} // namespace pwm
+
+#endif // PWM_DYNAMIC_HPP
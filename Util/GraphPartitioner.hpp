@@ -0,0 +1,511 @@
+/**
+ * @file GraphPartitioner.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Multilevel graph partitioner to minimize the edge cut of a row partitioning
+ * @version 0.1
+ * @date 2022-11-02
+ *
+ * The rows of the matrix are seen as vertices of the (symmetrized) adjacency graph of the matrix.
+ * The partitioner follows the classic multilevel scheme:
+ *   1) Coarsening using heavy-edge matching
+ *   2) Greedy graph growing partition of the coarsest graph
+ *   3) Uncoarsening with Fiduccia-Mattheyses style k-way boundary refinement on every level
+ *
+ * Vertices are weighted with the amount of nonzeros in their row such that the work per partition is balanced.
+ * The output is a row permutation which makes every partition a contiguous block of rows and the partition boundaries.
+ */
+
+#ifndef PWM_GRAPHPARTITIONER_HPP
+#define PWM_GRAPHPARTITIONER_HPP
+
+#include <vector>
+#include <deque>
+#include <queue>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <iostream>
+#include <cassert>
+
+namespace pwm {
+    template<typename int_type, typename nnz_type = int_type>
+    class GraphPartitioner {
+        protected:
+            // Undirected weighted graph, neighbours of v are adjncy[xadj[v]] until adjncy[xadj[v+1]-1]
+            struct Graph {
+                std::vector<nnz_type> xadj;
+                std::vector<int_type> adjncy;
+                std::vector<int_type> adjwgt;
+                std::vector<nnz_type> vwgt;
+
+                int_type nvtxs() const { return xadj.size() - 1; }
+            };
+
+            // Graph of the input matrix
+            Graph graph;
+
+            // Amount of partitions
+            int parts;
+
+            // Allowed relative imbalance of the partition weights
+            double imbalance;
+
+            // Random number generator for the matching order (fixed seed to get the same partition on every MPI process)
+            std::mt19937 gen;
+
+        public:
+            // Partition of each row of the input matrix
+            std::vector<int> part;
+
+            // Row permutation: new row i is old row perm[i]
+            std::vector<int_type> perm;
+
+            // Inverse row permutation: old row i is new row iperm[i]
+            std::vector<int_type> iperm;
+
+            // Partition boundaries in the permuted matrix: partition i has rows bounds[i] until bounds[i+1]-1
+            std::vector<int_type> bounds;
+
+            // Base constructor
+            GraphPartitioner(double imbalance = 0.03): parts(1), imbalance(imbalance), gen(747846) {}
+
+            /**
+             * @brief Build the adjacency graph from a matrix in Triplet format
+             *
+             * @param row_coord Array of row coordinates of Triplet format
+             * @param col_coord Array of column coordinates of Triplet format
+             * @param nnz Number of nonzeros in matrix
+             * @param nor Number of rows (and columns) of the matrix
+             */
+            void loadFromTriplets(const int_type* row_coord, const int_type* col_coord, nnz_type nnz, int_type nor) {
+                std::vector<std::pair<int_type, int_type>> edges;
+                edges.reserve(2*nnz);
+
+                graph.vwgt.assign(nor, 1);
+                for (nnz_type k = 0; k < nnz; ++k) {
+                    graph.vwgt[row_coord[k]]++;
+                    if (row_coord[k] != col_coord[k]) {
+                        edges.emplace_back(row_coord[k], col_coord[k]);
+                        edges.emplace_back(col_coord[k], row_coord[k]);
+                    }
+                }
+
+                buildAdjacency(edges, nor);
+            }
+
+            /**
+             * @brief Build the adjacency graph from a matrix in CRS format
+             *
+             * @param row_start Row start array of CRS format
+             * @param col_ind Column indices array of CRS format
+             * @param nor Number of rows (and columns) of the matrix
+             */
+            void loadFromCRS(const nnz_type* row_start, const int_type* col_ind, int_type nor) {
+                std::vector<std::pair<int_type, int_type>> edges;
+                edges.reserve(2*row_start[nor]);
+
+                graph.vwgt.assign(nor, 1);
+                for (int_type i = 0; i < nor; ++i) {
+                    graph.vwgt[i] += row_start[i+1] - row_start[i];
+                    for (nnz_type k = row_start[i]; k < row_start[i+1]; ++k) {
+                        if (col_ind[k] != i) {
+                            edges.emplace_back(i, col_ind[k]);
+                            edges.emplace_back(col_ind[k], i);
+                        }
+                    }
+                }
+
+                buildAdjacency(edges, nor);
+            }
+
+            /**
+             * @brief Partition the loaded graph
+             *
+             * Fills part, perm, iperm and bounds.
+             *
+             * @param partitions_am Amount of partitions
+             */
+            void partition(const int partitions_am) {
+                parts = partitions_am;
+                int_type n = graph.nvtxs();
+                std::vector<int> where(n, 0);
+
+                if (parts > 1) {
+                    // Coarsening phase (deque to keep references valid)
+                    std::deque<Graph> levels;
+                    std::vector<std::vector<int_type>> cmaps;
+                    const Graph* current = &graph;
+                    int_type coarsen_to = std::max<int_type>(20*parts, 100);
+                    while (current->nvtxs() > coarsen_to) {
+                        Graph coarse;
+                        std::vector<int_type> cmap;
+                        if (!coarsen(*current, coarse, cmap)) break;
+
+                        levels.push_back(std::move(coarse));
+                        cmaps.push_back(std::move(cmap));
+                        current = &levels.back();
+                    }
+
+                    // Initial partition of the coarsest graph
+                    std::vector<int> coarse_where;
+                    initialPartition(*current, coarse_where);
+                    refine(*current, coarse_where);
+
+                    // Uncoarsening phase: project to the finer graph and refine
+                    for (int level = levels.size() - 1; level >= 0; --level) {
+                        const Graph& finer = level > 0 ? levels[level-1] : graph;
+                        std::vector<int> fine_where(finer.nvtxs());
+                        for (int_type v = 0; v < finer.nvtxs(); ++v) {
+                            fine_where[v] = coarse_where[cmaps[level][v]];
+                        }
+
+                        refine(finer, fine_where);
+                        coarse_where.swap(fine_where);
+                    }
+
+                    where.swap(coarse_where);
+                }
+
+                part = where;
+                buildPermutation();
+            }
+
+            /**
+             * @brief Partition which splits the rows in equal contiguous blocks (like TripletToMultipleCRS)
+             *
+             * @param partitions_am Amount of partitions
+             */
+            std::vector<int> contiguousPartition(const int partitions_am) const {
+                int_type n = graph.nvtxs();
+                int_type am_rows = n/partitions_am;
+                std::vector<int> where(n);
+                for (int_type v = 0; v < n; ++v) {
+                    where[v] = am_rows == 0 ? partitions_am - 1 : std::min<int_type>(v/am_rows, partitions_am - 1);
+                }
+
+                return where;
+            }
+
+            /**
+             * @brief Edge cut of a partition, counted as the amount of nonzeros which couple two different partitions
+             *
+             * @param where Partition of each row
+             */
+            long long edgeCut(const std::vector<int>& where) const {
+                long long cut = 0;
+                for (int_type v = 0; v < graph.nvtxs(); ++v) {
+                    for (nnz_type e = graph.xadj[v]; e < graph.xadj[v+1]; ++e) {
+                        if (where[graph.adjncy[e]] != where[v]) cut += graph.adjwgt[e];
+                    }
+                }
+
+                return cut/2;
+            }
+
+            /**
+             * @brief Estimated communication volume of a partition
+             *
+             * Every vector element has to be sent once to every other partition which contains a neighbour of the row.
+             *
+             * @param where Partition of each row
+             */
+            long long communicationVolume(const std::vector<int>& where) const {
+                long long volume = 0;
+                std::vector<int_type> marker(parts, -1);
+                for (int_type v = 0; v < graph.nvtxs(); ++v) {
+                    for (nnz_type e = graph.xadj[v]; e < graph.xadj[v+1]; ++e) {
+                        int p = where[graph.adjncy[e]];
+                        if (p != where[v] && marker[p] != v) {
+                            marker[p] = v;
+                            volume++;
+                        }
+                    }
+                }
+
+                return volume;
+            }
+
+            /**
+             * @brief Maximal partition weight relative to the average partition weight
+             *
+             * @param where Partition of each row
+             */
+            double loadImbalance(const std::vector<int>& where) const {
+                std::vector<long long> pwgts(parts, 0);
+                for (int_type v = 0; v < graph.nvtxs(); ++v) {
+                    pwgts[where[v]] += graph.vwgt[v];
+                }
+
+                long long total = std::accumulate(pwgts.begin(), pwgts.end(), 0LL);
+                return *std::max_element(pwgts.begin(), pwgts.end()) * parts / (double) total;
+            }
+
+            /**
+             * @brief Print edge cut, communication volume and imbalance of the computed partition against the contiguous split
+             */
+            void printReport() const {
+                std::vector<int> contiguous = contiguousPartition(parts);
+
+                std::cout << "Partitioning into " << parts << " parts (contiguous split -> graph partitioner):" << std::endl;
+                std::cout << "  Edge cut: " << edgeCut(contiguous) << " -> " << edgeCut(part) << std::endl;
+                std::cout << "  Communication volume: " << communicationVolume(contiguous) << " -> " << communicationVolume(part) << std::endl;
+                std::cout << "  Load imbalance: " << loadImbalance(contiguous) << " -> " << loadImbalance(part) << std::endl;
+            }
+
+        private:
+            /**
+             * @brief Build the adjacency arrays from a list of directed edges, duplicate edges are merged into one weighted edge
+             */
+            void buildAdjacency(std::vector<std::pair<int_type, int_type>>& edges, int_type nor) {
+                std::sort(edges.begin(), edges.end());
+
+                graph.xadj.assign(nor+1, 0);
+                graph.adjncy.clear();
+                graph.adjwgt.clear();
+
+                size_t e = 0;
+                for (int_type v = 0; v < nor; ++v) {
+                    while (e < edges.size() && edges[e].first == v) {
+                        if (graph.xadj[v] < (nnz_type) graph.adjncy.size() && graph.adjncy.back() == edges[e].second) {
+                            graph.adjwgt.back()++;
+                        } else {
+                            graph.adjncy.push_back(edges[e].second);
+                            graph.adjwgt.push_back(1);
+                        }
+                        e++;
+                    }
+                    graph.xadj[v+1] = graph.adjncy.size();
+                }
+            }
+
+            /**
+             * @brief Coarsen the graph using heavy-edge matching
+             *
+             * @param g Graph to coarsen
+             * @param cg Output coarse graph
+             * @param cmap Output coarse vertex of every vertex of g
+             * @return false if the graph could not be coarsened significantly
+             */
+            bool coarsen(const Graph& g, Graph& cg, std::vector<int_type>& cmap) {
+                int_type n = g.nvtxs();
+
+                // Limit the weight of coarse vertices to keep the initial partition balanced
+                long long total = std::accumulate(g.vwgt.begin(), g.vwgt.end(), 0LL);
+                long long max_vwgt = std::max<long long>(1.5*total/(20*parts), 1);
+
+                std::vector<int_type> order(n);
+                std::iota(order.begin(), order.end(), 0);
+                std::shuffle(order.begin(), order.end(), gen);
+
+                // Heavy-edge matching: match every vertex to the unmatched neighbour with the heaviest edge
+                std::vector<int_type> match(n, -1);
+                for (int_type v : order) {
+                    if (match[v] != -1) continue;
+
+                    int_type best = v;
+                    int_type best_wgt = -1;
+                    for (nnz_type e = g.xadj[v]; e < g.xadj[v+1]; ++e) {
+                        int_type u = g.adjncy[e];
+                        if (match[u] == -1 && g.adjwgt[e] > best_wgt && g.vwgt[v] + g.vwgt[u] <= max_vwgt) {
+                            best = u;
+                            best_wgt = g.adjwgt[e];
+                        }
+                    }
+
+                    match[v] = best;
+                    match[best] = v;
+                }
+
+                // Number the coarse vertices
+                cmap.assign(n, -1);
+                std::vector<int_type> first, second;
+                for (int_type v = 0; v < n; ++v) {
+                    if (cmap[v] != -1) continue;
+                    cmap[v] = first.size();
+                    cmap[match[v]] = first.size();
+                    first.push_back(v);
+                    second.push_back(match[v]);
+                }
+
+                int_type cn = first.size();
+                if (cn > 0.9*n) return false;
+
+                // Build coarse adjacency by merging the neighbour lists of the matched vertices
+                cg.xadj.assign(1, 0);
+                cg.adjncy.clear();
+                cg.adjwgt.clear();
+                cg.vwgt.assign(cn, 0);
+                std::vector<int_type> marker(cn, -1);
+                for (int_type c = 0; c < cn; ++c) {
+                    nnz_type start = cg.adjncy.size();
+                    int_type members[2] = {first[c], second[c]};
+                    int am_members = first[c] == second[c] ? 1 : 2;
+                    for (int i = 0; i < am_members; ++i) {
+                        int_type v = members[i];
+                        cg.vwgt[c] += g.vwgt[v];
+                        for (nnz_type e = g.xadj[v]; e < g.xadj[v+1]; ++e) {
+                            int_type cu = cmap[g.adjncy[e]];
+                            if (cu == c) continue;
+
+                            if (marker[cu] == -1) {
+                                marker[cu] = cg.adjncy.size();
+                                cg.adjncy.push_back(cu);
+                                cg.adjwgt.push_back(g.adjwgt[e]);
+                            } else {
+                                cg.adjwgt[marker[cu]] += g.adjwgt[e];
+                            }
+                        }
+                    }
+
+                    for (size_t e = start; e < cg.adjncy.size(); ++e) {
+                        marker[cg.adjncy[e]] = -1;
+                    }
+                    cg.xadj.push_back(cg.adjncy.size());
+                }
+
+                return true;
+            }
+
+            /**
+             * @brief Greedy graph growing partition
+             *
+             * Each partition is grown from a seed vertex by adding the vertex with the strongest connection to the partition
+             * until the partition reaches its target weight.
+             */
+            void initialPartition(const Graph& g, std::vector<int>& where) {
+                int_type n = g.nvtxs();
+                where.assign(n, -1);
+
+                long long remaining = std::accumulate(g.vwgt.begin(), g.vwgt.end(), 0LL);
+                std::vector<int_type> conn(n, 0);
+                int_type cursor = 0;
+                for (int p = 0; p < parts; ++p) {
+                    long long target = remaining/(parts - p);
+                    long long pwgt = 0;
+                    std::priority_queue<std::pair<int_type, int_type>> queue;
+
+                    while (pwgt < target) {
+                        if (queue.empty()) {
+                            while (cursor < n && where[cursor] != -1) cursor++;
+                            if (cursor == n) break;
+                            queue.emplace(0, cursor);
+                        }
+
+                        int_type c = queue.top().first;
+                        int_type v = queue.top().second;
+                        queue.pop();
+                        if (where[v] != -1 || c != conn[v]) continue; // Outdated entry
+
+                        where[v] = p;
+                        pwgt += g.vwgt[v];
+                        for (nnz_type e = g.xadj[v]; e < g.xadj[v+1]; ++e) {
+                            int_type u = g.adjncy[e];
+                            if (where[u] == -1) {
+                                conn[u] += g.adjwgt[e];
+                                queue.emplace(conn[u], u);
+                            }
+                        }
+                    }
+
+                    // Vertices adjacent to this partition start fresh for the next one
+                    for (int_type v = 0; v < n; ++v) {
+                        if (where[v] == -1) conn[v] = 0;
+                    }
+                    remaining -= pwgt;
+                }
+
+                for (int_type v = 0; v < n; ++v) {
+                    if (where[v] == -1) where[v] = parts - 1;
+                }
+            }
+
+            /**
+             * @brief Fiduccia-Mattheyses style k-way boundary refinement
+             *
+             * Boundary vertices are moved to the neighbouring partition with the largest gain in edge cut if the balance constraint allows it.
+             * Moves without gain are only done if they improve the balance.
+             */
+            void refine(const Graph& g, std::vector<int>& where) {
+                int_type n = g.nvtxs();
+
+                std::vector<long long> pwgts(parts, 0);
+                for (int_type v = 0; v < n; ++v) {
+                    pwgts[where[v]] += g.vwgt[v];
+                }
+                long long total = std::accumulate(pwgts.begin(), pwgts.end(), 0LL);
+                long long max_pwgt = (1. + imbalance)*total/parts + 1;
+
+                std::vector<int_type> conn(parts, 0);
+                std::vector<int> touched;
+                for (int pass = 0; pass < 10; ++pass) {
+                    int_type moves = 0;
+
+                    for (int_type v = 0; v < n; ++v) {
+                        int p = where[v];
+                        int_type internal = 0;
+                        touched.clear();
+                        for (nnz_type e = g.xadj[v]; e < g.xadj[v+1]; ++e) {
+                            int q = where[g.adjncy[e]];
+                            if (q == p) {
+                                internal += g.adjwgt[e];
+                            } else {
+                                if (conn[q] == 0) touched.push_back(q);
+                                conn[q] += g.adjwgt[e];
+                            }
+                        }
+
+                        if (touched.empty()) continue; // Not a boundary vertex
+
+                        int best = -1;
+                        int_type best_gain = 0;
+                        for (int q : touched) {
+                            int_type gain = conn[q] - internal;
+                            conn[q] = 0;
+                            if (pwgts[q] + g.vwgt[v] > max_pwgt) continue;
+
+                            if (best == -1 || gain > best_gain || (gain == best_gain && pwgts[q] < pwgts[best])) {
+                                best = q;
+                                best_gain = gain;
+                            }
+                        }
+
+                        if (best == -1) continue;
+
+                        bool balance_gain = pwgts[best] + g.vwgt[v] < pwgts[p];
+                        if (best_gain > 0 || (best_gain == 0 && balance_gain) || (pwgts[p] > max_pwgt && balance_gain)) {
+                            where[v] = best;
+                            pwgts[p] -= g.vwgt[v];
+                            pwgts[best] += g.vwgt[v];
+                            moves++;
+                        }
+                    }
+
+                    if (moves == 0) break;
+                }
+            }
+
+            /**
+             * @brief Compute the row permutation and partition boundaries from the partition
+             *
+             * Rows keep their relative order within a partition.
+             */
+            void buildPermutation() {
+                int_type n = graph.nvtxs();
+                bounds.assign(parts+1, 0);
+                for (int_type v = 0; v < n; ++v) {
+                    bounds[part[v]+1]++;
+                }
+                std::partial_sum(bounds.begin(), bounds.end(), bounds.begin());
+
+                std::vector<int_type> pos(bounds.begin(), bounds.end()-1);
+                perm.resize(n);
+                iperm.resize(n);
+                for (int_type v = 0; v < n; ++v) {
+                    perm[pos[part[v]]] = v;
+                    iperm[v] = pos[part[v]]++;
+                }
+            }
+    };
+} // namespace pwm
+
+#endif // PWM_GRAPHPARTITIONER_HPP
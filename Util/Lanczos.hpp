@@ -0,0 +1,537 @@
+/**
+ * @file Lanczos.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Thick restart Lanczos eigensolver built on the matrix vector product of the implementations
+ * @version 0.1
+ * @date 2022-11-18
+ *
+ * The power method converges with the ratio |l2/l1| of the two dominant eigenvalues, which is close to 1 for the
+ * Poisson matrices. Lanczos builds an orthonormal basis of the Krylov space and extracts the eigenpairs of largest
+ * magnitude of a symmetric matrix from the projected matrix. The basis holds at most a fixed amount of vectors: when it
+ * is full the solver restarts with the best Ritz vectors (thick restart), so the memory footprint is bounded.
+ *
+ * The new vector is orthogonalized against the whole basis with classical Gram-Schmidt (this also gives the couplings
+ * with the kept Ritz vectors after a restart). A second pass is only done if the first pass removed most of the vector,
+ * the DGKS criterion for lost orthogonality. The dot products with all basis vectors are computed in one blocked pass
+ * over tiles of rows and the projection is subtracted in a second pass which also gives the new norm, using the parallel
+ * loops of the matrix so they run with the same threading model (and the same partitions) as the product.
+ *
+ * Full instead of partial or selective reorthogonalization: the thick restart bounds the basis (2k + 20 vectors by
+ * default), so the two passes cost about as much as a product of a sparse matrix with a handful of nonzeros per row.
+ * The new vector has to be orthogonalized against the kept Ritz vectors after every restart anyway, and without full
+ * orthogonality converged Ritz values come back as spurious copies which cannot be told apart from a multiple
+ * eigenvalue.
+ */
+
+#ifndef PWM_LANCZOS_HPP
+#define PWM_LANCZOS_HPP
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include "../Matrix/SparseMatrix.hpp"
+#include "Memory.hpp"
+#include "Batch.hpp"
+
+#include "omp.h"
+
+namespace pwm {
+    // Rows of a tile of the blocked Gram-Schmidt passes
+    constexpr long long lanczos_tile = 1024;
+
+    // Eigenpairs computed by the Lanczos solver
+    template<typename T>
+    struct LanczosResult {
+        // Eigenvalues ordered by decreasing magnitude
+        std::vector<T> values;
+
+        // Eigenvectors, vector i starts at element i*rows
+        std::vector<T> vectors;
+
+        // Residual norm |Av - lv| of each eigenpair (estimate of the Lanczos recurrence)
+        std::vector<T> residuals;
+
+        // All Ritz values of the last basis in increasing order and their residual norms (bounds of the spectrum)
+        std::vector<T> ritz_values;
+        std::vector<T> ritz_residuals;
+
+        // Amount of matrix vector products
+        int products = 0;
+
+        // Amount of restarts
+        int restarts = 0;
+
+        // All eigenpairs satisfy the tolerance
+        bool converged = false;
+    };
+
+    // Eigenpair computed by the power method until a tolerance
+    template<typename T>
+    struct PowerResult {
+        // Rayleigh quotient of the last iterate
+        T value = 0.;
+
+        // Residual norm |Av - lv| of the last iterate
+        T residual = 0.;
+
+        // Amount of matrix vector products
+        int products = 0;
+
+        // The residual satisfies the tolerance
+        bool converged = false;
+    };
+
+    /**
+     * @brief Eigenvalues and eigenvectors of a small dense symmetric matrix using the cyclic Jacobi method
+     *
+     * @param a Row major n by n matrix, destroyed
+     * @param n Size of the matrix
+     * @param values Eigenvalues (unordered)
+     * @param vectors Row major n by n matrix, column i is the eigenvector of eigenvalue i
+     */
+    template<typename T>
+    void symmetricEigen(std::vector<T>& a, int n, std::vector<T>& values, std::vector<T>& vectors) {
+        vectors.assign((size_t) n*n, 0.);
+        for (int i = 0; i < n; ++i) vectors[(size_t) i*n + i] = 1.;
+
+        for (int sweep = 0; sweep < 100; ++sweep) {
+            T off = 0., total = 0.;
+            for (int i = 0; i < n; ++i) {
+                for (int j = 0; j < n; ++j) {
+                    total += a[(size_t) i*n + j]*a[(size_t) i*n + j];
+                    if (i != j) off += a[(size_t) i*n + j]*a[(size_t) i*n + j];
+                }
+            }
+            if (off <= std::numeric_limits<T>::epsilon()*std::numeric_limits<T>::epsilon()*total) break;
+
+            for (int p = 0; p < n - 1; ++p) {
+                for (int q = p + 1; q < n; ++q) {
+                    T apq = a[(size_t) p*n + q];
+                    if (apq == 0.) continue;
+
+                    // Rotation which zeroes a[p][q]
+                    T theta = (a[(size_t) q*n + q] - a[(size_t) p*n + p]) / (2.*apq);
+                    T t = (theta >= 0. ? 1. : -1.) / (std::abs(theta) + std::sqrt(theta*theta + 1.));
+                    T c = 1./std::sqrt(t*t + 1.);
+                    T s = t*c;
+
+                    for (int k = 0; k < n; ++k) {
+                        T akp = a[(size_t) k*n + p];
+                        T akq = a[(size_t) k*n + q];
+                        a[(size_t) k*n + p] = c*akp - s*akq;
+                        a[(size_t) k*n + q] = s*akp + c*akq;
+                    }
+                    for (int k = 0; k < n; ++k) {
+                        T apk = a[(size_t) p*n + k];
+                        T aqk = a[(size_t) q*n + k];
+                        a[(size_t) p*n + k] = c*apk - s*aqk;
+                        a[(size_t) q*n + k] = s*apk + c*aqk;
+                    }
+                    for (int k = 0; k < n; ++k) {
+                        T vkp = vectors[(size_t) k*n + p];
+                        T vkq = vectors[(size_t) k*n + q];
+                        vectors[(size_t) k*n + p] = c*vkp - s*vkq;
+                        vectors[(size_t) k*n + q] = s*vkp + c*vkq;
+                    }
+                }
+            }
+        }
+
+        values.resize(n);
+        for (int i = 0; i < n; ++i) values[i] = a[(size_t) i*n + i];
+    }
+
+    /**
+     * @brief Seeded random start vector with entries in [0.5, 1.5)
+     *
+     * x = 1 is orthogonal to the eigenvectors of the Poisson matrices with an even mode, among which the dominant ones,
+     * a random vector has a component along every eigenvector.
+     *
+     * @param x Output vector
+     * @param n Size of the vector
+     * @param seed Seed of the random generator
+     */
+    template<typename T, typename int_type>
+    void randomStart(T* x, int_type n, unsigned seed) {
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<T> dist(0.5, 1.5);
+        for (int_type i = 0; i < n; ++i) x[i] = dist(gen);
+    }
+
+    // Seed of the start vector of the reports
+    constexpr unsigned report_seed = 1;
+
+    // First seed of the start vectors of the restart rounds of lanczos (round r uses restart_seed + r)
+    constexpr unsigned restart_seed = 1u << 16;
+
+    /**
+     * @brief Start vector of the reports of the solvers: a random vector with a fixed seed
+     *
+     * @param x Output vector
+     * @param n Size of the vector
+     */
+    template<typename T, typename int_type>
+    void reportStart(T* x, int_type n) {
+        pwm::randomStart(x, n, report_seed);
+    }
+
+    /**
+     * @brief Dot product of two vectors with the rows of a matrix using its threading model
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    T parallelDot(SparseMatrix<T, int_type, nnz_type>& mat, const T* x, const T* y) {
+        return mat.parallelSum([=](int_type begin, int_type end) -> T {
+            T sum = 0.;
+            for (int_type i = begin; i < end; ++i) sum += x[i]*y[i];
+            return sum;
+        });
+    }
+
+    /**
+     * @brief Thick restart Lanczos: eigenpairs of largest magnitude of a symmetric matrix
+     *
+     * The eigenpairs are converged if |Av - lv| <= tol*|l| for each of them.
+     *
+     * A Krylov space only holds one direction of the eigenspace of a multiple eigenvalue. After the first round has
+     * converged its eigenvectors are locked and a new round starts from a random vector: the basis is kept orthogonal to
+     * the locked vectors, so it finds the other directions of a multiple eigenvalue. The rounds stop when a round finds no
+     * eigenvalue larger in magnitude than the k-th one found so far.
+     *
+     * @param mat Symmetric matrix
+     * @param start Start vector of the first round (does not need to be normalized)
+     * @param k Amount of eigenpairs
+     * @param tol Relative tolerance on the residual norm
+     * @param basis Maximal amount of basis vectors (at least k+2, bounds the memory to basis+1 vectors)
+     * @param max_restarts Maximal amount of restarts of a round
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    LanczosResult<T> lanczos(SparseMatrix<T, int_type, nnz_type>& mat, const T* start, int k, T tol, int basis, int max_restarts) {
+        const int_type n = mat.getRows();
+        basis = (int) std::min<long long>(std::max(basis, k + 2), n);
+        k = std::min(k, basis);
+
+        // Basis vectors (one more than the basis for the next vector), the Ritz vectors of a restart and the locked vectors
+        pwm::Arena arena;
+        T* V = arena.template allocate<T>((size_t) (basis + 1)*n);
+        T* ritz = arena.template allocate<T>((size_t) basis*n);
+        T* L = arena.template allocate<T>((size_t) k*n);
+        auto vec = [=](int i) { return V + (size_t) i*n; };
+
+        // Projected matrix V^T A V and its eigen decomposition
+        std::vector<T> H((size_t) basis*basis, 0.), Hcopy, theta, S;
+        std::vector<T> h(basis + 1), c(basis + k + 2);
+        std::vector<int> order;
+        std::vector<T> random_start;
+        int locked = 0;
+
+        LanczosResult<T> result;
+
+        // Orthogonalize w against the first count basis vectors and the locked vectors, the coefficients of the basis
+        // vectors are added to h. Returns the norm of w after the projection, norm is set to the norm before.
+        auto orthogonalize = [&](T* w, int count, T& norm) -> T {
+            std::fill(h.begin(), h.begin() + count, 0.);
+            T* coef = c.data();
+            const int all = count + locked;
+            auto column = [=](int i) -> const T* { return i < count ? vec(i) : L + (size_t) (i - count)*n; };
+
+            T w_norm = 0.;
+            for (int pass = 0; pass < 2; ++pass) {
+                // Dot products with all vectors and the norm of w in one pass over tiles of rows (w stays in the cache)
+                parallelColumnSums<T, int_type, nnz_type>(mat, all + 1, [=](int_type begin, int_type end, T* part) {
+                    for (int_type first = begin; first < end; first += lanczos_tile) {
+                        int_type last = (int_type) std::min<long long>(end, (long long) first + lanczos_tile);
+                        for (int i = 0; i < all; ++i) {
+                            const T* v = column(i);
+                            T sum = 0.;
+                            for (int_type r = first; r < last; ++r) sum += v[r]*w[r];
+                            part[i] += sum;
+                        }
+
+                        T sum = 0.;
+                        for (int_type r = first; r < last; ++r) sum += w[r]*w[r];
+                        part[all] += sum;
+                    }
+                }, coef);
+                T before = std::sqrt(coef[all]);
+                if (pass == 0) norm = before;
+
+                // Subtract the projection and compute the new norm in one pass
+                T after = 0.;
+                parallelColumnSums<T, int_type, nnz_type>(mat, 1, [=](int_type begin, int_type end, T* part) {
+                    for (int_type first = begin; first < end; first += lanczos_tile) {
+                        int_type last = (int_type) std::min<long long>(end, (long long) first + lanczos_tile);
+                        for (int i = 0; i < all; ++i) {
+                            const T* v = column(i);
+                            T ci = coef[i];
+                            for (int_type r = first; r < last; ++r) w[r] -= ci*v[r];
+                        }
+
+                        T sum = 0.;
+                        for (int_type r = first; r < last; ++r) sum += w[r]*w[r];
+                        part[0] += sum;
+                    }
+                }, &after);
+                w_norm = std::sqrt(after);
+                for (int i = 0; i < count; ++i) h[i] += coef[i];
+
+                // Reorthogonalize only if the projection removed most of the vector (DGKS criterion)
+                if (w_norm >= std::sqrt(0.5)*before) break;
+            }
+
+            return w_norm;
+        };
+
+        for (int round = 0; round <= k; ++round) {
+            // Start vector orthogonal to the locked vectors
+            const T* first = start;
+            if (round > 0) {
+                random_start.resize(n);
+                pwm::randomStart(random_start.data(), n, restart_seed + round);
+                first = random_start.data();
+            }
+            mat.parallelFor([=](int_type begin, int_type end) {
+                std::copy(first + begin, first + end, V + begin);
+            });
+            T first_norm;
+            T start_norm = orthogonalize(V, 0, first_norm);
+            if (start_norm == 0.) break;
+            mat.parallelFor([=](int_type begin, int_type end) {
+                for (int_type i = begin; i < end; ++i) V[i] /= start_norm;
+            });
+
+            int kept = 0;
+            int round_restarts = 0;
+            std::fill(H.begin(), H.end(), 0.);
+            for (;;) {
+                // Extend the basis from the kept Ritz vectors until it is full (or an invariant subspace is found)
+                int size = basis;
+                T beta = 0.;
+                for (int j = kept; j < basis; ++j) {
+                    T* w = vec(j+1);
+                    mat.mv(vec(j), w);
+                    result.products++;
+
+                    T product_norm;
+                    T w_norm = orthogonalize(w, j + 1, product_norm);
+
+                    for (int i = 0; i <= j; ++i) {
+                        H[(size_t) i*basis + j] = h[i];
+                        H[(size_t) j*basis + i] = h[i];
+                    }
+
+                    beta = w_norm;
+                    if (beta <= 100.*std::numeric_limits<T>::epsilon()*product_norm) {
+                        // The basis spans an invariant subspace, the Ritz pairs are exact
+                        size = j + 1;
+                        beta = 0.;
+                        break;
+                    }
+
+                    mat.parallelFor([=](int_type begin, int_type end) {
+                        for (int_type r = begin; r < end; ++r) w[r] /= beta;
+                    });
+                }
+
+                // Ritz pairs of the projected matrix, ordered by decreasing magnitude
+                Hcopy.assign((size_t) size*size, 0.);
+                for (int i = 0; i < size; ++i) {
+                    for (int j = 0; j < size; ++j) Hcopy[(size_t) i*size + j] = H[(size_t) i*basis + j];
+                }
+                pwm::symmetricEigen(Hcopy, size, theta, S);
+
+                order.resize(size);
+                std::iota(order.begin(), order.end(), 0);
+                std::sort(order.begin(), order.end(), [&](int a, int b) { return std::abs(theta[a]) > std::abs(theta[b]); });
+
+                int wanted = std::min(k, size);
+                bool converged = true;
+                for (int i = 0; i < wanted; ++i) {
+                    T residual = std::abs(beta*S[(size_t) (size-1)*size + order[i]]);
+                    if (residual > tol*std::abs(theta[order[i]])) converged = false;
+                }
+
+                bool last = converged || round_restarts >= max_restarts || size < basis;
+
+                // Keep the wanted Ritz vectors and half of the others
+                int keep = last ? wanted : std::min(wanted + (size - wanted)/2, size - 1);
+                mat.parallelFor([&](int_type begin, int_type end) {
+                    for (int l = 0; l < keep; ++l) {
+                        T* y = ritz + (size_t) l*n;
+                        std::fill(y + begin, y + end, 0.);
+                        for (int i = 0; i < size; ++i) {
+                            const T* v = vec(i);
+                            T s = S[(size_t) i*size + order[l]];
+                            for (int_type r = begin; r < end; ++r) y[r] += s*v[r];
+                        }
+                    }
+                });
+
+                if (last) {
+                    bool entered = false;
+                    if (round == 0) {
+                        // The first round gives the eigenpairs and the bounds of the spectrum
+                        result.converged = converged;
+                        result.values.resize(wanted);
+                        result.residuals.resize(wanted);
+                        result.vectors.assign(ritz, ritz + (size_t) wanted*n);
+                        for (int i = 0; i < wanted; ++i) {
+                            result.values[i] = theta[order[i]];
+                            result.residuals[i] = std::abs(beta*S[(size_t) (size-1)*size + order[i]]);
+                        }
+
+                        std::vector<int> increasing = order;
+                        std::sort(increasing.begin(), increasing.end(), [&](int a, int b) { return theta[a] < theta[b]; });
+                        for (int i : increasing) {
+                            result.ritz_values.push_back(theta[i]);
+                            result.ritz_residuals.push_back(std::abs(beta*S[(size_t) (size-1)*size + i]));
+                        }
+                    } else if (converged) {
+                        // Merge the new eigenpairs which are larger in magnitude than the ones found so far
+                        std::vector<std::pair<T, int>> pairs;
+                        for (int i = 0; i < (int) result.values.size(); ++i) pairs.emplace_back(result.values[i], i);
+                        for (int i = 0; i < wanted; ++i) {
+                            if (result.values.size() < (size_t) k || std::abs(theta[order[i]]) > (1. + tol)*std::abs(result.values.back())) {
+                                pairs.emplace_back(theta[order[i]], -1 - i);
+                            }
+                        }
+                        std::stable_sort(pairs.begin(), pairs.end(), [](const std::pair<T, int>& a, const std::pair<T, int>& b) {
+                            return std::abs(a.first) > std::abs(b.first);
+                        });
+                        pairs.resize(std::min<size_t>(pairs.size(), k));
+
+                        std::vector<T> values, residuals, vectors((size_t) pairs.size()*n);
+                        for (size_t p = 0; p < pairs.size(); ++p) {
+                            int i = pairs[p].second;
+                            if (i < 0) entered = true;
+                            const T* v = i >= 0 ? result.vectors.data() + (size_t) i*n : ritz + (size_t) (-1 - i)*n;
+                            std::copy(v, v + n, vectors.begin() + p*n);
+                            values.push_back(pairs[p].first);
+                            residuals.push_back(i >= 0 ? result.residuals[i] : std::abs(beta*S[(size_t) (size-1)*size + order[-1 - i]]));
+                        }
+                        result.values = values;
+                        result.residuals = residuals;
+                        result.vectors = vectors;
+                    }
+
+                    // Continue with a new round only if this round converged and found a larger eigenvalue
+                    if (!converged || (round > 0 && !entered)) return result;
+
+                    // Lock the eigenvectors found so far
+                    locked = (int) result.values.size();
+                    std::copy(result.vectors.begin(), result.vectors.end(), L);
+                    break;
+                }
+
+                // Thick restart: the kept Ritz vectors followed by the last basis vector
+                result.restarts++;
+                round_restarts++;
+                mat.parallelFor([&](int_type begin, int_type end) {
+                    for (int l = 0; l < keep; ++l) std::copy(ritz + (size_t) l*n + begin, ritz + (size_t) l*n + end, vec(l) + begin);
+                    std::copy(vec(size) + begin, vec(size) + end, vec(keep) + begin);
+                });
+
+                // The projected matrix is diagonal on the Ritz vectors, the couplings with the last vector are recomputed
+                std::fill(H.begin(), H.end(), 0.);
+                for (int l = 0; l < keep; ++l) H[(size_t) l*basis + l] = theta[order[l]];
+                kept = keep;
+            }
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Power method until the residual of the Rayleigh quotient satisfies a relative tolerance
+     *
+     * Same iteration as powerMethod, the Rayleigh quotient and the residual are computed with the parallel loops of the
+     * matrix in every iteration.
+     *
+     * @param mat Square matrix
+     * @param x Start vector, contains the eigenvector at the end
+     * @param y Vector to store calculations
+     * @param tol Relative tolerance on the residual norm
+     * @param max_it Maximal amount of iterations
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    PowerResult<T> powerMethodTolerance(SparseMatrix<T, int_type, nnz_type>& mat, T* x, T* y, T tol, int max_it) {
+        PowerResult<T> result;
+
+        T norm = std::sqrt(parallelDot(mat, x, x));
+        mat.parallelFor([=](int_type begin, int_type end) {
+            for (int_type i = begin; i < end; ++i) x[i] /= norm;
+        });
+
+        while (result.products < max_it) {
+            mat.mv(x, y);
+            result.products++;
+
+            T value = parallelDot(mat, x, y);
+            T residual = std::sqrt(mat.parallelSum([=](int_type begin, int_type end) -> T {
+                T sum = 0.;
+                for (int_type i = begin; i < end; ++i) sum += (y[i] - value*x[i])*(y[i] - value*x[i]);
+                return sum;
+            }));
+
+            result.value = value;
+            result.residual = residual;
+            if (residual <= tol*std::abs(value)) {
+                result.converged = true;
+                break;
+            }
+
+            norm = std::sqrt(parallelDot(mat, y, y));
+            mat.parallelFor([=](int_type begin, int_type end) {
+                for (int_type i = begin; i < end; ++i) x[i] = y[i] / norm;
+            });
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Compare the time to tolerance of Lanczos and the power method on a symmetric matrix and print the results
+     *
+     * @param mat Symmetric matrix
+     * @param k Amount of eigenpairs of Lanczos
+     * @param tol Relative tolerance on the residual norm
+     * @param basis Maximal amount of basis vectors of Lanczos
+     * @param max_it Maximal amount of matrix vector products of both solvers
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void printEigensolverComparison(SparseMatrix<T, int_type, nnz_type>& mat, int k, T tol, int basis, int max_it) {
+        const int_type n = mat.getRows();
+        std::vector<T> x(n), y(n);
+        pwm::reportStart(x.data(), n);
+
+        int max_restarts = std::max(1, max_it / std::max(1, basis - k));
+        double start = omp_get_wtime();
+        LanczosResult<T> lanczos_result = pwm::lanczos(mat, x.data(), k, tol, basis, max_restarts);
+        double lanczos_time = (omp_get_wtime() - start) * 1000;
+
+        std::cout << "Lanczos (" << k << " eigenpairs, basis " << basis << ", tolerance " << tol << "): " << lanczos_time << "ms, ";
+        std::cout << lanczos_result.products << " products, " << lanczos_result.restarts << " restarts";
+        std::cout << (lanczos_result.converged ? "" : " (not converged)") << std::endl;
+        for (size_t i = 0; i < lanczos_result.values.size(); ++i) {
+            std::cout << "  eigenvalue " << lanczos_result.values[i] << ", residual " << lanczos_result.residuals[i] << std::endl;
+        }
+
+        start = omp_get_wtime();
+        PowerResult<T> power_result = pwm::powerMethodTolerance(mat, x.data(), y.data(), tol, max_it);
+        double power_time = (omp_get_wtime() - start) * 1000;
+
+        std::cout << "Power method (tolerance " << tol << "): " << power_time << "ms, " << power_result.products << " products";
+        std::cout << (power_result.converged ? "" : " (not converged)") << std::endl;
+        std::cout << "  eigenvalue " << power_result.value << ", residual " << power_result.residual << std::endl;
+
+        if (lanczos_result.converged && power_result.converged) {
+            std::cout << "Lanczos speedup to tolerance: " << power_time/lanczos_time << std::endl;
+        }
+    }
+} // namespace pwm
+
+#endif // PWM_LANCZOS_HPP
@@ -0,0 +1,217 @@
+/**
+ * @file MatrixPowers.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Matrix powers kernel for partitioned CRS matrices
+ * @version 0.1
+ * @date 2022-11-04
+ *
+ * Computes s matrix vector products on a partition of rows without synchronizing with the other partitions in between.
+ * To do this every partition stores the rows which are reachable in less than s steps from its own rows (the ghost zone).
+ * The vector is read once for all entries which are reachable in s steps and the products on the ghost rows are computed redundantly.
+ *
+ * The ghost zone of a graph with a small diameter (like Kronecker graphs) can contain almost all rows for larger s.
+ * The memory usage then grows to partitions times the size of the matrix.
+ */
+
+#ifndef PWM_MATRIXPOWERS_HPP
+#define PWM_MATRIXPOWERS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+namespace pwm {
+    template<typename T, typename int_type, typename nnz_type = int_type>
+    class MatrixPowers {
+        protected:
+            // Datastructures of one partition
+            struct Part {
+                // Global row of each local vector entry, ordered by level (own rows first)
+                std::vector<int_type> rows;
+
+                // level_end[k] is the amount of local entries which are reachable in k steps
+                std::vector<int_type> level_end;
+
+                // Local CRS matrix of the rows which are reachable in s-1 steps with local column indices
+                std::vector<nnz_type> row_start;
+                std::vector<int_type> col_ind;
+                std::vector<T> data_arr;
+
+                // Local work vectors
+                std::vector<T> buf_in;
+                std::vector<T> buf_out;
+            };
+
+            // Datastructures for each partition
+            std::vector<Part> parts;
+
+            // Maximal amount of steps
+            int s;
+
+        public:
+            // Base constructor
+            MatrixPowers(): s(0) {}
+
+            // Maximal amount of steps of the kernel
+            int steps() const { return s; }
+
+            /**
+             * @brief Amount of iterations done by each call of the kernel in the s-step power method
+             *
+             * The first call does one iteration to estimate the dominant eigenvalue, the other calls do at most s iterations.
+             * Every call switches between the two vectors of the power method, the amount of calls is chosen such that
+             * the result ends up in the same vector as for the standard power method.
+             *
+             * @param it Total amount of iterations
+             * @param s Maximal amount of iterations per call
+             */
+            static std::vector<int> schedule(int it, int s) {
+                std::vector<int> blocks;
+                for (int done = 0; done < it; done += blocks.back()) {
+                    blocks.push_back(done == 0 ? 1 : std::min(s, it - done));
+                }
+
+                if (blocks.size() % 2 != (size_t) it % 2) {
+                    // Split the last block which does more than one iteration
+                    for (int b = blocks.size() - 1; b >= 0; --b) {
+                        if (blocks[b] > 1) {
+                            blocks[b]--;
+                            blocks.insert(blocks.begin() + b + 1, 1);
+                            break;
+                        }
+                    }
+                }
+
+                return blocks;
+            }
+
+            /**
+             * @brief Build the ghost zones of all partitions
+             *
+             * @param row_start Row start arrays of the partitions
+             * @param col_ind Column index arrays of the partitions
+             * @param data_arr Data arrays of the partitions
+             * @param partitions Amount of partitions
+             * @param partition_rows Amount of rows of each partition
+             * @param first_rows First row of each partition
+             * @param nor Number of rows of the matrix
+             * @param steps Maximal amount of steps the kernel is used for
+             */
+            void build(nnz_type** row_start, int_type** col_ind, T** data_arr, int partitions,
+                       const int_type* partition_rows, const int_type* first_rows, int_type nor, int steps) {
+                s = steps;
+                parts = std::vector<Part>(partitions);
+
+                // Partition of each global row
+                std::vector<int> owner(nor);
+                for (int p = 0; p < partitions; ++p) {
+                    std::fill(owner.begin() + first_rows[p], owner.begin() + first_rows[p] + partition_rows[p], p);
+                }
+
+                std::vector<int_type> local_index(nor, -1);
+                for (int p = 0; p < partitions; ++p) {
+                    Part& part = parts[p];
+
+                    // Level 0: own rows
+                    for (int_type l = 0; l < partition_rows[p]; ++l) {
+                        local_index[first_rows[p] + l] = l;
+                        part.rows.push_back(first_rows[p] + l);
+                    }
+                    part.level_end.push_back(part.rows.size());
+
+                    // Level k: columns of the rows in level k-1 which are not yet present
+                    int_type level_start = 0;
+                    for (int k = 1; k <= s; ++k) {
+                        int_type level_stop = part.level_end[k-1];
+                        for (int_type v = level_start; v < level_stop; ++v) {
+                            int_type row = part.rows[v];
+                            int q = owner[row];
+                            int_type l = row - first_rows[q];
+                            for (nnz_type k2 = row_start[q][l]; k2 < row_start[q][l+1]; ++k2) {
+                                int_type col = col_ind[q][k2];
+                                if (local_index[col] == -1) {
+                                    local_index[col] = part.rows.size();
+                                    part.rows.push_back(col);
+                                }
+                            }
+                        }
+
+                        level_start = level_stop;
+                        part.level_end.push_back(part.rows.size());
+                    }
+
+                    // Local CRS matrix for the rows in level 0 until s-1
+                    part.row_start.push_back(0);
+                    for (int_type v = 0; v < part.level_end[s-1]; ++v) {
+                        int_type row = part.rows[v];
+                        int q = owner[row];
+                        int_type l = row - first_rows[q];
+                        for (nnz_type k = row_start[q][l]; k < row_start[q][l+1]; ++k) {
+                            part.col_ind.push_back(local_index[col_ind[q][k]]);
+                            part.data_arr.push_back(data_arr[q][k]);
+                        }
+                        part.row_start.push_back(part.col_ind.size());
+                    }
+
+                    part.buf_in.resize(part.rows.size());
+                    part.buf_out.resize(part.rows.size());
+
+                    // Reset the global to local map
+                    for (int_type row : part.rows) {
+                        local_index[row] = -1;
+                    }
+                }
+            }
+
+            /**
+             * @brief Apply the scaled matrix repeatedly on one partition: y = (step_scale*A)^steps (x_scale*x)
+             *
+             * Only the own rows of the partition are written to y.
+             *
+             * @param p Partition
+             * @param x Global input vector
+             * @param y Global output vector (may not be equal to x)
+             * @param steps Amount of matrix vector products (at most the amount of steps given to build)
+             * @param x_scale Scale factor for the input vector
+             * @param step_scale Scale factor applied after every matrix vector product
+             * @return T Sum of squares of the own rows of y
+             */
+            T run(int p, const T* x, T* y, int steps, T x_scale, T step_scale) {
+                assert(steps <= s);
+                Part& part = parts[p];
+
+                // Read the ghost zone of the input vector
+                for (int_type v = 0; v < part.level_end[steps]; ++v) {
+                    part.buf_in[v] = x_scale*x[part.rows[v]];
+                }
+
+                // Every step the rows of the outermost level are no longer needed
+                for (int k = 1; k <= steps; ++k) {
+                    const T* in = part.buf_in.data();
+                    T* out = part.buf_out.data();
+                    int_type j;
+                    for (int_type v = 0; v < part.level_end[steps-k]; ++v) {
+                        T sum = 0.;
+                        for (nnz_type l = part.row_start[v]; l < part.row_start[v+1]; ++l) {
+                            j = part.col_ind[l];
+                            sum += part.data_arr[l]*in[j];
+                        }
+                        out[v] = step_scale*sum;
+                    }
+
+                    part.buf_in.swap(part.buf_out);
+                }
+
+                // Write own rows
+                T norm_part = 0.;
+                for (int_type v = 0; v < part.level_end[0]; ++v) {
+                    y[part.rows[v]] = part.buf_in[v];
+                    norm_part += part.buf_in[v]*part.buf_in[v];
+                }
+
+                return norm_part;
+            }
+    };
+} // namespace pwm
+
+#endif // PWM_MATRIXPOWERS_HPP
@@ -0,0 +1,267 @@
+/**
+ * @file Memory.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Arena which owns the aligned (and huge page backed) arrays of a matrix
+ * @version 0.1
+ * @date 2022-11-16
+ *
+ * Every allocation is aligned to a cache line (64 bytes). Allocations of at least 2 MB are mapped separately with mmap
+ * and backed by huge pages depending on the policy: advised for transparent huge pages (default), explicit huge pages
+ * with MAP_HUGETLB (falls back to transparent huge pages if no huge pages are reserved) or normal pages. The memory is
+ * not touched when it is allocated, so the first touch of the (parallel) fill loops still decides the NUMA placement.
+ *
+ * An arena frees all its arrays at once when it is reset or destroyed, the matrix classes reset their arena when a new
+ * matrix is loaded.
+ */
+
+#ifndef PWM_MEMORY_HPP
+#define PWM_MEMORY_HPP
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstdint>
+#include <type_traits>
+#include <new>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+namespace pwm {
+    // Huge page policy of the large allocations
+    enum class HugePages {
+        off,
+        thp,
+        hugetlb
+    };
+
+    // Global huge page policy (transparent huge pages by default)
+    inline HugePages& hugePagePolicy() {
+        static HugePages policy = HugePages::thp;
+        return policy;
+    }
+
+    /**
+     * @brief Set the huge page policy from a command line value (off, thp or hugetlb)
+     *
+     * @return bool False if the value is not known
+     */
+    inline bool setHugePagePolicy(const std::string& value) {
+        if (value == "off") hugePagePolicy() = HugePages::off;
+        else if (value == "thp") hugePagePolicy() = HugePages::thp;
+        else if (value == "hugetlb") hugePagePolicy() = HugePages::hugetlb;
+        else return false;
+
+        return true;
+    }
+
+    class Arena {
+        protected:
+            // One allocation of the arena
+            struct Block {
+                void* ptr;
+                size_t bytes;
+                bool mapped;
+            };
+
+            // All allocations of the arena
+            std::vector<Block> blocks;
+
+            // Total amount of bytes of the arena
+            size_t total = 0;
+
+            // Amount of resets, arrays which were allocated before a reset are freed
+            size_t reset_am = 0;
+
+            // Free the memory of one allocation
+            static void freeBlock(const Block& block) {
+                if (block.mapped) munmap(block.ptr, block.bytes);
+                else std::free(block.ptr);
+            }
+
+            // Index of the allocation which starts at ptr
+            size_t findBlock(const void* ptr) const {
+                for (size_t i = 0; i < blocks.size(); ++i) {
+                    if (blocks[i].ptr == ptr) return i;
+                }
+
+                throw std::invalid_argument("Array is not allocated by this arena");
+            }
+
+        public:
+            // Alignment of every allocation (one cache line)
+            static constexpr size_t alignment = 64;
+
+            // Allocations of at least this size are mapped separately and use the huge page policy
+            static constexpr size_t huge_threshold = (size_t) 2 << 20;
+
+            // Base constructor
+            Arena() {}
+
+            // The arrays have one owner
+            Arena(const Arena&) = delete;
+            Arena& operator=(const Arena&) = delete;
+
+            // Move constructor
+            Arena(Arena&& other): blocks(std::move(other.blocks)), total(other.total) {
+                other.blocks.clear();
+                other.total = 0;
+            }
+
+            // Move assignment
+            Arena& operator=(Arena&& other) {
+                if (this != &other) {
+                    reset();
+                    blocks = std::move(other.blocks);
+                    total = other.total;
+                    other.blocks.clear();
+                    other.total = 0;
+                }
+
+                return *this;
+            }
+
+            // Destructor
+            ~Arena() {
+                reset();
+            }
+
+            /**
+             * @brief Allocate an uninitialized array which lives until the arena is reset
+             *
+             * @param n Amount of elements
+             * @return U* Array aligned to 64 bytes
+             */
+            template<typename U>
+            U* allocate(size_t n) {
+                static_assert(std::is_trivially_destructible<U>::value, "Arena arrays are freed without destructors");
+
+                size_t bytes = std::max<size_t>(n*sizeof(U), 1);
+                Block block{NULL, bytes, false};
+
+                if (bytes >= huge_threshold && hugePagePolicy() != HugePages::off) {
+                    // Round up to the huge page size such that the tail is also backed by a huge page
+                    block.bytes = (bytes + huge_threshold - 1)/huge_threshold*huge_threshold;
+                    void* ptr = MAP_FAILED;
+                    if (hugePagePolicy() == HugePages::hugetlb) {
+                        ptr = mmap(NULL, block.bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                    }
+
+                    if (ptr == MAP_FAILED) {
+                        ptr = mmap(NULL, block.bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                        if (ptr != MAP_FAILED) madvise(ptr, block.bytes, MADV_HUGEPAGE);
+                    }
+
+                    if (ptr == MAP_FAILED) throw std::bad_alloc();
+                    block.ptr = ptr;
+                    block.mapped = true;
+                } else {
+                    block.bytes = (bytes + alignment - 1)/alignment*alignment;
+                    block.ptr = std::aligned_alloc(alignment, block.bytes);
+                    if (block.ptr == NULL) throw std::bad_alloc();
+                }
+
+                blocks.push_back(block);
+                total += block.bytes;
+                return static_cast<U*>(block.ptr);
+            }
+
+            /**
+             * @brief Free one array before the arena is reset
+             *
+             * @param ptr Array allocated by this arena
+             */
+            void deallocate(const void* ptr) {
+                size_t i = findBlock(ptr);
+                freeBlock(blocks[i]);
+                total -= blocks[i].bytes;
+                blocks.erase(blocks.begin() + i);
+            }
+
+            /**
+             * @brief Move an array of another arena to this arena without copying it
+             *
+             * @param other Arena which allocated the array
+             * @param ptr Array allocated by the other arena
+             * @return U* The same array, now owned by this arena
+             */
+            template<typename U>
+            U* adopt(Arena& other, U* ptr) {
+                size_t i = other.findBlock(ptr);
+                blocks.push_back(other.blocks[i]);
+                total += other.blocks[i].bytes;
+                other.total -= other.blocks[i].bytes;
+                other.blocks.erase(other.blocks.begin() + i);
+                return ptr;
+            }
+
+            /**
+             * @brief Free all arrays of the arena
+             */
+            void reset() {
+                for (const Block& block : blocks) freeBlock(block);
+
+                blocks.clear();
+                total = 0;
+                reset_am++;
+            }
+
+            // Total amount of bytes of the arena
+            size_t bytes() const { return total; }
+
+            // Amount of resets of the arena
+            size_t resets() const { return reset_am; }
+    };
+
+    /**
+     * @brief Peak resident set size of the process in bytes
+     */
+    inline size_t peakResidentBytes() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return (size_t) usage.ru_maxrss * 1024;
+    }
+
+    /**
+     * @brief Resident bytes of the process and the part of it which is backed by huge pages
+     *
+     * Read from /proc/self/smaps_rollup (transparent and explicit huge pages), both are 0 if it is not available.
+     */
+    inline void residentBytes(size_t& resident, size_t& huge) {
+        resident = 0;
+        huge = 0;
+
+        std::ifstream input("/proc/self/smaps_rollup");
+        std::string line;
+        while (std::getline(input, line)) {
+            std::istringstream words(line);
+            std::string key;
+            size_t kb = 0;
+            words >> key >> kb;
+            if (key == "Rss:") resident = kb * 1024;
+            else if (key == "AnonHugePages:" || key == "Private_Hugetlb:") huge += kb * 1024;
+        }
+    }
+
+    /**
+     * @brief Print the bytes of an arena and the (huge page backed) resident and peak resident memory of the process
+     *
+     * @param label Name of the arrays in the arena
+     * @param arena_bytes Bytes of the arena
+     */
+    inline void printMemoryReport(const std::string& label, size_t arena_bytes) {
+        size_t resident, huge;
+        residentBytes(resident, huge);
+
+        const double mb = 1024.*1024.;
+        std::cout << "Memory: " << label << " " << arena_bytes/mb << "MB, resident " << resident/mb << "MB (" << huge/mb;
+        std::cout << "MB huge pages), peak resident " << peakResidentBytes()/mb << "MB" << std::endl;
+    }
+} // namespace pwm
+
+#endif // PWM_MEMORY_HPP
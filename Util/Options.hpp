@@ -0,0 +1,68 @@
+/**
+ * @file Options.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Utility functions to parse optional command line flags of the drivers
+ * @version 0.1
+ * @date 2022-11-02
+ *
+ * The drivers take their main arguments positionally. Optional features are enabled with flags
+ * of the form "--name value" or "--name" which are placed after the positional arguments.
+ */
+
+#ifndef PWM_OPTIONS_HPP
+#define PWM_OPTIONS_HPP
+
+#include <string>
+
+#include <boost/lexical_cast.hpp>
+
+namespace pwm {
+    /**
+     * @brief Amount of positional arguments (including the program name)
+     *
+     * @param argc Amount of command line arguments
+     * @param argv Command line arguments
+     * @return int Index of the first optional flag or argc if there are none
+     */
+    inline int positionalArgs(int argc, char** argv) {
+        for (int i = 1; i < argc; ++i) {
+            if (std::string(argv[i]).rfind("--", 0) == 0) return i;
+        }
+
+        return argc;
+    }
+
+    /**
+     * @brief Check if an optional flag is present on the command line
+     *
+     * @param argc Amount of command line arguments
+     * @param argv Command line arguments
+     * @param name Name of the flag (including the leading dashes)
+     */
+    inline bool hasOption(int argc, char** argv, const std::string& name) {
+        for (int i = 1; i < argc; ++i) {
+            if (name == argv[i]) return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Get the value of an optional flag
+     *
+     * @param argc Amount of command line arguments
+     * @param argv Command line arguments
+     * @param name Name of the flag (including the leading dashes)
+     * @param default_val Value which is returned if the flag (or its value) is not present
+     */
+    template<typename V>
+    V getOption(int argc, char** argv, const std::string& name, V default_val) {
+        for (int i = 1; i < argc-1; ++i) {
+            if (name == argv[i]) return boost::lexical_cast<V>(argv[i+1]);
+        }
+
+        return default_val;
+    }
+} // namespace pwm
+
+#endif // PWM_OPTIONS_HPP
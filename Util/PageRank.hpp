@@ -0,0 +1,165 @@
+/**
+ * @file PageRank.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief PageRank of a graph built on the matrix vector product of the implementations
+ * @version 0.1
+ * @date 2022-11-20
+ *
+ * The adjacency matrix A of the graph is converted once at load time to the column stochastic matrix P = A^T D^-1, where
+ * D holds the out degrees (the sums of the absolute weights of the rows). P is stored in the usual row layout, so the
+ * product P x of every implementation is the pull step of PageRank. The PageRank vector is the fixed point of
+ *
+ *     x = d P x + (d m(x) + 1 - d)/n,   m(x) = sum of x over the dangling nodes (no outgoing edges)
+ *
+ * The columns of P of the dangling nodes are zero, so m(x) = sum(x) - sum(Px) with sum(x) = 1. The dangling mass is
+ * thus one reduction over the product instead of a gather over a list of dangling nodes, and the update of the iterate
+ * is fused with the L1 norm of the change which is the convergence check.
+ */
+
+#ifndef PWM_PAGERANK_HPP
+#define PWM_PAGERANK_HPP
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include "../Matrix/SparseMatrix.hpp"
+#include "../Matrix/Triplet.hpp"
+
+#include "omp.h"
+
+namespace pwm {
+    // Result of the PageRank iteration
+    template<typename T>
+    struct PageRankResult {
+        // L1 norm of the change of the last iteration
+        T change = 0.;
+
+        // Amount of iterations (matrix vector products)
+        int iterations = 0;
+
+        // The change satisfies the tolerance
+        bool converged = false;
+    };
+
+    /**
+     * @brief Convert the adjacency matrix of a graph to the column stochastic matrix P = A^T D^-1 of PageRank
+     *
+     * The weights are divided by the sum of the absolute weights of their row and the coordinates are swapped.
+     *
+     * @param input Adjacency matrix (square), converted in place
+     * @return long long Amount of dangling nodes (rows without nonzero weights)
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    long long toPageRankMatrix(Triplet<T, int_type, nnz_type>& input) {
+        std::vector<T> out_weight(input.row_size, 0.);
+        for (nnz_type k = 0; k < input.nnz; ++k) {
+            out_weight[input.row_coord[k]] += std::abs(input.data[k]);
+        }
+
+        #pragma omp parallel for
+        for (nnz_type k = 0; k < input.nnz; ++k) {
+            T weight = out_weight[input.row_coord[k]];
+            input.data[k] = weight > 0. ? std::abs(input.data[k]) / weight : 0.;
+        }
+
+        std::swap(input.row_coord, input.col_coord);
+        std::swap(input.row_size, input.col_size);
+
+        return std::count(out_weight.begin(), out_weight.end(), (T) 0.);
+    }
+
+    /**
+     * @brief PageRank iteration until the L1 norm of the change satisfies a tolerance
+     *
+     * @param mat Column stochastic matrix P of the graph (see toPageRankMatrix)
+     * @param x Start vector (normalized to sum 1 here), contains the PageRank vector at the end
+     * @param y Vector to store calculations
+     * @param damping Damping factor d (probability of following an edge)
+     * @param tol Tolerance on the L1 norm of the change of the iterate
+     * @param max_it Maximal amount of iterations
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    PageRankResult<T> pageRank(SparseMatrix<T, int_type, nnz_type>& mat, T* x, T* y, T damping, T tol, int max_it) {
+        const int_type n = mat.getRows();
+        PageRankResult<T> result;
+
+        T sum = mat.parallelSum([=](int_type begin, int_type end) -> T {
+            T part = 0.;
+            for (int_type i = begin; i < end; ++i) part += std::abs(x[i]);
+            return part;
+        });
+        mat.parallelFor([=](int_type begin, int_type end) {
+            for (int_type i = begin; i < end; ++i) x[i] = std::abs(x[i]) / sum;
+        });
+
+        T* in = x;
+        T* out = y;
+        while (result.iterations < max_it) {
+            mat.mv(in, out);
+            result.iterations++;
+
+            // Mass of the dangling nodes: the part of the iterate (sum 1) which the product lost
+            T kept = mat.parallelSum([=](int_type begin, int_type end) -> T {
+                T part = 0.;
+                for (int_type i = begin; i < end; ++i) part += out[i];
+                return part;
+            });
+            T teleport = (damping*(1. - kept) + 1. - damping) / n;
+
+            // Fused update and L1 norm of the change
+            result.change = mat.parallelSum([=](int_type begin, int_type end) -> T {
+                T part = 0.;
+                for (int_type i = begin; i < end; ++i) {
+                    T value = damping*out[i] + teleport;
+                    part += std::abs(value - in[i]);
+                    out[i] = value;
+                }
+                return part;
+            });
+
+            std::swap(in, out);
+            if (result.change <= tol) {
+                result.converged = true;
+                break;
+            }
+        }
+
+        // The last iterate is in y after an odd amount of iterations
+        if (in != x) {
+            mat.parallelFor([=](int_type begin, int_type end) {
+                std::copy(y + begin, y + end, x + begin);
+            });
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Run PageRank from the uniform vector and print the iterations, the time to converge and the edges per second
+     *
+     * @param mat Column stochastic matrix P of the graph
+     * @param damping Damping factor
+     * @param tol Tolerance on the L1 norm of the change
+     * @param max_it Maximal amount of iterations
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void printPageRankReport(SparseMatrix<T, int_type, nnz_type>& mat, T damping, T tol, int max_it) {
+        const int_type n = mat.getRows();
+        std::vector<T> x(n, 1.), y(n);
+
+        double start = omp_get_wtime();
+        PageRankResult<T> result = pwm::pageRank(mat, x.data(), y.data(), damping, tol, max_it);
+        double time = omp_get_wtime() - start;
+
+        std::cout << "PageRank (damping " << damping << ", L1 tolerance " << tol << "): " << time * 1000 << "ms, ";
+        std::cout << result.iterations << " iterations, change " << result.change << (result.converged ? "" : " (not converged)") << std::endl;
+        std::cout << "  " << (double) mat.getNonzeros() * result.iterations / time / 1e6 << " million edges per second" << std::endl;
+
+        int_type top = (int_type) (std::max_element(x.begin(), x.end()) - x.begin());
+        std::cout << "  highest rank " << x[top] << " of node " << top << " (" << x[top]*n << "x uniform)" << std::endl;
+    }
+} // namespace pwm
+
+#endif // PWM_PAGERANK_HPP
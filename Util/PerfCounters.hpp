@@ -0,0 +1,340 @@
+/**
+ * @file PerfCounters.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Hardware performance counters per thread using perf_event_open
+ * @version 0.1
+ * @date 2022-11-09
+ *
+ * Only used when compiled with PWM_PERF_COUNTERS (see the _perf targets in the Makefile), otherwise the
+ * PWM_PERF_SCOPE macro does nothing. Every thread opens one group of counters the first time it is measured.
+ * The counters only count user space events of the calling thread, so a perf_event_paranoid level of 2 is enough.
+ * A measured scope adds its counts to a slot (a partition or a thread), the caller slot counts the complete
+ * mv or powerMethod call on the thread which calls it.
+ *
+ * When a counter can not be opened (no permission, no PMU in a virtual machine...) it is reported as not available
+ * and the rest of the program runs unchanged.
+ */
+
+#ifndef PWM_PERFCOUNTERS_HPP
+#define PWM_PERFCOUNTERS_HPP
+
+#include <vector>
+#include <array>
+#include <mutex>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+
+namespace pwm {
+    // Counts of one measurement (raw values of the counter group)
+    struct PerfSample {
+        std::array<uint64_t, 5> values;
+        uint64_t enabled = 0;
+        uint64_t running = 0;
+        bool valid = false;
+    };
+
+    class PerfCounters {
+        public:
+            // Measured events
+            enum Event {CYCLES = 0, INSTRUCTIONS, LLC_MISSES, DTLB_MISSES, STALL_CYCLES, EVENTS};
+
+            // Slot for a complete mv or powerMethod call on the calling thread
+            static const int caller = -1;
+
+        protected:
+            // Counter group of one thread
+            struct ThreadGroup {
+                bool opened = false;
+
+                // File descriptor of the group leader (-1 if not available)
+                int leader = -1;
+
+                // File descriptors of all events
+                std::array<int, EVENTS> fds;
+
+                // Position of each event in the group read (-1 if not available)
+                std::array<int, EVENTS> index;
+
+                // Amount of events in the group
+                int size = 0;
+
+                // Depth of nested caller scopes
+                int caller_depth = 0;
+
+                ~ThreadGroup() {
+                    for (int e = 0; e < EVENTS; ++e) {
+                        if (index[e] >= 0) close(fds[e]);
+                    }
+                }
+            };
+
+            // Scaled counts of each slot
+            std::vector<std::array<double, EVENTS>> slots;
+
+            // Scaled counts of the caller slot
+            std::array<double, EVENTS> caller_counts;
+
+            // Protects the counts
+            std::mutex lock;
+
+            /**
+             * @brief Type and config of each event for perf_event_open
+             */
+            static void eventConfig(int e, __u32& type, __u64& config) {
+                switch (e) {
+                    case CYCLES:
+                        type = PERF_TYPE_HARDWARE;
+                        config = PERF_COUNT_HW_CPU_CYCLES;
+                        break;
+
+                    case INSTRUCTIONS:
+                        type = PERF_TYPE_HARDWARE;
+                        config = PERF_COUNT_HW_INSTRUCTIONS;
+                        break;
+
+                    case LLC_MISSES:
+                        type = PERF_TYPE_HW_CACHE;
+                        config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                        break;
+
+                    case DTLB_MISSES:
+                        type = PERF_TYPE_HW_CACHE;
+                        config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                        break;
+
+                    default:
+                        // Cycles in which the backend (mostly the memory subsystem) stalls
+                        type = PERF_TYPE_HARDWARE;
+                        config = PERF_COUNT_HW_STALLED_CYCLES_BACKEND;
+                        break;
+                }
+            }
+
+            /**
+             * @brief Counter group of the calling thread, opened on first use
+             */
+            static ThreadGroup& threadGroup() {
+                thread_local ThreadGroup group;
+                if (group.opened) return group;
+
+                group.opened = true;
+                group.index.fill(-1);
+                for (int e = 0; e < EVENTS; ++e) {
+                    perf_event_attr attr;
+                    std::memset(&attr, 0, sizeof(attr));
+                    attr.size = sizeof(attr);
+                    eventConfig(e, attr.type, attr.config);
+                    attr.exclude_kernel = 1;
+                    attr.exclude_hv = 1;
+                    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+                    int fd = syscall(__NR_perf_event_open, &attr, 0, -1, group.leader, 0);
+                    if (fd < 0) {
+                        if (e == CYCLES) {
+                            unavailableReason() = std::strerror(errno);
+                            return group;
+                        }
+
+                        continue;
+                    }
+
+                    if (e == CYCLES) group.leader = fd;
+                    group.fds[e] = fd;
+                    group.index[e] = group.size++;
+                }
+
+                availableEvents() = group.index;
+                return group;
+            }
+
+            // Reason why the counters are not available
+            static std::string& unavailableReason() {
+                static std::string reason;
+                return reason;
+            }
+
+            // Position of each event in the group read of the first thread which opened its counters
+            static std::array<int, EVENTS>& availableEvents() {
+                static std::array<int, EVENTS> events = {-1, -1, -1, -1, -1};
+                return events;
+            }
+
+        public:
+            // Base constructor
+            PerfCounters() {
+                caller_counts.fill(0.);
+            }
+
+            /**
+             * @brief Read the counters of the calling thread
+             */
+            static PerfSample read() {
+                PerfSample sample;
+                ThreadGroup& group = threadGroup();
+                if (group.leader < 0) return sample;
+
+                uint64_t buf[3 + EVENTS];
+                if (::read(group.leader, buf, sizeof(buf)) < (ssize_t) ((3 + group.size)*sizeof(uint64_t))) return sample;
+
+                sample.enabled = buf[1];
+                sample.running = buf[2];
+                for (int e = 0; e < EVENTS; ++e) {
+                    sample.values[e] = group.index[e] >= 0 ? buf[3 + group.index[e]] : 0;
+                }
+                sample.valid = true;
+                return sample;
+            }
+
+            /**
+             * @brief Start a measurement on the calling thread
+             *
+             * @param slot Slot to which the measurement is added (caller for a complete call)
+             */
+            PerfSample start(int slot) {
+                if (slot == caller && threadGroup().caller_depth++ > 0) return PerfSample();
+
+                return read();
+            }
+
+            /**
+             * @brief Stop a measurement on the calling thread and add the counts to the slot
+             *
+             * Counts are scaled with the fraction of time the group was running on the PMU (multiplexing).
+             *
+             * @param begin Sample returned by start
+             * @param slot Slot to which the measurement is added
+             */
+            void stop(const PerfSample& begin, int slot) {
+                if (slot == caller) threadGroup().caller_depth--;
+                if (!begin.valid) return;
+
+                PerfSample end = read();
+                if (!end.valid) return;
+
+                uint64_t running = end.running - begin.running;
+                double scale = running > 0 ? (double) (end.enabled - begin.enabled) / running : 0.;
+
+                std::lock_guard<std::mutex> guard(lock);
+                if (slot != caller && slot >= (int) slots.size()) {
+                    std::array<double, EVENTS> zero;
+                    zero.fill(0.);
+                    slots.resize(slot+1, zero);
+                }
+
+                std::array<double, EVENTS>& counts = slot == caller ? caller_counts : slots[slot];
+                for (int e = 0; e < EVENTS; ++e) {
+                    counts[e] += scale * (end.values[e] - begin.values[e]);
+                }
+            }
+
+            /**
+             * @brief Reset all counts (e.g. after the warm up runs)
+             */
+            void reset() {
+                std::lock_guard<std::mutex> guard(lock);
+                slots.clear();
+                caller_counts.fill(0.);
+            }
+
+            /**
+             * @brief Check if the counters could be opened
+             */
+            bool available() const {
+                return availableEvents()[CYCLES] >= 0;
+            }
+
+            /**
+             * @brief Print the counts per slot and in total
+             *
+             * @param executions Amount of measured executions, the counts are divided by this amount
+             */
+            void printSummary(int executions) {
+                read(); // Make sure the counters of the calling thread are opened
+                if (!available()) {
+                    std::cout << "Hardware counters not available (perf_event_open: " << unavailableReason() << ")" << std::endl;
+                    return;
+                }
+
+                const char* names[EVENTS] = {"Cycles", "Instructions", "LLC misses", "DTLB misses", "Stall cycles"};
+                executions = std::max(executions, 1);
+
+                std::cout << "Hardware counters per execution:" << std::endl;
+                std::cout << std::setw(10) << "Slot";
+                for (int e = 0; e < EVENTS; ++e) std::cout << std::setw(15) << names[e];
+                std::cout << std::setw(8) << "IPC" << std::endl;
+
+                std::array<double, EVENTS> total;
+                total.fill(0.);
+                for (size_t s = 0; s <= slots.size(); ++s) {
+                    bool is_total = s == slots.size();
+                    std::array<double, EVENTS>& counts = is_total ? total : slots[s];
+
+                    if (is_total) std::cout << std::setw(10) << "Total";
+                    else std::cout << std::setw(10) << s;
+                    printCounts(counts, executions);
+
+                    if (!is_total) {
+                        for (int e = 0; e < EVENTS; ++e) total[e] += counts[e];
+                    }
+                }
+
+                std::cout << std::setw(10) << "Caller";
+                printCounts(caller_counts, executions);
+            }
+
+        protected:
+            // Print one line of the summary
+            void printCounts(const std::array<double, EVENTS>& counts, int executions) {
+                for (int e = 0; e < EVENTS; ++e) {
+                    if (availableEvents()[e] >= 0) std::cout << std::setw(15) << (uint64_t) (counts[e] / executions);
+                    else std::cout << std::setw(15) << "n/a";
+                }
+
+                if (counts[CYCLES] > 0 && availableEvents()[INSTRUCTIONS] >= 0) {
+                    std::streamsize precision = std::cout.precision(3);
+                    std::cout << std::setw(8) << counts[INSTRUCTIONS] / counts[CYCLES] << std::endl;
+                    std::cout.precision(precision);
+                } else {
+                    std::cout << std::setw(8) << "n/a" << std::endl;
+                }
+            }
+    };
+
+    // Measures the enclosing scope and adds the counts to a slot
+    class PerfScope {
+        protected:
+            PerfCounters& counters;
+            int slot;
+            PerfSample begin;
+
+        public:
+            PerfScope(PerfCounters& counters_in, int slot_in): counters(counters_in), slot(slot_in) {
+                begin = counters.start(slot);
+            }
+
+            ~PerfScope() {
+                counters.stop(begin, slot);
+            }
+    };
+} // namespace pwm
+
+#define PWM_PERF_CONCAT_(a, b) a##b
+#define PWM_PERF_CONCAT(a, b) PWM_PERF_CONCAT_(a, b)
+
+// Measure the enclosing scope when compiled with PWM_PERF_COUNTERS
+#ifdef PWM_PERF_COUNTERS
+#define PWM_PERF_SCOPE(counters, slot) pwm::PerfScope PWM_PERF_CONCAT(pwm_perf_scope_, __LINE__)(counters, slot)
+#else
+#define PWM_PERF_SCOPE(counters, slot)
+#endif
+
+#endif // PWM_PERFCOUNTERS_HPP
@@ -9,10 +9,27 @@
 #ifndef PWM_POISSONUTILL_HPP
 #define PWM_POISSONUTILL_HPP
 
+#include <vector>
+#include <algorithm>
+
 #include "omp.h"
 #include "oneapi/tbb.h"
 
 namespace pwm {
+    /**
+     * @brief Amount of nonzeros of the 2D discretized Poisson matrix
+     * 
+     * Computed in nnz_type, the amount of nonzeros is about five times the amount of rows and overflows a 32-bit type
+     * long before the amount of rows does.
+     * 
+     * @param m The amount of discretization steps in the x direction
+     * @param n The amount of discretization steps in the y direction
+     */
+    template<typename nnz_type, typename int_type>
+    nnz_type poissonNonzeros(int_type m, int_type n) {
+        return (nnz_type) n*(m+2*(m-1)) + 2*((nnz_type) n-1)*m;
+    }
+
     /**
      * @brief Fill the 2D discretized Poisson matrix.
      * 
@@ -28,8 +45,8 @@ namespace pwm {
      * @param first_row First row of the matrix which is put into CRS format
      * @param last_row Last row of the matrix which is put into CRS format
      */
-    template<typename T, typename int_type>
-    void fillPoisson(T* data_arr, int_type* row_start, int_type* col_ind, int_type m, int_type n, int_type first_row = 0, int_type last_row = 0) {
+    template<typename T, typename int_type, typename nnz_type>
+    void fillPoisson(T* data_arr, nnz_type* row_start, int_type* col_ind, int_type m, int_type n, int_type first_row = 0, int_type last_row = 0) {
         if (last_row == 0) {
             last_row = m*n;
         }
@@ -37,7 +54,7 @@ namespace pwm {
         row_start[0] = 0;
 
         // Fill data rows
-        int_type nnz_index = 0;
+        nnz_type nnz_index = 0;
         for (int_type row = first_row; row < last_row; ++row) {
 
             // Check for identity before D
@@ -80,6 +97,25 @@ namespace pwm {
         }
     }
 
+    /**
+     * @brief Fill the 2D discretized Poisson matrix in Triplet format, e.g. to reorder it before it is converted
+     * 
+     * @param data Data array of Triplet format (poissonNonzeros(m, n) entries)
+     * @param row_coord Row coordinate array of Triplet format
+     * @param col_coord Column coordinate array of Triplet format
+     * @param m The amount of discretization steps in the x direction
+     * @param n The amount of discretization steps in the y direction
+     */
+    template<typename T, typename int_type>
+    void fillPoissonTriplets(T* data, int_type* row_coord, int_type* col_coord, int_type m, int_type n) {
+        std::vector<long long> row_start((size_t) m*n + 1);
+        fillPoisson(data, row_start.data(), col_coord, m, n);
+
+        for (int_type row = 0; row < m*n; ++row) {
+            std::fill(row_coord + row_start[row], row_coord + row_start[row+1], row);
+        }
+    }
+
     /**
      * @brief Fill the 2D discretized Poisson matrix.
      * 
@@ -97,8 +133,8 @@ namespace pwm {
      * @param first_row First row of the matrix which is put into CRS format
      * @param last_row Last row of the matrix which is put into CRS format
      */
-    template<typename T, typename int_type>
-    void fillPoissonOMP(T* data_arr, int_type* row_start, int_type* col_ind, int_type m, int_type n) {
+    template<typename T, typename int_type, typename nnz_type>
+    void fillPoissonOMP(T* data_arr, nnz_type* row_start, int_type* col_ind, int_type m, int_type n) {
         int_type last_row = m*n;
         row_start[0] = 0;
 
@@ -106,13 +142,13 @@ namespace pwm {
         #pragma omp parallel for shared(data_arr, row_start, col_ind) schedule(dynamic, 8)
         for (int_type row = 0; row < last_row; ++row) {
             // Calculate nnz_index (this is needed because this variable can't be shared anymore).
-            int_type nnz_index = 0;
+            nnz_type nnz_index = 0;
             if (row > 0) {
-                nnz_index += std::max(0, row - m);
-                nnz_index += (row/m)*(m-1) + row%m;
+                nnz_index += std::max<int_type>(0, row - m);
+                nnz_index += (nnz_type) (row/m)*(m-1) + row%m;
                 nnz_index += row;
-                nnz_index += (row/m)*(m-1) + row%m;
-                nnz_index += std::min(row, m*n - m);
+                nnz_index += (nnz_type) (row/m)*(m-1) + row%m;
+                nnz_index += std::min<int_type>(row, m*n - m);
             
                 if (row % m >= 1) nnz_index -= 1;
             }            
@@ -174,21 +210,21 @@ namespace pwm {
      * @param first_row First row of the matrix which is put into CRS format
      * @param last_row Last row of the matrix which is put into CRS format
      */
-    template<typename T, typename int_type>
-    void fillPoissonTBB(T* data_arr, int_type* row_start, int_type* col_ind, int_type m, int_type n) {
+    template<typename T, typename int_type, typename nnz_type>
+    void fillPoissonTBB(T* data_arr, nnz_type* row_start, int_type* col_ind, int_type m, int_type n) {
         int_type last_row = m*n;
         row_start[0] = 0;
 
         // Fill data rows using TBB to avoid first touch
-        tbb::parallel_for(0, last_row, [=](int_type row) {
+        tbb::parallel_for((int_type) 0, last_row, [=](int_type row) {
             // Calculate nnz_index (this is needed because this variable can't be shared anymore).
-            int_type nnz_index = 0;
+            nnz_type nnz_index = 0;
             if (row > 0) {
-                nnz_index += std::max(0, row - m);
-                nnz_index += (row/m)*(m-1) + row%m;
+                nnz_index += std::max<int_type>(0, row - m);
+                nnz_index += (nnz_type) (row/m)*(m-1) + row%m;
                 nnz_index += row;
-                nnz_index += (row/m)*(m-1) + row%m;
-                nnz_index += std::min(row, m*n - m);
+                nnz_index += (nnz_type) (row/m)*(m-1) + row%m;
+                nnz_index += std::min<int_type>(row, m*n - m);
             
                 if (row % m >= 1) nnz_index -= 1;
             }            
@@ -0,0 +1,191 @@
+/**
+ * @file Reproducible.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Reductions which give the same bits for every amount of threads, partitioning and schedule
+ * @version 0.1
+ * @date 2022-11-27
+ *
+ * In the reproducible mode the rows are split in blocks of a fixed size. Every block is summed sequentially and the
+ * block sums are added with a fixed pairwise tree, so the order of the additions only depends on the amount of rows.
+ * The blocks are spread over the parallel loop of the implementation: a block is summed by the range which contains
+ * its first row (it may read rows of the next range). norm2, parallelSum of every implementation and
+ * parallelColumnSums use these reductions, so the power method and the solvers built on the parallel sums give the
+ * same result for every amount of threads and for all implementations which sum the nonzeros of a row in order.
+ * The products which split rows over threads (merge path, long rows of the adaptive CRS) use splits which do not depend
+ * on the amount of threads when the mode is set before the matrix is loaded.
+ * The transpose products use the transposed CRS (the scatter version depends on the schedule).
+ */
+
+#ifndef PWM_REPRODUCIBLE_HPP
+#define PWM_REPRODUCIBLE_HPP
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cstdint>
+
+#include "omp.h"
+
+namespace pwm {
+    template<typename T, typename int_type, typename nnz_type>
+    class SparseMatrix;
+
+    // Rows of a block of the reproducible reductions (independent of the amount of threads)
+    constexpr long long reproducible_block = 4096;
+
+    // Global reproducible mode (off by default)
+    inline bool& reproducibleMode() {
+        static bool mode = false;
+        return mode;
+    }
+
+    /**
+     * @brief Add partial sums with a fixed pairwise tree, the order only depends on the amount of partial sums
+     *
+     * @param parts Partial sums, destroyed
+     * @param count Amount of partial sums
+     * @param stride Distance between two partial sums in parts
+     */
+    template<typename T>
+    T treeSum(T* parts, size_t count, size_t stride = 1) {
+        if (count == 0) return 0.;
+
+        for (size_t step = 1; step < count; step *= 2) {
+            for (size_t i = 0; i + step < count; i += 2*step) parts[i*stride] += parts[(i + step)*stride];
+        }
+
+        return parts[0];
+    }
+
+    /**
+     * @brief Reproducible dot product, the blocks are summed in parallel with OpenMP
+     */
+    template<typename T, typename int_type>
+    T reproducibleDot(const T* x, const T* y, int_type size) {
+        const long long blocks = (size + reproducible_block - 1) / reproducible_block;
+        std::vector<T> parts(blocks);
+
+        #pragma omp parallel for schedule(static) if(blocks > 1)
+        for (long long b = 0; b < blocks; ++b) {
+            int_type end = (int_type) std::min<long long>(size, (b + 1)*reproducible_block);
+            T sum = 0.;
+            for (int_type i = (int_type) (b*reproducible_block); i < end; ++i) sum += x[i]*y[i];
+            parts[b] = sum;
+        }
+
+        return treeSum(parts.data(), blocks);
+    }
+
+    /**
+     * @brief Reproducible sum over the rows with the parallel loop of a matrix
+     *
+     * @param parallel_for Parallel loop over the rows of the matrix
+     * @param nor Amount of rows
+     * @param body Function which returns the partial sum of a range of rows
+     */
+    template<typename T, typename int_type, typename For>
+    T reproducibleSum(For parallel_for, int_type nor, const std::function<T(int_type, int_type)>& body) {
+        const long long blocks = (nor + reproducible_block - 1) / reproducible_block;
+        std::vector<T> parts(blocks, 0.);
+        T* part = parts.data();
+
+        parallel_for([=, &body](int_type begin, int_type end) {
+            for (long long b = (begin + reproducible_block - 1) / reproducible_block; b*reproducible_block < end; ++b) {
+                part[b] = body((int_type) (b*reproducible_block), (int_type) std::min<long long>(nor, (b + 1)*reproducible_block));
+            }
+        });
+
+        return treeSum(part, blocks);
+    }
+
+    /**
+     * @brief Reproducible version of several sums over the rows at once (see parallelColumnSums)
+     *
+     * @param parallel_for Parallel loop over the rows of the matrix
+     * @param nor Amount of rows
+     * @param count Amount of sums
+     * @param body Function which adds the partial sums of a range of rows to an array of count zeros
+     * @param sums Output array of count sums
+     */
+    template<typename T, typename int_type, typename For>
+    void reproducibleColumnSums(For parallel_for, int_type nor, int count, const std::function<void(int_type, int_type, T*)>& body, T* sums) {
+        const long long blocks = (nor + reproducible_block - 1) / reproducible_block;
+        std::vector<T> parts((size_t) blocks*count, 0.);
+        T* part = parts.data();
+
+        parallel_for([=, &body](int_type begin, int_type end) {
+            for (long long b = (begin + reproducible_block - 1) / reproducible_block; b*reproducible_block < end; ++b) {
+                body((int_type) (b*reproducible_block), (int_type) std::min<long long>(nor, (b + 1)*reproducible_block), part + b*count);
+            }
+        });
+
+        for (int c = 0; c < count; ++c) sums[c] = treeSum(part + c, blocks, count);
+    }
+
+    /**
+     * @brief Hash of the bits of a vector (FNV-1a) to compare results of different runs
+     */
+    template<typename T, typename int_type>
+    uint64_t vectorHash(const T* x, int_type size) {
+        uint64_t hash = 14695981039346656037ull;
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(x);
+        for (size_t i = 0; i < (size_t) size*sizeof(T); ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+
+        return hash;
+    }
+
+    /**
+     * @brief Compare the power method and the parallel dot product of the reproducible mode with the fast mode and
+     * print the hash of the reproducible result
+     *
+     * @param mat Square matrix
+     * @param it Amount of iterations of the power method
+     * @param s Amount of iterations between two normalizations (1 for the power method)
+     * @param repeat Amount of timed runs of each mode (the minimum is reported)
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void printReproducibleReport(SparseMatrix<T, int_type, nnz_type>& mat, int it, int s, int repeat) {
+        const int_type n = mat.getRows();
+        std::vector<T> x(n), y(n);
+        const bool mode = reproducibleMode();
+
+        double power_time[2], dot_time[2];
+        for (int reproducible = 0; reproducible < 2; ++reproducible) {
+            reproducibleMode() = reproducible == 1;
+            power_time[reproducible] = dot_time[reproducible] = 1e300;
+
+            for (int r = 0; r < repeat; ++r) {
+                std::fill(x.begin(), x.end(), 1.);
+                double start = omp_get_wtime();
+                if (s > 1) mat.powerMethodSStep(x.data(), y.data(), it, s);
+                else mat.powerMethod(x.data(), y.data(), it);
+                power_time[reproducible] = std::min(power_time[reproducible], (omp_get_wtime() - start) * 1000);
+
+                const T* a = x.data();
+                start = omp_get_wtime();
+                for (int d = 0; d < it; ++d) {
+                    mat.parallelSum([=](int_type begin, int_type end) -> T {
+                        T sum = 0.;
+                        for (int_type i = begin; i < end; ++i) sum += a[i]*a[i];
+                        return sum;
+                    });
+                }
+                dot_time[reproducible] = std::min(dot_time[reproducible], (omp_get_wtime() - start) * 1000);
+            }
+        }
+        reproducibleMode() = mode;
+
+        const T* result = it % 2 == 0 ? x.data() : y.data();
+        std::cout << "Reproducible reductions (blocks of " << reproducible_block << " rows): power method " << power_time[1] << "ms, fast ";
+        std::cout << power_time[0] << "ms (overhead " << (power_time[1]/power_time[0] - 1.)*100 << "%), " << it << " dot products ";
+        std::cout << dot_time[1] << "ms, fast " << dot_time[0] << "ms (overhead " << (dot_time[1]/dot_time[0] - 1.)*100 << "%)" << std::endl;
+        std::cout << "  hash of the reproducible result: " << std::hex << vectorHash(result, n) << std::dec << std::endl;
+    }
+} // namespace pwm
+
+#endif // PWM_REPRODUCIBLE_HPP
@@ -0,0 +1,181 @@
+/**
+ * @file Singular.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Largest singular value and HITS scores with the power method on A^T A and A A^T
+ * @version 0.1
+ * @date 2022-11-23
+ *
+ * The power method on A^T A converges to the right singular vector v of the largest singular value s (the eigenvalue
+ * is s^2), the power method on A A^T to the left singular vector u. The products are the fused mvTmv and mvmvT of the
+ * matrix, which read the matrix once per iteration instead of a product with A followed by one with A^T.
+ *
+ * For the adjacency matrix A of a graph (A_ij > 0 for an edge from i to j) v holds the HITS authority scores and
+ * A v the hub scores (Kleinberg), both are normalized to sum 1.
+ */
+
+#ifndef PWM_SINGULAR_HPP
+#define PWM_SINGULAR_HPP
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include "../Matrix/SparseMatrix.hpp"
+#include "Lanczos.hpp"
+
+#include "omp.h"
+
+namespace pwm {
+    // Result of the power method on A^T A or A A^T
+    template<typename T>
+    struct SingularResult {
+        // Largest singular value (square root of the eigenvalue of the normal matrix)
+        T value = 0.;
+
+        // Residual norm |Nv - s^2 v| with the normal matrix N
+        T residual = 0.;
+
+        // Amount of products with the normal matrix
+        int products = 0;
+
+        // The residual satisfies the tolerance
+        bool converged = false;
+    };
+
+    /**
+     * @brief Power method on A^T A (right singular vector) or A A^T (left singular vector) until the residual of the
+     * Rayleigh quotient satisfies a relative tolerance
+     *
+     * @param mat Square matrix
+     * @param x Start vector, contains the singular vector at the end
+     * @param y Vector to store calculations
+     * @param left Iterate with A A^T instead of A^T A
+     * @param tol Relative tolerance on the residual norm
+     * @param max_it Maximal amount of iterations
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    SingularResult<T> singularPowerMethod(SparseMatrix<T, int_type, nnz_type>& mat, T* x, T* y, bool left, T tol, int max_it) {
+        SingularResult<T> result;
+
+        T norm = std::sqrt(parallelDot(mat, x, x));
+        mat.parallelFor([=](int_type begin, int_type end) {
+            for (int_type i = begin; i < end; ++i) x[i] /= norm;
+        });
+
+        while (result.products < max_it) {
+            if (left) mat.mvmvT(x, y);
+            else mat.mvTmv(x, y);
+            result.products++;
+
+            T value = parallelDot(mat, x, y);
+            T residual = std::sqrt(mat.parallelSum([=](int_type begin, int_type end) -> T {
+                T sum = 0.;
+                for (int_type i = begin; i < end; ++i) sum += (y[i] - value*x[i])*(y[i] - value*x[i]);
+                return sum;
+            }));
+
+            result.value = std::sqrt(std::abs(value));
+            result.residual = residual;
+            if (residual <= tol*std::abs(value)) {
+                result.converged = true;
+                break;
+            }
+
+            norm = std::sqrt(parallelDot(mat, y, y));
+            mat.parallelFor([=](int_type begin, int_type end) {
+                for (int_type i = begin; i < end; ++i) x[i] = y[i] / norm;
+            });
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Scale a vector to sum 1 (with absolute values, the singular vectors have an arbitrary sign)
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void normalizeSum(SparseMatrix<T, int_type, nnz_type>& mat, T* x) {
+        T sum = mat.parallelSum([=](int_type begin, int_type end) -> T {
+            T part = 0.;
+            for (int_type i = begin; i < end; ++i) part += std::abs(x[i]);
+            return part;
+        });
+        mat.parallelFor([=](int_type begin, int_type end) {
+            for (int_type i = begin; i < end; ++i) x[i] = std::abs(x[i]) / sum;
+        });
+    }
+
+    /**
+     * @brief Compute the largest singular value with A^T A and A A^T and print the products per second of the transpose
+     * products, optionally with the nodes of the highest HITS scores
+     *
+     * @param mat Square matrix
+     * @param hits Print the highest authority and hub scores (adjacency matrix of a graph)
+     * @param tol Relative tolerance on the residual norm
+     * @param max_it Maximal amount of iterations of each power method
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void printSingularReport(SparseMatrix<T, int_type, nnz_type>& mat, bool hits, T tol, int max_it) {
+        const int_type n = mat.getRows();
+        std::vector<T> x(n, 1.), y(n);
+
+        // The first transpose product chooses the version and builds the transposed CRS
+        double start = omp_get_wtime();
+        mat.mvT(x.data(), y.data());
+        double setup_time = (omp_get_wtime() - start) * 1000;
+
+        const int repeat = 10;
+        start = omp_get_wtime();
+        for (int i = 0; i < repeat; ++i) mat.mv(x.data(), y.data());
+        double mv_time = (omp_get_wtime() - start) * 1000 / repeat;
+
+        start = omp_get_wtime();
+        for (int i = 0; i < repeat; ++i) mat.mvT(x.data(), y.data());
+        double mvt_time = (omp_get_wtime() - start) * 1000 / repeat;
+
+        start = omp_get_wtime();
+        for (int i = 0; i < repeat; ++i) mat.mvTmv(x.data(), y.data());
+        double fused_time = (omp_get_wtime() - start) * 1000 / repeat;
+
+        std::cout << "Transpose product (" << (mat.transposeStored() ? "transposed CRS" : "without transposed CRS") << ", first product " << setup_time << "ms): ";
+        std::cout << mvt_time << "ms, product " << mv_time << "ms, fused A^T A product " << fused_time << "ms (";
+        std::cout << fused_time/(mv_time + mvt_time) << "x of both products)" << std::endl;
+
+        // HITS starts from the uniform scores, the singular values from a random vector (x = 1 can be orthogonal to the
+        // singular vector, e.g. on the Poisson matrix with an even m)
+        if (hits) std::fill(x.begin(), x.end(), 1.);
+        else pwm::reportStart(x.data(), n);
+        start = omp_get_wtime();
+        SingularResult<T> right = pwm::singularPowerMethod(mat, x.data(), y.data(), false, tol, max_it);
+        double right_time = (omp_get_wtime() - start) * 1000;
+
+        std::cout << "Power method on A^T A (tolerance " << tol << "): " << right_time << "ms, " << right.products << " products";
+        std::cout << (right.converged ? "" : " (not converged)") << std::endl;
+        std::cout << "  singular value " << right.value << ", residual " << right.residual << std::endl;
+
+        std::vector<T> u(n);
+        pwm::reportStart(u.data(), n);
+        start = omp_get_wtime();
+        SingularResult<T> left = pwm::singularPowerMethod(mat, u.data(), y.data(), true, tol, max_it);
+        double left_time = (omp_get_wtime() - start) * 1000;
+
+        std::cout << "Power method on A A^T (tolerance " << tol << "): " << left_time << "ms, " << left.products << " products";
+        std::cout << (left.converged ? "" : " (not converged)") << std::endl;
+        std::cout << "  singular value " << left.value << ", residual " << left.residual << std::endl;
+
+        if (hits) {
+            // Authorities are the right singular vector, hubs its product with A
+            mat.mv(x.data(), y.data());
+            pwm::normalizeSum(mat, x.data());
+            pwm::normalizeSum(mat, y.data());
+
+            int_type authority = (int_type) (std::max_element(x.begin(), x.end()) - x.begin());
+            int_type hub = (int_type) (std::max_element(y.begin(), y.end()) - y.begin());
+            std::cout << "HITS: highest authority " << x[authority] << " of node " << authority;
+            std::cout << ", highest hub " << y[hub] << " of node " << hub << std::endl;
+        }
+    }
+} // namespace pwm
+
+#endif // PWM_SINGULAR_HPP
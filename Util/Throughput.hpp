@@ -0,0 +1,251 @@
+/**
+ * @file Throughput.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Throughput mode: many independent power methods on the same matrix
+ * @version 0.1
+ * @date 2022-11-24
+ *
+ * The timed runs of the drivers solve one power method at a time with all threads. For a workload of many independent
+ * solves two schedules keep all cores busy with less synchronization:
+ *  - tasks: every solve is a TBB task which runs the power method in its thread with a sequential product on the CRS
+ *    arrays of the matrix (all partitions). The tasks are stolen by idle threads, the vectors of a thread are allocated
+ *    once and reused by all solves it runs.
+ *  - batch: the solves are computed in batches of interleaved vectors with mvBatch of the implementation, so the
+ *    matrix is read once per iteration of a batch. The batch arrays are allocated once for all batches.
+ * Implementations without CRS arrays only support the batch schedule.
+ */
+
+#ifndef PWM_THROUGHPUT_HPP
+#define PWM_THROUGHPUT_HPP
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+#include "../Matrix/SparseMatrix.hpp"
+#include "Memory.hpp"
+#include "Transpose.hpp"
+#include "Batch.hpp"
+
+#include "omp.h"
+#include "oneapi/tbb.h"
+
+namespace pwm {
+    // Schedule of the independent solves
+    enum class ThroughputMode {
+        tasks,
+        batch
+    };
+
+    // Result of a throughput run
+    template<typename T>
+    struct ThroughputResult {
+        // Wall time of all solves in ms
+        double time = 0.;
+
+        // Time of every solve in ms (for the batch schedule the time of its batch)
+        std::vector<double> latencies;
+
+        // Norm of the last product of every solve (estimate of the dominant eigenvalue)
+        std::vector<T> values;
+    };
+
+    /**
+     * @brief Start vector of a solve, different for every solve
+     */
+    template<typename T, typename int_type>
+    inline T throughputStart(int solve, int_type i) {
+        return 1. + 0.5*std::sin(0.7*(solve + 1)*(i + 1));
+    }
+
+    /**
+     * @brief Sequential product y = Ax with the CRS arrays of a matrix
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void sequentialMv(const std::vector<CRSPart<T, int_type, nnz_type>>& parts, const T* x, T* y) {
+        for (const CRSPart<T, int_type, nnz_type>& part : parts) {
+            T* y_part = y + part.first_row;
+            for (int_type i = 0; i < part.rows; ++i) {
+                T sum = 0.;
+                for (nnz_type k = part.row_start[i]; k < part.row_start[i+1]; ++k) {
+                    sum += part.data[k]*x[part.col_ind[k]];
+                }
+
+                y_part[i] = sum;
+            }
+        }
+    }
+
+    /**
+     * @brief Run independent power methods as TBB tasks, every task runs one solve with sequential products
+     *
+     * @param mat Square matrix with CRS arrays
+     * @param solves Amount of solves
+     * @param it Amount of iterations of every solve
+     * @param threads Amount of threads of the task arena
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    ThroughputResult<T> throughputTasks(SparseMatrix<T, int_type, nnz_type>& mat, int solves, int it, int threads) {
+        const int_type n = mat.getRows();
+        const std::vector<CRSPart<T, int_type, nnz_type>> parts = mat.rowArrays();
+        if (parts.empty()) throw std::runtime_error("The tasks schedule needs the CRS arrays of the matrix");
+
+        ThroughputResult<T> result;
+        result.latencies.resize(solves);
+        result.values.resize(solves);
+
+        // Two vectors per thread, allocated by the first solve of the thread
+        oneapi::tbb::enumerable_thread_specific<std::vector<T>> vectors;
+
+        oneapi::tbb::task_arena arena(threads);
+        double start = omp_get_wtime();
+        arena.execute([&]() {
+            oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<int>(0, solves, 1), [&](const oneapi::tbb::blocked_range<int>& r) {
+                std::vector<T>& local = vectors.local();
+                local.resize(2*(size_t) n);
+
+                for (int solve = r.begin(); solve < r.end(); ++solve) {
+                    double solve_start = omp_get_wtime();
+                    T* x = local.data();
+                    T* y = local.data() + n;
+                    for (int_type i = 0; i < n; ++i) x[i] = throughputStart<T>(solve, i);
+
+                    T norm = 0.;
+                    for (int iteration = 0; iteration < it; ++iteration) {
+                        sequentialMv(parts, x, y);
+
+                        norm = 0.;
+                        for (int_type i = 0; i < n; ++i) norm += y[i]*y[i];
+                        norm = std::sqrt(norm);
+                        for (int_type i = 0; i < n; ++i) y[i] /= norm;
+                        std::swap(x, y);
+                    }
+
+                    result.values[solve] = norm;
+                    result.latencies[solve] = (omp_get_wtime() - solve_start) * 1000;
+                }
+            }, oneapi::tbb::simple_partitioner());
+        });
+        result.time = (omp_get_wtime() - start) * 1000;
+
+        return result;
+    }
+
+    /**
+     * @brief Run independent power methods in batches of interleaved vectors with mvBatch
+     *
+     * @param mat Square matrix
+     * @param solves Amount of solves
+     * @param it Amount of iterations of every solve
+     * @param width Amount of vectors in a batch
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    ThroughputResult<T> throughputBatch(SparseMatrix<T, int_type, nnz_type>& mat, int solves, int it, int width) {
+        const int_type n = mat.getRows();
+        width = std::max(1, std::min(width, solves));
+
+        ThroughputResult<T> result;
+        result.latencies.resize(solves);
+        result.values.resize(solves);
+
+        pwm::Arena arena;
+        T* cur = arena.template allocate<T>((size_t) n*width);
+        T* next = arena.template allocate<T>((size_t) n*width);
+        std::vector<T> norms(width);
+
+        double start = omp_get_wtime();
+        for (int first = 0; first < solves; first += width) {
+            double batch_start = omp_get_wtime();
+            const int batch = std::min(width, solves - first);
+            T* X = cur;
+            T* Y = next;
+
+            mat.parallelFor([=](int_type begin, int_type end) {
+                for (int_type i = begin; i < end; ++i) {
+                    for (int b = 0; b < batch; ++b) X[(size_t) i*batch + b] = throughputStart<T>(first + b, i);
+                }
+            });
+
+            for (int iteration = 0; iteration < it; ++iteration) {
+                mat.mvBatch(X, Y, batch);
+
+                const T* in = Y;
+                parallelColumnSums<T, int_type, nnz_type>(mat, batch, [=](int_type begin, int_type end, T* part) {
+                    for (int_type i = begin; i < end; ++i) {
+                        for (int b = 0; b < batch; ++b) part[b] += in[(size_t) i*batch + b]*in[(size_t) i*batch + b];
+                    }
+                }, norms.data());
+                for (int b = 0; b < batch; ++b) norms[b] = std::sqrt(norms[b]);
+
+                const T* scale = norms.data();
+                mat.parallelFor([=](int_type begin, int_type end) {
+                    for (int_type i = begin; i < end; ++i) {
+                        for (int b = 0; b < batch; ++b) Y[(size_t) i*batch + b] /= scale[b];
+                    }
+                });
+                std::swap(X, Y);
+            }
+
+            double latency = (omp_get_wtime() - batch_start) * 1000;
+            for (int b = 0; b < batch; ++b) {
+                result.values[first + b] = norms[b];
+                result.latencies[first + b] = latency;
+            }
+        }
+        result.time = (omp_get_wtime() - start) * 1000;
+
+        return result;
+    }
+
+    /**
+     * @brief Run independent solves in the throughput mode and compare the solves per second with single solves
+     *
+     * @param mat Square matrix
+     * @param solves Amount of solves
+     * @param it Amount of iterations of every solve
+     * @param mode Schedule: tasks or batch (tasks falls back to batch without CRS arrays)
+     * @param threads Amount of threads of the tasks schedule
+     * @param width Amount of vectors in a batch of the batch schedule
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void printThroughputReport(SparseMatrix<T, int_type, nnz_type>& mat, int solves, int it, const std::string& mode, int threads, int width) {
+        const int_type n = mat.getRows();
+        if (solves < 1) {
+            std::cout << "Throughput needs at least one solve" << std::endl;
+            return;
+        }
+
+        // Latency of one solve with all threads
+        std::vector<T> x(n), y(n);
+        for (int_type i = 0; i < n; ++i) x[i] = throughputStart<T>(0, i);
+        double start = omp_get_wtime();
+        mat.powerMethod(x.data(), y.data(), it);
+        double single = (omp_get_wtime() - start) * 1000;
+
+        ThroughputMode schedule = mode == "batch" || mat.rowArrays().empty() ? ThroughputMode::batch : ThroughputMode::tasks;
+        ThroughputResult<T> result = schedule == ThroughputMode::tasks ? pwm::throughputTasks(mat, solves, it, threads)
+                                                                       : pwm::throughputBatch(mat, solves, it, width);
+
+        std::vector<double> latencies = result.latencies;
+        std::sort(latencies.begin(), latencies.end());
+        double mean = 0.;
+        for (double latency : latencies) mean += latency;
+        mean /= solves;
+
+        std::cout << "Throughput (" << solves << " solves of " << it << " iterations, ";
+        if (schedule == ThroughputMode::tasks) std::cout << "TBB tasks on " << threads << " threads";
+        else std::cout << "batches of " << std::min(width, solves) << " vectors";
+        std::cout << "): " << result.time << "ms, " << solves / (result.time / 1000) << " solves per second" << std::endl;
+        std::cout << "  latency of a solve: mean " << mean << "ms, median " << latencies[solves/2] << "ms, max " << latencies.back() << "ms" << std::endl;
+        std::cout << "  single solve with all threads: " << single << "ms, " << 1000 / single << " solves per second";
+        std::cout << " (throughput mode " << single * solves / result.time << "x)" << std::endl;
+
+        auto range = std::minmax_element(result.values.begin(), result.values.end());
+        std::cout << "  eigenvalue estimates between " << *range.first << " and " << *range.second << std::endl;
+    }
+} // namespace pwm
+
+#endif // PWM_THROUGHPUT_HPP
@@ -0,0 +1,305 @@
+/**
+ * @file Trace.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Per partition timing and load imbalance tracing of the partitioned methods
+ * @version 0.1
+ * @date 2022-11-10
+ *
+ * Only used when compiled with PWM_TRACE (see the _trace targets in the Makefile), otherwise the macros do nothing.
+ * Every partition function/node records its begin and end time (steady_clock) in a preallocated ring buffer,
+ * the calling thread records the time it waits for the partitions. When the buffer is full the oldest events are overwritten.
+ *
+ * The events can be written as a Chrome trace (open in chrome://tracing or https://ui.perfetto.dev) with one track per worker thread.
+ */
+
+#ifndef PWM_TRACE_HPP
+#define PWM_TRACE_HPP
+
+#include <vector>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+
+namespace pwm {
+    // One traced interval
+    struct TraceEvent {
+        // Begin and end in ns since the start of the trace
+        int64_t begin;
+        int64_t end;
+
+        // Iteration (matrix vector product) in which the event happened
+        int32_t iteration;
+
+        // Partition of the event (-1 for the calling thread)
+        int16_t partition;
+
+        // Worker thread which executed the event
+        int16_t worker;
+
+        // Kind of the event
+        int8_t kind;
+    };
+
+    class Tracer {
+        public:
+            // Kinds of events
+            enum Kind {MV = 0, NORM, MPK, WAIT};
+
+        protected:
+            // Ring buffer of events
+            std::vector<TraceEvent> buffer;
+
+            // Amount of events which were recorded since the last reset
+            std::atomic<uint64_t> recorded;
+
+            // Current iteration
+            std::atomic<int32_t> iteration;
+
+            // Start of the trace
+            std::chrono::steady_clock::time_point origin;
+
+            // Name of each kind of event
+            static const char* kindName(int kind) {
+                static const char* names[] = {"mv", "norm", "mpk", "wait"};
+                return names[kind];
+            }
+
+        public:
+            /**
+             * @brief Base constructor
+             *
+             * @param capacity Amount of events in the ring buffer
+             */
+            Tracer(size_t capacity = 1 << 18): buffer(capacity), recorded(0), iteration(0) {
+                origin = std::chrono::steady_clock::now();
+            }
+
+            /**
+             * @brief Small number of the calling thread, assigned on first use
+             */
+            static int workerId() {
+                static std::atomic<int> workers(0);
+                thread_local int id = workers++;
+                return id;
+            }
+
+            // Time in ns since the start of the trace
+            int64_t now() const {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+            }
+
+            // Start a new iteration (called before the partitions are dispatched)
+            void nextIteration() {
+                iteration++;
+            }
+
+            // Current iteration
+            int32_t currentIteration() const {
+                return iteration.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * @brief Store an event in the ring buffer
+             */
+            void record(int kind, int partition, int32_t it, int64_t begin, int64_t end) {
+                uint64_t index = recorded.fetch_add(1, std::memory_order_relaxed);
+                TraceEvent& event = buffer[index % buffer.size()];
+                event.begin = begin;
+                event.end = end;
+                event.iteration = it;
+                event.partition = partition;
+                event.worker = workerId();
+                event.kind = kind;
+            }
+
+            /**
+             * @brief Remove all events and restart the clock (e.g. after the warm up runs)
+             */
+            void reset() {
+                recorded = 0;
+                iteration = 0;
+                origin = std::chrono::steady_clock::now();
+            }
+
+            /**
+             * @brief Events which are still in the ring buffer ordered by begin time
+             */
+            std::vector<TraceEvent> events() const {
+                uint64_t total = recorded.load();
+                uint64_t first = total > buffer.size() ? total - buffer.size() : 0;
+
+                std::vector<TraceEvent> result;
+                for (uint64_t i = first; i < total; ++i) {
+                    result.push_back(buffer[i % buffer.size()]);
+                }
+
+                std::sort(result.begin(), result.end(), [](const TraceEvent& a, const TraceEvent& b) { return a.begin < b.begin; });
+                return result;
+            }
+
+            /**
+             * @brief Write the events in the Chrome trace event format
+             *
+             * @param filename Output filename
+             */
+            void writeChromeTrace(const std::string& filename) const {
+                std::vector<TraceEvent> list = events();
+                std::ofstream out(filename);
+                out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+
+                // Name the tracks
+                std::vector<int> workers;
+                for (const TraceEvent& e : list) workers.push_back(e.worker);
+                std::sort(workers.begin(), workers.end());
+                workers.erase(std::unique(workers.begin(), workers.end()), workers.end());
+                for (int w : workers) {
+                    out << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << w << ", \"args\": {\"name\": \"worker " << w << "\"}},\n";
+                }
+
+                for (size_t i = 0; i < list.size(); ++i) {
+                    const TraceEvent& e = list[i];
+                    out << "  {\"name\": \"" << kindName(e.kind);
+                    if (e.partition >= 0) out << " " << e.partition;
+                    out << "\", \"cat\": \"" << kindName(e.kind) << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << e.worker;
+                    out << ", \"ts\": " << e.begin / 1000. << ", \"dur\": " << (e.end - e.begin) / 1000.;
+                    out << ", \"args\": {\"partition\": " << e.partition << ", \"iteration\": " << e.iteration << "}}";
+                    out << (i+1 < list.size() ? "," : "") << "\n";
+                }
+
+                out << "]}" << std::endl;
+            }
+
+            /**
+             * @brief Print the load imbalance of the partition events
+             *
+             * For every iteration the max/mean ratio of the time of the partitions is computed. The start latency is the time
+             * between the first dispatch and the start of the first partition, the completion latency is the time between
+             * the end of the last partition and the end of the wait of the calling thread.
+             */
+            void printSummary() const {
+                std::vector<TraceEvent> list = events();
+                if (recorded.load() > buffer.size()) {
+                    std::cout << "Trace: " << recorded.load() - buffer.size() << " events were overwritten (ring buffer full)" << std::endl;
+                }
+
+                // Per iteration: time per partition and the wait of the calling thread
+                struct IterationData {
+                    std::map<int, int64_t> partition_time;
+                    int64_t first_begin = INT64_MAX;
+                    int64_t last_end = 0;
+                    int64_t wait_begin = INT64_MAX;
+                    int64_t wait_end = 0;
+                };
+                std::map<int32_t, IterationData> iterations;
+                for (const TraceEvent& e : list) {
+                    IterationData& data = iterations[e.iteration];
+                    if (e.kind == WAIT && data.wait_end == 0) {
+                        // Only the first wait of an iteration is the wait for the matrix vector product
+                        data.wait_begin = e.begin;
+                        data.wait_end = e.end;
+                    } else if (e.kind == MV || e.kind == MPK) {
+                        data.partition_time[e.partition] += e.end - e.begin;
+                        data.first_begin = std::min(data.first_begin, e.begin);
+                        data.last_end = std::max(data.last_end, e.end);
+                    }
+                }
+
+                int count = 0;
+                double ratio_sum = 0.;
+                double worst_ratio = 0.;
+                int32_t worst_iteration = 0;
+                double start_latency = 0.;
+                double completion_latency = 0.;
+                int latency_count = 0;
+                std::map<int, int> slowest;
+                for (auto& entry : iterations) {
+                    IterationData& data = entry.second;
+                    if (data.partition_time.empty()) continue;
+
+                    int64_t max_time = 0;
+                    int max_partition = 0;
+                    double mean_time = 0.;
+                    for (auto& p : data.partition_time) {
+                        mean_time += p.second;
+                        if (p.second > max_time) {
+                            max_time = p.second;
+                            max_partition = p.first;
+                        }
+                    }
+                    mean_time /= data.partition_time.size();
+                    if (mean_time <= 0.) continue;
+
+                    double ratio = max_time / mean_time;
+                    ratio_sum += ratio;
+                    if (ratio > worst_ratio) {
+                        worst_ratio = ratio;
+                        worst_iteration = entry.first;
+                    }
+                    slowest[max_partition]++;
+                    count++;
+
+                    if (data.wait_end > 0) {
+                        start_latency += std::max<int64_t>(0, data.first_begin - data.wait_begin);
+                        completion_latency += std::max<int64_t>(0, data.wait_end - data.last_end);
+                        latency_count++;
+                    }
+                }
+
+                if (count == 0) {
+                    std::cout << "Trace: no partition events recorded" << std::endl;
+                    return;
+                }
+
+                auto straggler = std::max_element(slowest.begin(), slowest.end(),
+                    [](const std::pair<const int, int>& a, const std::pair<const int, int>& b) { return a.second < b.second; });
+
+                std::cout << "Trace summary over " << count << " iterations:" << std::endl;
+                std::cout << "  Load imbalance (max/mean partition time): mean " << ratio_sum / count;
+                std::cout << ", worst " << worst_ratio << " (iteration " << worst_iteration << ")" << std::endl;
+                std::cout << "  Slowest partition most often: " << straggler->first << " (" << 100. * straggler->second / count << "% of the iterations)" << std::endl;
+                if (latency_count > 0) {
+                    std::cout << "  Mean start latency: " << start_latency / latency_count / 1000. << "us";
+                    std::cout << ", mean completion latency: " << completion_latency / latency_count / 1000. << "us" << std::endl;
+                }
+            }
+    };
+
+    // Records the enclosing scope as one event
+    class TraceScope {
+        protected:
+            Tracer& tracer;
+            int kind;
+            int partition;
+            int32_t iteration;
+            int64_t begin;
+
+        public:
+            TraceScope(Tracer& tracer_in, int kind_in, int partition_in): tracer(tracer_in), kind(kind_in), partition(partition_in) {
+                iteration = tracer.currentIteration();
+                begin = tracer.now();
+            }
+
+            ~TraceScope() {
+                tracer.record(kind, partition, iteration, begin, tracer.now());
+            }
+    };
+} // namespace pwm
+
+#define PWM_TRACE_CONCAT_(a, b) a##b
+#define PWM_TRACE_CONCAT(a, b) PWM_TRACE_CONCAT_(a, b)
+
+// Trace the enclosing scope and start a new iteration when compiled with PWM_TRACE
+#ifdef PWM_TRACE
+#define PWM_TRACE_SCOPE(tracer, kind, partition) pwm::TraceScope PWM_TRACE_CONCAT(pwm_trace_scope_, __LINE__)(tracer, kind, partition)
+#define PWM_TRACE_ITERATION(tracer) (tracer).nextIteration()
+#else
+#define PWM_TRACE_SCOPE(tracer, kind, partition)
+#define PWM_TRACE_ITERATION(tracer)
+#endif
+
+#endif // PWM_TRACE_HPP
@@ -0,0 +1,404 @@
+/**
+ * @file Transpose.hpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Transpose matrix vector product and the fused products with A^T A and A A^T of the CRS implementations
+ * @version 0.1
+ * @date 2022-11-23
+ *
+ * A^T x is computed in one of two ways, chosen by a memory budget when the first transpose product is computed:
+ *  - Transposed CRS: a one-time parallel transpose of the structure to a second CRS (the rows of A^T) whose entries
+ *    hold a copy of the values of the matrix. A^T x is then a gather like A x, with one load per entry.
+ *  - Scatter: every range of rows adds its contributions to a private output vector, the private vectors are summed
+ *    afterwards. No arrays of the size of the matrix, but one vector of the size of the output per thread.
+ * The transposed CRS is built if it fits in the budget, which is the size of the matrix unless it is set. In the
+ * reproducible mode it is always built, the sums of the scatter version depend on the ranges of the rows.
+ *
+ * A^T A x is computed in one pass over the rows: the dot product of a row with x is scattered with the same row, so the
+ * matrix is read once per product instead of twice. A A^T x does the same on the rows of the transposed CRS.
+ *
+ * The classes are independent of the matrix classes, the parallel loop over the rows of the matrix is passed as a
+ * function (parallelFor of the matrix) such that the products use the threading model of the implementation.
+ */
+
+#ifndef PWM_TRANSPOSE_HPP
+#define PWM_TRANSPOSE_HPP
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+#include "Memory.hpp"
+#include "Reproducible.hpp"
+
+#include "omp.h"
+
+namespace pwm {
+    // Rows of a matrix stored as CRS arrays (one part per partition of the partitioned implementations)
+    template<typename T, typename int_type, typename nnz_type>
+    struct CRSPart {
+        // First row and amount of rows
+        int_type first_row;
+        int_type rows;
+
+        // CRS arrays of the rows, row i of the matrix starts at row_start[i - first_row]
+        const nnz_type* row_start;
+        const int_type* col_ind;
+        const T* data;
+    };
+
+    /**
+     * @brief First column of the part of a vector with cols elements which belongs to a row of a loop over rows rows
+     *
+     * Used to split a loop over the columns with the parallel loop over the rows of a matrix.
+     */
+    template<typename int_type>
+    inline int_type rowToColumn(int_type row, int_type rows, int_type cols) {
+        return (int_type) ((long long) row * cols / rows);
+    }
+
+    // Private output vectors of the scatter products
+    template<typename T>
+    class ScatterBuffers {
+        protected:
+            // All buffers (zero when they are not in use)
+            std::vector<std::unique_ptr<T[]>> all;
+
+            // Buffers which are not in use
+            std::vector<T*> unused;
+
+            // Amount of elements of a buffer
+            size_t size = 0;
+
+            std::mutex lock;
+
+        public:
+            /**
+             * @brief Set the amount of elements of the buffers, the buffers of another size are freed
+             */
+            void resize(size_t n) {
+                if (n == size) return;
+
+                all.clear();
+                unused.clear();
+                size = n;
+            }
+
+            /**
+             * @brief Zero buffer for one range of rows, a new buffer is allocated if all buffers are in use
+             */
+            T* acquire() {
+                std::lock_guard<std::mutex> guard(lock);
+                if (unused.empty()) {
+                    all.emplace_back(new T[size]());
+                    return all.back().get();
+                }
+
+                T* buffer = unused.back();
+                unused.pop_back();
+                return buffer;
+            }
+
+            /**
+             * @brief Return a buffer after the range of rows is added to it
+             */
+            void release(T* buffer) {
+                std::lock_guard<std::mutex> guard(lock);
+                unused.push_back(buffer);
+            }
+
+            /**
+             * @brief Sum of the buffers on the elements begin until end, the buffers are set to zero again
+             *
+             * The buffers are added in the order they were allocated.
+             */
+            void reduce(size_t begin, size_t end, T* y) {
+                std::fill(y + begin, y + end, (T) 0.);
+                for (const std::unique_ptr<T[]>& buffer : all) {
+                    T* b = buffer.get();
+                    for (size_t i = begin; i < end; ++i) {
+                        y[i] += b[i];
+                        b[i] = 0.;
+                    }
+                }
+            }
+
+            // Bytes of the buffers
+            size_t bytes() const { return all.size()*size*sizeof(T); }
+    };
+
+    template<typename T, typename int_type, typename nnz_type>
+    class TransposeProduct {
+        protected:
+            // Transposed CRS: start of every row of A^T, the row of A and the value of every entry
+            nnz_type* col_start = NULL;
+            int_type* row_ind = NULL;
+            T* values = NULL;
+
+            // The transposed CRS is built (in the arena of the matrix)
+            bool stored = false;
+
+            // Amount of resets of the arena of the matrix when the version was chosen (a reset frees the transpose)
+            size_t chosen_resets = (size_t) -1;
+
+            // Memory budget of the transposed CRS in bytes (the size of the matrix if it is not set)
+            size_t budget = 0;
+            bool budget_set = false;
+
+            // Private output vectors of the scatter version
+            ScatterBuffers<T> buffers;
+
+            /**
+             * @brief Call f(row, begin, end, part) for every row of the parts in the rows begin until end
+             */
+            template<typename F>
+            static void forRows(const std::vector<CRSPart<T, int_type, nnz_type>>& parts, int_type begin, int_type end, F f) {
+                for (const CRSPart<T, int_type, nnz_type>& part : parts) {
+                    int_type lo = std::max(begin, part.first_row);
+                    int_type hi = std::min(end, part.first_row + part.rows);
+                    for (int_type i = lo; i < hi; ++i) {
+                        f(i, part.row_start[i - part.first_row], part.row_start[i - part.first_row + 1], part);
+                    }
+                }
+            }
+
+            /**
+             * @brief Transpose the structure of the parts in parallel
+             *
+             * Every thread counts the entries of every column in its rows, the prefix sum over the columns and threads
+             * gives every thread its positions, so the entries of a row of A^T are sorted by their row in A. The counters
+             * of the threads are bounded by the amount of nonzeros (buildThreads), so the scratch memory stays below the
+             * transposed CRS, which is charged against the budget.
+             */
+            void build(const std::vector<CRSPart<T, int_type, nnz_type>>& parts, int_type nor, int_type noc, nnz_type nnz, pwm::Arena& arena) {
+                col_start = arena.template allocate<nnz_type>((size_t) noc + 1);
+                row_ind = arena.template allocate<int_type>(nnz);
+                values = arena.template allocate<T>(nnz);
+
+                int max_threads = buildThreads(noc, nnz);
+                std::vector<nnz_type> position((size_t) max_threads*noc, 0);
+                int thread_am = 1;
+
+                #pragma omp parallel num_threads(max_threads)
+                {
+                    int thread = omp_get_thread_num();
+                    #pragma omp single
+                    thread_am = omp_get_num_threads();
+
+                    int_type begin = (int_type) ((long long) nor * thread / thread_am);
+                    int_type end = (int_type) ((long long) nor * (thread + 1) / thread_am);
+                    nnz_type* count = position.data() + (size_t) thread*noc;
+
+                    forRows(parts, begin, end, [=](int_type, nnz_type k_begin, nnz_type k_end, const CRSPart<T, int_type, nnz_type>& part) {
+                        for (nnz_type k = k_begin; k < k_end; ++k) count[part.col_ind[k]]++;
+                    });
+
+                    #pragma omp barrier
+                    #pragma omp single
+                    {
+                        nnz_type sum = 0;
+                        for (int_type j = 0; j < noc; ++j) {
+                            col_start[j] = sum;
+                            for (int t = 0; t < thread_am; ++t) {
+                                nnz_type c = position[(size_t) t*noc + j];
+                                position[(size_t) t*noc + j] = sum;
+                                sum += c;
+                            }
+                        }
+                        col_start[noc] = sum;
+                    }
+
+                    nnz_type* next = count;
+                    forRows(parts, begin, end, [=](int_type i, nnz_type k_begin, nnz_type k_end, const CRSPart<T, int_type, nnz_type>& part) {
+                        for (nnz_type k = k_begin; k < k_end; ++k) {
+                            nnz_type pos = next[part.col_ind[k]]++;
+                            row_ind[pos] = i;
+                            values[pos] = part.data[k];
+                        }
+                    });
+                }
+            }
+
+        public:
+            /**
+             * @brief Set the memory budget of the transposed CRS, the version is chosen again at the next product
+             *
+             * @param bytes Maximal size of the transposed CRS in bytes (0 always uses the scatter version)
+             */
+            void setBudget(size_t bytes) {
+                budget = bytes;
+                budget_set = true;
+                chosen_resets = (size_t) -1;
+            }
+
+            /**
+             * @brief Free the transposed CRS after the structure or the values of the matrix changed, the version is chosen
+             * again at the next product
+             *
+             * The transposed CRS holds a copy of the values, so a change of the values only needs this as well.
+             *
+             * @param arena Arena of the matrix, owns the transposed CRS
+             */
+            void release(pwm::Arena& arena) {
+                if (stored && chosen_resets == arena.resets()) {
+                    arena.deallocate(col_start);
+                    arena.deallocate(row_ind);
+                    arena.deallocate(values);
+                }
+
+                col_start = NULL;
+                row_ind = NULL;
+                values = NULL;
+                stored = false;
+                chosen_resets = (size_t) -1;
+            }
+
+            // Bytes of the transposed CRS of a matrix
+            static size_t transposedBytes(int_type noc, nnz_type nnz) {
+                return ((size_t) noc + 1)*sizeof(nnz_type) + (size_t) nnz*(sizeof(int_type) + sizeof(T));
+            }
+
+            // Threads of the transpose, at most one counter per column and thread for every nonzero
+            static int buildThreads(int_type noc, nnz_type nnz) {
+                long long per_column = noc > 0 ? (long long) nnz / noc : 1;
+                return (int) std::max(1LL, std::min<long long>(omp_get_max_threads(), per_column));
+            }
+
+            // Bytes of the counters of the threads while the transposed CRS is built
+            static size_t buildScratchBytes(int_type noc, nnz_type nnz) {
+                return (size_t) buildThreads(noc, nnz)*noc*sizeof(nnz_type);
+            }
+
+            // The transposed CRS is used (valid after prepare)
+            bool isStored() const { return stored; }
+
+            // Bytes of the private output vectors of the scatter version
+            size_t bufferBytes() const { return buffers.bytes(); }
+
+            /**
+             * @brief Choose the version for the arrays of the matrix and build the transposed CRS if it fits in the budget
+             *
+             * Only does work for the first product after a matrix is loaded (or the budget changes).
+             *
+             * @param parts CRS arrays of the rows of the matrix
+             * @param arena Arena of the matrix, owns the transposed CRS
+             */
+            void prepare(const std::vector<CRSPart<T, int_type, nnz_type>>& parts, int_type nor, int_type noc, nnz_type nnz, pwm::Arena& arena) {
+                if (chosen_resets == arena.resets()) return;
+
+                size_t limit = budget_set ? budget : arena.bytes();
+                stored = pwm::reproducibleMode() || transposedBytes(noc, nnz) <= limit;
+                if (stored) build(parts, nor, noc, nnz, arena);
+                chosen_resets = arena.resets();
+            }
+
+            /**
+             * @brief Add the products of the rows with a factor per row to the private buffers and sum them into y
+             *
+             * @param parallel_for Parallel loop over the rows of the matrix
+             * @param factor Function which returns the factor of row i (with its entries begin until end of a part)
+             * @param y Output vector (size noc)
+             */
+            template<typename For, typename Factor>
+            void scatter(For parallel_for, const std::vector<CRSPart<T, int_type, nnz_type>>& parts, int_type nor, int_type noc,
+                         Factor factor, T* y) {
+                buffers.resize(noc);
+                ScatterBuffers<T>* pool = &buffers;
+
+                parallel_for([&](int_type begin, int_type end) {
+                    T* buffer = pool->acquire();
+                    forRows(parts, begin, end, [&](int_type i, nnz_type k_begin, nnz_type k_end, const CRSPart<T, int_type, nnz_type>& part) {
+                        T f = factor(i, k_begin, k_end, part);
+                        for (nnz_type k = k_begin; k < k_end; ++k) buffer[part.col_ind[k]] += part.data[k]*f;
+                    });
+                    pool->release(buffer);
+                });
+
+                parallel_for([&](int_type begin, int_type end) {
+                    pool->reduce(rowToColumn(begin, nor, noc), rowToColumn(end, nor, noc), y);
+                });
+            }
+
+            /**
+             * @brief Transpose matrix vector product A^T x = y
+             *
+             * @param parallel_for Parallel loop over the rows of the matrix
+             * @param parts CRS arrays of the rows of the matrix
+             * @param arena Arena of the matrix
+             * @param x Input vector (size nor)
+             * @param y Output vector (size noc)
+             */
+            template<typename For>
+            void mvT(For parallel_for, const std::vector<CRSPart<T, int_type, nnz_type>>& parts, int_type nor, int_type noc, nnz_type nnz,
+                     pwm::Arena& arena, const T* x, T* y) {
+                prepare(parts, nor, noc, nnz, arena);
+
+                if (stored) {
+                    const nnz_type* start = col_start;
+                    const int_type* rows = row_ind;
+                    const T* vals = values;
+                    parallel_for([=](int_type begin, int_type end) {
+                        for (int_type j = rowToColumn(begin, nor, noc); j < rowToColumn(end, nor, noc); ++j) {
+                            T sum = 0.;
+                            for (nnz_type k = start[j]; k < start[j+1]; ++k) sum += vals[k]*x[rows[k]];
+                            y[j] = sum;
+                        }
+                    });
+                } else {
+                    scatter(parallel_for, parts, nor, noc, [=](int_type i, nnz_type, nnz_type, const CRSPart<T, int_type, nnz_type>&) {
+                        return x[i];
+                    }, y);
+                }
+            }
+
+            /**
+             * @brief Fused product A^T A x = y in one pass over the rows (scatter version)
+             *
+             * @param parallel_for Parallel loop over the rows of the matrix
+             * @param parts CRS arrays of the rows of the matrix
+             * @param x Input vector (size noc)
+             * @param y Output vector (size noc)
+             */
+            template<typename For>
+            void mvTmv(For parallel_for, const std::vector<CRSPart<T, int_type, nnz_type>>& parts, int_type nor, int_type noc,
+                       const T* x, T* y) {
+                scatter(parallel_for, parts, nor, noc, [=](int_type, nnz_type k_begin, nnz_type k_end, const CRSPart<T, int_type, nnz_type>& part) {
+                    T sum = 0.;
+                    for (nnz_type k = k_begin; k < k_end; ++k) sum += part.data[k]*x[part.col_ind[k]];
+                    return sum;
+                }, y);
+            }
+
+            /**
+             * @brief Fused product A A^T x = y in one pass over the rows of the transposed CRS (only if it is stored)
+             *
+             * @param parallel_for Parallel loop over the rows of the matrix
+             * @param x Input vector (size nor)
+             * @param y Output vector (size nor)
+             */
+            template<typename For>
+            void mvmvT(For parallel_for, int_type nor, int_type noc, const T* x, T* y) {
+                buffers.resize(nor);
+                ScatterBuffers<T>* pool = &buffers;
+                const nnz_type* start = col_start;
+                const int_type* rows = row_ind;
+                const T* vals = values;
+
+                parallel_for([=](int_type begin, int_type end) {
+                    T* buffer = pool->acquire();
+                    for (int_type j = rowToColumn(begin, nor, noc); j < rowToColumn(end, nor, noc); ++j) {
+                        T sum = 0.;
+                        for (nnz_type k = start[j]; k < start[j+1]; ++k) sum += vals[k]*x[rows[k]];
+                        for (nnz_type k = start[j]; k < start[j+1]; ++k) buffer[rows[k]] += vals[k]*sum;
+                    }
+                    pool->release(buffer);
+                });
+
+                parallel_for([=](int_type begin, int_type end) {
+                    pool->reduce(begin, end, y);
+                });
+            }
+    };
+} // namespace pwm
+
+#endif // PWM_TRANSPOSE_HPP
@@ -10,14 +10,18 @@
 #define PWM_TRIPLETTOCRS_HPP
 
 #include <stdlib.h>
+#include <algorithm>
+#include <cmath>
 
 #include "VectorUtill.hpp"
+#include "Memory.hpp"
+#include "../Matrix/Triplet.hpp"
 
 #include "oneapi/tbb.h"
 
 namespace pwm {
-    template<typename T, typename int_type>
-    void swapArrayElems(int_type** coords, T* data, int am_coords, int_type index_1, int_type index_2) {
+    template<typename T, typename int_type, typename nnz_type>
+    void swapArrayElems(int_type** coords, T* data, int am_coords, nnz_type index_1, nnz_type index_2) {
         for (int i = 0; i < am_coords; ++i) {
             int_type temp = coords[i][index_1];
             coords[i][index_1] = coords[i][index_2];
@@ -29,14 +33,14 @@ namespace pwm {
         data[index_2] = data_temp;
     }
 
-    template<typename T, typename int_type>
-    int_type partitionArrays(int_type** coords, T* data, int am_coords, int_type low, int_type high) {
+    template<typename T, typename int_type, typename nnz_type>
+    nnz_type partitionArrays(int_type** coords, T* data, int am_coords, nnz_type low, nnz_type high) {
         // Select pivot (rightmost element)
         int_type pivot = coords[0][high];
 
         // Points to biggest element
-        int_type i = (low - 1);
-        for (int j = low; j < high; ++j) {
+        nnz_type i = (low - 1);
+        for (nnz_type j = low; j < high; ++j) {
             if (coords[0][j] <= pivot) {
                 // If element is smaller than pivot swap it with i+1
                 i++;
@@ -64,11 +68,11 @@ namespace pwm {
      * @param low Start index of quicksort
      * @param high End index of quicksort
      */
-    template<typename T, typename int_type>
-    void sortCoordsForCRS(int_type** coords, T* data, int am_coords, int_type low, int_type high) {
+    template<typename T, typename int_type, typename nnz_type>
+    void sortCoordsForCRS(int_type** coords, T* data, int am_coords, nnz_type low, nnz_type high) {
         if (low < high) {
-            swapArrayElems(coords, data, am_coords, (rand() % (high-low)) + low, high); // Random permutation of biggest element
-            int_type middle = partitionArrays(coords, data, am_coords, low, high);
+            swapArrayElems(coords, data, am_coords, (nnz_type) (rand() % (high-low)) + low, high); // Random permutation of biggest element
+            nnz_type middle = partitionArrays(coords, data, am_coords, low, high);
 
             sortCoordsForCRS(coords, data, am_coords, low, middle - 1);
             sortCoordsForCRS(coords, data, am_coords, middle + 1, high);
@@ -88,18 +92,18 @@ namespace pwm {
      * @param CRS_data Output data array of CRS format
      * @param nnz Number of nonzeros in matrix
      */
-    template<typename T, typename int_type>
-    void TripletToCRS(int_type* row_coord, int_type* col_coord, T* data, int_type* row_start, int_type* col_ind, T* CRS_data, int_type nnz, int_type nor) {
+    template<typename T, typename int_type, typename nnz_type>
+    void TripletToCRS(int_type* row_coord, int_type* col_coord, T* data, nnz_type* row_start, int_type* col_ind, T* CRS_data, nnz_type nnz, int_type nor) {
         // Sort triplets on row value
         int_type** coords = new int_type*[2];
         coords[0] = row_coord;
         coords[1] = col_coord;
-        sortCoordsForCRS(coords, data, 2, 0, nnz-1);
+        sortCoordsForCRS(coords, data, 2, (nnz_type) 0, nnz-1);
 
         // Fill CRS datastructures
         row_start[0] = 0;
         int_type row_index = 0;
-        for (int i = 0; i < nnz; ++i) {
+        for (nnz_type i = 0; i < nnz; ++i) {
             col_ind[i] = col_coord[i];
             CRS_data[i] = data[i];
 
@@ -117,7 +121,7 @@ namespace pwm {
 
         // Sort columns of CRS data
         coords[0] = col_ind;
-        for (int row = 0; row <= row_coord[nnz-1]; ++row) {
+        for (int_type row = 0; row <= row_coord[nnz-1]; ++row) {
             sortCoordsForCRS(coords, CRS_data, 1, row_start[row], row_start[row+1]-1);
         }
     }
@@ -137,17 +141,17 @@ namespace pwm {
      * @param CRS_data Output data array of CRS format
      * @param nnz Number of nonzeros in matrix
      */
-    template<typename T, typename int_type>
-    void TripletToCRSOMP(int_type* row_coord, int_type* col_coord, T* data, int_type* row_start, int_type* col_ind, T* CRS_data, int_type nnz, int_type nor) {
+    template<typename T, typename int_type, typename nnz_type>
+    void TripletToCRSOMP(int_type* row_coord, int_type* col_coord, T* data, nnz_type* row_start, int_type* col_ind, T* CRS_data, nnz_type nnz, int_type nor) {
         // Sort triplets on row value
         int_type** coords = new int_type*[2];
         coords[0] = row_coord;
         coords[1] = col_coord;
-        sortCoordsForCRS(coords, data, 2, 0, nnz-1);
+        sortCoordsForCRS(coords, data, 2, (nnz_type) 0, nnz-1);
 
         // Fill CRS data with omp to avoid first touch
         #pragma omp parallel for shared(col_ind, col_coord, CRS_data, data, row_coord, row_start) schedule(dynamic, 8)
-        for (int i = 0; i < nnz; ++i) {
+        for (nnz_type i = 0; i < nnz; ++i) {
             col_ind[i] = col_coord[i];
             CRS_data[i] = data[i];
         }
@@ -155,7 +159,7 @@ namespace pwm {
         // Fill CRS row_start
         row_start[0] = 0;
         int_type row_index = 0;
-        for (int i = 0; i < nnz; ++i) {
+        for (nnz_type i = 0; i < nnz; ++i) {
             while (row_coord[i] != row_index) {
                 row_index++;
                 row_start[row_index] = i;
@@ -171,7 +175,7 @@ namespace pwm {
         // Sort columns of CRS data
         coords[0] = col_ind;
         #pragma omp parallel for shared(col_ind, CRS_data, row_start) schedule(dynamic)
-        for (int row = 0; row <= row_coord[nnz-1]; ++row) {
+        for (int_type row = 0; row <= row_coord[nnz-1]; ++row) {
             sortCoordsForCRS(coords, CRS_data, 1, row_start[row], row_start[row+1]-1);
         }
     }
@@ -191,16 +195,16 @@ namespace pwm {
      * @param CRS_data Output data array of CRS format
      * @param nnz Number of nonzeros in matrix
      */
-    template<typename T, typename int_type>
-    void TripletToCRSTBB(int_type* row_coord, int_type* col_coord, T* data, int_type* row_start, int_type* col_ind, T* CRS_data, int_type nnz, int_type nor) {
+    template<typename T, typename int_type, typename nnz_type>
+    void TripletToCRSTBB(int_type* row_coord, int_type* col_coord, T* data, nnz_type* row_start, int_type* col_ind, T* CRS_data, nnz_type nnz, int_type nor) {
         // Sort triplets on row value
         int_type** coords = new int_type*[2];
         coords[0] = row_coord;
         coords[1] = col_coord;
-        sortCoordsForCRS(coords, data, 2, 0, nnz-1);
+        sortCoordsForCRS(coords, data, 2, (nnz_type) 0, nnz-1);
 
         // Fill CRS data with omp to avoid first touch
-        tbb::parallel_for(0, nnz, [=](int_type i) {
+        tbb::parallel_for((nnz_type) 0, nnz, [=](nnz_type i) {
             col_ind[i] = col_coord[i];
             CRS_data[i] = data[i];
         });
@@ -208,7 +212,7 @@ namespace pwm {
         // Fill CRS row_start
         row_start[0] = 0;
         int_type row_index = 0;
-        for (int i = 0; i < nnz; ++i) {
+        for (nnz_type i = 0; i < nnz; ++i) {
             while (row_coord[i] != row_index) {
                 row_index++;
                 row_start[row_index] = i;
@@ -223,7 +227,7 @@ namespace pwm {
 
         // Sort columns of CRS data
         coords[0] = col_ind;
-        tbb::parallel_for(0, row_coord[nnz-1]+1, [=](int_type row) {
+        tbb::parallel_for((int_type) 0, row_coord[nnz-1]+1, [=](int_type row) {
             sortCoordsForCRS(coords, CRS_data, 1, row_start[row], row_start[row+1]-1);
         });
     }
@@ -241,32 +245,36 @@ namespace pwm {
      * @param CRS_data Output data arrays of CRS format
      * @param partitions Amount of partitions for the CRS matrix (amount of arrays in row_start, col_ind, and CRS_data)
      * @param nnz Number of nonzeros in matrix
+     * @param arena Arena which owns the CRS arrays of the partitions
+     * @param bounds Optional partition boundaries (partitions+1 rows), if NULL the rows are split in equal parts
      */
-    template<typename T, typename int_type>
-    void TripletToMultipleCRS(int_type* row_coord, int_type* col_coord, T* data, int_type** row_start, int_type** col_ind, T** CRS_data, 
-                              int partitions, int_type* thread_rows, int_type* first_rows, int_type nnz, int_type nor) {
+    template<typename T, typename int_type, typename nnz_type>
+    void TripletToMultipleCRS(int_type* row_coord, int_type* col_coord, T* data, nnz_type** row_start, int_type** col_ind, T** CRS_data, 
+                              int partitions, int_type* thread_rows, int_type* first_rows, nnz_type nnz, int_type nor, pwm::Arena& arena,
+                              const int_type* bounds = NULL) {
 
         // Sort triplets on row value
         int_type** coords = new int_type*[2];
         coords[0] = row_coord;
         coords[1] = col_coord;
-        sortCoordsForCRS(coords, data, 2, 0, nnz-1);
+        sortCoordsForCRS(coords, data, 2, (nnz_type) 0, nnz-1);
 
         // Fill CRS datastructures
         int_type am_rows = std::round(nor/partitions);
         int_type last_row = 0;
-        int_type nnz_index = 0;
-        int_type part_index = 0;
+        nnz_type nnz_index = 0;
+        nnz_type part_index = 0;
         int_type row_index;
         for (int i = 0; i < partitions; ++i) {
             // Calculate first and last row (last row is exclusive)
             first_rows[i] = last_row;
-            if (i == partitions - 1) last_row = nor;
+            if (bounds != NULL) last_row = bounds[i+1];
+            else if (i == partitions - 1) last_row = nor;
             else last_row = first_rows[i] + am_rows;
             thread_rows[i] = last_row - first_rows[i];
 
             // Calculate nnz for the amount of rows
-            int_type j = nnz_index;
+            nnz_type j = nnz_index;
             while (true) {
                 if (j == nnz || row_coord[j] >= last_row) {
                     break;
@@ -276,16 +284,16 @@ namespace pwm {
             }
 
             // Create datastructures
-            int_type nnz_this_part = j - nnz_index;
-            row_start[i] = new int_type[thread_rows[i]+1];
-            col_ind[i] = new int_type[nnz_this_part];
-            CRS_data[i] = new T[nnz_this_part];
+            nnz_type nnz_this_part = j - nnz_index;
+            row_start[i] = arena.allocate<nnz_type>(thread_rows[i]+1);
+            col_ind[i] = arena.allocate<int_type>(nnz_this_part);
+            CRS_data[i] = arena.allocate<T>(nnz_this_part);
 
             // Fill datastructures
             row_start[i][0] = 0;
             row_index = 0;
             part_index = 0;
-            while (true) {
+            while (nnz_index < nnz && row_coord[nnz_index] < last_row) {
                 col_ind[i][part_index] = col_coord[nnz_index];
                 CRS_data[i][part_index] = data[nnz_index];
 
@@ -296,10 +304,6 @@ namespace pwm {
 
                 part_index++;
                 nnz_index++;
-
-                if (nnz_index >= nnz || row_coord[nnz_index] >= last_row) {
-                    break;
-                }
             }
 
             // Fill last elements of row_start with part_index
@@ -310,11 +314,124 @@ namespace pwm {
             
             // Sort columns of CRS data
             coords[0] = col_ind[i];
-            for (int row = 0; row < thread_rows[i]; ++row) {
+            for (int_type row = 0; row < thread_rows[i]; ++row) {
                 sortCoordsForCRS(coords, CRS_data[i], 1, row_start[i][row], row_start[i][row+1]-1);
             }
         }        
     }
+
+    /**
+     * @brief Transforms Triplet format to CRS format in place
+     * 
+     * The triplets are sorted on row with a counting sort which swaps every triplet to the next free position of its row
+     * (one cursor per row) and on column within every row. The column and data arrays of the triplets are then the CRS 
+     * arrays and move to the arena of the matrix without a copy, the row coordinates are freed. Besides the CRS arrays 
+     * only the row coordinates and the cursors are allocated during the conversion, instead of a copy of the columns and
+     * the data. The Triplet is empty afterwards.
+     * 
+     * @param input Triplet format matrix, its arrays must be allocated by its arena
+     * @param row_start Output row_start array of CRS format (allocated in arena)
+     * @param col_ind Output col_ind array of CRS format (the column array of the input)
+     * @param CRS_data Output data array of CRS format (the data array of the input)
+     * @param arena Arena which owns the CRS arrays afterwards
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void TripletToCRSInPlace(pwm::Triplet<T, int_type, nnz_type>& input, nnz_type*& row_start, int_type*& col_ind, T*& CRS_data, 
+                             pwm::Arena& arena) {
+        nnz_type nnz = input.nnz;
+        int_type nor = input.row_size;
+        int_type* row_coord = input.row_coord;
+        col_ind = arena.adopt(input.arena, input.col_coord);
+        CRS_data = arena.adopt(input.arena, input.data);
+
+        // Count the nonzeros of every row
+        row_start = arena.allocate<nnz_type>(nor+1);
+        std::fill(row_start, row_start+nor+1, 0);
+        for (nnz_type i = 0; i < nnz; ++i) {
+            row_start[row_coord[i]+1]++;
+        }
+
+        for (int_type row = 0; row < nor; ++row) {
+            row_start[row+1] += row_start[row];
+        }
+
+        // Swap every triplet to its row, the rows before the current row are complete
+        pwm::Arena scratch;
+        nnz_type* cursor = scratch.allocate<nnz_type>(nor);
+        std::copy(row_start, row_start+nor, cursor);
+        for (int_type row = 0; row < nor; ++row) {
+            while (cursor[row] < row_start[row+1]) {
+                nnz_type i = cursor[row];
+                int_type target = row_coord[i];
+                if (target == row) {
+                    cursor[row]++;
+                    continue;
+                }
+
+                nnz_type j = cursor[target]++;
+                std::swap(row_coord[i], row_coord[j]);
+                std::swap(col_ind[i], col_ind[j]);
+                std::swap(CRS_data[i], CRS_data[j]);
+            }
+        }
+
+        input.release();
+
+        // Sort columns of CRS data
+        int_type* coords[1] = {col_ind};
+        #pragma omp parallel for shared(coords, CRS_data, row_start) schedule(dynamic, 64)
+        for (int_type row = 0; row < nor; ++row) {
+            sortCoordsForCRS(coords, CRS_data, 1, row_start[row], row_start[row+1]-1);
+        }
+    }
+
+    /**
+     * @brief Transforms Triplet format to CRS format for multiple partitions in place
+     * 
+     * The whole matrix is converted with TripletToCRSInPlace, the partitions point into its column and data arrays and 
+     * only get their own row_start array.
+     * 
+     * @param input Triplet format matrix, its arrays must be allocated by its arena (empty afterwards)
+     * @param row_start Output row_start arrays of CRS format
+     * @param col_ind Output col_ind arrays of CRS format
+     * @param CRS_data Output data arrays of CRS format
+     * @param partitions Amount of partitions for the CRS matrix (amount of arrays in row_start, col_ind, and CRS_data)
+     * @param arena Arena which owns the CRS arrays afterwards
+     * @param bounds Optional partition boundaries (partitions+1 rows), if NULL the rows are split in equal parts
+     */
+    template<typename T, typename int_type, typename nnz_type>
+    void TripletToMultipleCRSInPlace(pwm::Triplet<T, int_type, nnz_type>& input, nnz_type** row_start, int_type** col_ind, T** CRS_data,
+                                     int partitions, int_type* thread_rows, int_type* first_rows, pwm::Arena& arena,
+                                     const int_type* bounds = NULL) {
+        int_type nor = input.row_size;
+        nnz_type* crs_row_start;
+        int_type* crs_col;
+        T* crs_data;
+        TripletToCRSInPlace(input, crs_row_start, crs_col, crs_data, arena);
+
+        int_type am_rows = std::round(nor/partitions);
+        int_type last_row = 0;
+        for (int i = 0; i < partitions; ++i) {
+            // Calculate first and last row (last row is exclusive)
+            first_rows[i] = last_row;
+            if (bounds != NULL) last_row = bounds[i+1];
+            else if (i == partitions - 1) last_row = nor;
+            else last_row = first_rows[i] + am_rows;
+            thread_rows[i] = last_row - first_rows[i];
+
+            // Row offsets relative to the first nonzero of the partition
+            nnz_type offset = crs_row_start[first_rows[i]];
+            row_start[i] = arena.allocate<nnz_type>(thread_rows[i]+1);
+            for (int_type row = 0; row <= thread_rows[i]; ++row) {
+                row_start[i][row] = crs_row_start[first_rows[i]+row] - offset;
+            }
+
+            col_ind[i] = crs_col + offset;
+            CRS_data[i] = crs_data + offset;
+        }
+
+        arena.deallocate(crs_row_start);
+    }
 } // namespace pwm
 
 
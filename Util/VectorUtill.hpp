@@ -14,16 +14,22 @@
 #include <cmath>
 #include <iostream>
 
+#include "Reproducible.hpp"
+
 namespace pwm
 {
     /**
      * @brief Calculate 2 norm of vector
      *
+     * In the reproducible mode the blocks of the vector are summed in parallel and added with a fixed tree.
+     *
      * @param x Vector 
      * @param size Vector size
      */
     template<typename T, typename int_type>
     T norm2(const T* x, int_type size) {
+        if (pwm::reproducibleMode()) return std::sqrt(pwm::reproducibleDot(x, x, size));
+
         return std::sqrt(std::inner_product(x, x+size, x, 0.));
     }
 
@@ -0,0 +1,317 @@
+/**
+ * @file benchmark.cpp
+ * @author Kobe Bergmans (kobe.bergmans@student.kuleuven.be)
+ * @brief Benchmark executable which sweeps methods, threads, partitions and matrices from a configuration file
+ * @version 0.1
+ * @date 2022-11-07
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <functional>
+#include <map>
+#include <limits>
+
+#include "Matrix/CRS.hpp"
+#include "Env_Implementations/CRSOMP.hpp"
+#include "Env_Implementations/CRSTBB.hpp"
+#include "Env_Implementations/CRSTBBGraph.hpp"
+#include "Env_Implementations/CRSTBBGraphPinned.hpp"
+#include "Env_Implementations/CRSThreadPool.hpp"
+#include "Env_Implementations/CRSThreadPoolPinned.hpp"
+#include "Env_Implementations/CRSAdaptive.hpp"
+#include "Env_Implementations/CRSMergePath.hpp"
+#include "Env_Implementations/CSB.hpp"
+#include "Env_Implementations/CRSCompressed.hpp"
+#include "Env_Implementations/CRSOutOfCore.hpp"
+#include "Env_Implementations/CRSDynamic.hpp"
+#include "Util/Benchmark.hpp"
+#include "Util/Bandwidth.hpp"
+#include "Matrix/Triplet.hpp"
+
+#include "omp.h"
+#include "oneapi/tbb.h"
+
+void printErrorMsg() {
+    std::cout << "You need to provide the correct command line arguments:" << std::endl;
+    std::cout << "  1° Configuration file with lines of the form \"key = value\" (see Timing_Scripts for examples)" << std::endl;
+    std::cout << "  Other) Pairs of the form \"key=value\" which overwrite the configuration file" << std::endl;
+    std::cout << "Possible keys:" << std::endl;
+    std::cout << "  matrices               List of input files (see driver_input for the naming of the files)" << std::endl;
+    std::cout << "  poisson                List of Poisson equation discretization steps" << std::endl;
+    std::cout << "  methods                List of methods as numbered in driver_input (default: 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13)" << std::endl;
+    std::cout << "  threads                List of thread counts for the parallel methods (default: 1)" << std::endl;
+    std::cout << "  partitions             List of partition counts for method 4, 5, 6 and 7" << std::endl;
+    std::cout << "  partitions_per_thread  List of partitions per thread, used if partitions is not given (default: 2)" << std::endl;
+    std::cout << "  iterations             Amount of times the power algorithm is executed (default: 10)" << std::endl;
+    std::cout << "  warm_up                Amount of warm up runs for the power algorithm (default: 2)" << std::endl;
+    std::cout << "  pwm_iterations         Amount of iterations in the power method algorithm (default: 100)" << std::endl;
+    std::cout << "  s_step                 Amount of iterations between normalizations (default: 1)" << std::endl;
+    std::cout << "  json                   Output file for the results in JSON format" << std::endl;
+    std::cout << "  csv                    Output file for the results in CSV format" << std::endl;
+}
+
+template<typename T, typename int_type, typename nnz_type>
+pwm::SparseMatrix<T, int_type, nnz_type>* selectType(int method, int threads) {
+    switch (method) {
+        case 1:
+            return new pwm::CRS<T, int_type, nnz_type>(threads);
+
+        case 2:
+            return new pwm::CRSOMP<T, int_type, nnz_type>(threads);
+
+        case 3:
+            return new pwm::CRSTBB<T, int_type, nnz_type>(threads);
+
+        case 4:
+            return new pwm::CRSTBBGraph<T, int_type, nnz_type>(threads);
+
+        case 5:
+            return new pwm::CRSTBBGraphPinned<T, int_type, nnz_type>(threads);
+
+        case 6:
+            return new pwm::CRSThreadPool<T, int_type, nnz_type>(threads);
+
+        case 7:
+            return new pwm::CRSThreadPoolPinned<T, int_type, nnz_type>(threads);
+
+        case 8:
+            return new pwm::CRSAdaptive<T, int_type, nnz_type>(threads);
+
+        case 9:
+            return new pwm::CRSMergePath<T, int_type, nnz_type>(threads);
+
+        case 10:
+            return new pwm::CSB<T, int_type, nnz_type>(threads);
+
+        case 11:
+            return new pwm::CRSCompressed<T, int_type, nnz_type>(threads);
+
+        case 12:
+            return new pwm::CRSOutOfCore<T, int_type, nnz_type>(threads);
+
+        case 13:
+            return new pwm::CRSDynamic<T, int_type, nnz_type>(threads);
+
+        default:
+            return NULL;
+    }
+}
+
+std::string methodName(int method) {
+    switch (method) {
+        case 1: return "CRS";
+        case 2: return "CRSOMP";
+        case 3: return "CRSTBB";
+        case 4: return "CRSTBBGraph";
+        case 5: return "CRSTBBGraphPinned";
+        case 6: return "CRSThreadPool";
+        case 7: return "CRSThreadPoolPinned";
+        case 8: return "CRSAdaptive";
+        case 9: return "CRSMergePath";
+        case 10: return "CSB";
+        case 11: return "CRSCompressed";
+        case 12: return "CRSOutOfCore";
+        case 13: return "CRSDynamic";
+        default: return "Unknown";
+    }
+}
+
+/**
+ * @brief Run all configurations of the sweep on one matrix
+ *
+ * @param name Name of the matrix in the output
+ * @param load Function which loads the matrix in the given datastructure with the given amount of partitions
+ * @param config Configuration of the sweep
+ * @param results Vector to which the results are appended
+ * 
+ * Next to the timings the arithmetic intensity and the percentage of the roofline peak are reported. 
+ * The roofline peak is the arithmetic intensity times the STREAM triad bandwidth for the same amount of threads and pinning policy.
+ */
+template<typename nnz_type>
+void benchmarkMatrix(const std::string& name, std::function<void(pwm::SparseMatrix<double, int, nnz_type>*, int)> load,
+                     const pwm::BenchmarkConfig& config, std::vector<pwm::BenchmarkResult>& results) {
+    double start, stop;
+
+    // Measured bandwidth for each amount of threads and pinning policy
+    static std::map<std::pair<int, bool>, pwm::StreamResult> stream_results;
+
+    for (int method : config.methods) {
+        // The sequential method only needs to run once
+        std::vector<int> thread_list = method == 1 ? std::vector<int>{1} : config.threads;
+        bool partitioned = method >= 4 && method <= 7;
+
+        for (int threads : thread_list) {
+            std::vector<int> partition_list = {0};
+            if (partitioned && !config.partitions.empty()) {
+                partition_list = config.partitions;
+            } else if (partitioned) {
+                partition_list.clear();
+                for (int ppt : config.partitions_per_thread) partition_list.push_back(ppt*threads);
+            }
+
+            for (int partitions : partition_list) {
+                pwm::SparseMatrix<double, int, nnz_type>* test_mat = selectType<double, int, nnz_type>(method, threads);
+                if (test_mat == NULL) {
+                    std::cout << "Unknown method " << method << std::endl;
+                    return;
+                }
+
+                pwm::BenchmarkResult result;
+                result.matrix = name;
+                result.method = methodName(method);
+                result.threads = threads;
+                result.partitions = partitions;
+                result.pwm_iterations = config.pwm_iterations;
+
+                start = omp_get_wtime();
+                load(test_mat, partitions);
+                stop = omp_get_wtime();
+                result.setup_time = (stop - start) * 1000;
+
+                int mat_size = test_mat->getRows();
+                result.nor = mat_size;
+                result.nnz = test_mat->getNonzeros();
+
+                double* x = new double[mat_size];
+                double* y = new double[mat_size];
+
+                for (int i = 0; i < config.warm_up + config.iterations; ++i) {
+                    std::fill(x, x+mat_size, 1.);
+
+                    start = omp_get_wtime();
+                    if (config.s_step > 1) test_mat->powerMethodSStep(x, y, config.pwm_iterations, config.s_step);
+                    else test_mat->powerMethod(x, y, config.pwm_iterations);
+                    stop = omp_get_wtime();
+
+                    if (i >= config.warm_up) result.timings.push_back((stop - start) * 1000);
+                }
+
+                result.stats = pwm::computeStatistics(result.timings);
+
+                double seconds = result.stats.median / 1000.;
+                double flops = test_mat->flopsPerIteration();
+                double bytes = test_mat->bytesPerIteration();
+                result.gflops = config.pwm_iterations * flops / seconds / 1e9;
+                result.gbs = config.pwm_iterations * bytes / seconds / 1e9;
+                result.intensity = flops / bytes;
+
+                // The bandwidth is only measured once for every amount of threads and pinning policy
+                bool pinned = method == 5 || method == 7;
+                std::pair<int, bool> stream_key(threads, pinned);
+                if (stream_results.count(stream_key) == 0) {
+                    stream_results[stream_key] = pwm::measureBandwidth(threads, pinned);
+                }
+                result.stream_gbs = stream_results[stream_key].triad;
+                result.pct_peak = 100. * result.gbs / result.stream_gbs;
+
+                std::cout << std::left << std::setw(24) << name << std::setw(22) << result.method << std::right;
+                std::cout << std::setw(8) << threads << std::setw(11) << partitions;
+                std::cout << std::setw(12) << result.stats.median << std::setw(12) << result.stats.min << std::setw(12) << result.stats.p95;
+                std::cout << std::setw(9) << result.stats.outliers << std::setw(10) << result.gflops << std::setw(10) << result.gbs;
+                std::cout << std::setw(9) << result.intensity << std::setw(8) << result.pct_peak << std::endl;
+
+                results.push_back(result);
+
+                delete test_mat;
+                delete[] x;
+                delete[] y;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Run all configurations of the sweep on the Poisson matrix
+ *
+ * @param m Poisson equation discretization steps
+ */
+template<typename nnz_type>
+void benchmarkPoisson(int m, const pwm::BenchmarkConfig& config, std::vector<pwm::BenchmarkResult>& results) {
+    benchmarkMatrix<nnz_type>("poisson_" + std::to_string(m), [=](pwm::SparseMatrix<double, int, nnz_type>* mat, int partitions) {
+        mat->generatePoissonMatrix(m, m, partitions);
+    }, config, results);
+}
+
+/**
+ * @brief Run all configurations of the sweep on an input matrix, the file is only read once
+ *
+ * @param input_file Input file (see driver_input for the naming of the files)
+ * @return bool False if the file can't be read
+ */
+template<typename nnz_type>
+bool benchmarkInput(const std::string& input_file, const pwm::BenchmarkConfig& config, std::vector<pwm::BenchmarkResult>& results) {
+    pwm::Triplet<double, int, nnz_type> input_mat;
+    if (!input_mat.loadFromFile(input_file)) return false;
+
+    benchmarkMatrix<nnz_type>(input_file, [&](pwm::SparseMatrix<double, int, nnz_type>* mat, int partitions) {
+        mat->loadFromTriplets(input_mat, partitions);
+    }, config, results);
+
+    input_mat.release();
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printErrorMsg();
+        return -1;
+    }
+
+    pwm::BenchmarkConfig config;
+    if (!config.loadFromFile(argv[1])) {
+        printErrorMsg();
+        return -1;
+    }
+
+    for (int i = 2; i < argc; ++i) {
+        if (!config.setPair(argv[i])) {
+            std::cout << "Unknown argument: " << argv[i] << std::endl;
+            printErrorMsg();
+            return -1;
+        }
+    }
+
+    std::cout << std::setprecision(4);
+    std::cout << std::left << std::setw(24) << "Matrix" << std::setw(22) << "Method" << std::right;
+    std::cout << std::setw(8) << "Threads" << std::setw(11) << "Partitions";
+    std::cout << std::setw(12) << "Median(ms)" << std::setw(12) << "Min(ms)" << std::setw(12) << "P95(ms)";
+    std::cout << std::setw(9) << "Outliers" << std::setw(10) << "GFLOP/s" << std::setw(10) << "GB/s";
+    std::cout << std::setw(9) << "AI" << std::setw(8) << "%Peak" << std::endl;
+
+    std::vector<pwm::BenchmarkResult> results;
+
+    // Column indices are 32-bit, the row offsets are 64-bit if the amount of nonzeros does not fit in 32 bits
+    for (int m : config.poisson) {
+        if (pwm::poissonNonzeros<long long>(m, m) > std::numeric_limits<int>::max()) benchmarkPoisson<long long>(m, config, results);
+        else benchmarkPoisson<int>(m, config, results);
+    }
+
+    for (const std::string& input_file : config.matrices) {
+        long long rows, nnz;
+        if (!pwm::peekFileSize(input_file, rows, nnz)) {
+            std::cout << "Unknown input file format: " << input_file << std::endl;
+            return -1;
+        }
+
+        if (rows > std::numeric_limits<int>::max()) {
+            std::cout << "Matrices with more than " << std::numeric_limits<int>::max() << " rows are not supported: " << input_file << std::endl;
+            return -1;
+        }
+
+        bool loaded = nnz > std::numeric_limits<int>::max() ? benchmarkInput<long long>(input_file, config, results)
+                                                            : benchmarkInput<int>(input_file, config, results);
+        if (!loaded) {
+            std::cout << "Unknown input file format: " << input_file << std::endl;
+            return -1;
+        }
+    }
+
+    if (!config.json.empty()) pwm::writeJSON(results, config.json);
+    if (!config.csv.empty()) pwm::writeCSV(results, config.csv);
+
+    return 0;
+}
@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <time.h>
 #include <string>
+#include <limits>
 
 #include "Matrix/CRS.hpp"
 #include "Env_Implementations/CRSOMP.hpp"
@@ -18,7 +19,26 @@
 #include "Env_Implementations/CRSTBBGraphPinned.hpp"
 #include "Env_Implementations/CRSThreadPool.hpp"
 #include "Env_Implementations/CRSThreadPoolPinned.hpp"
+#include "Env_Implementations/CRSAdaptive.hpp"
+#include "Env_Implementations/CRSMergePath.hpp"
+#include "Env_Implementations/CSB.hpp"
+#include "Env_Implementations/CRSCompressed.hpp"
+#include "Env_Implementations/CRSOutOfCore.hpp"
+#include "Env_Implementations/CRSDynamic.hpp"
 #include "Util/VectorUtill.hpp"
+#include "Util/Options.hpp"
+#include "Util/Bandwidth.hpp"
+#include "Util/Memory.hpp"
+#include "Util/Lanczos.hpp"
+#include "Util/Chebyshev.hpp"
+#include "Util/Batch.hpp"
+#include "Util/Deflation.hpp"
+#include "Util/Singular.hpp"
+#include "Util/Throughput.hpp"
+#include "Util/Dynamic.hpp"
+#include "Util/Checkpoint.hpp"
+#include "Util/Reproducible.hpp"
+#include "Util/GraphPartitioner.hpp"
 
 #include "omp.h"
 #include "oneapi/tbb.h"
@@ -37,83 +57,157 @@ void printErrorMsg() {
     std::cout << "     5) CRS parallelized using TBB graphs with each node pinned to a CPU" << std::endl;
     std::cout << "     6) CRS parallelized using Boost Thread Pool" << std::endl;
     std::cout << "     7) CRS parallelized using Boost Thread Pool with functions pinned to a CPU" << std::endl;
+    std::cout << "     8) CRS parallelized using OpenMP with the rows binned by length (packed short rows, split long rows)" << std::endl;
+    std::cout << "     9) CRS parallelized using OpenMP with merge path load balancing (equal rows + nonzeros per thread)" << std::endl;
+    std::cout << "     10) Compressed Sparse Blocks (cache blocked) parallelized using TBB" << std::endl;
+    std::cout << "     11) CRS parallelized using OpenMP with delta compressed column indices (8/16/32 bit runs)" << std::endl;
+    std::cout << "     12) CRS streamed from disk in row blocks (out of core) parallelized using OpenMP" << std::endl;
+    std::cout << "     13) CRS with free slots per row for edge updates parallelized using OpenMP" << std::endl;
     std::cout << "  6° Amount of threads (only for a parallel method).";
     std::cout << " -1 lets the program choose the amount of threads arbitrarily" << std::endl;
     std::cout << "  7° Amount of partitions the matrix is split up into (only for method 4, 5, 6 and 7)" << std::endl;
+    std::cout << "Optional flags (after the arguments above):" << std::endl;
+    std::cout << "  --partitioner  Partition the rows with the multilevel graph partitioner instead of equal contiguous blocks (only for method 4, 5, 6 and 7)" << std::endl;
+    std::cout << "  --s-step s     Use the s-step power method which only normalizes (synchronizes) every s iterations" << std::endl;
+    std::cout << "  --bandwidth b  Memory bandwidth in GB/s used for the roofline report instead of measuring it with a STREAM triad" << std::endl;
+    std::cout << "  --index64      Use 64-bit row offsets even if the amount of nonzeros fits in 32 bits (selected automatically otherwise)" << std::endl;
+    std::cout << "  --ooc-dir d    Directory of the scratch file of method 12 (default: $TMPDIR or /tmp)" << std::endl;
+    std::cout << "  --ooc-block-mb b  Size of a row block of method 12 in MB (default: 64)" << std::endl;
+    std::cout << "  --ooc-buffers n   Amount of row blocks of method 12 in memory, 2 or more (default: 3)" << std::endl;
+    std::cout << "  --lanczos k    Compute the k eigenvalues of largest magnitude with thick restart Lanczos and compare the time to tolerance with the power method" << std::endl;
+    std::cout << "  --tol t        Relative residual tolerance of --lanczos (default: 1e-8)" << std::endl;
+    std::cout << "  --lanczos-basis m  Maximal amount of Lanczos basis vectors, bounds the memory (default: 2k+20)" << std::endl;
+    std::cout << "  --max-products p   Maximal amount of matrix vector products of both eigensolvers of --lanczos (default: 10000)" << std::endl;
+    std::cout << "  --chebyshev d  Chebyshev accelerated power method with filters of degree d, compared with the power method to --tol" << std::endl;
+    std::cout << "  --cheb-lower a --cheb-upper b  Interval of the unwanted eigenvalues damped by --chebyshev (default: estimated with Lanczos)" << std::endl;
+    std::cout << "  --cheb-steps n Amount of Lanczos steps of the estimate of the interval (default: 20)" << std::endl;
+    std::cout << "  --shift s      Shifted power method with A - sI, compared with the power method to --tol" << std::endl;
+    std::cout << "  --batch B      Run B power methods from different start vectors per sweep over the matrix and compare with one by one" << std::endl;
+    std::cout << "  --deflate k    Compute the k eigenpairs of largest magnitude one after the other with the deflated power method to --tol" << std::endl;
+    std::cout << "  --deflate-mode m  Deflation of --deflate: hotelling (A - l v v^T, default) or projection ((I - VV^T) A)" << std::endl;
+    std::cout << "  --svd          Largest singular value with the power method on A^T A and A A^T (fused transpose products) to --tol" << std::endl;
+    std::cout << "  --transpose-budget b  Memory budget in MB of the transposed CRS of the transpose products, scatter if it does not fit (default: size of the matrix)" << std::endl;
+    std::cout << "  --throughput N Run N (at least 1) independent power methods (with the iterations of the power method) concurrently and report the solves per second" << std::endl;
+    std::cout << "  --throughput-mode m  Schedule of --throughput: tasks (one TBB task per solve, default) or batch (interleaved vectors)" << std::endl;
+    std::cout << "  --updates n    Remove n random edges and insert n random edges (with their mirrored edges if the matrix is symmetric) and compare the power method to --tol started from the previous eigenvector with a random start (only for method 13)" << std::endl;
+    std::cout << "  --slack f      Free slots of a row of method 13 as a fraction of its length (default: 0.25, at least 2)" << std::endl;
+    std::cout << "  --checkpoint f Run the power method (with the iterations of the power method) with checkpoints of the iterate written to f in the background" << std::endl;
+    std::cout << "  --checkpoint-every k  Iterations between two checkpoints of --checkpoint (default: 10)" << std::endl;
+    std::cout << "  --resume       Continue --checkpoint from the checkpoint in f" << std::endl;
+    std::cout << "  --reproducible Bitwise reproducible norms and dot products for every amount of threads (fixed blocks summed with a fixed tree), reports the overhead" << std::endl;
+    std::cout << "  --huge-pages p Huge pages for the matrix arrays: off, thp (transparent, default) or hugetlb (reserved, falls back to thp)" << std::endl;
+    std::cout << "  --trace file   Write a Chrome trace of the partitions to file (only for method 4, 5, 6 and 7 and compiled with PWM_TRACE)" << std::endl;
 }
 
-template<typename T, typename int_type>
-pwm::SparseMatrix<T, int_type>* selectType(int method, int threads) {
+template<typename T, typename int_type, typename nnz_type>
+pwm::SparseMatrix<T, int_type, nnz_type>* selectType(int method, int threads) {
     switch (method) {
         case 1:
-            return new pwm::CRS<T, int_type>(threads);
+            return new pwm::CRS<T, int_type, nnz_type>(threads);
 
         case 2:
-            return new pwm::CRSOMP<T, int_type>(threads);
+            return new pwm::CRSOMP<T, int_type, nnz_type>(threads);
 
         case 3:
-            return new pwm::CRSTBB<T, int_type>(threads);
+            return new pwm::CRSTBB<T, int_type, nnz_type>(threads);
 
         case 4:
-            return new pwm::CRSTBBGraph<T, int_type>(threads);
+            return new pwm::CRSTBBGraph<T, int_type, nnz_type>(threads);
 
         case 5:
-            return new pwm::CRSTBBGraphPinned<T, int_type>(threads);
+            return new pwm::CRSTBBGraphPinned<T, int_type, nnz_type>(threads);
 
         case 6:
-            return new pwm::CRSThreadPool<T, int_type>(threads);
+            return new pwm::CRSThreadPool<T, int_type, nnz_type>(threads);
 
         case 7:
-            return new pwm::CRSThreadPoolPinned<T, int_type>(threads);
+            return new pwm::CRSThreadPoolPinned<T, int_type, nnz_type>(threads);
+
+        case 8:
+            return new pwm::CRSAdaptive<T, int_type, nnz_type>(threads);
+
+        case 9:
+            return new pwm::CRSMergePath<T, int_type, nnz_type>(threads);
+
+        case 10:
+            return new pwm::CSB<T, int_type, nnz_type>(threads);
+
+        case 11:
+            return new pwm::CRSCompressed<T, int_type, nnz_type>(threads);
+
+        case 12:
+            return new pwm::CRSOutOfCore<T, int_type, nnz_type>(threads);
+
+        case 13:
+            return new pwm::CRSDynamic<T, int_type, nnz_type>(threads);
         
         default:
             return NULL;
     }
 }
 
-int main(int argc, char** argv) {
+/**
+ * @brief Generate the Poisson matrix, run the power method and report the timings
+ * 
+ * nnz_type is the type of the amount of nonzeros and the row offsets, column indices are always 32-bit.
+ */
+template<typename nnz_type>
+int runPoisson(int argc, char** argv, int iter, int warm_up, int pwm_iter, int m, int method, int s, int threads, int partitions) {
     double start, stop, time; 
+    int mat_size = m*m;
+
+    //Select method
+    pwm::SparseMatrix<double, int, nnz_type>* test_mat = selectType<double, int, nnz_type>(method, threads);
 
-    if (argc < 6) {
+    if (test_mat == NULL) {
         printErrorMsg();
         return -1;
     }
 
-    int iter = std::stoi(argv[1]);
-    int warm_up = std::stoi(argv[2]);
-    int pwm_iter = std::stoi(argv[3]);
-    int m = std::stoi(argv[4]);
-    int mat_size = m*m;
-
-    int method = std::stoi(argv[5]);
-    int threads = 0;
-    int partitions = 0;
-    if (method > 1 && argc < 6) {
-        // No amount of threads specified
-        printErrorMsg();
-        return -1;
-    } else if (method > 1) {
-        threads = std::stoi(argv[6]);
+    // Storage of the out of core method
+    pwm::CRSOutOfCore<double, int, nnz_type>* out_of_core = dynamic_cast<pwm::CRSOutOfCore<double, int, nnz_type>*>(test_mat);
+    if (out_of_core != NULL) {
+        out_of_core->setStorage(pwm::getOption<std::string>(argc, argv, "--ooc-dir", ""), 
+                                (size_t) pwm::getOption(argc, argv, "--ooc-block-mb", 64) << 20, pwm::getOption(argc, argv, "--ooc-buffers", 3));
     }
 
-    if ((method == 4 || method == 5 || method == 6 || method == 7) && argc < 7) {
-        printErrorMsg();
-        return -1;
-    } else if (method == 4 || method == 5 || method == 6 || method == 7) {
-        partitions = std::stoi(argv[7]);
+    // Free slots of the rows of the dynamic method
+    pwm::CRSDynamic<double, int, nnz_type>* dynamic = dynamic_cast<pwm::CRSDynamic<double, int, nnz_type>*>(test_mat);
+    if (dynamic != NULL && pwm::hasOption(argc, argv, "--slack")) {
+        dynamic->setSlack(pwm::getOption(argc, argv, "--slack", 0.25), 2);
     }
-    
-    //Select method
-    pwm::SparseMatrix<double, int>* test_mat = selectType<double, int>(method, threads);
 
-    if (test_mat == NULL) {
-        printErrorMsg();
-        return -1;
+    // Memory budget of the transposed CRS of the transpose products
+    if (pwm::hasOption(argc, argv, "--transpose-budget")) {
+        test_mat->setTransposeBudget((size_t) (pwm::getOption(argc, argv, "--transpose-budget", 0.) * (1 << 20)));
     }
     
     //Initialize matrix and vectors
     start = omp_get_wtime();
-    test_mat->generatePoissonMatrix(m, m, partitions);
+
+    // Reorder the matrix such that each partition is a contiguous block of rows with a minimal edge cut
+    pwm::GraphPartitioner<int, nnz_type> partitioner;
+    if (partitions > 0 && pwm::hasOption(argc, argv, "--partitioner")) {
+        pwm::Triplet<double, int, nnz_type> poisson;
+        poisson.row_size = mat_size;
+        poisson.col_size = mat_size;
+        poisson.nnz = pwm::poissonNonzeros<nnz_type>(m, m);
+        poisson.allocate();
+        pwm::fillPoissonTriplets(poisson.data, poisson.row_coord, poisson.col_coord, m, m);
+
+        partitioner.loadFromTriplets(poisson.row_coord, poisson.col_coord, poisson.nnz, mat_size);
+        partitioner.partition(partitions);
+        partitioner.printReport();
+
+        poisson.permute(partitioner.iperm.data());
+        test_mat->setPartitionBounds(partitioner.bounds.data());
+
+        // Convert in place such that the peak memory stays close to the size of the matrix
+        poisson.in_place = true;
+        test_mat->loadFromTriplets(poisson, partitions);
+    } else {
+        test_mat->generatePoissonMatrix(m, m, partitions);
+    }
 
     double* x = new double[mat_size];
     double* y = new double[mat_size];
@@ -122,25 +216,165 @@ int main(int argc, char** argv) {
     stop = omp_get_wtime();
     time = (stop - start) * 1000;
     std::cout << "Time to set up datastructures: " << time << "ms" << std::endl;
+    pwm::printMemoryReport("matrix", test_mat->allocatedBytes());
 
     // Do warm up iterations
     for (int i = 0; i < warm_up; ++i) {
         std::fill(x, x+mat_size, 1.);
-        test_mat->powerMethod(x, y, pwm_iter);
+        if (s > 1) test_mat->powerMethodSStep(x, y, pwm_iter, s);
+        else test_mat->powerMethod(x, y, pwm_iter);
     }
 
+    // Only report the reads of the timed executions
+    if (out_of_core != NULL) out_of_core->resetStatistics();
+
+#ifdef PWM_PERF_COUNTERS
+    // Only count the timed executions
+    test_mat->perfCounters().reset();
+#endif
+
+#ifdef PWM_TRACE
+    // Only trace the timed executions
+    test_mat->trace().reset();
+#endif
+
     // Solve power method an amount of time
     double timings[iter];
     for (int i = 0; i < iter; ++i) {
         start = omp_get_wtime();
         std::fill(x, x+mat_size, 1.);
-        test_mat->powerMethod(x, y, pwm_iter);
+        if (s > 1) test_mat->powerMethodSStep(x, y, pwm_iter, s);
+        else test_mat->powerMethod(x, y, pwm_iter);
         stop = omp_get_wtime();
         timings[i] = (stop - start) * 1000;
     }
 
     pwm::printVector(timings, iter);
 
+#ifdef PWM_PERF_COUNTERS
+    test_mat->perfCounters().printSummary(iter);
+#endif
+
+#ifdef PWM_TRACE
+    test_mat->trace().printSummary();
+    if (pwm::hasOption(argc, argv, "--trace")) {
+        test_mat->trace().writeChromeTrace(pwm::getOption<std::string>(argc, argv, "--trace", "trace.json"));
+    }
+#else
+    if (pwm::hasOption(argc, argv, "--trace")) {
+        std::cout << "Tracing is not available, compile with PWM_TRACE (make driver_poisson_trace)" << std::endl;
+    }
+#endif
+
+    // Compare the median time with the memory roofline
+    if (iter > 0) {
+        std::sort(timings, timings+iter);
+        double median = iter % 2 == 1 ? timings[iter/2] : (timings[iter/2-1] + timings[iter/2])/2.;
+
+        pwm::StreamResult bandwidth;
+        bandwidth.triad = pwm::getOption(argc, argv, "--bandwidth", 0.);
+        if (bandwidth.triad <= 0.) {
+            int probe_threads = threads > 0 ? threads : omp_get_max_threads();
+            bandwidth = pwm::measureBandwidth(method == 1 ? 1 : probe_threads, method == 5 || method == 7);
+        }
+        pwm::printRooflineReport(test_mat->flopsPerIteration(), test_mat->bytesPerIteration(), pwm_iter, median, bandwidth);
+        if (out_of_core != NULL) out_of_core->printReport();
+
+        // Compare the compressed column indices with the uncompressed CRS of method 2
+        pwm::CRSCompressed<double, int, nnz_type>* compressed = dynamic_cast<pwm::CRSCompressed<double, int, nnz_type>*>(test_mat);
+        if (compressed != NULL) {
+            pwm::CRSOMP<double, int, nnz_type> uncompressed(threads);
+            uncompressed.generatePoissonMatrix(m, m, 0);
+
+            double* x_ref = new double[mat_size];
+            double* y_ref = new double[mat_size];
+            double uncompressed_timings[iter];
+            for (int i = 0; i < warm_up + iter; ++i) {
+                std::fill(x_ref, x_ref+mat_size, 1.);
+                start = omp_get_wtime();
+                if (s > 1) uncompressed.powerMethodSStep(x_ref, y_ref, pwm_iter, s);
+                else uncompressed.powerMethod(x_ref, y_ref, pwm_iter);
+                stop = omp_get_wtime();
+                if (i >= warm_up) uncompressed_timings[i - warm_up] = (stop - start) * 1000;
+            }
+
+            std::sort(uncompressed_timings, uncompressed_timings+iter);
+            double uncompressed_median = iter % 2 == 1 ? uncompressed_timings[iter/2] : (uncompressed_timings[iter/2-1] + uncompressed_timings[iter/2])/2.;
+            std::cout << "Column index compression ratio: " << compressed->compressionRatio();
+            std::cout << ", matrix bytes per iteration: " << compressed->bytesPerIteration()/uncompressed.bytesPerIteration() << "x of CRS" << std::endl;
+            std::cout << "Speedup over uncompressed CRS (method 2, median " << uncompressed_median << "ms): " << uncompressed_median/median << std::endl;
+
+            delete[] x_ref;
+            delete[] y_ref;
+        }
+    }
+
+    // Overhead of the reproducible reductions
+    if (pwm::reproducibleMode()) {
+        pwm::printReproducibleReport(*test_mat, pwm_iter, s, 3);
+    }
+
+    // Power method with checkpoints, optionally resumed
+    if (pwm::hasOption(argc, argv, "--checkpoint")) {
+        pwm::printCheckpointReport(*test_mat, pwm_iter, pwm::getOption<std::string>(argc, argv, "--checkpoint", "pwm.checkpoint"), 
+                                   std::max(1, pwm::getOption(argc, argv, "--checkpoint-every", 10)), pwm::hasOption(argc, argv, "--resume"));
+    }
+
+    // Warm start of the power method after edge updates
+    if (pwm::hasOption(argc, argv, "--updates")) {
+        if (dynamic == NULL) {
+            std::cout << "Edge updates need method 13" << std::endl;
+        } else {
+            pwm::printUpdateReport(*test_mat, pwm::getOption(argc, argv, "--updates", 100), pwm::getOption(argc, argv, "--tol", 1e-8), 
+                                   pwm::getOption(argc, argv, "--max-products", 10000));
+            std::cout << "  structure copies for free slots: " << dynamic->rebuilds() << std::endl;
+        }
+    }
+
+    // Many independent solves at once
+    if (pwm::hasOption(argc, argv, "--throughput")) {
+        pwm::printThroughputReport(*test_mat, pwm::getOption(argc, argv, "--throughput", 64), pwm_iter, pwm::getOption<std::string>(argc, argv, "--throughput-mode", "tasks"), 
+                                   threads > 0 ? threads : omp_get_max_threads(), pwm::batch_width);
+    }
+
+    // Advance a batch of power methods per sweep over the matrix
+    if (pwm::hasOption(argc, argv, "--batch")) {
+        pwm::printBatchReport(*test_mat, pwm::getOption(argc, argv, "--batch", 8), false, 0.85, pwm::getOption(argc, argv, "--tol", 1e-8), 
+                              pwm::getOption(argc, argv, "--max-products", 10000));
+    }
+
+    // Compare the time to tolerance of Lanczos with the power method
+    if (pwm::hasOption(argc, argv, "--lanczos")) {
+        int k = pwm::getOption(argc, argv, "--lanczos", 1);
+        pwm::printEigensolverComparison(*test_mat, k, pwm::getOption(argc, argv, "--tol", 1e-8), 
+                                        pwm::getOption(argc, argv, "--lanczos-basis", 2*k + 20), pwm::getOption(argc, argv, "--max-products", 10000));
+    }
+
+    // Compare the time to tolerance of the Chebyshev accelerated or shifted power method with the power method
+    if (pwm::hasOption(argc, argv, "--chebyshev") || pwm::hasOption(argc, argv, "--shift")) {
+        double tol = pwm::getOption(argc, argv, "--tol", 1e-8);
+        int max_products = pwm::getOption(argc, argv, "--max-products", 10000);
+        if (pwm::hasOption(argc, argv, "--shift")) {
+            double shift = pwm::getOption(argc, argv, "--shift", 0.);
+            pwm::printChebyshevComparison(*test_mat, 1, shift - 1., shift + 1., false, 0, tol, max_products);
+        } else {
+            bool estimate = !pwm::hasOption(argc, argv, "--cheb-lower") || !pwm::hasOption(argc, argv, "--cheb-upper");
+            pwm::printChebyshevComparison(*test_mat, pwm::getOption(argc, argv, "--chebyshev", 10), pwm::getOption(argc, argv, "--cheb-lower", 0.), 
+                                          pwm::getOption(argc, argv, "--cheb-upper", 0.), estimate, pwm::getOption(argc, argv, "--cheb-steps", 20), tol, max_products);
+        }
+    }
+
+    // Compute the eigenpairs of largest magnitude with deflation
+    if (pwm::hasOption(argc, argv, "--deflate")) {
+        pwm::printDeflationReport(*test_mat, pwm::getOption(argc, argv, "--deflate", 2), pwm::getOption<std::string>(argc, argv, "--deflate-mode", "hotelling"), 
+                                  pwm::getOption(argc, argv, "--tol", 1e-8), pwm::getOption(argc, argv, "--max-products", 10000));
+    }
+
+    // Largest singular value with the transpose products
+    if (pwm::hasOption(argc, argv, "--svd")) {
+        pwm::printSingularReport(*test_mat, false, pwm::getOption(argc, argv, "--tol", 1e-8), pwm::getOption(argc, argv, "--max-products", 10000));
+    }
+
 #ifndef NDEBUG
     std::cout << "Result for checking measures: " << std::endl;
     if (pwm_iter % 2 == 0) {
@@ -152,4 +386,63 @@ int main(int argc, char** argv) {
 #endif
     
     return 0;
-}
\ No newline at end of file
+}
+
+int main(int argc, char** argv) {
+    int args = pwm::positionalArgs(argc, argv);
+    if (args < 6) {
+        printErrorMsg();
+        return -1;
+    }
+
+    int iter = std::stoi(argv[1]);
+    int warm_up = std::stoi(argv[2]);
+    int pwm_iter = std::stoi(argv[3]);
+    int m = std::stoi(argv[4]);
+
+    int method = std::stoi(argv[5]);
+    int s = pwm::getOption(argc, argv, "--s-step", 1);
+    int threads = 0;
+    int partitions = 0;
+    if (method > 1 && args < 7) {
+        // No amount of threads specified
+        printErrorMsg();
+        return -1;
+    } else if (method > 1) {
+        threads = std::stoi(argv[6]);
+    }
+
+    if ((method == 4 || method == 5 || method == 6 || method == 7) && args < 8) {
+        printErrorMsg();
+        return -1;
+    } else if (method == 4 || method == 5 || method == 6 || method == 7) {
+        partitions = std::stoi(argv[7]);
+    }
+    
+    pwm::reproducibleMode() = pwm::hasOption(argc, argv, "--reproducible");
+    if (!pwm::setHugePagePolicy(pwm::getOption<std::string>(argc, argv, "--huge-pages", "thp"))) {
+        printErrorMsg();
+        return -1;
+    }
+
+    // At least one solve in the throughput mode
+    if (pwm::hasOption(argc, argv, "--throughput") && pwm::getOption(argc, argv, "--throughput", 64) < 1) {
+        printErrorMsg();
+        return -1;
+    }
+
+    // Column indices are 32-bit, the row offsets are 64-bit if the amount of nonzeros does not fit in 32 bits
+    long long rows = (long long) m*m;
+    long long nnz = pwm::poissonNonzeros<long long>(m, m);
+    if (rows > std::numeric_limits<int>::max()) {
+        std::cout << "Matrices with more than " << std::numeric_limits<int>::max() << " rows are not supported" << std::endl;
+        return -1;
+    }
+
+    if (nnz > std::numeric_limits<int>::max() || pwm::hasOption(argc, argv, "--index64")) {
+        std::cout << "Using 64-bit row offsets for " << nnz << " nonzeros" << std::endl;
+        return runPoisson<long long>(argc, argv, iter, warm_up, pwm_iter, m, method, s, threads, partitions);
+    }
+
+    return runPoisson<int>(argc, argv, iter, warm_up, pwm_iter, m, method, s, threads, partitions);
+}